@@ -0,0 +1,142 @@
+/**
+ * @file capture.h
+ * @brief Frequency, period and pulse-width measurement with the input capture stage of the timers.
+ * @note
+ * General steps for use:
+ *   0. Connect the signal to CH1 of a timer, see @ref hal_pwm_timer_t for the pins.
+ *   1. Start measuring                   (hal_capture_start())
+ *   2. Read the latest figures           (hal_capture_read())
+ *   3. Give the timer back               (hal_capture_stop())
+ *
+ * Every active edge resets the counter in hardware (reset slave mode) and latches the time
+ * since the previous one into CCR1, so the period is counted in ticks of the timer clock
+ * with no CPU involvement per edge:
+ *
+ * - @ref HAL_CAPTURE_PWM_INPUT also latches the opposite edge into CCR2, which gives the
+ *   pulse width and so the duty cycle of the input. Reads return the last period.
+ * - @ref HAL_CAPTURE_PERIODS has the DMA copy every 1st, 2nd, 4th or 8th period into a
+ *   caller ring buffer. Reads average the ring, e.g. to smooth a fan tachometer.
+ *
+ * The timer prescaler is picked so that the slowest input of interest still fits in the
+ * counter. Inputs slower than that, or no input at all, read as HAL_STATUS_TIMEOUT.
+ * TIM2 and TIM5 count to 32 bits and keep the full timer clock down to below 1 Hz.
+ *
+ * A timer is either generating PWM, measuring an input or decoding an encoder. Starting a
+ * capture takes CH1 of the timer away from the PWM driver, and none of the hal_pwm_tim_*()
+ * functions may be used on the timer until hal_capture_stop(). They return HAL_STATUS_BUSY
+ * meanwhile. A timer decoding an encoder turns a capture away with HAL_STATUS_BUSY.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hal_types.h"
+#include "pwm.h"
+
+/**
+ * @brief What is measured.
+ */
+typedef enum {
+  _HAL_CAPTURE_MODE_MIN,
+  HAL_CAPTURE_PWM_INPUT = _HAL_CAPTURE_MODE_MIN, /*!< Period and pulse width of the last period, from CCR1 and CCR2. */
+  HAL_CAPTURE_PERIODS,                          /*!< Periods copied by DMA into a ring buffer, averaged on read. */
+  _HAL_CAPTURE_MODE_MAX
+} hal_capture_mode_t;
+
+/**
+ * @brief The edge that starts a period. The pulse is the time from it to the opposite edge.
+ */
+typedef enum {
+  _HAL_CAPTURE_POLARITY_MIN,
+  HAL_CAPTURE_RISING = _HAL_CAPTURE_POLARITY_MIN, /*!< Periods start on rising edges, the pulse is the high time. */
+  HAL_CAPTURE_FALLING,                            /*!< Periods start on falling edges, the pulse is the low time. */
+  _HAL_CAPTURE_POLARITY_MAX
+} hal_capture_polarity_t;
+
+/**
+ * @brief How many periods pass per recorded one, CCR1's input prescaler (IC1PSC).
+ */
+typedef enum {
+  _HAL_CAPTURE_PRESCALER_MIN,
+  HAL_CAPTURE_EVERY_PERIOD = _HAL_CAPTURE_PRESCALER_MIN, /*!< Every period. */
+  HAL_CAPTURE_EVERY_2ND,                                 /*!< One period in 2. */
+  HAL_CAPTURE_EVERY_4TH,                                 /*!< One period in 4. */
+  HAL_CAPTURE_EVERY_8TH,                                 /*!< One period in 8. */
+  _HAL_CAPTURE_PRESCALER_MAX
+} hal_capture_prescaler_t;
+
+/**
+ * @brief Maximum input filter setting (IC1F). Higher settings need the input stable for more samples.
+ */
+#define HAL_CAPTURE_FILTER_MAX (15U)
+
+/**
+ * @brief Maximum entries of the ring buffer. One DMA transfer moves one period.
+ */
+#define HAL_CAPTURE_MAX_LENGTH (0xFFFFU)
+
+/**
+ * @brief Description of a measurement.
+ */
+typedef struct {
+    hal_capture_mode_t mode;           /*!< PWM input or periods into a ring buffer. */
+    hal_capture_polarity_t polarity;   /*!< Edge that starts a period. */
+    hal_capture_prescaler_t prescaler; /*!< Periods per recorded one. HAL_CAPTURE_PERIODS only. */
+    uint8_t filter;                    /*!< Input filter, 0 (off) to HAL_CAPTURE_FILTER_MAX. */
+    uint32_t min_frequency_hz;         /*!< Slowest input to measure. At least 1. */
+    uint32_t *buffer;                  /*!< Ring the DMA writes periods into. HAL_CAPTURE_PERIODS only. */
+    size_t length;                     /*!< Entries in buffer, 2 to HAL_CAPTURE_MAX_LENGTH. */
+} hal_capture_config_t;
+
+/**
+ * @brief The input as measured.
+ */
+typedef struct {
+    uint32_t tick_hz;           /*!< Clock the counter counts, after the prescaler. Rounded down. */
+    uint32_t period_ticks;      /*!< Input period in counter ticks. Rounded average in HAL_CAPTURE_PERIODS. */
+    uint32_t pulse_ticks;       /*!< Pulse width in counter ticks. HAL_CAPTURE_PWM_INPUT only, else 0. */
+    uint64_t frequency_millihz; /*!< Input frequency in mHz, from the exact timer clock and all periods measured. */
+    uint16_t duty_q16;          /*!< pulse_ticks / period_ticks as Q16, 0xFFFF at most. HAL_CAPTURE_PWM_INPUT only. */
+    size_t periods;             /*!< Periods behind the figures: 1 in HAL_CAPTURE_PWM_INPUT, else ring entries. */
+} hal_capture_result_t;
+
+/**
+ * @brief Starts measuring the input on CH1 of a timer. Restarts a measurement already running.
+ *
+ * @param timer The timer to measure with.
+ * @param config The measurement. buffer must stay valid until hal_capture_stop().
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR on a bad timer or config, or if
+ *         min_frequency_hz is too slow for the timer, HAL_STATUS_BUSY if the waveform
+ *         stream owns the timer or it is decoding an encoder.
+ */
+hal_status_t hal_capture_start(hal_pwm_timer_t timer, const hal_capture_config_t *config);
+
+/**
+ * @brief Reads the latest measurement from the hardware. Never waits.
+ *
+ * The first period after a start or a timeout is discarded, since it only measures the
+ * time to the first edge.
+ *
+ * @param timer The timer measuring.
+ * @param result Filled in on HAL_STATUS_OK.
+ *
+ * @return HAL_STATUS_OK with a measurement, HAL_STATUS_BUSY until the first whole period
+ *         has been measured, HAL_STATUS_TIMEOUT if the input has been slower than
+ *         min_frequency_hz or stopped since the last read, HAL_STATUS_ERROR if no
+ *         measurement is running on timer or result is NULL.
+ */
+hal_status_t hal_capture_read(hal_pwm_timer_t timer, hal_capture_result_t *result);
+
+/**
+ * @brief Stops the measurement and the timer. The timer may be used for PWM again.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer is out of range.
+ */
+hal_status_t hal_capture_stop(hal_pwm_timer_t timer);
+
+#endif /* _CAPTURE_H */
@@ -0,0 +1,111 @@
+/**
+ * @file encoder.h
+ * @brief Quadrature encoder decoding in the timers' encoder interface.
+ * @note
+ * General steps for use:
+ *   0. Connect A to CH1 and B to CH2 of a timer, see @ref hal_pwm_timer_t for the pins.
+ *   1. Start decoding                    (hal_encoder_start())
+ *   2. Read position and velocity        (hal_encoder_read())
+ *   3. Give the timer back               (hal_encoder_stop())
+ *
+ * The timer counts every edge up or down in hardware, so decoding costs no CPU per edge
+ * and no edge is missed at any speed the input filter lets through.
+ *
+ * A SysTick timer takes a snapshot of each counter every sample_period_ms. The difference
+ * to the previous snapshot extends the counter to a 64-bit position and, divided by the
+ * period, gives the velocity. Reads add whatever the counter moved since the last snapshot,
+ * so the position is always current. The 16-bit timers must not move 32768 counts or more
+ * between two snapshots, e.g. at most 32 million counts per second with 1 ms snapshots.
+ * TIM2 and TIM5 count to 32 bits and have no practical limit.
+ *
+ * A timer is either generating PWM, measuring an input or decoding an encoder. Starting
+ * an encoder takes CH1 and CH2 of the timer away from the PWM driver, and none of the
+ * hal_pwm_tim_*() functions may be used on the timer until hal_encoder_stop(). They return
+ * HAL_STATUS_BUSY meanwhile. A timer measuring an input turns an encoder away with
+ * HAL_STATUS_BUSY.
+ *
+ * @attention Requires @ref hal_systick_init().
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _ENCODER_H
+#define _ENCODER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "hal_types.h"
+#include "pwm.h"
+
+/**
+ * @brief Which edges are counted. Follows the SMCR.SMS encoder modes 1, 2 and 3.
+ */
+typedef enum {
+  _HAL_ENCODER_MODE_MIN,
+  HAL_ENCODER_COUNT_TI1 = _HAL_ENCODER_MODE_MIN, /*!< Both edges of A. Two counts per cycle. */
+  HAL_ENCODER_COUNT_TI2,                         /*!< Both edges of B. Two counts per cycle. */
+  HAL_ENCODER_COUNT_BOTH,                        /*!< Every edge of A and B. Four counts per cycle. */
+  _HAL_ENCODER_MODE_MAX
+} hal_encoder_mode_t;
+
+/**
+ * @brief Maximum input filter setting (IC1F/IC2F). Higher settings need an input stable for more samples.
+ */
+#define HAL_ENCODER_FILTER_MAX (15U)
+
+/**
+ * @brief Description of an encoder.
+ */
+typedef struct {
+    hal_encoder_mode_t mode;   /*!< Edges counted. */
+    uint8_t filter;            /*!< Input filter on A and B, 0 (off) to HAL_ENCODER_FILTER_MAX. */
+    bool reverse;              /*!< Count down when A leads B. */
+    uint32_t sample_period_ms; /*!< Time between snapshots. At least 1. */
+} hal_encoder_config_t;
+
+/**
+ * @brief Where the encoder is and how fast it moves.
+ */
+typedef struct {
+    int64_t position;      /*!< Counts since the start or hal_encoder_set_position(), up to the read. */
+    int32_t velocity_cps;  /*!< Counts per second between the last two snapshots. */
+    uint32_t snapshots;    /*!< Snapshots taken, tells a new velocity from the one read before. */
+} hal_encoder_reading_t;
+
+/**
+ * @brief Starts decoding an encoder on CH1 and CH2 of a timer. The position starts at 0.
+ *
+ * Restarts an encoder already running on the timer.
+ *
+ * @param timer The timer to decode with.
+ * @param config The encoder.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR on a bad timer or config, or if no
+ *         SysTick timer is free, HAL_STATUS_BUSY if the waveform stream owns the timer or
+ *         it is measuring an input.
+ */
+hal_status_t hal_encoder_start(hal_pwm_timer_t timer, const hal_encoder_config_t *config);
+
+/**
+ * @brief Reads the position and the velocity. Safe against the snapshot interrupt.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if no encoder is running on timer
+ *         or reading is NULL.
+ */
+hal_status_t hal_encoder_read(hal_pwm_timer_t timer, hal_encoder_reading_t *reading);
+
+/**
+ * @brief Redefines the current position, e.g. at a homing switch or index pulse.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if no encoder is running on timer.
+ */
+hal_status_t hal_encoder_set_position(hal_pwm_timer_t timer, int64_t position);
+
+/**
+ * @brief Stops decoding. The timer may be used for PWM again.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer is out of range.
+ */
+hal_status_t hal_encoder_stop(hal_pwm_timer_t timer);
+
+#endif /* _ENCODER_H */
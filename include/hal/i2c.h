@@ -15,8 +15,40 @@
  * and poll the `processing_state` to determine when the transaction is @ref HAL_I2C_TXN_STATE_COMPLETED.
  * Once completed, results can be retrieved from inside the transaction struct.
  *
- * @attention @ref hal_i2c_transaction_servicer() must be called periodically to
- * service the transactions that are submitted to the I2C driver. Otherwise, they remain in
+ * Transactions are ordered by @ref hal_i2c_priority_t. The servicer always loads the oldest
+ * transaction of the highest priority that is waiting, so a time-critical read is never stuck
+ * behind a long run of background work. Work that spans several transactions is naturally
+ * preempted between its transactions. Transactions of equal priority are processed in the order
+ * they were submitted. The time each priority spends waiting in the queue is reported through
+ * @ref hal_i2c_get_queue_latency(). Queue wait, on-bus time, bytes and failures per target address,
+ * and the share of time the bus is busy, are reported through @ref hal_i2c_get_target_metrics() and
+ * @ref hal_i2c_get_bus_utilization().
+ *
+ * Which addresses answer on a bus is found with @ref hal_i2c_scan(). The probes run back-to-back
+ * inside the interrupt handler, so a full scan costs one transaction. See also i2c_watch.h.
+ *
+ * Targets with 7-bit and 10-bit addresses share a queue, see @ref hal_i2c_addr_mode_t. So do
+ * transactions at different SCL speeds, see @ref hal_i2c_speed_t. Both are chosen per transaction
+ * and the driver reconfigures the bus between transactions as needed.
+ *
+ * Several operations, possibly on different targets, can be bundled into one transaction with
+ * @ref HAL_I2C_OP_SEQUENCE. The segments of a sequence run back-to-back inside the interrupt
+ * handler, joined by repeated STARTs, and the transaction completes once after the final STOP.
+ * Polling a group of sensors then costs one bus burst and one servicer round-trip.
+ *
+ * The driver runs up to three buses, see @ref hal_i2c_bus_t. Each bus has its own queue,
+ * interrupt handlers and state, so slow devices on one bus never hold up fast devices on
+ * another. Every call takes the bus it applies to.
+ *
+ * A bus can instead act as a target device on someone else's bus, see i2c_target.h.
+ *
+ * A bus can also run as an SMBus host, see @ref hal_i2c_smbus_enable(). The peripheral then appends
+ * and checks the Packet Error Code (PEC) of every transaction in hardware, @ref HAL_I2C_OP_SMBUS_BLOCK_WRITE
+ * and @ref HAL_I2C_OP_SMBUS_BLOCK_READ move a length prefixed block in one transaction, and SMBALERT#
+ * is reported through a callback.
+ *
+ * @attention @ref hal_i2c_transaction_servicer() must be called periodically for every
+ * initialized bus to service the transactions that are submitted to the I2C driver. Otherwise, they remain in
  * the queue untouched.
  *
  * Copyright (c) 2025 - 2026 Cory McKiel.
@@ -27,10 +59,43 @@
 
 #include "hal_types.h"
 
+#include <stdbool.h>
+
 /// May be set to change the size of the TX data array inside the I2C transaction data struct. Unit is bytes.
 #define TX_MESSAGE_MAX_LENGTH 1024
 /// May be set to change the size of the RX data array inside the I2C transaction data struct. Unit is bytes.
 #define RX_MESSAGE_MAX_LENGTH 1024
+/// Number of distinct target addresses per bus that @ref hal_i2c_get_target_metrics() keeps figures for.
+#define HAL_I2C_METRICS_MAX_TARGETS 8
+/// Largest block an SMBus block transfer can carry. The length byte limits it.
+#define HAL_I2C_SMBUS_BLOCK_MAX 255
+/// The SMBus Alert Response Address. Read one byte from it to learn which device pulled SMBALERT#.
+#define HAL_I2C_SMBUS_ALERT_RESPONSE_ADDR 0x0C
+/// Size of a presence map: one bit per 7-bit address, bit (addr % 8) of byte (addr / 8).
+#define HAL_I2C_PRESENCE_MAP_BYTES 16
+/// True if addr is marked present in a presence map.
+#define HAL_I2C_PRESENT(map, addr) (((map)[(addr) / 8U] >> ((addr) % 8U)) & 1U)
+/// First address probed by @ref hal_i2c_scan(). Lower ones are reserved.
+#define HAL_I2C_SCAN_FIRST_ADDR 0x08
+/// Last address probed by @ref hal_i2c_scan(). Higher ones are reserved.
+#define HAL_I2C_SCAN_LAST_ADDR  0x77
+/// Set in a metrics address to mean a 10-bit target. See @ref hal_i2c_get_target_metrics().
+#define HAL_I2C_METRICS_ADDR_10BIT 0x8000U
+/// Times a transaction that lost arbitration is put back in the queue before it fails.
+#define HAL_I2C_ARBITRATION_REQUEUES 4
+/// Mask bit of one @ref hal_i2c_error_t for @ref hal_i2c_retry_policy_t.
+#define HAL_I2C_RETRY_ON(error) (1UL << (error))
+
+/**
+ * @brief The I2C buses (peripherals) available to the driver.
+ */
+typedef enum {
+    _HAL_I2C_BUS_MIN = 0,          /*!< Lower bound of enum. Inclusive. */
+    HAL_I2C1 = _HAL_I2C_BUS_MIN,   /*!< PB8 SCL, PB9 SDA. */
+    HAL_I2C2,                      /*!< PB10 SCL, PC12 SDA. */
+    HAL_I2C3,                      /*!< PA8 SCL, PC9 SDA. Shares PA8 with PWM channel 1. */
+    _HAL_I2C_BUS_MAX               /*!< Upper bound of enum. Exclusive. */
+} hal_i2c_bus_t;
 
 /**
  * @brief The possible states of an I2C transaction (txn).
@@ -63,9 +128,87 @@ typedef enum {
     HAL_I2C_OP_WRITE = _HAL_I2C_OP_MIN, /*!< Send bytes to the target device. */
     HAL_I2C_OP_READ,                    /*!< Read bytes from the target device. */
     HAL_I2C_OP_WRITE_READ,              /*!< Most common pattern for reading a specific register from the target device. */
+    HAL_I2C_OP_SEQUENCE,                /*!< Run a list of @ref hal_i2c_segment_t joined by repeated STARTs. */
+    HAL_I2C_OP_SMBUS_BLOCK_WRITE,       /*!< SMBus Block Write. tx_data holds the command then the block. The driver sends the length byte. */
+    HAL_I2C_OP_SMBUS_BLOCK_READ,        /*!< SMBus Block Read. tx_data[0] holds the command. The target's length byte sets how much is read. */
+    HAL_I2C_OP_SCAN,                    /*!< Address each target listed in tx_data alone. rx_data receives the presence map. See @ref hal_i2c_scan(). */
     _HAL_I2C_OP_MAX                     /*!< Upper bound of enum. Exclusive. */
 } hal_i2c_op_t;
 
+/**
+ * @brief Direction of one segment of a @ref HAL_I2C_OP_SEQUENCE transaction.
+ */
+typedef enum {
+    _HAL_I2C_SEGMENT_MIN = 0,                       /*!< Lower bound of enum. Inclusive. */
+    HAL_I2C_SEGMENT_WRITE = _HAL_I2C_SEGMENT_MIN,   /*!< Send the segment's bytes to the target. May be zero length. */
+    HAL_I2C_SEGMENT_READ,                           /*!< Read bytes from the target into the segment's buffer. Must be at least one byte. */
+    HAL_I2C_SEGMENT_BLOCK_READ,                     /*!< Read an SMBus length byte, then that many bytes into the buffer. length is the most accepted. */
+    _HAL_I2C_SEGMENT_MAX                            /*!< Upper bound of enum. Exclusive. */
+} hal_i2c_segment_dir_t;
+
+/**
+ * @brief Width of a target address.
+ *
+ * A 10-bit target is addressed with a header byte (11110 followed by the top two address bits)
+ * and then the low byte of its address. A read from a 10-bit target first addresses it for writing,
+ * then turns the bus around with a repeated START and a read header. Where a write segment to the
+ * same target comes right before the read, as in @ref HAL_I2C_OP_WRITE_READ, the read header alone
+ * follows the repeated START.
+ */
+typedef enum {
+    _HAL_I2C_ADDR_MIN = 0,                      /*!< Lower bound of enum. Inclusive. */
+    HAL_I2C_ADDR_7BIT = _HAL_I2C_ADDR_MIN,      /*!< Default. Address 0x00 to 0x7F. */
+    HAL_I2C_ADDR_10BIT,                         /*!< Address 0x000 to 0x3FF. */
+    _HAL_I2C_ADDR_MAX                           /*!< Upper bound of enum. Exclusive. */
+} hal_i2c_addr_mode_t;
+
+/**
+ * @brief SCL frequency of a transaction.
+ *
+ * The bus is switched between transactions, never within one. A transaction that follows one
+ * with @ref hal_i2c_txn_t.no_stop set runs at the speed the bus is already at, since the bus is
+ * still held.
+ */
+typedef enum {
+    _HAL_I2C_SPEED_MIN = 0,                         /*!< Lower bound of enum. Inclusive. */
+    HAL_I2C_SPEED_STANDARD = _HAL_I2C_SPEED_MIN,    /*!< Default. 100 kHz. */
+    HAL_I2C_SPEED_FAST,                             /*!< Fast mode. Close to 400 kHz. Every target on the bus must support it. */
+    _HAL_I2C_SPEED_MAX                              /*!< Upper bound of enum. Exclusive. */
+} hal_i2c_speed_t;
+
+/**
+ * @brief One addressed transfer inside a @ref HAL_I2C_OP_SEQUENCE transaction.
+ *
+ * Each segment begins with a START (a repeated START after the first segment) and the
+ * target address. Only the last segment of a sequence is followed by a STOP.
+ *
+ * @note The segment buffers belong to the client and are read and written directly by the
+ * driver while the transaction is processing. They are not copied.
+ */
+typedef struct {
+    uint16_t target_addr;            /*!< The I2C address of the target device for this segment. */
+    hal_i2c_segment_dir_t direction; /*!< Write to or read from the target. */
+    uint8_t *data;                   /*!< WRITE: bytes to send. READ: where the received bytes are stored. */
+    size_t length;                   /*!< Number of bytes to send or receive. */
+    size_t actual_length;            /*!< Set by the driver. Bytes actually moved. Valid once the transaction is COMPLETED. */
+    hal_i2c_addr_mode_t addr_mode;   /*!< Width of target_addr. Defaults to 7-bit when zero initialized. */
+} hal_i2c_segment_t;
+
+/**
+ * @brief Scheduling priority of a transaction.
+ *
+ * Higher priorities are always loaded before lower ones. A zero initialized transaction
+ * is @ref HAL_I2C_PRIORITY_LOW, so clients that do not care about priority all share one
+ * FIFO ordered class.
+ */
+typedef enum {
+    _HAL_I2C_PRIORITY_MIN = 0,                        /*!< Lower bound of enum. Inclusive. */
+    HAL_I2C_PRIORITY_LOW = _HAL_I2C_PRIORITY_MIN,     /*!< Default. Background work such as bulk EEPROM writes. */
+    HAL_I2C_PRIORITY_MEDIUM,                          /*!< Routine work that should not wait behind background work. */
+    HAL_I2C_PRIORITY_HIGH,                            /*!< Time-critical work such as IMU reads. */
+    _HAL_I2C_PRIORITY_MAX                             /*!< Upper bound of enum. Exclusive. */
+} hal_i2c_priority_t;
+
 /**
  * @brief Result status of a completed transaction.
  *
@@ -82,6 +225,56 @@ typedef enum {
     _HAL_I2C_TX_RESULT_MAX                             /*!< Upper bound of enum. Exclusive. */
 } hal_i2c_txn_result_t;
 
+/**
+ * @brief Why a transaction finished with @ref HAL_I2C_TXN_RESULT_FAIL.
+ */
+typedef enum {
+    _HAL_I2C_ERROR_MIN = 0,                   /*!< Lower bound of enum. Inclusive. */
+    HAL_I2C_ERROR_NONE = _HAL_I2C_ERROR_MIN,  /*!< No error. Always the case for successful transactions. */
+    HAL_I2C_ERROR_INVALID,                    /*!< The transaction was rejected by validation and never reached the bus. */
+    HAL_I2C_ERROR_NACK,                       /*!< The target did not acknowledge its address or a data byte. */
+    HAL_I2C_ERROR_BUS,                        /*!< Misplaced START or STOP seen on the bus (BERR), or a short SMBus read whose last byte was acknowledged. The bus was recovered. */
+    HAL_I2C_ERROR_ARBITRATION_LOST,           /*!< Another controller won the bus (ARLO). */
+    HAL_I2C_ERROR_TIMEOUT,                    /*!< The transaction did not finish in time. The bus was recovered. */
+    HAL_I2C_ERROR_DRIVER,                     /*!< The driver reached an inconsistent state and aborted. */
+    HAL_I2C_ERROR_PEC,                        /*!< SMBus only. The PEC received from the target did not match (PECERR). */
+    HAL_I2C_ERROR_BLOCK_LENGTH,               /*!< SMBus only. The target announced an empty block, or one larger than the buffer. */
+    _HAL_I2C_ERROR_MAX                        /*!< Upper bound of enum. Exclusive. */
+} hal_i2c_error_t;
+
+/**
+ * @brief When and how often a failed transaction is tried again.
+ *
+ * A transaction that fails with one of the errors in retry_on goes back into the queue after a
+ * delay, up to max_retries times. The delay starts at delay_ms and is multiplied by backoff on every
+ * further retry, up to max_delay_ms. Delays are timed on the SysTick millisecond tick and released by
+ * @ref hal_i2c_transaction_servicer(), so nothing waits on the bus or in an interrupt handler.
+ *
+ * A policy is usually shared by many transactions and must outlive them.
+ *
+ * @code
+ * // An EEPROM in its write cycle NACKs its address for up to 5 ms.
+ * static const hal_i2c_retry_policy_t eeprom_busy = {
+ *     .max_retries = 6, .delay_ms = 1, .backoff = 2, .max_delay_ms = 4,
+ *     .retry_on = HAL_I2C_RETRY_ON(HAL_I2C_ERROR_NACK),
+ * };
+ * @endcode
+ */
+typedef struct {
+    uint8_t max_retries;     /*!< Attempts after the first. */
+    uint32_t delay_ms;       /*!< Wait before the first retry. 0 puts the transaction straight back in the queue. */
+    uint8_t backoff;         /*!< Factor applied to the wait on every further retry. 0 and 1 keep it constant. */
+    uint32_t max_delay_ms;   /*!< Longest wait. 0 for no limit. */
+    uint32_t retry_on;       /*!< Errors worth a retry, as HAL_I2C_RETRY_ON(error) bits. */
+} hal_i2c_retry_policy_t;
+
+typedef struct hal_i2c_txn hal_i2c_txn_t;
+
+/**
+ * @brief Optional completion notification for a transaction. See @ref hal_i2c_txn_t.
+ */
+typedef void (*hal_i2c_txn_callback_t)(hal_i2c_txn_t *txn);
+
 /**
  * @brief The main data structure for interacting with the I2C module.
  *
@@ -97,14 +290,56 @@ typedef enum {
  * @note When submitting a transaction for processing, the client must maintain the memory for the transaction.
  * Only a reference is passed to the driver. If the memory for the transaction is erased (i.e. declared in a function
  * followed by the function's return) then the I2C driver will operate on a reference to invalid memory.
+ *
+ * @note If @ref on_complete is set, the servicer calls it once the transaction has been processed and
+ * is COMPLETED. It runs in the context of @ref hal_i2c_transaction_servicer() and may submit new
+ * transactions. Transactions rejected by validation are COMPLETED with @ref HAL_I2C_ERROR_INVALID
+ * and called back the same way.
+ *
+ * @note Every transaction is bounded in time. If it is still on the bus after @ref timeout_ms, the
+ * driver aborts it, recovers the bus (SCL pulses and a peripheral reset) and fails it with
+ * @ref HAL_I2C_ERROR_TIMEOUT. The rest of the queue is unaffected.
+ *
+ * @note A transaction that loses arbitration to another controller is put back in the queue, up to
+ * @ref HAL_I2C_ARBITRATION_REQUEUES times, whatever its @ref retry_policy. Other failures are
+ * retried as @ref retry_policy says. Either way the transaction completes, and @ref on_complete
+ * is called, only once, with the result of the final attempt.
+ *
+ * @note With @ref no_stop set, the transaction completes with the bus still held and SCL stretched.
+ * Whatever the servicer loads next, on any target, begins with a repeated START, so another
+ * controller can not get in between. Submit the follow-on transaction before this one completes,
+ * or the bus stays held until some transaction comes along. A failed transaction always ends
+ * with a STOP.
+ *
+ * @note With @ref ack_poll_timeout_ms set, a successful transaction is followed by address-only
+ * probes of the target until it acknowledges again, and only then completes. This is the
+ * acknowledge polling an EEPROM needs after a write: once the transaction completes, the write
+ * cycle is over and the data is in memory. A target that stays silent fails the transaction with
+ * @ref HAL_I2C_ERROR_TIMEOUT.
+ *
+ * @note The driver queues transactions by linking them together through @ref next. There is therefore
+ * no limit on how many transactions may be waiting, but a transaction can not be submitted again
+ * until it is @ref HAL_I2C_TXN_STATE_COMPLETED. Submitting it earlier returns @ref HAL_STATUS_BUSY.
  */
-typedef struct {
+struct hal_i2c_txn {
     // Immutable input. Can not change once transaction has been submitted.
-    uint8_t target_addr;                     /*!< The I2C address of the target device. */
+    uint16_t target_addr;                    /*!< The I2C address of the target device. 7-bit unless addr_mode says otherwise. */
     hal_i2c_op_t i2c_op;                     /*!< The type of transaction. i.e. READ, WRITE, or WRITE-READ. */
-    uint8_t tx_data[TX_MESSAGE_MAX_LENGTH];  /*!< The data to send. Put the register addr in the first slot. */
+    uint8_t tx_data[TX_MESSAGE_MAX_LENGTH];  /*!< The data to send. Put the register addr (SMBus: the command) in the first slot. */
     size_t expected_bytes_to_tx;             /*!< The num of bytes to send the device. Include the reg addr in the count. */
-    size_t expected_bytes_to_rx;             /*!< The desired number of bytes to read from the device during this transaction. Only set for READ or WRITE-READ. */
+    size_t expected_bytes_to_rx;             /*!< The desired number of bytes to read from the device during this transaction. Only set for READ or WRITE-READ.
+                                                  For SMBUS_BLOCK_READ, the largest block accepted. */
+    hal_i2c_priority_t priority;             /*!< Scheduling priority. Defaults to LOW when zero initialized. */
+    hal_i2c_segment_t *segments;             /*!< Only for SEQUENCE. The segments to run, in order. tx_data and rx_data are unused. */
+    size_t segment_count;                    /*!< Only for SEQUENCE. Number of entries in segments. */
+    hal_i2c_txn_callback_t on_complete;      /*!< Optional. Called by the servicer once the processed transaction is COMPLETED. NULL for none. */
+    void *context;                           /*!< Optional. Client data for on_complete. Never touched by the driver. */
+    uint32_t timeout_ms;                     /*!< Optional. Time allowed on the bus. 0 selects a default of 10 ms plus 1 ms per 10 bytes. */
+    const hal_i2c_retry_policy_t *retry_policy; /*!< Optional. How failures are retried. NULL fails on the first error. */
+    uint32_t ack_poll_timeout_ms;            /*!< Optional. After success, poll the target until it acknowledges, for up to this long. 0 for none. */
+    hal_i2c_addr_mode_t addr_mode;           /*!< Optional. Width of target_addr. Not used by SEQUENCE, whose segments carry their own, or SCAN. */
+    hal_i2c_speed_t speed;                   /*!< Optional. SCL frequency. Defaults to 100 kHz when zero initialized. */
+    bool no_stop;                            /*!< Optional. End without a STOP and keep the bus, so the next transaction begins with a repeated START. */
 
     // Poll to determine when transaction has been completed.
     hal_i2c_txn_state_t processing_state;    /*!< Submit transaction with CREATED. When processing_state == COMPLETED then client can collect results. Safe to check periodically.
@@ -113,42 +348,229 @@ typedef struct {
     // Results of the transaction. Only valid once processing_state == COMPLETED.
     // Initialize to prescribed values when submitting transaction.
     hal_i2c_txn_result_t transaction_result; /*!< Only valid once processing_state == COMPLETED. Contains the result of the transaction (success, fail, etc). Init to NONE. */
-    size_t actual_bytes_received;            /*!< The actual number of bytes that got read during the transaction. Init to 0. */
-    size_t actual_bytes_transmitted;         /*!< The actual number of bytes that got transmitted during the transaction. Init to 0. */
+    hal_i2c_error_t error;                   /*!< Only valid once processing_state == COMPLETED. The cause of a FAIL result. Init to NONE. */
+    size_t actual_bytes_received;            /*!< The actual number of bytes that got read during the transaction. Summed over all segments of a SEQUENCE.
+                                                  For SMBus block reads, the block length. Length and PEC bytes are never counted. Init to 0. */
+    size_t actual_bytes_transmitted;         /*!< The actual number of bytes that got transmitted during the transaction. Summed over all segments of a SEQUENCE.
+                                                  Includes the length byte of an SMBus block write, but never the PEC. Init to 0. */
+    uint8_t retries;                         /*!< Retries made under retry_policy. Reset on submission. */
+    uint8_t arbitration_requeues;            /*!< Times arbitration was lost and the transaction queued again. Reset on submission. */
     uint8_t rx_data[RX_MESSAGE_MAX_LENGTH];  /*!< Data read from device will be stored here. Only valid after processing_state == COMPLETED.
                                                   Init rx_data to zeros when creating the transaction struct. */
-} hal_i2c_txn_t;
+
+    // Driver bookkeeping. Never modified by the client.
+    uint32_t queued_tick;                    /*!< Tick (ms) at which the transaction was submitted. Used for queue latency reporting. */
+    uint32_t queued_us;                      /*!< Time (us) at which the transaction was submitted. Used for per-target metrics. */
+    uint32_t retry_delay_ms;                 /*!< Wait before the last retry. The next one is derived from it. */
+    uint32_t retry_due_tick;                 /*!< Tick (ms) at which a waiting retry goes back in the queue. */
+    struct hal_i2c_txn *next;                /*!< Link to the transaction queued behind this one. */
+};
+
+/**
+ * @brief Queue wait statistics for one priority.
+ *
+ * Wait time is measured from submission until the servicer loads the transaction onto the bus.
+ * Unit is milliseconds, as reported by @ref hal_get_tick().
+ */
+typedef struct {
+    uint32_t transactions_loaded; /*!< Number of transactions of this priority that have left the queue. */
+    uint32_t total_wait_ms;       /*!< Sum of the wait time of every loaded transaction. Divide by transactions_loaded for the mean. */
+    uint32_t max_wait_ms;         /*!< Longest wait time seen. */
+} hal_i2c_queue_latency_t;
+
+/**
+ * @brief Traffic of one target address on one bus.
+ *
+ * Queue wait runs from submission until the servicer loads the transaction. On-bus time runs
+ * from the START until the interrupt handler requests the final STOP, or until the transaction
+ * is aborted. Unit is microseconds, as reported by @ref hal_get_time_us(). A
+ * @ref HAL_I2C_OP_SEQUENCE is booked to the target of its first segment. 10-bit targets are booked
+ * under their address with @ref HAL_I2C_METRICS_ADDR_10BIT set.
+ */
+typedef struct {
+    uint16_t target_addr;         /*!< The address these figures belong to. */
+    uint32_t transactions;        /*!< Completed transactions, failed ones included. Every retry counts as one more. */
+    uint32_t total_wait_us;       /*!< Sum of the queue wait of every transaction. */
+    uint32_t max_wait_us;         /*!< Longest queue wait seen. */
+    uint32_t total_bus_us;        /*!< Sum of the on-bus time of every transaction. */
+    uint32_t max_bus_us;          /*!< Longest on-bus time seen. */
+    uint32_t bytes_transmitted;   /*!< Data bytes written to the target. Address bytes are not counted. */
+    uint32_t bytes_received;      /*!< Data bytes read from the target. */
+    uint32_t nacks;               /*!< Transactions that failed with @ref HAL_I2C_ERROR_NACK. */
+    uint32_t errors;              /*!< Transactions that failed for any other reason. */
+} hal_i2c_target_metrics_t;
+
+/**
+ * @brief How much of the time the bus carried a transaction.
+ */
+typedef struct {
+    uint32_t window_ms;               /*!< Time since the figures were last reset. */
+    uint64_t busy_us;                 /*!< On-bus time of every transaction in the window. */
+    uint8_t busy_percent;             /*!< busy_us as a share of window_ms. 0 until a millisecond has passed. */
+    uint32_t untracked_transactions;  /*!< Transactions to targets beyond the first @ref HAL_I2C_METRICS_MAX_TARGETS. Counted in busy_us only. */
+} hal_i2c_bus_utilization_t;
+
+/**
+ * @brief Notification that a device pulled SMBALERT# low. See @ref hal_i2c_smbus_config_t.
+ */
+typedef void (*hal_i2c_smbus_alert_callback_t)(hal_i2c_bus_t bus, void *context);
+
+/**
+ * @brief SMBus host settings of one bus.
+ */
+typedef struct {
+    bool pec;                                 /*!< Append a PEC to every transaction and check the PEC of every read. */
+    hal_i2c_smbus_alert_callback_t on_alert;  /*!< Optional. Called from the error interrupt on SMBALERT#. NULL leaves the SMBA pin alone. */
+    void *context;                            /*!< Optional. Client data for on_alert. Never touched by the driver. */
+} hal_i2c_smbus_config_t;
+
+/**
+ * @brief Initialize one I2C bus. Must be called prior to using the bus.
+ *
+ * @param bus The bus to initialize.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR if bus is out of range.
+ */
+hal_status_t hal_i2c_init(hal_i2c_bus_t bus);
+
+/**
+ * @brief Find every device on a bus.
+ *
+ * Fills txn with a @ref HAL_I2C_OP_SCAN of addresses @ref HAL_I2C_SCAN_FIRST_ADDR to
+ * @ref HAL_I2C_SCAN_LAST_ADDR and submits it. The interrupt handler addresses each target in turn,
+ * moving to the next on its ACK or NACK with a repeated START, and ends the scan with one STOP.
+ * Nothing is written to any target. At 100 kHz the 112 probes take about 12 ms.
+ *
+ * Once txn is COMPLETED, its rx_data holds the presence map. Test an address with
+ * @ref HAL_I2C_PRESENT(). A NACK only means absent, so the scan succeeds unless the bus itself fails.
+ *
+ * @code
+ * static hal_i2c_txn_t scan;
+ * hal_i2c_scan(HAL_I2C1, &scan);
+ * // ... service until scan.processing_state == HAL_I2C_TXN_STATE_COMPLETED
+ * if (HAL_I2C_PRESENT(scan.rx_data, 0x68)) { ... }
+ * @endcode
+ *
+ * Any other list of up to 128 addresses can be probed by filling in a @ref HAL_I2C_OP_SCAN
+ * transaction by hand: the addresses in tx_data and their number in expected_bytes_to_tx.
+ *
+ * @param bus The bus to scan.
+ * @param txn Client-owned transaction. Overwritten except for on_complete and context. Same lifetime
+ *            rules as any submitted transaction.
+ *
+ * @return As @ref hal_i2c_submit_transaction().
+ */
+hal_status_t hal_i2c_scan(hal_i2c_bus_t bus, hal_i2c_txn_t *txn);
 
 /**
- * @brief Initialize the I2C Module. Must be called prior to using the I2C Module.
+ * @brief Run an initialized bus as an SMBus host.
+ *
+ * With pec set, the peripheral's PEC engine computes the CRC-8 of every transaction. It is sent
+ * after the last byte of a transaction that ends in a write, and checked against the last byte of
+ * one that ends in a read. A mismatch fails the transaction with @ref HAL_I2C_ERROR_PEC. PEC bytes
+ * never appear in tx_data, rx_data or the byte counts.
+ *
+ * Reads whose length is only known on the way, block reads and PEC checked reads, take their bytes
+ * one interrupt at a time. Blocks of one or two bytes, a one byte block with a PEC and a PEC checked
+ * read of one byte need the event interrupt to run within one byte time (90 us at 100 kHz, 23 us at
+ * 400 kHz) of their second to last byte. Later than that, the last byte has been acknowledged and the
+ * transaction fails with @ref HAL_I2C_ERROR_BUS. Longer reads end on BTF and have no such limit.
  *
- * @return @ref HAL_STATUS_OK on success.
+ * With on_alert set, the bus's SMBA pin (I2C1 PB5, I2C2 PB12, I2C3 PA9) is put on AF4 and every
+ * falling edge of SMBALERT# calls on_alert from the error interrupt. Read one byte from
+ * @ref HAL_I2C_SMBUS_ALERT_RESPONSE_ADDR to learn which device raised it. PA9 is also USART1 TX,
+ * so I2C3 can not report alerts while UART1 is in use.
+ *
+ * @param bus The bus, already initialized with @ref hal_i2c_init().
+ * @param config The SMBus settings. Copied.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR if bus is out of range, config is NULL,
+ * the bus is in target mode or a transaction is on the bus.
+ *
+ * @note @ref hal_i2c_init() returns the bus to plain I2C.
  */
-hal_status_t hal_i2c_init();
+hal_status_t hal_i2c_smbus_enable(hal_i2c_bus_t bus, const hal_i2c_smbus_config_t *config);
 
 /**
  * @brief Submit a transaction to be processed by the driver.
  *
+ * @param bus The bus the target device is on.
  * @param txn A reference to a transaction with the appropriate fields already filled out.
  * See @ref hal_i2c_txn_t for details about filling out the transaction correctly, as well as
  * information about checking progress.
  *
- * @return @ref HAL_STATUS_OK if transaction was submitted successfully.
+ * @return @ref HAL_STATUS_OK if transaction was submitted successfully, @ref HAL_STATUS_ERROR if
+ * txn is NULL, bus is out of range or bus is in target mode, @ref HAL_STATUS_BUSY if txn is still
+ * @ref HAL_I2C_TXN_STATE_QUEUED or @ref HAL_I2C_TXN_STATE_PROCESSING. A busy transaction is left
+ * untouched.
  *
  * @note Successful return from this function *only* represents that the transaction was
  * successfully queued.
  *
  * @note Clients must maintain the memory of their transactions. Only a *reference* to the
  * transaction is queued.
+ *
+ * @note Lock-free and safe to call from any context: the main loop, timer callbacks and other
+ * interrupt handlers, concurrently with each other and with the servicer. Interrupts are never
+ * disabled.
  */
-hal_status_t hal_i2c_submit_transaction(hal_i2c_txn_t *txn);
+hal_status_t hal_i2c_submit_transaction(hal_i2c_bus_t bus, hal_i2c_txn_t *txn);
 
 /**
  * @brief Called periodically to manage the loading and unloading of
- * transactions.
+ * transactions on one bus.
+ *
+ * @param bus The bus to service.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_BUSY while a transaction is on the bus,
+ * @ref HAL_STATUS_ERROR if an invalid transaction was rejected or bus is out of range.
+ */
+hal_status_t hal_i2c_transaction_servicer(hal_i2c_bus_t bus);
+
+/**
+ * @brief Retrieve the queue wait statistics for one priority of one bus.
+ *
+ * @param bus The bus to report on.
+ * @param priority The priority to report on.
+ * @param latency Filled with the statistics gathered since @ref hal_i2c_init().
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR if bus or priority is out of range or latency is NULL.
+ */
+hal_status_t hal_i2c_get_queue_latency(hal_i2c_bus_t bus, hal_i2c_priority_t priority, hal_i2c_queue_latency_t *latency);
+
+/**
+ * @brief Retrieve the traffic figures of one target address.
+ *
+ * The first @ref HAL_I2C_METRICS_MAX_TARGETS addresses seen on a bus each get their own figures.
+ *
+ * @param bus The bus the target is on.
+ * @param target_addr 7-bit address of the target, or a 10-bit address with @ref HAL_I2C_METRICS_ADDR_10BIT set.
+ * @param metrics Filled with the figures gathered since @ref hal_i2c_init() or @ref hal_i2c_reset_metrics().
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR if bus is out of range, metrics is NULL or
+ * no transaction to target_addr has completed yet.
+ */
+hal_status_t hal_i2c_get_target_metrics(hal_i2c_bus_t bus, uint16_t target_addr, hal_i2c_target_metrics_t *metrics);
+
+/**
+ * @brief Retrieve the share of time one bus spent carrying transactions.
+ *
+ * @param bus The bus to report on.
+ * @param utilization Filled with the figures gathered since @ref hal_i2c_init() or @ref hal_i2c_reset_metrics().
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR if bus is out of range or utilization is NULL.
+ */
+hal_status_t hal_i2c_get_bus_utilization(hal_i2c_bus_t bus, hal_i2c_bus_utilization_t *utilization);
+
+/**
+ * @brief Clear the per-target figures and the utilization window of one bus.
+ *
+ * Queue latency statistics are not affected.
+ *
+ * @param bus The bus to reset.
  *
- * @return @ref HAL_STATUS_OK on success.
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR if bus is out of range.
  */
-hal_status_t hal_i2c_transaction_servicer();
+hal_status_t hal_i2c_reset_metrics(hal_i2c_bus_t bus);
 
 #endif /* _I2C_H */
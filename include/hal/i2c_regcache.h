@@ -0,0 +1,157 @@
+/**
+ * @file i2c_regcache.h
+ * @brief Write-combining register cache for I2C devices, built on the I2C transaction queue.
+ *
+ * Configuration registers of most devices only change when the driver changes them, yet a
+ * read-modify-write of one costs a full WRITE_READ and a WRITE on the bus. A register cache
+ * keeps a shadow copy of a block of registers of one target so that:
+ *
+ * - Reads of a register whose value is known are answered from the shadow without touching the bus.
+ * - Writes only update the shadow and mark the register dirty. Writing the value a register
+ *   already holds is free.
+ * - @ref hal_i2c_regcache_flush() sends the dirty registers, merging each run of adjacent
+ *   dirty registers into a single burst write.
+ *
+ * Registers the device changes on its own (status, data, interrupt flags) must be dropped from the
+ * shadow with @ref hal_i2c_regcache_invalidate() before each read, or kept outside the cached block.
+ *
+ * The cache has at most one transaction on the bus at a time. Calls that need the bus submit a
+ * transaction and return @ref HAL_STATUS_BUSY. Call them again once the servicer has run:
+ *
+ * @code
+ * while (hal_i2c_regcache_update_bits(&imu_cache, CTRL1, ODR_MASK, ODR_100HZ) == HAL_STATUS_BUSY)
+ * {
+ *     hal_i2c_transaction_servicer(HAL_I2C1);
+ * }
+ * while (hal_i2c_regcache_flush(&imu_cache) == HAL_STATUS_BUSY)
+ * {
+ *     hal_i2c_transaction_servicer(HAL_I2C1);
+ * }
+ * @endcode
+ *
+ * The target must auto-increment its register pointer across burst reads and writes, as
+ * nearly every register based device does.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _I2C_REGCACHE_H
+#define _I2C_REGCACHE_H
+
+#include "hal_types.h"
+#include "hal/i2c.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Largest block of registers one cache can shadow.
+#define HAL_I2C_REGCACHE_MAX_REGISTERS 64
+
+/**
+ * @brief State of one register cache.
+ *
+ * The client provides the memory and must keep it alive while the cache is in use.
+ * Every field is owned by the cache. Clients only read the statistics.
+ */
+typedef struct {
+    hal_i2c_bus_t bus;                               /*!< The bus the target is on. */
+    uint8_t target_addr;                             /*!< 7-bit address of the target. */
+    uint8_t base_register;                           /*!< Address of the first cached register. */
+    size_t register_count;                           /*!< Number of cached registers. */
+    hal_i2c_priority_t priority;                     /*!< Priority of the transactions the cache submits. */
+    uint8_t shadow[HAL_I2C_REGCACHE_MAX_REGISTERS];  /*!< Last known value of every cached register. */
+    uint64_t valid;                                  /*!< Bit n set when shadow[n] holds the value of the register. */
+    uint64_t dirty;                                  /*!< Bit n set when shadow[n] has not been written to the target yet. */
+    uint64_t in_flight;                              /*!< Registers covered by the transaction on the bus. */
+    hal_i2c_txn_t txn;                               /*!< The one transaction the cache has on the bus. */
+    volatile bool busy;                              /*!< True while txn is queued or on the bus. */
+    bool read_failed;                                /*!< The last fetch failed. Reported by the next read that misses. */
+    bool write_failed;                               /*!< The last burst write failed. Reported by the next flush. */
+    uint32_t reads_skipped;                          /*!< Reads answered from the shadow. */
+    uint32_t bus_reads;                              /*!< Burst reads submitted. */
+    uint32_t bus_writes;                             /*!< Burst writes submitted. */
+    uint32_t failures;                               /*!< Transactions that completed with @ref HAL_I2C_TXN_RESULT_FAIL. */
+} hal_i2c_regcache_t;
+
+/**
+ * @brief Set up a cache over a block of registers. Every register starts out unknown.
+ *
+ * @param cache Client-owned cache state. Overwritten.
+ * @param bus The bus the target is on.
+ * @param target_addr 7-bit address of the target. 0x00 to 0x7F.
+ * @param base_register Address of the first register to cache.
+ * @param register_count Number of consecutive registers to cache. 1 to @ref HAL_I2C_REGCACHE_MAX_REGISTERS,
+ * and the block must not run past register 0xFF.
+ * @param priority Priority of the transactions the cache submits.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR on bad arguments.
+ */
+hal_status_t hal_i2c_regcache_init(hal_i2c_regcache_t *cache, hal_i2c_bus_t bus, uint8_t target_addr,
+                                   uint8_t base_register, size_t register_count, hal_i2c_priority_t priority);
+
+/**
+ * @brief Read a register.
+ *
+ * Answered from the shadow when the value is known. Otherwise a burst read is submitted that
+ * fetches the register and every unknown register after it.
+ *
+ * @param cache The cache.
+ * @param reg Register address.
+ * @param value Set to the register value on @ref HAL_STATUS_OK.
+ *
+ * @return @ref HAL_STATUS_OK with value set, @ref HAL_STATUS_BUSY while the value is being fetched
+ * (call again later), @ref HAL_STATUS_ERROR on bad arguments, if the read could not be submitted or
+ * if the previous fetch failed. The call after an error fetches again.
+ */
+hal_status_t hal_i2c_regcache_read(hal_i2c_regcache_t *cache, uint8_t reg, uint8_t *value);
+
+/**
+ * @brief Write a register. Only the shadow is updated until @ref hal_i2c_regcache_flush().
+ *
+ * @param cache The cache.
+ * @param reg Register address.
+ * @param value New register value.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR on bad arguments.
+ */
+hal_status_t hal_i2c_regcache_write(hal_i2c_regcache_t *cache, uint8_t reg, uint8_t value);
+
+/**
+ * @brief Read-modify-write the bits of a register selected by mask.
+ *
+ * @param cache The cache.
+ * @param reg Register address.
+ * @param mask Bits to change.
+ * @param value New value of those bits.
+ *
+ * @return As @ref hal_i2c_regcache_read(). Nothing is modified unless @ref HAL_STATUS_OK is returned.
+ */
+hal_status_t hal_i2c_regcache_update_bits(hal_i2c_regcache_t *cache, uint8_t reg, uint8_t mask, uint8_t value);
+
+/**
+ * @brief Send dirty registers to the target.
+ *
+ * Submits one burst write for the first run of adjacent dirty registers. A write that fails
+ * leaves its registers dirty, so the call after the error tries again.
+ *
+ * @param cache The cache.
+ *
+ * @return @ref HAL_STATUS_OK once nothing is dirty and the cache is idle, @ref HAL_STATUS_BUSY while
+ * there is still work (call again later), @ref HAL_STATUS_ERROR if cache is NULL, a write could not be submitted
+ * or the previous write failed.
+ */
+hal_status_t hal_i2c_regcache_flush(hal_i2c_regcache_t *cache);
+
+/**
+ * @brief Forget the value of registers, so the next read of each goes to the bus.
+ *
+ * Dirty registers are not affected. Their shadow is the value the target is about to get.
+ *
+ * @param cache The cache.
+ * @param reg First register address.
+ * @param count Number of registers. Registers outside the cached block are ignored.
+ */
+void hal_i2c_regcache_invalidate(hal_i2c_regcache_t *cache, uint8_t reg, size_t count);
+
+#endif /* _I2C_REGCACHE_H */
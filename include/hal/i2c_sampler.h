@@ -0,0 +1,119 @@
+/**
+ * @file i2c_sampler.h
+ * @brief Periodic I2C sampling built on the I2C transaction queue and SysTick timers.
+ *
+ * A sampler repeats one I2C transaction (e.g. "read 6 bytes from the IMU") at a fixed
+ * period without any involvement from the application loop. The SysTick interrupt decides
+ * when a sample is due and submits it to the I2C driver. The servicer runs it like any
+ * other transaction and publishes the result when it completes.
+ *
+ * Each sampler owns two copies of the transaction. While one copy is on the bus, the other
+ * holds the latest published sample, so a reader never sees a half-written result. Reads
+ * follow a seqlock pattern:
+ *
+ * @code
+ * const uint8_t *data;
+ * size_t length;
+ * uint32_t sequence;
+ * uint8_t copy[6];
+ *
+ * if (hal_i2c_sampler_read(&imu_sampler, &data, &length, &sequence) == HAL_STATUS_OK)
+ * {
+ *     memcpy(copy, data, sizeof(copy));
+ *     if (hal_i2c_sampler_read_is_valid(&imu_sampler, sequence))
+ *     {
+ *         // copy holds sample number `sequence`, untouched by the driver.
+ *     }
+ * }
+ * @endcode
+ *
+ * A sample that comes due while the previous one is still queued or on the bus is skipped
+ * and counted in @ref hal_i2c_sampler_t.overruns. A sample that fails is not published and
+ * is counted in @ref hal_i2c_sampler_t.failures.
+ *
+ * @attention @ref hal_i2c_transaction_servicer() must still be called periodically.
+ * @attention Requires @ref hal_systick_init() and @ref hal_i2c_init().
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _I2C_SAMPLER_H
+#define _I2C_SAMPLER_H
+
+#include "hal_types.h"
+#include "hal/i2c.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HAL_I2C_SAMPLER_MAX_CLIENTS (8)
+
+/**
+ * @brief State of one periodic sampler.
+ *
+ * The client provides the memory and must keep it alive while the sampler is registered.
+ * Every field is owned by the sampler engine. Clients only read the statistics.
+ */
+typedef struct {
+    hal_i2c_txn_t buffers[2];    /*!< Sample n is written into buffers[n & 1]. */
+    hal_i2c_bus_t bus;           /*!< The bus the samples are submitted to. */
+    uint32_t period_ms;          /*!< Time between samples. */
+    volatile uint32_t published; /*!< Number of the latest published sample. 0 until the first sample succeeds. */
+    volatile uint32_t claimed;   /*!< Number of the sample most recently handed to the driver. */
+    volatile bool in_flight;     /*!< True while a sample is queued or on the bus. */
+    uint32_t overruns;           /*!< Samples skipped because the previous one had not completed. */
+    uint32_t failures;           /*!< Samples that completed with @ref HAL_I2C_TXN_RESULT_FAIL. */
+} hal_i2c_sampler_t;
+
+/**
+ * @brief Start sampling a transaction periodically.
+ *
+ * @param sampler Client-owned sampler state. Zero it before its first registration. Overwritten.
+ * @param bus The bus the target device is on.
+ * @param request The transaction to repeat. Copied, so it need not outlive the call.
+ * Checked as the servicer would check it, with 7-bit addresses held to 0x00-0x7F and READ, WRITE
+ * and WRITE_READ moving at least one byte each way. Any operation but @ref HAL_I2C_OP_SEQUENCE,
+ * whose segment buffers can not be double-buffered.
+ * @param period_ms Time between samples. Must be > 0.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR on bad arguments, if
+ * @ref HAL_I2C_SAMPLER_MAX_CLIENTS samplers are already registered or no SysTick timer is free,
+ * @ref HAL_STATUS_BUSY if a sample submitted before the sampler was deregistered is still in flight.
+ */
+hal_status_t hal_i2c_sampler_register(hal_i2c_sampler_t *sampler, hal_i2c_bus_t bus, const hal_i2c_txn_t *request, uint32_t period_ms);
+
+/**
+ * @brief Stop sampling.
+ *
+ * No new samples are submitted once this returns. A sample that is already queued still
+ * completes, so keep the sampler memory alive until @ref hal_i2c_sampler_t.in_flight is false.
+ *
+ * @param sampler A registered sampler. No-op otherwise.
+ */
+void hal_i2c_sampler_deregister(hal_i2c_sampler_t *sampler);
+
+/**
+ * @brief Get the latest published sample without copying it.
+ *
+ * @param sampler The sampler to read.
+ * @param data Set to the received bytes of the sample.
+ * @param length Set to the number of valid bytes in data.
+ * @param sequence Set to the sample number. Pass to @ref hal_i2c_sampler_read_is_valid() once done with data.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_BUSY if no sample has been published yet,
+ * @ref HAL_STATUS_ERROR if any argument is NULL.
+ */
+hal_status_t hal_i2c_sampler_read(const hal_i2c_sampler_t *sampler, const uint8_t **data, size_t *length, uint32_t *sequence);
+
+/**
+ * @brief Check that a sample returned by @ref hal_i2c_sampler_read() was not overwritten while in use.
+ *
+ * @param sampler The sampler that was read.
+ * @param sequence The sample number returned by the read.
+ *
+ * @return true if the data of that sample is still intact.
+ */
+bool hal_i2c_sampler_read_is_valid(const hal_i2c_sampler_t *sampler, uint32_t sequence);
+
+#endif /* _I2C_SAMPLER_H */
@@ -0,0 +1,108 @@
+/**
+ * @file i2c_target.h
+ * @brief I2C target (slave) mode with a register map emulation.
+ *
+ * In target mode a bus answers to its own addresses instead of driving transactions. The
+ * application describes its device as a register map: a plain array of bytes it owns. The
+ * driver follows the common register protocol of I2C devices:
+ *
+ * - A write from the controller starts with a register pointer. Every byte after it is
+ *   stored straight into the map at the pointer, which then advances.
+ * - A read from the controller is served straight out of the map, starting at the pointer.
+ *   A write of just the pointer followed by a repeated START reads from that register.
+ *
+ * Nothing is copied on either side. The interrupt handler reads and writes the application's
+ * array directly, so the application publishes new values simply by storing them.
+ *
+ * @code
+ * static uint8_t sensor_registers[16];
+ *
+ * hal_i2c_target_config_t config = {
+ *     .own_address = 0x42,
+ *     .registers = sensor_registers,
+ *     .register_count = sizeof(sensor_registers),
+ *     .stretch_until_published = true,
+ * };
+ * hal_i2c_target_init(HAL_I2C1, &config);
+ *
+ * // Later, once a new measurement is in sensor_registers.
+ * hal_i2c_target_publish(HAL_I2C1);
+ * @endcode
+ *
+ * With @ref hal_i2c_target_config_t.stretch_until_published set, every read must be preceded by
+ * @ref hal_i2c_target_publish(). A read that arrives before fresh data has been published holds
+ * SCL low after the address until the application publishes, so the controller never sees the
+ * same measurement twice or a half-updated one. Reads of fresh data are never stretched.
+ *
+ * @attention A bus in target mode does not accept controller transactions. Call
+ * @ref hal_i2c_init() to return it to controller mode.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _I2C_TARGET_H
+#define _I2C_TARGET_H
+
+#include "hal_types.h"
+#include "hal/i2c.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Largest register map that a one byte register pointer can address.
+#define HAL_I2C_TARGET_MAX_REGISTERS 256
+
+/// Value sent for reads past the end of the register map.
+#define HAL_I2C_TARGET_FILL_BYTE 0xFF
+
+/**
+ * @brief Called once at the end of every write from the controller that changed the map.
+ *
+ * Runs in interrupt context.
+ *
+ * @param first_register The register the write started at.
+ * @param length Number of registers the write covered, including read-only ones that were left alone.
+ * @param context The context of the target configuration.
+ */
+typedef void (*hal_i2c_target_write_callback_t)(uint8_t first_register, size_t length, void *context);
+
+/**
+ * @brief Addresses and register map of a bus in target mode.
+ */
+typedef struct {
+    uint8_t own_address;                      /*!< 7-bit address. */
+    uint8_t second_address;                   /*!< Optional second 7-bit address. 0 to disable. */
+    bool general_call;                        /*!< Also answer to the general call address 0x00. Treated like a write to own_address. */
+    uint8_t *registers;                       /*!< Application-owned register map. Must stay alive while in target mode. */
+    size_t register_count;                    /*!< Size of registers. 1 to @ref HAL_I2C_TARGET_MAX_REGISTERS. */
+    const uint8_t *writable;                  /*!< Optional bitmap, one bit per register, LSB first. Writes to registers with a 0 bit are dropped. NULL makes every register writable. */
+    bool stretch_until_published;             /*!< Stretch reads until @ref hal_i2c_target_publish() has been called since the last read. */
+    hal_i2c_target_write_callback_t on_write; /*!< Optional. Notified of writes from the controller. */
+    void *context;                            /*!< Passed to on_write. */
+} hal_i2c_target_config_t;
+
+/**
+ * @brief Initialize a bus and put it in target mode.
+ *
+ * @param bus The bus to answer on.
+ * @param config Addresses and register map. Copied, but the memory it points to must outlive target mode.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR if bus is out of range, config or its
+ * registers are NULL, register_count is out of range, or an address is not a 7-bit address.
+ */
+hal_status_t hal_i2c_target_init(hal_i2c_bus_t bus, const hal_i2c_target_config_t *config);
+
+/**
+ * @brief Mark the register map as holding fresh data.
+ *
+ * Releases a read that is stretched waiting for data. The next read completes immediately.
+ * Only meaningful with @ref hal_i2c_target_config_t.stretch_until_published set.
+ *
+ * @param bus A bus in target mode.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR if bus is out of range or not in target mode.
+ */
+hal_status_t hal_i2c_target_publish(hal_i2c_bus_t bus);
+
+#endif /* _I2C_TARGET_H */
@@ -0,0 +1,104 @@
+/**
+ * @file i2c_watch.h
+ * @brief Periodic presence checks of expected I2C devices, built on the SCAN transaction.
+ *
+ * A watch probes a fixed list of addresses at a fixed period with one @ref HAL_I2C_OP_SCAN
+ * transaction and reports every device that appeared or disappeared since the previous scan.
+ * This catches hot-plugged modules as well as devices that have died or lost power, without
+ * any involvement from the application loop.
+ *
+ * Every listed device starts out assumed present, so one that is missing at the first scan is
+ * reported straight away. The current state is kept as a presence map:
+ *
+ * @code
+ * static const uint8_t expected[] = { 0x50, 0x68 };
+ * static hal_i2c_watch_t watch;
+ *
+ * hal_i2c_watch_register(&watch, HAL_I2C1, expected, 2, 100, on_change, NULL);
+ * ...
+ * if (!HAL_I2C_PRESENT(watch.present, 0x68)) { ... }
+ * @endcode
+ *
+ * A scan that comes due while the previous one is still queued or on the bus is skipped and
+ * counted in @ref hal_i2c_watch_t.overruns. A scan that fails, e.g. on a bus error, changes
+ * nothing and is counted in @ref hal_i2c_watch_t.failures.
+ *
+ * @attention @ref hal_i2c_transaction_servicer() must still be called periodically.
+ * @attention Requires @ref hal_systick_init() and @ref hal_i2c_init().
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _I2C_WATCH_H
+#define _I2C_WATCH_H
+
+#include "hal_types.h"
+#include "hal/i2c.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HAL_I2C_WATCH_MAX_CLIENTS (4)
+
+typedef struct hal_i2c_watch hal_i2c_watch_t;
+
+/**
+ * @brief Called when a watched device appears or disappears.
+ *
+ * Runs in the context of @ref hal_i2c_transaction_servicer(), once per changed address.
+ *
+ * @param watch The watch that saw the change.
+ * @param address The 7-bit address of the device.
+ * @param present True if the device now answers.
+ */
+typedef void (*hal_i2c_watch_callback_t)(hal_i2c_watch_t *watch, uint8_t address, bool present);
+
+/**
+ * @brief State of one watch.
+ *
+ * The client provides the memory and must keep it alive while the watch is registered.
+ * Every field is owned by the watch engine. Clients only read present and the statistics.
+ */
+struct hal_i2c_watch {
+    hal_i2c_txn_t txn;                            /*!< The SCAN of the watched addresses. */
+    hal_i2c_bus_t bus;                            /*!< The bus being watched. */
+    uint32_t period_ms;                           /*!< Time between scans. */
+    uint8_t present[HAL_I2C_PRESENCE_MAP_BYTES];  /*!< Presence map of the watched devices as of the last scan. Test with @ref HAL_I2C_PRESENT(). */
+    volatile bool in_flight;                      /*!< True while a scan is queued or on the bus. */
+    uint32_t scans;                               /*!< Scans that completed successfully. */
+    uint32_t failures;                            /*!< Scans that completed with @ref HAL_I2C_TXN_RESULT_FAIL. */
+    uint32_t overruns;                            /*!< Scans skipped because the previous one had not completed. */
+    hal_i2c_watch_callback_t on_change;           /*!< Optional. NULL for none. */
+    void *context;                                /*!< Optional. Client data for on_change. Never touched by the watch engine. */
+};
+
+/**
+ * @brief Start watching a list of devices.
+ *
+ * @param watch Client-owned watch state. Zero it before its first registration. Overwritten.
+ * @param bus The bus the devices are on.
+ * @param addresses The 7-bit addresses to watch. Copied, so they need not outlive the call.
+ * @param count Number of addresses. 1 to 128.
+ * @param period_ms Time between scans. Must be > 0.
+ * @param on_change Optional. Called for every device that appears or disappears.
+ * @param context Optional. Stored in @ref hal_i2c_watch_t.context for on_change.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR on bad arguments, if
+ * @ref HAL_I2C_WATCH_MAX_CLIENTS watches are already registered or no SysTick timer is free,
+ * @ref HAL_STATUS_BUSY while a scan submitted before the watch was deregistered is in flight.
+ */
+hal_status_t hal_i2c_watch_register(hal_i2c_watch_t *watch, hal_i2c_bus_t bus, const uint8_t *addresses, size_t count,
+                                    uint32_t period_ms, hal_i2c_watch_callback_t on_change, void *context);
+
+/**
+ * @brief Stop watching.
+ *
+ * No new scans are submitted once this returns. A scan that is already queued still
+ * completes, so keep the watch memory alive until @ref hal_i2c_watch_t.in_flight is false.
+ *
+ * @param watch A registered watch. No-op otherwise.
+ */
+void hal_i2c_watch_deregister(hal_i2c_watch_t *watch);
+
+#endif /* _I2C_WATCH_H */
@@ -1,6 +1,6 @@
 /**
  * @file pwm.h
- * @brief Control for PWM signals generated by the micro on up to four channels.
+ * @brief Control for PWM signals generated by the micro's timers, four channels each.
  * @note
  * General steps for use:
  *   0. Choose a base frequency.
@@ -9,10 +9,43 @@
  *   3. Enable the channel output         (hal_pwm_enable())
  *   4. Set the duty cycle                (hal_pwm_set_duty_cycle())
  *
+ * hal_pwm_set_duty_cycle() works in whole percent. hal_pwm_set_duty_q16() and
+ * hal_pwm_set_duty_counts() reach every step of the timer instead, see
+ * hal_pwm_get_resolution_bits(). hal_pwm_ramp_to() fades a channel to a new duty
+ * cycle from the update interrupt, e.g. to soft-start a motor.
+ *
  * All four channels share the same base frequency set in step 1.
  * Each channel's duty cycle is independent. Channels may be brought up
  * one at a time in any order after the timer is initialized.
  *
+ * The functions above drive TIM1. The hal_pwm_tim_*() variants take a
+ * @ref hal_pwm_timer_t and follow the same steps on any PWM-capable timer,
+ * each with its own base frequency, e.g. servos at 50 Hz on TIM3 next to
+ * fans at 25 kHz on TIM4. TIM2 and TIM5 count to 32 bits and keep the full
+ * timer clock as resolution down to 1 Hz.
+ *
+ * Instead of step 4, a waveform may be streamed to the compare registers
+ * (hal_pwm_stream_start()). At every update event the timer requests one DMA
+ * burst that loads CCR1-CCR4 from the next @ref hal_pwm_frame_t in a caller
+ * buffer, so the duty cycles follow an arbitrary table period by period
+ * without the CPU. The caller refills the buffer from the half/complete
+ * callbacks.
+ *
+ * The counter runs edge-aligned by default. hal_pwm_set_alignment() switches it to
+ * center-aligned counting, keeping the frequency, and hal_pwm_set_trigger_output()
+ * routes a point in the period to TRGO, e.g. to start an ADC conversion in hardware.
+ *
+ * For half bridges, CH1-CH3 can drive a complementary output each (CH1N-CH3N)
+ * with hardware dead-time between the two edges (hal_pwm_complementary_init(),
+ * hal_pwm_set_dead_time()). The break input (hal_pwm_break_init()) clears the
+ * main output enable in hardware on a fault, independent of the CPU.
+ *
+ * A timer measuring an input (capture.h) or decoding an encoder (encoder.h) is borrowed
+ * from this driver until it is given back. Meanwhile every setter that touches it returns
+ * HAL_STATUS_BUSY without writing a register, as the same bits mean other things in input
+ * mode and a forced update would reset the counter being read. hal_pwm_set_frequency()
+ * just does nothing. The break input and main output enable stay available.
+ *
  * Copyright (c) 2025 - 2026 Cory McKiel.
  * Licensed under the MIT License. See LICENSE file in the project root.
  */
@@ -20,6 +53,7 @@
 #define _PWM_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "hal_types.h"
 
 /**
@@ -34,13 +68,174 @@ typedef enum {
   _HAL_PWM_CH_MAX
 } hal_pwm_channel_t;
 
+/**
+ * @brief Timer select type. Each timer has four channels and its own base frequency.
+ *
+ * Waveform streaming, ramps, the trigger output, complementary outputs and the break input are TIM1 only.
+ */
+typedef enum {
+  _HAL_PWM_TIMER_MIN,
+  HAL_PWM_TIM1 = _HAL_PWM_TIMER_MIN, /*!< PA8-PA11. Advanced timer. Used by the functions without a timer. */
+  HAL_PWM_TIM2,                      /*!< PA5, PB3, PB10, PB2. 32-bit. CH3 shares PB10 with I2C2. */
+  HAL_PWM_TIM3,                      /*!< PB4, PB5, PB0, PB1. */
+  HAL_PWM_TIM4,                      /*!< PB6-PB9. CH3 and CH4 share PB8 and PB9 with I2C1. */
+  HAL_PWM_TIM5,                      /*!< PA0-PA3. 32-bit. CH3 and CH4 share PA2 and PA3 with USART2. */
+  HAL_PWM_TIM8,                      /*!< PC6-PC9. Advanced timer. CH4 shares PC9 with I2C3. */
+  _HAL_PWM_TIMER_MAX
+} hal_pwm_timer_t;
+
+/**
+ * @brief Full-scale value of @ref hal_pwm_set_duty_q16(). Holds the output high.
+ */
+#define HAL_PWM_DUTY_Q16_FULL (0xFFFFU)
+
+/**
+ * @brief Roughly how often a ramp steps, see @ref hal_pwm_ramp_to(). Slow PWM steps once per update event.
+ */
+#define HAL_PWM_RAMP_STEP_HZ (1000U)
+
+/**
+ * @brief What a timer actually produces for the frequency it was given.
+ *
+ * The frequency is planned from the timer clock the RCC configuration provides, so the
+ * timer clock may differ between timers and from one clock setup to the next.
+ */
+typedef struct {
+    uint32_t timer_clock_hz;   /*!< Clock the timer counts, before its prescaler. */
+    uint32_t requested_hz;     /*!< Frequency last asked for. */
+    uint32_t achieved_hz;      /*!< Frequency produced, rounded to the nearest Hz. */
+    int32_t  error_ppm;        /*!< (achieved - requested) / requested in parts per million. */
+    uint32_t period_counts;    /*!< Duty cycle steps per period, see hal_pwm_get_period_counts(). */
+    uint8_t  resolution_bits;  /*!< Whole bits of duty cycle, see hal_pwm_get_resolution_bits(). */
+} hal_pwm_timing_t;
+
+/**
+ * @brief Compare values for all four channels for one PWM period.
+ *
+ * Raw timer counts, CCR1 first. 0 holds the output low for the period and anything
+ * above ARR holds it high. This is the layout of one DMA burst, so a waveform is
+ * simply an array of frames.
+ */
+typedef struct {
+    uint16_t ccr[4]; /*!< Compare value of CH1 through CH4. */
+} hal_pwm_frame_t;
+
+/**
+ * @brief How the stream walks the caller's frames.
+ */
+typedef enum {
+  _HAL_PWM_STREAM_MODE_MIN,
+  HAL_PWM_STREAM_CIRCULAR = _HAL_PWM_STREAM_MODE_MIN, /*!< One buffer played in a loop. Refill a half while the other plays. */
+  HAL_PWM_STREAM_DOUBLE_BUFFER,                       /*!< Two buffers played alternately. Refill or swap the idle one. */
+  _HAL_PWM_STREAM_MODE_MAX
+} hal_pwm_stream_mode_t;
+
+/**
+ * @brief Why the stream callback was called.
+ */
+typedef enum {
+  _HAL_PWM_STREAM_EVENT_MIN,
+  HAL_PWM_STREAM_EVENT_HALF = _HAL_PWM_STREAM_EVENT_MIN, /*!< The first half of the circular buffer has been loaded. */
+  HAL_PWM_STREAM_EVENT_COMPLETE,                         /*!< The second half, or a whole double buffer, has been loaded. */
+  HAL_PWM_STREAM_EVENT_ERROR,                            /*!< The DMA hit a bus error and the stream has stopped. */
+  _HAL_PWM_STREAM_EVENT_MAX
+} hal_pwm_stream_event_t;
+
+/**
+ * @brief Called from the DMA interrupt as the stream moves through the frames.
+ *
+ * @param event What happened.
+ * @param done The frames that have just been loaded into the timer and may now be rewritten.
+ *             NULL for @ref HAL_PWM_STREAM_EVENT_ERROR.
+ * @param count Number of frames at done.
+ * @param context The context given to hal_pwm_stream_start().
+ */
+typedef void (*hal_pwm_stream_callback_t)(hal_pwm_stream_event_t event, hal_pwm_frame_t *done, size_t count,
+                                          void *context);
+
+/**
+ * @brief Description of a waveform stream.
+ */
+typedef struct {
+    hal_pwm_stream_mode_t mode;          /*!< Circular or double-buffered. */
+    hal_pwm_frame_t *buffer;             /*!< The circular buffer, or the first of the double buffers. */
+    hal_pwm_frame_t *second_buffer;      /*!< The second double buffer. Unused in circular mode. */
+    size_t frames;                       /*!< Frames per buffer. Even in circular mode. */
+    hal_pwm_stream_callback_t on_event;  /*!< Optional. NULL for none. */
+    void *context;                       /*!< Optional. Passed to on_event. */
+} hal_pwm_stream_config_t;
+
+/**
+ * @brief Maximum frames per buffer. One DMA transfer moves one compare value.
+ */
+#define HAL_PWM_STREAM_MAX_FRAMES (0xFFFFU / 4U)
+
+/**
+ * @brief Counter alignment. Follows the CR1.CMS encoding.
+ *
+ * In the center-aligned modes the counter runs up to ARR and back down, so the pulses of all
+ * channels are centered on the same instant and the update event falls at both ends of the
+ * slope. The three variants only differ in when the compare interrupt flags are set.
+ */
+typedef enum {
+  _HAL_PWM_ALIGN_MIN,
+  HAL_PWM_ALIGN_EDGE = _HAL_PWM_ALIGN_MIN, /*!< Counting up only. The default. */
+  HAL_PWM_ALIGN_CENTER_DOWN,               /*!< Center-aligned, compare flags set counting down. */
+  HAL_PWM_ALIGN_CENTER_UP,                 /*!< Center-aligned, compare flags set counting up. */
+  HAL_PWM_ALIGN_CENTER_BOTH,               /*!< Center-aligned, compare flags set both ways. */
+  _HAL_PWM_ALIGN_MAX
+} hal_pwm_alignment_t;
+
+/**
+ * @brief What drives TIM1's trigger output (TRGO).
+ */
+typedef enum {
+  _HAL_PWM_TRIGGER_MIN,
+  HAL_PWM_TRIGGER_NONE = _HAL_PWM_TRIGGER_MIN, /*!< Only software update events (reset state). */
+  HAL_PWM_TRIGGER_UPDATE,                      /*!< Every update event. */
+  HAL_PWM_TRIGGER_OC4REF,                      /*!< OC4REF, rising at a chosen point of the period. Takes CH4. */
+  _HAL_PWM_TRIGGER_MAX
+} hal_pwm_trigger_t;
+
+/**
+ * @brief Active level of the break input (BKIN, PA6).
+ */
+typedef enum {
+  _HAL_PWM_BREAK_POLARITY_MIN,
+  HAL_PWM_BREAK_ACTIVE_LOW = _HAL_PWM_BREAK_POLARITY_MIN, /*!< A low level on BKIN is a fault. */
+  HAL_PWM_BREAK_ACTIVE_HIGH,                             /*!< A high level on BKIN is a fault. */
+  _HAL_PWM_BREAK_POLARITY_MAX
+} hal_pwm_break_polarity_t;
+
+/**
+ * @brief Called from the break interrupt after the hardware has cut the outputs.
+ *
+ * @param context The context given in @ref hal_pwm_break_config_t.
+ */
+typedef void (*hal_pwm_break_callback_t)(void *context);
+
+/**
+ * @brief Break input configuration.
+ */
+typedef struct {
+    hal_pwm_break_polarity_t polarity;  /*!< Level of BKIN that trips the break. */
+    bool auto_restart;                  /*!< AOE: Outputs come back at the first update event after BKIN releases. */
+    hal_pwm_break_callback_t on_break;  /*!< Optional. NULL for none. */
+    void *context;                      /*!< Optional. Passed to on_break. */
+} hal_pwm_break_config_t;
+
 /**
  * @brief Initializes the hardware timer (TIM1) for PWM output at the given base frequency.
  *        Must be called once before initializing any channel. All channels share this frequency.
  *
+ * The prescaler and period are planned from the timer clock of the current RCC configuration,
+ * APB prescaler doubling included. Of all settings with the most whole bits of resolution, the
+ * one closest to the requested frequency is used. See hal_pwm_get_timing() for the outcome.
+ * Call hal_pwm_set_frequency() again after changing the clock tree.
+ *
  * @param pwm_frequency_hz The base frequency in Hz (e.g. 20000 for 20 kHz).
  *
- * @return HAL_STATUS_OK on success.
+ * @return HAL_STATUS_OK on success, HAL_STATUS_BUSY while TIM1 is borrowed.
  */
 hal_status_t hal_pwm_timer_init(uint32_t pwm_frequency_hz);
 
@@ -50,7 +245,7 @@ hal_status_t hal_pwm_timer_init(uint32_t pwm_frequency_hz);
  *
  * @param channel The channel to bring up.
  *
- * @return HAL_STATUS_OK on success.
+ * @return HAL_STATUS_OK on success, HAL_STATUS_BUSY while TIM1 is borrowed.
  */
 hal_status_t hal_pwm_channel_init(hal_pwm_channel_t channel);
 
@@ -60,7 +255,8 @@ hal_status_t hal_pwm_channel_init(hal_pwm_channel_t channel);
  * @param channel The channel to enable or disable.
  * @param enable  true to enable, false to disable.
  *
- * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if channel is out of range.
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if channel is out of range,
+ *         HAL_STATUS_BUSY for CH4 while it drives the trigger output or while TIM1 is borrowed.
  */
 hal_status_t hal_pwm_enable(hal_pwm_channel_t channel, bool enable);
 
@@ -70,10 +266,127 @@ hal_status_t hal_pwm_enable(hal_pwm_channel_t channel, bool enable);
  * @param channel The target channel.
  * @param percent 0 through 100.
  *
- * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if channel is out of range.
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if channel is out of range,
+ *         HAL_STATUS_BUSY while a stream owns the compare registers, CH4 drives the trigger output
+ *         or TIM1 is borrowed.
  */
 hal_status_t hal_pwm_set_duty_cycle(hal_pwm_channel_t channel, uint8_t percent);
 
+/**
+ * @brief Sets the duty cycle of one channel as a Q16 fraction of the period.
+ *
+ * duty / 65536 of the period, rounded to the nearest timer count, so the full resolution
+ * of the timer is available (see hal_pwm_get_resolution_bits()). 0 holds the output low
+ * and @ref HAL_PWM_DUTY_Q16_FULL holds it high. Same enable rules as hal_pwm_set_duty_cycle().
+ *
+ * @param channel The target channel.
+ * @param duty    0 through @ref HAL_PWM_DUTY_Q16_FULL.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if channel is out of range,
+ *         HAL_STATUS_BUSY while a stream owns the compare registers, CH4 drives the trigger output
+ *         or TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_set_duty_q16(hal_pwm_channel_t channel, uint16_t duty);
+
+/**
+ * @brief Sets the duty cycle of all four channels at once, as Q16 fractions of the period.
+ *
+ * Unlike a series of single-channel calls, no update event is forced and the counter is
+ * not reset. The four compare registers are written behind their preload and take effect
+ * together at the next natural update event, so no period ever mixes old and new values.
+ * A channel coming out of a forced 0% or 100% level switches to PWM mode right away, as
+ * the output mode itself is not preloaded.
+ *
+ * Same per-channel rules as hal_pwm_set_duty_q16(): 0 is always accepted, other values
+ * are dropped for disabled channels.
+ *
+ * @param duties CH1 through CH4, 0 through @ref HAL_PWM_DUTY_Q16_FULL.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if duties is NULL,
+ *         HAL_STATUS_BUSY while a stream owns the compare registers or TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_set_duty_all(const uint16_t duties[4]);
+
+/**
+ * @brief Sets the duty cycle of one channel in timer counts, written to CCR as is.
+ *
+ * The output is high for counts out of every hal_pwm_get_period_counts(). 0 holds the
+ * output low and anything at or above the period holds it high. Same enable rules as
+ * hal_pwm_set_duty_cycle(). hal_pwm_set_frequency() preserves the ratio, not the count.
+ *
+ * @param channel The target channel.
+ * @param counts  High time in timer counts.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if channel is out of range,
+ *         HAL_STATUS_BUSY while a stream owns the compare registers, CH4 drives the trigger output
+ *         or TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_set_duty_counts(hal_pwm_channel_t channel, uint32_t counts);
+
+/**
+ * @brief Moves a channel's duty cycle to target over duration_ms, in the TIM1 update interrupt.
+ *
+ * Starts from where the channel is, or from where a ramp already running on it has got to.
+ * Every N update events, N chosen for about @ref HAL_PWM_RAMP_STEP_HZ steps a second,
+ * the interrupt adds a fixed-point increment and writes the compare register behind its
+ * preload, so each step lands on a period boundary. The last step lands on target exactly.
+ * Durations are counted in periods of the frequency at the start of the ramp.
+ *
+ * The ramp is stretched to stay within the channel's slew limit, see
+ * hal_pwm_set_slew_limit(). With no limit, a duration of 0 sets the duty cycle at once.
+ * Setting the duty cycle directly, disabling the channel or starting a stream ends the ramp.
+ *
+ * @param channel The target channel. Must be enabled, as non-zero duty cycles are otherwise dropped.
+ * @param target  Duty cycle to end on, 0 through @ref HAL_PWM_DUTY_Q16_FULL.
+ * @param duration_ms Time to get there.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if channel is out of range,
+ *         HAL_STATUS_BUSY while a stream owns the compare registers, CH4 drives the trigger output
+ *         or TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_ramp_to(hal_pwm_channel_t channel, uint16_t target, uint32_t duration_ms);
+
+/**
+ * @brief Limits how fast ramps may move a channel. Kept until changed.
+ *
+ * @param channel The target channel.
+ * @param q16_per_second Largest change per second, in Q16 duty cycle. 0 for no limit.
+ *                       E.g. HAL_PWM_DUTY_Q16_FULL / 2 takes two seconds from off to full.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if channel is out of range.
+ */
+hal_status_t hal_pwm_set_slew_limit(hal_pwm_channel_t channel, uint32_t q16_per_second);
+
+/**
+ * @brief Returns true while a ramp is moving the channel.
+ */
+bool hal_pwm_ramp_is_active(hal_pwm_channel_t channel);
+
+/**
+ * @brief Returns the number of duty cycle steps in one PWM period, in timer counts.
+ *
+ * ARR + 1 edge-aligned. Center-aligned the counter runs up to ARR and back down, and a
+ * channel is active for CCR counts on each slope, so the period is ARR steps.
+ */
+uint32_t hal_pwm_get_period_counts(void);
+
+/**
+ * @brief Returns the duty cycle resolution at the current frequency in whole bits.
+ *
+ * floor(log2(hal_pwm_get_period_counts())). E.g. 9 at 20 kHz edge-aligned (800 counts),
+ * 15 at 200 Hz (40000 counts). Center alignment at the same frequency costs one bit.
+ */
+uint8_t hal_pwm_get_resolution_bits(void);
+
+/**
+ * @brief Reports the frequency, error and resolution TIM1 achieves.
+ *
+ * @param timing Filled in.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timing is NULL.
+ */
+hal_status_t hal_pwm_get_timing(hal_pwm_timing_t *timing);
+
 /**
  * @brief Changes the base PWM frequency shared by all channels. The duty-cycle ratio of every
  *        enabled channel is preserved by rescaling its compare register.
@@ -82,4 +395,233 @@ hal_status_t hal_pwm_set_duty_cycle(hal_pwm_channel_t channel, uint8_t percent);
  */
 void hal_pwm_set_frequency(uint32_t pwm_frequency_hz);
 
+/**
+ * @brief Initializes a timer for PWM output at the given base frequency.
+ *        hal_pwm_timer_init() for any timer. Must be called before its channels are initialized.
+ *
+ * @param timer            The timer to bring up.
+ * @param pwm_frequency_hz The base frequency of the timer's four channels in Hz.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer is out of range,
+ *         HAL_STATUS_BUSY while the timer is borrowed.
+ */
+hal_status_t hal_pwm_tim_init(hal_pwm_timer_t timer, uint32_t pwm_frequency_hz);
+
+/**
+ * @brief hal_pwm_channel_init() for any timer. The pin is listed with @ref hal_pwm_timer_t.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer or channel is out of range,
+ *         HAL_STATUS_BUSY while the timer is borrowed.
+ */
+hal_status_t hal_pwm_tim_channel_init(hal_pwm_timer_t timer, hal_pwm_channel_t channel);
+
+/**
+ * @brief hal_pwm_enable() for any timer.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer or channel is out of range,
+ *         HAL_STATUS_BUSY for TIM1 CH4 while it drives the trigger output or while the timer
+ *         is borrowed.
+ */
+hal_status_t hal_pwm_tim_enable(hal_pwm_timer_t timer, hal_pwm_channel_t channel, bool enable);
+
+/**
+ * @brief hal_pwm_set_duty_cycle() for any timer.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer or channel is out of range,
+ *         HAL_STATUS_BUSY if TIM1's stream or trigger output owns the channel or the timer
+ *         is borrowed.
+ */
+hal_status_t hal_pwm_tim_set_duty_cycle(hal_pwm_timer_t timer, hal_pwm_channel_t channel, uint8_t percent);
+
+/**
+ * @brief hal_pwm_set_duty_q16() for any timer.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer or channel is out of range,
+ *         HAL_STATUS_BUSY if TIM1's stream or trigger output owns the channel or the timer
+ *         is borrowed.
+ */
+hal_status_t hal_pwm_tim_set_duty_q16(hal_pwm_timer_t timer, hal_pwm_channel_t channel, uint16_t duty);
+
+/**
+ * @brief hal_pwm_set_duty_counts() for any timer. Counts use all 32 bits on TIM2 and TIM5.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer or channel is out of range,
+ *         HAL_STATUS_BUSY if TIM1's stream or trigger output owns the channel or the timer
+ *         is borrowed.
+ */
+hal_status_t hal_pwm_tim_set_duty_counts(hal_pwm_timer_t timer, hal_pwm_channel_t channel, uint32_t counts);
+
+/**
+ * @brief hal_pwm_set_duty_all() for any timer.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer is out of range or duties is NULL,
+ *         HAL_STATUS_BUSY while TIM1's stream owns the compare registers or the timer is borrowed.
+ */
+hal_status_t hal_pwm_tim_set_duty_all(hal_pwm_timer_t timer, const uint16_t duties[4]);
+
+/**
+ * @brief hal_pwm_get_period_counts() for any timer. 0 if timer is out of range.
+ */
+uint32_t hal_pwm_tim_get_period_counts(hal_pwm_timer_t timer);
+
+/**
+ * @brief hal_pwm_get_resolution_bits() for any timer. 0 if timer is out of range.
+ */
+uint8_t hal_pwm_tim_get_resolution_bits(hal_pwm_timer_t timer);
+
+/**
+ * @brief hal_pwm_get_timing() for any timer.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer is out of range or timing is NULL.
+ */
+hal_status_t hal_pwm_tim_get_timing(hal_pwm_timer_t timer, hal_pwm_timing_t *timing);
+
+/**
+ * @brief hal_pwm_set_frequency() for any timer. The other timers keep their frequencies.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if timer is out of range,
+ *         HAL_STATUS_BUSY while the timer is borrowed.
+ */
+hal_status_t hal_pwm_tim_set_frequency(hal_pwm_timer_t timer, uint32_t pwm_frequency_hz);
+
+/**
+ * @brief Switches between edge-aligned and center-aligned counting.
+ *
+ * The base frequency is kept: ARR is halved for center alignment, which costs one bit of
+ * resolution. The duty-cycle ratio of every enabled channel is preserved, as in
+ * hal_pwm_set_frequency(). The counter is stopped and restarted to change modes.
+ *
+ * @param alignment The new counting mode.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if alignment is out of range,
+ *         HAL_STATUS_BUSY while a stream is running or TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_set_alignment(hal_pwm_alignment_t alignment);
+
+/**
+ * @brief Selects the source of TRGO.
+ *
+ * With @ref HAL_PWM_TRIGGER_OC4REF, CH4 runs in PWM Mode 2 as an internal trigger channel:
+ * OC4REF rises point_q16 / 65536 of the way through the period (on the up slope when
+ * center-aligned, so 0xFFFF lands at the peak) and the point follows frequency and alignment
+ * changes. CH4 then refuses duty and enable calls, and hal_pwm_stream_start() refuses to run,
+ * with HAL_STATUS_BUSY until another source is selected. On the STM32F4 the ADC injected group
+ * can start on TIM1_TRGO (JEXTSEL = 0001).
+ *
+ * @param trigger   The TRGO source.
+ * @param point_q16 Position of the trigger in the period. Only used for OC4REF.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if trigger is out of range,
+ *         HAL_STATUS_BUSY for OC4REF while a stream is running, as its bursts rewrite CCR4,
+ *         and for any trigger while TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_set_trigger_output(hal_pwm_trigger_t trigger, uint16_t point_q16);
+
+/**
+ * @brief Adds the complementary output to CH1, CH2 or CH3.
+ *
+ * CH1N-CH3N come out on PB13-PB15. Each is the inverse of its channel with the dead-time of
+ * hal_pwm_set_dead_time() inserted before every rising edge of either output. The duty cycle
+ * still describes the main (high side) output, so at 0% the complementary output is held on.
+ * hal_pwm_channel_init() must be called for the channel first.
+ *
+ * @param channel CH1, CH2 or CH3. CH4 has no complementary output.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR for any other channel,
+ *         HAL_STATUS_BUSY while TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_complementary_init(hal_pwm_channel_t channel);
+
+/**
+ * @brief Sets the dead-time inserted between complementary edges, shared by all channels.
+ *
+ * The value is rounded up to what the dead-time generator can produce from the timer clock,
+ * never down, and written back through actual_ns. At 16 MHz steps are 62.5 ns up to 7.9 us,
+ * coarser above, up to 252 us. The timer clock division (CR1.CKD) is raised only when needed.
+ *
+ * @param dead_time_ns Requested dead-time in nanoseconds.
+ * @param actual_ns    Optional. The dead-time that was programmed.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if the dead-time is out of reach,
+ *         HAL_STATUS_BUSY while TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_set_dead_time(uint32_t dead_time_ns, uint32_t *actual_ns);
+
+/**
+ * @brief Arms the break input on PA6.
+ *
+ * When BKIN goes active the hardware clears the main output enable asynchronously and every
+ * output goes to its inactive (low) state, complementary ones included. The outputs stay off
+ * until hal_pwm_main_output_enable() or, with auto_restart, the next update event after BKIN
+ * releases. The STM32F4 break input has no digital filter, so filter externally if needed.
+ *
+ * @param config The break configuration. Copied.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR on a bad config.
+ */
+hal_status_t hal_pwm_break_init(const hal_pwm_break_config_t *config);
+
+/**
+ * @brief Sets or clears the main output enable (MOE) of all channels.
+ *
+ * Used to restart after a break. Also re-arms the break interrupt.
+ *
+ * @param enable true to drive the outputs, false to force them all inactive.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_BUSY if the break input is still active.
+ */
+hal_status_t hal_pwm_main_output_enable(bool enable);
+
+/**
+ * @brief Returns true while the main output enable is set, false after a break.
+ */
+bool hal_pwm_main_output_is_enabled(void);
+
+/**
+ * @brief Starts streaming frames into the compare registers, one frame per PWM period.
+ *
+ * TIM1's update event requests a DMA burst (DCR/DMAR) on DMA2 Stream 5 that writes CCR1-CCR4.
+ * Because the compare registers are preloaded, each frame takes effect at the update event
+ * after the one that loaded it. Every enabled channel is put in PWM mode so it follows its
+ * column of the frames. Disabled channels stay low.
+ *
+ * In circular mode @ref HAL_PWM_STREAM_EVENT_HALF hands back the first half of the buffer
+ * and @ref HAL_PWM_STREAM_EVENT_COMPLETE the second. In double-buffered mode only
+ * @ref HAL_PWM_STREAM_EVENT_COMPLETE is raised, once per buffer, handing back the buffer
+ * that just finished while the other one plays.
+ *
+ * @attention The buffers are read by the DMA while the stream runs and must stay alive until
+ *            hal_pwm_stream_stop(). hal_pwm_timer_init() must be called first.
+ *
+ * @param config The stream. Copied.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR on a bad config,
+ *         HAL_STATUS_BUSY if a stream is already running, CH4 drives the trigger output or
+ *         TIM1 is borrowed.
+ */
+hal_status_t hal_pwm_stream_start(const hal_pwm_stream_config_t *config);
+
+/**
+ * @brief Replaces the idle buffer of a double-buffered stream.
+ *
+ * The DMA switches to next at the end of the buffer currently playing. Lets a stream
+ * play any number of buffers back to back.
+ *
+ * @param next The buffer to play next. Same frame count as the stream.
+ *
+ * @return HAL_STATUS_OK on success, HAL_STATUS_ERROR if next is NULL or no
+ *         double-buffered stream is running.
+ */
+hal_status_t hal_pwm_stream_queue(hal_pwm_frame_t *next);
+
+/**
+ * @brief Stops the stream. The channels hold the last frame that was loaded.
+ */
+void hal_pwm_stream_stop(void);
+
+/**
+ * @brief Returns true while a stream is running.
+ */
+bool hal_pwm_stream_active(void);
+
 #endif /* _PWM_H */
@@ -38,6 +38,18 @@ hal_status_t hal_systick_init(void);
  */
 uint32_t hal_get_tick(void);
 
+/**
+ * @brief Return microseconds elapsed since hal_systick_init was called.
+ *
+ * Combines the millisecond tick with the SysTick down-counter. Wraps after about 71 minutes,
+ * so only differences of nearby timestamps are meaningful.
+ *
+ * @note Safe to call from interrupt handlers. While SysTick itself is held off (by a higher
+ * priority handler or with interrupts disabled) a reload that has not been serviced yet is
+ * missed, and the result can be up to 1 ms behind.
+ */
+uint32_t hal_get_time_us(void);
+
 /**
  * @brief Block for the given number of milliseconds.
  *
@@ -1,7 +1,20 @@
 /**
  * @file i2c_transaction_queue.h
  *
- * @brief FIFO data structure used to store handles to client I2C transaction requests.
+ * @brief Priority ordered FIFO data structure used to store handles to client I2C transaction requests.
+ *
+ * Each bus owns one queue. The queue is passed to every operation, so queues are fully independent.
+ *
+ * Each @ref hal_i2c_priority_t has its own FIFO. Dequeueing always takes the oldest transaction
+ * from the highest priority FIFO that is not empty. Enqueue and dequeue are both O(1).
+ *
+ * The FIFOs are intrusive singly linked lists threaded through @ref hal_i2c_txn_t::next.
+ * The queue allocates nothing and its capacity is bounded only by the transactions the clients own.
+ *
+ * Any number of producers may add concurrently, from thread or interrupt context, without
+ * disabling interrupts. Adding pushes onto a lock-free inbox with a single compare-and-swap.
+ * The one consumer empties the whole inbox with a single atomic exchange and sorts it into the
+ * FIFOs, which only the consumer ever touches. Neither side can be blocked by the other.
  *
  * @note Clients are responsible for owning the memory for their transactions. This
  * queue only holds handles to the transactions so they may be processed in order.
@@ -12,10 +25,10 @@
  * Copyright (c) 2025 - 2026 Cory McKiel.
  * Licensed under the MIT License. See LICENSE file in the project root.
  */
-#include "hal/i2c.h"
+#ifndef _I2C_TRANSACTION_QUEUE_H
+#define _I2C_TRANSACTION_QUEUE_H
 
-/// @brief Adjust to increase/decrease the queue size.
-#define I2C_TRANSACTION_QUEUE_SIZE 10
+#include "hal/i2c.h"
 
 /**
  * @brief Possible return types for queue operations.
@@ -24,41 +37,82 @@ typedef enum {
     _I2C_QUEUE_STATUS_ENUM_MIN = 0,                        /*!< Lower bound of enum. Inclusive. */
     I2C_QUEUE_STATUS_SUCCESS = _I2C_QUEUE_STATUS_ENUM_MIN, /*!< The queue operation was successful. */
     I2C_QUEUE_STATUS_FAIL,                                 /*!< The queue operation encountered an error and was not successful. */
-    I2C_QUEUE_STATUS_QUEUE_FULL,                           /*!< The queue operation could not be performed because the queue is full. */
     I2C_QUEUE_STATUS_QUEUE_EMPTY,                          /*!< The queue operation could not be performed because the queue is empty. */
     _I2C_QUEUE_STATUS_ENUM_MAX,                            /*!< Upper bound of enum. Exclusive. */
 } i2c_queue_status_t;
 
 /**
- * @brief Add a transaction to the queue.
+ * @brief A FIFO that holds references to the transactions of a single priority.
+ *
+ * Implemented as an intrusive singly linked list. Transactions are appended at the
+ * tail and removed from the head.
+ */
+typedef struct {
+    hal_i2c_txn_t *head; /*!< The next transaction to be dequeued. NULL when empty. */
+    hal_i2c_txn_t *tail; /*!< The most recently queued transaction. Only valid when head is not NULL. */
+} i2c_transaction_fifo_t;
+
+/**
+ * @brief The queue that holds references to the transactions to be processed. One FIFO per priority.
+ *
+ * @note Must be reset with @ref i2c_transaction_queue_reset() before first use, unless zero initialized.
+ */
+typedef struct {
+    hal_i2c_txn_t *inbox;                                /*!< Added but not yet sorted, newest first. Shared with producers. Only accessed atomically. */
+    i2c_transaction_fifo_t fifos[_HAL_I2C_PRIORITY_MAX]; /*!< Indexed by hal_i2c_priority_t. Consumer only. */
+} i2c_transaction_queue_t;
+
+/**
+ * @brief Add a transaction to the queue of its priority.
  *
+ * @param queue The queue to add to.
  * @param txn A reference to the transaction to queue.
  *
  * @warning Clients are responsible for maintaining the memory for
  * their transactions. This merely queues a handle.
  *
+ * @warning A transaction that is already in the queue must not be added again. Doing so
+ * corrupts the links of the queue.
+ *
+ * @note Lock-free. Safe to call from any context, concurrently with other adds and with
+ * @ref i2c_transaction_queue_get_next().
+ *
+ * @note A transaction with an out of range priority is filed with @ref HAL_I2C_PRIORITY_LOW.
+ * Rejecting it is left to the driver's transaction validation.
+ *
  * @return The status of the request. SUCCESS is the only return value indicating
  * the request was queued.
  */
-i2c_queue_status_t i2c_transaction_queue_add(hal_i2c_txn_t *txn);
+i2c_queue_status_t i2c_transaction_queue_add(i2c_transaction_queue_t *queue, hal_i2c_txn_t *txn);
 
 /**
  * @brief Get the next transaction from the queue. Removes the transaction from the queue.
  *
+ * The next transaction is the oldest one of the highest priority that has any waiting.
+ *
+ * @param queue The queue to take from.
  * @param txn A reference to a handle type for a transaction.
  *
  * @note txn is a double pointer because the client is meant to pass in a null handle that
  * they want set to point to the next transaction to process. But to actually set a param,
  * there needs to be a reference to it, hence, the double pointer.
  *
+ * @warning Single consumer. Only one context may take from a given queue.
+ *
  * @return The status of the request. SUCCESS is the only return value indicating
  * the next transaction was properly dequeued.
  */
-i2c_queue_status_t i2c_transaction_queue_get_next(hal_i2c_txn_t **txn);
+i2c_queue_status_t i2c_transaction_queue_get_next(i2c_transaction_queue_t *queue, hal_i2c_txn_t **txn);
 
 /**
  * @brief Resets the queue.
  *
  * It resets all internal variables that manage the queue so it will be "like new".
+ *
+ * @warning Not safe against concurrent adds.
+ *
+ * @param queue The queue to reset. No-op if NULL.
  */
-void i2c_transaction_queue_reset();
+void i2c_transaction_queue_reset(i2c_transaction_queue_t *queue);
+
+#endif /* _I2C_TRANSACTION_QUEUE_H */
@@ -0,0 +1,31 @@
+/**
+ * @file stm32f4_i2c_request.h
+ *
+ * @brief Glue between the I2C controller driver and the modules that submit on a client's behalf.
+ *
+ * The sampler and the other engines built on the driver keep a copy of a client's transaction
+ * and submit it later from interrupt context. They check it here when it is handed over, so a
+ * bad request is refused to the client instead of failing on the bus every time it runs.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _STM32F4_I2C_REQUEST_H
+#define _STM32F4_I2C_REQUEST_H
+
+#include "hal/i2c.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Check a transaction the way the servicer will before it runs. Provided by the controller driver.
+ *
+ * On top of the servicer's checks, READ, WRITE and WRITE_READ must move at least one byte each
+ * way they go, within tx_data and rx_data.
+ * processing_state is not looked at.
+ *
+ * @return true if the servicer would run txn, false if txn is NULL or would be rejected.
+ */
+bool i2c_request_is_valid(const hal_i2c_txn_t *txn);
+
+#endif /* _STM32F4_I2C_REQUEST_H */
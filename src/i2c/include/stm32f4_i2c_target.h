@@ -0,0 +1,51 @@
+/**
+ * @file stm32f4_i2c_target.h
+ *
+ * @brief Glue between the I2C controller driver and target mode.
+ *
+ * A bus is either in controller mode or in target mode. The controller driver owns the
+ * interrupt vectors and the bus hardware, and hands both over to target mode while it is enabled.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _STM32F4_I2C_TARGET_H
+#define _STM32F4_I2C_TARGET_H
+
+// Expects the device header (or registers.h on desktop) to be included first.
+#include "hal/i2c.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Get the registers of a bus. Provided by the controller driver.
+ *
+ * @return The peripheral registers, or NULL if bus is out of range.
+ */
+I2C_TypeDef *i2c_bus_registers(hal_i2c_bus_t bus);
+
+/**
+ * @brief Handle an event interrupt if the bus is in target mode.
+ *
+ * @return true if the interrupt was handled, false if the bus is in controller mode.
+ */
+bool i2c_target_event_irq(hal_i2c_bus_t bus);
+
+/**
+ * @brief Handle an error interrupt if the bus is in target mode.
+ *
+ * @return true if the interrupt was handled, false if the bus is in controller mode.
+ */
+bool i2c_target_error_irq(hal_i2c_bus_t bus);
+
+/**
+ * @brief Check if a bus is in target mode.
+ */
+bool i2c_target_is_enabled(hal_i2c_bus_t bus);
+
+/**
+ * @brief Return a bus to controller mode. Forgets the register map and clears the own addresses.
+ */
+void i2c_target_disable(hal_i2c_bus_t bus);
+
+#endif /* _STM32F4_I2C_TARGET_H */
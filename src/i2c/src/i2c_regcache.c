@@ -0,0 +1,305 @@
+/**
+ * @file i2c_regcache.c
+ * @brief Write-combining register cache for I2C devices.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+
+#include "hal/i2c_regcache.h"
+#include "hal/i2c.h"
+#include "stm32f4_hal.h"
+
+#include <string.h>
+
+#define REGISTER_ADDRESS_MAX 0xFF
+#define TARGET_ADDRESS_MAX   0x7F
+
+static bool register_index(const hal_i2c_regcache_t *cache, uint8_t reg, size_t *index);
+static uint64_t run_of(uint64_t bits, size_t first, size_t register_count);
+static hal_status_t submit(hal_i2c_regcache_t *cache, hal_i2c_op_t op, size_t first, uint64_t run);
+static void txn_completed(hal_i2c_txn_t *txn);
+
+hal_status_t hal_i2c_regcache_init(hal_i2c_regcache_t *cache, hal_i2c_bus_t bus, uint8_t target_addr,
+                                   uint8_t base_register, size_t register_count, hal_i2c_priority_t priority)
+{
+    if (!cache ||
+        !ENUM_IN_RANGE(bus, _HAL_I2C_BUS_MIN, _HAL_I2C_BUS_MAX) ||
+        target_addr > TARGET_ADDRESS_MAX ||
+        !ENUM_IN_RANGE(priority, _HAL_I2C_PRIORITY_MIN, _HAL_I2C_PRIORITY_MAX) ||
+        register_count == 0 ||
+        register_count > HAL_I2C_REGCACHE_MAX_REGISTERS ||
+        (size_t)base_register + register_count - 1 > REGISTER_ADDRESS_MAX)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    memset(cache, 0, sizeof(*cache));
+    cache->bus = bus;
+    cache->target_addr = target_addr;
+    cache->base_register = base_register;
+    cache->register_count = register_count;
+    cache->priority = priority;
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_i2c_regcache_read(hal_i2c_regcache_t *cache, uint8_t reg, uint8_t *value)
+{
+    size_t index;
+
+    if (!cache || !value || !register_index(cache, reg, &index))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    if (cache->valid & (1ULL << index))
+    {
+        *value = cache->shadow[index];
+        cache->reads_skipped++;
+        return HAL_STATUS_OK;
+    }
+
+    // Wait for the fetch already on its way, or for the bus to be ours.
+    if (cache->busy)
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    // Report a failed fetch once, so callers polling for the value do not retry forever.
+    if (cache->read_failed)
+    {
+        cache->read_failed = false;
+        return HAL_STATUS_ERROR;
+    }
+
+    // Fetch every unknown register from here on in one burst. They are usually read next.
+    if (submit(cache, HAL_I2C_OP_WRITE_READ, index, run_of(~cache->valid, index, cache->register_count)) != HAL_STATUS_OK)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    return HAL_STATUS_BUSY;
+}
+
+hal_status_t hal_i2c_regcache_write(hal_i2c_regcache_t *cache, uint8_t reg, uint8_t value)
+{
+    size_t index;
+
+    if (!cache || !register_index(cache, reg, &index))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    uint64_t bit = 1ULL << index;
+
+    // The target already holds this value.
+    if ((cache->valid & bit) && cache->shadow[index] == value)
+    {
+        return HAL_STATUS_OK;
+    }
+
+    cache->shadow[index] = value;
+    cache->valid |= bit;
+    cache->dirty |= bit;
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_i2c_regcache_update_bits(hal_i2c_regcache_t *cache, uint8_t reg, uint8_t mask, uint8_t value)
+{
+    uint8_t current;
+    hal_status_t status = hal_i2c_regcache_read(cache, reg, &current);
+
+    if (status != HAL_STATUS_OK)
+    {
+        return status;
+    }
+
+    return hal_i2c_regcache_write(cache, reg, (uint8_t)((current & ~mask) | (value & mask)));
+}
+
+hal_status_t hal_i2c_regcache_flush(hal_i2c_regcache_t *cache)
+{
+    if (!cache)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    if (cache->busy)
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    if (cache->write_failed)
+    {
+        cache->write_failed = false;
+        return HAL_STATUS_ERROR;
+    }
+
+    if (!cache->dirty)
+    {
+        return HAL_STATUS_OK;
+    }
+
+    // Lowest dirty register starts the run.
+    size_t first = 0;
+    while (!(cache->dirty & (1ULL << first)))
+    {
+        first++;
+    }
+
+    if (submit(cache, HAL_I2C_OP_WRITE, first, run_of(cache->dirty, first, cache->register_count)) != HAL_STATUS_OK)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    return HAL_STATUS_BUSY;
+}
+
+void hal_i2c_regcache_invalidate(hal_i2c_regcache_t *cache, uint8_t reg, size_t count)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count && (size_t)reg + i <= REGISTER_ADDRESS_MAX; i++)
+    {
+        size_t index;
+        if (register_index(cache, (uint8_t)(reg + i), &index))
+        {
+            cache->valid &= ~(1ULL << index) | cache->dirty;
+        }
+    }
+}
+
+static bool register_index(const hal_i2c_regcache_t *cache, uint8_t reg, size_t *index)
+{
+    if (reg < cache->base_register || (size_t)(reg - cache->base_register) >= cache->register_count)
+    {
+        return false;
+    }
+
+    *index = reg - cache->base_register;
+    return true;
+}
+
+/// @brief The bits of the run of set bits in bits that starts at first.
+static uint64_t run_of(uint64_t bits, size_t first, size_t register_count)
+{
+    uint64_t run = 0;
+
+    for (size_t i = first; i < register_count && (bits & (1ULL << i)); i++)
+    {
+        run |= 1ULL << i;
+    }
+
+    return run;
+}
+
+static hal_status_t submit(hal_i2c_regcache_t *cache, hal_i2c_op_t op, size_t first, uint64_t run)
+{
+    hal_i2c_txn_t *txn = &cache->txn;
+    size_t length = 0;
+
+    for (size_t i = first; i < HAL_I2C_REGCACHE_MAX_REGISTERS && (run & (1ULL << i)); i++)
+    {
+        length++;
+    }
+
+    txn->target_addr = cache->target_addr;
+    txn->i2c_op = op;
+    txn->priority = cache->priority;
+    txn->segments = NULL;
+    txn->segment_count = 0;
+    txn->on_complete = txn_completed;
+    txn->context = cache;
+    txn->timeout_ms = 0;
+    txn->processing_state = HAL_I2C_TXN_STATE_CREATED;
+    txn->transaction_result = HAL_I2C_TXN_RESULT_NONE;
+    txn->error = HAL_I2C_ERROR_NONE;
+    txn->actual_bytes_received = 0;
+    txn->actual_bytes_transmitted = 0;
+
+    // Every transfer starts by pointing the target at the first register.
+    txn->tx_data[0] = (uint8_t)(cache->base_register + first);
+
+    if (op == HAL_I2C_OP_WRITE)
+    {
+        memcpy(&txn->tx_data[1], &cache->shadow[first], length);
+        txn->expected_bytes_to_tx = length + 1;
+        txn->expected_bytes_to_rx = 0;
+    }
+    else
+    {
+        txn->expected_bytes_to_tx = 1;
+        txn->expected_bytes_to_rx = length;
+    }
+
+    cache->busy = true;
+    cache->in_flight = run;
+
+    if (hal_i2c_submit_transaction(cache->bus, txn) != HAL_STATUS_OK)
+    {
+        cache->busy = false;
+        cache->in_flight = 0;
+        return HAL_STATUS_ERROR;
+    }
+
+    if (op == HAL_I2C_OP_WRITE)
+    {
+        // Writes made while this one is on the bus dirty their register again.
+        cache->dirty &= ~run;
+        cache->bus_writes++;
+    }
+    else
+    {
+        cache->bus_reads++;
+    }
+
+    return HAL_STATUS_OK;
+}
+
+/// @brief Transaction completion callback. Runs in the context of the I2C servicer.
+static void txn_completed(hal_i2c_txn_t *txn)
+{
+    hal_i2c_regcache_t *cache = (hal_i2c_regcache_t *)txn->context;
+    bool success = (txn->transaction_result == HAL_I2C_TXN_RESULT_SUCCESS);
+
+    if (txn->i2c_op == HAL_I2C_OP_WRITE)
+    {
+        if (!success)
+        {
+            cache->dirty |= cache->in_flight;
+            cache->write_failed = true;
+        }
+    }
+    else if (!success)
+    {
+        cache->read_failed = true;
+    }
+    else
+    {
+        size_t first = txn->tx_data[0] - cache->base_register;
+
+        for (size_t i = 0; i < txn->actual_bytes_received; i++)
+        {
+            // A register written while the read was on the bus already holds a newer value.
+            uint64_t bit = 1ULL << (first + i);
+            if (!(cache->valid & bit))
+            {
+                cache->shadow[first + i] = txn->rx_data[i];
+                cache->valid |= bit;
+            }
+        }
+    }
+
+    if (!success)
+    {
+        cache->failures++;
+    }
+
+    cache->in_flight = 0;
+    cache->busy = false;
+}
@@ -0,0 +1,172 @@
+/**
+ * @file i2c_sampler.c
+ * @brief Periodic I2C sampling scheduled by the shared SysTick periodic tables.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+
+#ifdef DESKTOP_BUILD
+#include "registers.h"
+#else
+#include "stm32f4xx.h"
+#endif
+
+#include "hal/i2c_sampler.h"
+#include "hal/i2c.h"
+#include "stm32f4_hal.h"
+#include "stm32f4_i2c_request.h"
+#include "systick_periodic.h"
+
+#include <string.h>
+
+static void sample_due(void *client);
+static void sample_completed(hal_i2c_txn_t *txn);
+static void submit_sample(hal_i2c_sampler_t *sampler);
+
+/* Private variables */
+static periodic_slot_t sampler_slots[HAL_I2C_SAMPLER_MAX_CLIENTS];
+static periodic_table_t samplers = PERIODIC_TABLE(sampler_slots, sample_due);
+
+hal_status_t hal_i2c_sampler_register(hal_i2c_sampler_t *sampler, hal_i2c_bus_t bus, const hal_i2c_txn_t *request, uint32_t period_ms)
+{
+    // Refuse a request the servicer would reject, rather than fail it every period.
+    if (!sampler || period_ms == 0 ||
+        !ENUM_IN_RANGE(bus, _HAL_I2C_BUS_MIN, _HAL_I2C_BUS_MAX) ||
+        !i2c_request_is_valid(request) ||
+        request->i2c_op == HAL_I2C_OP_SEQUENCE)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    if (periodic_contains(&samplers, sampler))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // A sample submitted before a deregister is still linked into the I2C queue. Clearing it would break the links.
+    if (sampler->in_flight)
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    memset(sampler, 0, sizeof(*sampler));
+    for (size_t i = 0; i < ARRAY_SIZE(sampler->buffers); i++)
+    {
+        sampler->buffers[i] = *request;
+        sampler->buffers[i].on_complete = sample_completed;
+        sampler->buffers[i].context = sampler;
+        sampler->buffers[i].processing_state = HAL_I2C_TXN_STATE_CREATED;
+        sampler->buffers[i].transaction_result = HAL_I2C_TXN_RESULT_NONE;
+        sampler->buffers[i].actual_bytes_received = 0;
+        sampler->buffers[i].actual_bytes_transmitted = 0;
+        sampler->buffers[i].next = NULL;
+    }
+    sampler->bus = bus;
+    sampler->period_ms = period_ms;
+
+    return periodic_add(&samplers, sampler, period_ms);
+}
+
+void hal_i2c_sampler_deregister(hal_i2c_sampler_t *sampler)
+{
+    if (!sampler)
+    {
+        return;
+    }
+
+    periodic_remove(&samplers, sampler);
+}
+
+hal_status_t hal_i2c_sampler_read(const hal_i2c_sampler_t *sampler, const uint8_t **data, size_t *length, uint32_t *sequence)
+{
+    if (!sampler || !data || !length || !sequence)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    uint32_t published = sampler->published;
+    if (published == 0)
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    const hal_i2c_txn_t *sample = &sampler->buffers[published & 1U];
+    *data = sample->rx_data;
+    *length = sample->actual_bytes_received;
+    *sequence = published;
+
+    return HAL_STATUS_OK;
+}
+
+bool hal_i2c_sampler_read_is_valid(const hal_i2c_sampler_t *sampler, uint32_t sequence)
+{
+    if (!sampler || sequence == 0)
+    {
+        return false;
+    }
+
+    // Sample n + 2 is the first one written into the buffer holding sample n.
+    // Unsigned subtraction survives sequence rollover.
+    return (uint32_t)(sampler->claimed - sequence) < 2U;
+}
+
+/// @brief Just for testing.
+/// @warning Grave consequences if used in production code.
+void _test_fixture_hal_i2c_sampler_reset_internals()
+{
+    _test_fixture_systick_periodic_reset_internals();
+}
+
+/// @brief Periodic table callback. Runs in the SysTick interrupt when a sampler is due.
+static void sample_due(void *client)
+{
+    hal_i2c_sampler_t *sampler = (hal_i2c_sampler_t *)client;
+
+    if (sampler->in_flight)
+    {
+        sampler->overruns++;
+    }
+    else
+    {
+        submit_sample(sampler);
+    }
+}
+
+static void submit_sample(hal_i2c_sampler_t *sampler)
+{
+    // Write into the buffer the reader is not using. A failed sample is retried in the same buffer.
+    uint32_t number = sampler->published + 1U;
+    hal_i2c_txn_t *txn = &sampler->buffers[number & 1U];
+
+    // Claim the buffer before touching it so readers of the sample it held can tell.
+    sampler->claimed = number;
+    sampler->in_flight = true;
+
+    txn->processing_state = HAL_I2C_TXN_STATE_CREATED;
+    txn->transaction_result = HAL_I2C_TXN_RESULT_NONE;
+    txn->actual_bytes_received = 0;
+    txn->actual_bytes_transmitted = 0;
+
+    if (hal_i2c_submit_transaction(sampler->bus, txn) != HAL_STATUS_OK)
+    {
+        sampler->in_flight = false;
+    }
+}
+
+/// @brief Transaction completion callback. Runs in the context of the I2C servicer.
+static void sample_completed(hal_i2c_txn_t *txn)
+{
+    hal_i2c_sampler_t *sampler = (hal_i2c_sampler_t *)txn->context;
+
+    if (txn->transaction_result == HAL_I2C_TXN_RESULT_SUCCESS)
+    {
+        sampler->published = sampler->claimed;
+    }
+    else
+    {
+        sampler->failures++;
+    }
+
+    sampler->in_flight = false;
+}
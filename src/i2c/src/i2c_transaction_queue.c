@@ -6,48 +6,30 @@
  * Licensed under the MIT License. See LICENSE file in the project root.
  */
 #include "i2c_transaction_queue.h"
+#include "stm32f4_hal.h"
 
-/**
- * @brief A queue that holds references to the transactions to be processed.
- *
- * Implemented as a ring buffer with no data overwrite.
- */
-typedef struct {
-    hal_i2c_txn_t *transactions[I2C_TRANSACTION_QUEUE_SIZE]; /*!< Array that holds all the references to transactions. */
-    size_t head;                                             /*!< head points to either an empty slot (space in queue) or to tail (no space in queue). */
-    size_t tail;                                             /*!< tail points to the next message to be dequeued. */
-    size_t transaction_count;                                /*!< A current count of the number of transactions in the queue. */
-} i2c_transaction_queue_t;
-
-static i2c_transaction_queue_t queue = {
-    .head = 0,
-    .tail = 0,
-    .transaction_count = 0
-};
-
-i2c_queue_status_t i2c_transaction_queue_add(hal_i2c_txn_t *txn)
+#include <stdbool.h>
+
+static void sort_inbox(i2c_transaction_queue_t *queue);
+
+i2c_queue_status_t i2c_transaction_queue_add(i2c_transaction_queue_t *queue, hal_i2c_txn_t *txn)
 {
     i2c_queue_status_t status = I2C_QUEUE_STATUS_FAIL;
 
-    if (txn)
+    if (queue && txn)
     {
-        // Check if there is space for another message
-        if (queue.transaction_count < I2C_TRANSACTION_QUEUE_SIZE)
-        {
-            // Queue the message
-            queue.transactions[queue.head] = txn;
-            queue.transactions[queue.head]->processing_state = HAL_I2C_TXN_STATE_QUEUED;
+        txn->processing_state = HAL_I2C_TXN_STATE_QUEUED;
 
-            // Increment the queue
-            queue.head = (queue.head + 1) % I2C_TRANSACTION_QUEUE_SIZE;
-            queue.transaction_count++;
-
-            status = I2C_QUEUE_STATUS_SUCCESS;
-        }
-        else
+        // Push onto the inbox. A producer that interrupts this one between the load and the
+        // swap makes the swap fail, and the push is retried on the new head. Release ordering
+        // publishes the transaction's fields to the consumer along with the link.
+        hal_i2c_txn_t *head = __atomic_load_n(&queue->inbox, __ATOMIC_RELAXED);
+        do
         {
-            status = I2C_QUEUE_STATUS_QUEUE_FULL;
-        }
+            txn->next = head;
+        } while (!__atomic_compare_exchange_n(&queue->inbox, &head, txn, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+        status = I2C_QUEUE_STATUS_SUCCESS;
     }
 
     return status;
@@ -57,31 +39,88 @@ i2c_queue_status_t i2c_transaction_queue_add(hal_i2c_txn_t *txn)
 // The desire is to actually set the pointer passed to this function, and to set
 // a parameter, there needs to be a reference. In conclusion, this is a reference to
 // a pointer type.
-i2c_queue_status_t i2c_transaction_queue_get_next(hal_i2c_txn_t **txn)
+i2c_queue_status_t i2c_transaction_queue_get_next(i2c_transaction_queue_t *queue, hal_i2c_txn_t **txn)
 {
     i2c_queue_status_t status = I2C_QUEUE_STATUS_FAIL;
 
-    if (txn)
+    if (queue && txn)
     {
-        if (queue.transaction_count == 0)
-        {
-            status = I2C_QUEUE_STATUS_QUEUE_EMPTY;
-        }
-        else
+        status = I2C_QUEUE_STATUS_QUEUE_EMPTY;
+
+        sort_inbox(queue);
+
+        // Highest priority first. The number of priorities is fixed, so this is O(1).
+        for (int priority = _HAL_I2C_PRIORITY_MAX - 1; priority >= _HAL_I2C_PRIORITY_MIN; priority--)
         {
-            *txn = queue.transactions[queue.tail];
-            queue.tail = (queue.tail + 1) % I2C_TRANSACTION_QUEUE_SIZE;
-            queue.transaction_count--;
-            status = I2C_QUEUE_STATUS_SUCCESS;
+            i2c_transaction_fifo_t *fifo = &queue->fifos[priority];
+
+            if (fifo->head)
+            {
+                *txn = fifo->head;
+                fifo->head = fifo->head->next;
+                (*txn)->next = NULL;
+                status = I2C_QUEUE_STATUS_SUCCESS;
+                break;
+            }
         }
     }
 
     return status;
 }
 
-void i2c_transaction_queue_reset()
+void i2c_transaction_queue_reset(i2c_transaction_queue_t *queue)
 {
-    queue.head = 0;
-    queue.tail = 0;
-    queue.transaction_count = 0;
+    if (!queue)
+    {
+        return;
+    }
+
+    __atomic_store_n(&queue->inbox, NULL, __ATOMIC_RELAXED);
+
+    for (size_t i = 0; i < ARRAY_SIZE(queue->fifos); i++)
+    {
+        queue->fifos[i].head = NULL;
+        queue->fifos[i].tail = NULL;
+    }
+}
+
+/**
+ * @brief Move everything added since the last call into the FIFOs, oldest first.
+ */
+static void sort_inbox(i2c_transaction_queue_t *queue)
+{
+    // Take the whole inbox at once. Producers start a new one behind us.
+    hal_i2c_txn_t *newest_first = __atomic_exchange_n(&queue->inbox, NULL, __ATOMIC_ACQUIRE);
+    hal_i2c_txn_t *oldest_first = NULL;
+
+    // The inbox is a stack. Reverse it to restore submission order.
+    while (newest_first)
+    {
+        hal_i2c_txn_t *txn = newest_first;
+        newest_first = txn->next;
+        txn->next = oldest_first;
+        oldest_first = txn;
+    }
+
+    while (oldest_first)
+    {
+        hal_i2c_txn_t *txn = oldest_first;
+        oldest_first = txn->next;
+
+        hal_i2c_priority_t priority = ENUM_IN_RANGE(txn->priority, _HAL_I2C_PRIORITY_MIN, _HAL_I2C_PRIORITY_MAX) ?
+                                      txn->priority : HAL_I2C_PRIORITY_LOW;
+        i2c_transaction_fifo_t *fifo = &queue->fifos[priority];
+
+        // Link it in behind the current tail.
+        txn->next = NULL;
+        if (fifo->head)
+        {
+            fifo->tail->next = txn;
+        }
+        else
+        {
+            fifo->head = txn;
+        }
+        fifo->tail = txn;
+    }
 }
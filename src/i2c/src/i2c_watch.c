@@ -0,0 +1,158 @@
+/**
+ * @file i2c_watch.c
+ * @brief Periodic presence checks scheduled by the shared SysTick periodic tables.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+
+#ifdef DESKTOP_BUILD
+#include "registers.h"
+#else
+#include "stm32f4xx.h"
+#endif
+
+#include "hal/i2c_watch.h"
+#include "hal/i2c.h"
+#include "stm32f4_hal.h"
+#include "systick_periodic.h"
+
+#include <string.h>
+
+static void scan_due(void *client);
+static void scan_completed(hal_i2c_txn_t *txn);
+static void submit_scan(hal_i2c_watch_t *watch);
+
+/* Private variables */
+static periodic_slot_t watch_slots[HAL_I2C_WATCH_MAX_CLIENTS];
+static periodic_table_t watches = PERIODIC_TABLE(watch_slots, scan_due);
+
+hal_status_t hal_i2c_watch_register(hal_i2c_watch_t *watch, hal_i2c_bus_t bus, const uint8_t *addresses, size_t count,
+                                    uint32_t period_ms, hal_i2c_watch_callback_t on_change, void *context)
+{
+    if (!watch || !addresses || count == 0 || count > (HAL_I2C_PRESENCE_MAP_BYTES * 8U) || period_ms == 0 ||
+        !ENUM_IN_RANGE(bus, _HAL_I2C_BUS_MIN, _HAL_I2C_BUS_MAX))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (addresses[i] > 0x7F)
+        {
+            return HAL_STATUS_ERROR;
+        }
+    }
+
+    if (periodic_contains(&watches, watch))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // Its last scan may still be queued from before a deregister.
+    if (watch->in_flight)
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    memset(watch, 0, sizeof(*watch));
+    watch->txn.i2c_op = HAL_I2C_OP_SCAN;
+    memcpy(watch->txn.tx_data, addresses, count);
+    watch->txn.expected_bytes_to_tx = count;
+    watch->txn.on_complete = scan_completed;
+    watch->txn.context = watch;
+    watch->bus = bus;
+    watch->period_ms = period_ms;
+    watch->on_change = on_change;
+    watch->context = context;
+
+    // Expected until the first scan says otherwise.
+    for (size_t i = 0; i < count; i++)
+    {
+        watch->present[addresses[i] / 8U] |= (uint8_t)(1U << (addresses[i] % 8U));
+    }
+
+    return periodic_add(&watches, watch, period_ms);
+}
+
+void hal_i2c_watch_deregister(hal_i2c_watch_t *watch)
+{
+    if (!watch)
+    {
+        return;
+    }
+
+    periodic_remove(&watches, watch);
+}
+
+/// @brief Just for testing.
+/// @warning Grave consequences if used in production code.
+void _test_fixture_hal_i2c_watch_reset_internals()
+{
+    _test_fixture_systick_periodic_reset_internals();
+}
+
+/// @brief Periodic table callback. Runs in the SysTick interrupt when a watch is due.
+static void scan_due(void *client)
+{
+    hal_i2c_watch_t *watch = (hal_i2c_watch_t *)client;
+
+    if (watch->in_flight)
+    {
+        watch->overruns++;
+    }
+    else
+    {
+        submit_scan(watch);
+    }
+}
+
+static void submit_scan(hal_i2c_watch_t *watch)
+{
+    watch->in_flight = true;
+
+    watch->txn.processing_state = HAL_I2C_TXN_STATE_CREATED;
+    watch->txn.transaction_result = HAL_I2C_TXN_RESULT_NONE;
+    watch->txn.actual_bytes_received = 0;
+    watch->txn.actual_bytes_transmitted = 0;
+
+    if (hal_i2c_submit_transaction(watch->bus, &watch->txn) != HAL_STATUS_OK)
+    {
+        watch->in_flight = false;
+    }
+}
+
+/// @brief Transaction completion callback. Runs in the context of the I2C servicer.
+static void scan_completed(hal_i2c_txn_t *txn)
+{
+    hal_i2c_watch_t *watch = (hal_i2c_watch_t *)txn->context;
+
+    if (txn->transaction_result != HAL_I2C_TXN_RESULT_SUCCESS)
+    {
+        watch->failures++;
+        watch->in_flight = false;
+        return;
+    }
+
+    watch->scans++;
+
+    for (size_t i = 0; i < txn->expected_bytes_to_tx; i++)
+    {
+        uint8_t address = txn->tx_data[i];
+        bool present = HAL_I2C_PRESENT(txn->rx_data, address);
+
+        if (present == (bool)HAL_I2C_PRESENT(watch->present, address))
+        {
+            continue;
+        }
+
+        watch->present[address / 8U] ^= (uint8_t)(1U << (address % 8U));
+        if (watch->on_change)
+        {
+            watch->on_change(watch, address, present);
+        }
+    }
+
+    // Last, so the next scan cannot be submitted over the results before they are read.
+    watch->in_flight = false;
+}
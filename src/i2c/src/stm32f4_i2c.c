@@ -14,7 +14,10 @@
 #endif
 
 #include "hal/i2c.h"
+#include "hal/systick.h"
 #include "i2c_transaction_queue.h"
+#include "stm32f4_i2c_request.h"
+#include "stm32f4_i2c_target.h"
 #include "stm32f4_hal.h"
 
 #include <string.h>
@@ -23,127 +26,659 @@
 #define SYS_FREQ_MHZ 16
 #define I2C_DIRECTION_WRITE 0
 #define I2C_DIRECTION_READ  1
+// First byte of a 10-bit address: 11110, the top two address bits, then the direction.
+#define I2C_ADDR10_HEADER   0xF0U
 
-static void configure_gpio();
-static void configure_peripheral();
-static void configure_interrupts();
-static bool load_new_transaction();
-static bool current_transaction_is_valid();
+// Default transaction timeout. A byte takes 90 us at 100 kHz, so 10 bytes per ms leaves margin.
+#define I2C_TIMEOUT_BASE_MS      10
+#define I2C_TIMEOUT_BYTES_PER_MS 10
+
+// Nine clocks are enough for a target to finish any byte it is driving, plus its ACK bit.
+#define BUS_RECOVERY_SCL_PULSES  9
+// Roughly 5 us per busy-wait at 16 MHz, i.e. a 100 kHz SCL.
+#define BUS_RECOVERY_DELAY_LOOPS 20
+
+// GPIO mode register fields, two bits per pin.
+#define GPIO_MODE_WIDTH  2U
+#define GPIO_MODE_MASK   0x3U
+#define GPIO_MODE_OUTPUT 0x1U
+#define GPIO_MODE_AF     0x2U
+
+/**
+ * @brief One pin of a bus. Every pin used by the driver is on AF4.
+ */
+typedef struct {
+    GPIO_TypeDef *port;
+    uint32_t      pin;
+    uint32_t      port_clock_enable; // RCC AHB1ENR bit of the port.
+} i2c_pin_t;
+
+/**
+ * @brief Everything the driver knows about one bus: its hardware, its queue, and the
+ * state shared between the servicer and the interrupt handlers.
+ */
+typedef struct {
+    // Hardware description. Fixed at compile time.
+    I2C_TypeDef  *regs;
+    IRQn_Type     ev_irqn;
+    IRQn_Type     er_irqn;
+    uint32_t      peripheral_clock_enable; // RCC APB1ENR bit of the peripheral.
+    i2c_pin_t     scl;
+    i2c_pin_t     sda;
+    i2c_pin_t     smba;                    // SMBALERT#. Only configured when SMBus alerts are enabled.
+
+    // SMBus settings. Written by hal_i2c_smbus_enable() while the bus is idle.
+    hal_i2c_speed_t                speed;          // SCL speed the peripheral is set up for.
+    bool                           smbus;
+    bool                           smbus_pec;
+    hal_i2c_smbus_alert_callback_t smbus_on_alert;
+    void                          *smbus_alert_context;
+
+    // Servicer variables.
+    i2c_transaction_queue_t queue;
+    hal_i2c_txn_t          *current_i2c_transaction;
+    hal_i2c_queue_latency_t queue_latency[_HAL_I2C_PRIORITY_MAX];
+    uint32_t                transaction_start_tick;
+    uint32_t                transaction_timeout;
+    hal_i2c_txn_t          *retries_waiting;        // Transactions waiting out a retry delay, linked through next.
+    bool                    ack_polling;            // The current transaction is done and its target is being probed.
+    uint32_t                ack_poll_deadline;      // Tick at which an unanswered ack poll gives up.
+    bool                    bus_held;               // The last transaction ended without a STOP. The next START is a repeated START.
+
+    // Metrics, kept by the servicer.
+    hal_i2c_target_metrics_t target_metrics[HAL_I2C_METRICS_MAX_TARGETS];
+    size_t                   target_metrics_count;
+    uint32_t                 untracked_transactions;
+    uint64_t                 busy_us;
+    uint32_t                 metrics_start_tick;
+    uint32_t                 transaction_wait_us;
+    uint32_t                 transaction_start_us;
+
+    // ISR variables.
+    volatile hal_i2c_txn_t   isr_transaction;       // Copy of a WRITE, READ or WRITE_READ transaction.
+    hal_i2c_segment_t        op_segments[2];        // Segments describing a WRITE, READ or WRITE_READ transaction.
+    hal_i2c_segment_t       *segments;              // The segments of the transaction being processed.
+    size_t                   segment_count;
+    volatile size_t          segment_index;
+    volatile size_t          tx_position;           // Position inside the current segment while writing.
+    volatile size_t          rx_position;           // Position inside the current segment while reading.
+    volatile bool            tx_last_byte_written;
+    volatile bool            rx_last_byte_read;
+    volatile bool            tx_in_progress;
+    volatile bool            rx_in_progress;
+    volatile bool            rx_counted;            // The read segment's length is found on the way. See receive_counted_byte().
+    volatile bool            rx_counted_tail;       // The last three bytes of a counted read are taken at BTF.
+    volatile bool            scanning;              // The transaction is a SCAN. See scan_next().
+    volatile size_t          scan_index;            // Entry of the SCAN address list being probed.
+    volatile bool            hold_bus;              // End the transaction without a STOP.
+    volatile bool            addr10_reached;        // The 10-bit target of the current segment has been addressed for writing.
+    volatile size_t          rx_wire_position;      // Bytes of a counted read received so far, length and PEC bytes included.
+    volatile size_t          rx_wire_length;        // Bytes a counted read takes on the wire. Settled by a block's length byte.
+    volatile bool            error_occurred;
+    volatile hal_i2c_error_t error_cause;
+    volatile bool            bus_recovery_needed;   // Set when the bus may be left in a bad state.
+    volatile uint32_t        transaction_end_us;    // When the final STOP was requested or the transaction aborted.
+} i2c_bus_t;
+
+static void event_irq_handler(i2c_bus_t *bus);
+static void error_irq_handler(i2c_bus_t *bus);
+static i2c_bus_t *get_bus(hal_i2c_bus_t bus_id);
+static hal_i2c_bus_t get_bus_id(const i2c_bus_t *bus);
+static void reset_bus_internals(i2c_bus_t *bus);
+static void configure_pin(const i2c_pin_t *pin, uint32_t mode);
+static void configure_gpio(i2c_bus_t *bus);
+static void configure_peripheral(i2c_bus_t *bus);
+static void write_timing(i2c_bus_t *bus, hal_i2c_speed_t speed);
+static void set_bus_speed(i2c_bus_t *bus, hal_i2c_speed_t speed);
+static void configure_interrupts(i2c_bus_t *bus);
+static bool load_new_transaction(i2c_bus_t *bus);
+static bool transaction_is_live(const hal_i2c_txn_t *txn);
+static bool claim_transaction(hal_i2c_txn_t *txn);
+static bool current_transaction_is_valid(i2c_bus_t *bus);
+static bool transaction_is_valid(const hal_i2c_txn_t *txn);
+static bool segments_are_valid(const hal_i2c_segment_t *segments, size_t segment_count);
+static bool scan_addresses_are_valid(const hal_i2c_txn_t *txn);
+static bool address_is_valid(uint16_t target_addr, hal_i2c_addr_mode_t addr_mode);
+static void record_queue_latency(i2c_bus_t *bus, const hal_i2c_txn_t *txn);
+static void transaction_target(const hal_i2c_txn_t *txn, uint16_t *target_addr, hal_i2c_addr_mode_t *addr_mode);
+static uint16_t metrics_target_addr(const hal_i2c_txn_t *txn);
+static hal_i2c_target_metrics_t *find_target_metrics(i2c_bus_t *bus, uint16_t target_addr, bool create);
+static void record_target_metrics(i2c_bus_t *bus, const hal_i2c_txn_t *txn, uint32_t bus_us);
+static void reset_metrics(i2c_bus_t *bus);
+static void prepare_segments(i2c_bus_t *bus, const hal_i2c_txn_t *txn);
+static void start_transfer(i2c_bus_t *bus, uint32_t timeout_ms);
+static void finish_transaction(i2c_bus_t *bus, hal_i2c_txn_t *txn);
+static bool retry_transaction(i2c_bus_t *bus, hal_i2c_txn_t *txn);
+static void requeue_transaction(i2c_bus_t *bus, hal_i2c_txn_t *txn);
+static void release_due_retries(i2c_bus_t *bus);
+static bool start_ack_poll(i2c_bus_t *bus, const hal_i2c_txn_t *txn);
+static bool ack_poll_answered(i2c_bus_t *bus, hal_i2c_txn_t *txn);
+static void send_ack_poll(i2c_bus_t *bus, const hal_i2c_txn_t *txn);
+static uint32_t transaction_timeout_ms(i2c_bus_t *bus, const hal_i2c_txn_t *txn);
+static bool transaction_timed_out(i2c_bus_t *bus);
+static void abort_timed_out_transaction(i2c_bus_t *bus);
+static void recover_bus(i2c_bus_t *bus);
+static void bus_recovery_delay();
+static void configure_smbus(i2c_bus_t *bus);
+static void smbus_disable(i2c_bus_t *bus);
 
 /* Private variables */
-static hal_i2c_txn_t   *current_i2c_transaction = NULL;
-
-/* ISR variables */
-static volatile hal_i2c_txn_t _current_i2c_transaction;
-static volatile size_t        _tx_position = 0;
-static volatile size_t        _rx_position = 0;
-static volatile bool          _tx_last_byte_written = false;
-static volatile bool          _rx_last_byte_read = false;
-static volatile bool          _tx_in_progress = false;
-static volatile bool          _rx_in_progress = false;
-static volatile bool          _error_occurred = false;
-
-#define _SET_ERROR_FLAG_AND_ABORT_TRANSACTION() \
-_error_occurred = true; \
-I2C1->CR2 &= ~I2C_CR2_ITBUFEN; \
-I2C1->CR1 |= I2C_CR1_STOP; \
-_tx_in_progress = false; \
-_rx_in_progress = false;
+// The buses are spread over the board so they do not collide with the UART pins.
+// I2C3 shares PA8 with PWM channel 1, so the two can not be used together.
+static i2c_bus_t buses[_HAL_I2C_BUS_MAX] = {
+    [HAL_I2C1] = {
+        .regs = I2C1,
+        .ev_irqn = I2C1_EV_IRQn,
+        .er_irqn = I2C1_ER_IRQn,
+        .peripheral_clock_enable = RCC_APB1ENR_I2C1EN,
+        .scl = { .port = GPIOB, .pin = 8, .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+        .sda = { .port = GPIOB, .pin = 9, .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+        .smba = { .port = GPIOB, .pin = 5, .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+    },
+    [HAL_I2C2] = {
+        .regs = I2C2,
+        .ev_irqn = I2C2_EV_IRQn,
+        .er_irqn = I2C2_ER_IRQn,
+        .peripheral_clock_enable = RCC_APB1ENR_I2C2EN,
+        .scl = { .port = GPIOB, .pin = 10, .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+        .sda = { .port = GPIOC, .pin = 12, .port_clock_enable = RCC_AHB1ENR_GPIOCEN },
+        .smba = { .port = GPIOB, .pin = 12, .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+    },
+    [HAL_I2C3] = {
+        .regs = I2C3,
+        .ev_irqn = I2C3_EV_IRQn,
+        .er_irqn = I2C3_ER_IRQn,
+        .peripheral_clock_enable = RCC_APB1ENR_I2C3EN,
+        .scl = { .port = GPIOA, .pin = 8, .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+        .sda = { .port = GPIOC, .pin = 9, .port_clock_enable = RCC_AHB1ENR_GPIOCEN },
+        .smba = { .port = GPIOA, .pin = 9, .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+    },
+};
+
+#define _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, cause) \
+bus->error_occurred = true; \
+bus->error_cause = (cause); \
+bus->regs->CR2 &= ~I2C_CR2_ITBUFEN; \
+bus->regs->CR1 |= I2C_CR1_STOP; \
+bus->tx_in_progress = false; \
+bus->rx_in_progress = false; \
+bus->transaction_end_us = hal_get_time_us();
+
+/**
+ * @brief The segment currently on the bus.
+ */
+static inline hal_i2c_segment_t *current_segment(i2c_bus_t *bus)
+{
+    return &bus->segments[bus->segment_index];
+}
+
+/**
+ * @brief True if the current segment is not the last of the transaction.
+ */
+static inline bool more_segments_follow(i2c_bus_t *bus)
+{
+    return (bus->segment_index + 1) < bus->segment_count;
+}
+
+/**
+ * @brief True if the current segment ends with a PEC byte.
+ *
+ * The PEC covers the whole message, repeated STARTs included, so only the last segment carries it.
+ */
+static inline bool segment_has_pec(i2c_bus_t *bus)
+{
+    return bus->smbus_pec && !more_segments_follow(bus);
+}
+
+/**
+ * @brief Set the control variables so the next SB event addresses the given segment.
+ */
+static inline void arm_segment(i2c_bus_t *bus, const hal_i2c_segment_t *segment)
+{
+    bool block = (segment->direction == HAL_I2C_SEGMENT_BLOCK_READ);
+    bool pec = segment_has_pec(bus);
+
+    bus->tx_position = 0;
+    bus->rx_position = 0;
+    bus->addr10_reached = false;
+    bus->tx_in_progress = (segment->direction == HAL_I2C_SEGMENT_WRITE);
+    bus->rx_in_progress = !bus->tx_in_progress;
+
+    // Until a block's length byte is in, assume the largest block the segment accepts.
+    bus->rx_counted = bus->rx_in_progress && (block || pec);
+    bus->rx_counted_tail = false;
+    bus->rx_wire_position = 0;
+    bus->rx_wire_length = segment->length + (block ? 1U : 0U) + (pec ? 1U : 0U);
+}
+
+/**
+ * @brief Request the bus condition that ends the current segment.
+ *
+ * A repeated START if another segment follows, otherwise STOP. The reference manual
+ * places both at the same point of the transfer, so callers treat them alike. A transaction
+ * that keeps the bus ends with neither. The next transaction's START follows instead.
+ */
+static inline void request_end_of_segment(i2c_bus_t *bus)
+{
+    if (more_segments_follow(bus))
+    {
+        bus->regs->CR1 |= I2C_CR1_START;
+    }
+    else if (!bus->hold_bus)
+    {
+        bus->regs->CR1 |= I2C_CR1_STOP;
+    }
+}
+
+/**
+ * @brief Record the current segment as finished and move on to the next one, if any.
+ */
+static inline void advance_segment(i2c_bus_t *bus)
+{
+    hal_i2c_segment_t *segment = current_segment(bus);
+    segment->actual_length = (segment->direction == HAL_I2C_SEGMENT_WRITE) ? bus->tx_position : bus->rx_position;
+
+    if (more_segments_follow(bus))
+    {
+        const hal_i2c_segment_t *next = &bus->segments[bus->segment_index + 1];
+
+        bus->segment_index++;
+        arm_segment(bus, next);
+
+        // A 10-bit target just written to is still addressed. A read header alone reaches it.
+        bus->addr10_reached = (segment->addr_mode == HAL_I2C_ADDR_10BIT && next->addr_mode == HAL_I2C_ADDR_10BIT &&
+                               segment->direction == HAL_I2C_SEGMENT_WRITE && segment->target_addr == next->target_addr);
+    }
+    else
+    {
+        bus->tx_in_progress = false;
+        bus->rx_in_progress = false;
+        bus->transaction_end_us = hal_get_time_us();
+
+        if (bus->hold_bus)
+        {
+            // The bus stays stretched until the next START. Keep BTF from firing meanwhile.
+            bus->regs->CR2 &= ~I2C_CR2_ITEVTEN;
+        }
+    }
+}
+
+/**
+ * @brief Write the first address byte of the current segment. Reading SR1 beforehand cleared SB.
+ *
+ * A 10-bit target is first addressed for writing: the header, then its low byte on ADD10. A read
+ * turns around from there with a repeated START and the header again, this time with the read bit.
+ */
+static inline void send_address(i2c_bus_t *bus, uint8_t direction)
+{
+    const hal_i2c_segment_t *segment = current_segment(bus);
+
+    if (segment->addr_mode == HAL_I2C_ADDR_10BIT)
+    {
+        uint8_t header = I2C_ADDR10_HEADER | ((segment->target_addr >> 7) & 0x06U);
+        bus->regs->DR = header | (bus->addr10_reached ? direction : I2C_DIRECTION_WRITE);
+    }
+    else
+    {
+        bus->regs->DR = (segment->target_addr << 1) | direction;
+    }
+}
+
+/**
+ * @brief True if ADDR only means a 10-bit target has been addressed on the way to reading from it.
+ */
+static inline bool addr10_turnaround_due(i2c_bus_t *bus)
+{
+    return bus->rx_in_progress && current_segment(bus)->addr_mode == HAL_I2C_ADDR_10BIT && !bus->addr10_reached;
+}
+
+/**
+ * @brief Store the final byte of a read segment and close the segment out.
+ */
+static inline void receive_final_byte(i2c_bus_t *bus)
+{
+    current_segment(bus)->data[bus->rx_position] = bus->regs->DR;
+    bus->rx_position++;
+
+    // Turn off buffer interrupt.
+    bus->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+
+    // Close out the segment.
+    advance_segment(bus);
+}
+
+/**
+ * @brief Take one byte of a read segment whose end is only found on the way.
+ *
+ * An SMBus block read learns its length from its first byte, and a PEC checked read ends in a byte
+ * that is not data. The BTF driven reception has to know the length at ADDR time, so these reads take
+ * bytes on RXNE with ACK set until the length is known. Once three bytes are left, they switch to the
+ * same end as any other read: RXNE off, then at BTF, with N-2 in DR and N-1 in the shift register, ACK is
+ * cleared and N-2 read, and at the next BTF the end of the segment is requested and N-1 read. N comes in
+ * on RXNE. POS stays clear, so setting CR1.PEC once N-2 is read makes the hardware compare byte N
+ * against its own PEC.
+ *
+ * Blocks of one or two bytes, a one byte block with a PEC and a PEC checked read of one byte have
+ * fewer than three bytes left once their length is known. Their ACK is cleared on the RXNE of the second
+ * to last byte, which only works if the handler takes that byte before the last one is in, within one
+ * byte time (90 us at 100 kHz). If BTF is already set by then, the last byte has been acknowledged and
+ * the target sends on. The read fails with HAL_I2C_ERROR_BUS and the bus is recovered.
+ */
+static void receive_counted_byte(i2c_bus_t *bus)
+{
+    hal_i2c_segment_t *segment = current_segment(bus);
+    bool pec = segment_has_pec(bus);
+    // The byte behind the one in DR is already in, and was acknowledged.
+    bool behind = (bus->regs->SR1 & I2C_SR1_BTF) != 0;
+    size_t left = bus->rx_wire_length - bus->rx_wire_position;
+
+    if (bus->rx_counted_tail && left > 1 && !behind)
+    {
+        // The last three bytes are taken at BTF only.
+        return;
+    }
+
+    if (bus->rx_counted_tail && left == 3)
+    {
+        // N-2 in DR, N-1 in the shift register. Reading DR lets N through, so NACK it first.
+        bus->regs->CR1 &= ~I2C_CR1_ACK;
+    }
+    else if (bus->rx_counted_tail && left == 2)
+    {
+        // N-1 in DR, N in the shift register. End the segment behind N.
+        request_end_of_segment(bus);
+    }
+
+    uint8_t byte = bus->regs->DR;
+
+    bus->rx_wire_position++;
+
+    if (segment->direction == HAL_I2C_SEGMENT_BLOCK_READ && bus->rx_wire_position == 1)
+    {
+        // The length byte. Settle how many bytes are left.
+        if (byte == 0 || byte > segment->length)
+        {
+            bus->regs->CR1 &= ~I2C_CR1_ACK;
+            _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, HAL_I2C_ERROR_BLOCK_LENGTH);
+            return;
+        }
+        bus->rx_wire_length = 1U + byte + (pec ? 1U : 0U);
+    }
+    else if (!pec || bus->rx_wire_position < bus->rx_wire_length)
+    {
+        segment->data[bus->rx_position] = byte;
+        bus->rx_position++;
+    }
+
+    left = bus->rx_wire_length - bus->rx_wire_position;
+
+    if (left == 0)
+    {
+        bus->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+        bus->rx_counted_tail = false;
+
+        if (pec && (bus->regs->SR1 & I2C_SR1_PECERR))
+        {
+            bus->regs->SR1 &= ~I2C_SR1_PECERR;
+            _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, HAL_I2C_ERROR_PEC);
+            return;
+        }
+
+        advance_segment(bus);
+    }
+    else if (bus->rx_counted_tail)
+    {
+        if (left == 2 && pec)
+        {
+            bus->regs->CR1 |= I2C_CR1_PEC;
+        }
+        else if (left == 1)
+        {
+            // Byte N comes in on RXNE.
+            bus->regs->CR2 |= I2C_CR2_ITBUFEN;
+        }
+    }
+    else if (left == 3)
+    {
+        // Hand the last three bytes to BTF.
+        bus->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+        bus->rx_counted_tail = true;
+    }
+    else if (left == 1)
+    {
+        if (behind)
+        {
+            // Too late to NACK the last byte.
+            bus->regs->CR1 &= ~I2C_CR1_ACK;
+            bus->bus_recovery_needed = true;
+            _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, HAL_I2C_ERROR_BUS);
+            return;
+        }
+
+        // The last byte is on its way. NACK it and end the segment behind it.
+        bus->regs->CR1 &= ~I2C_CR1_ACK;
+        request_end_of_segment(bus);
+        if (pec)
+        {
+            bus->regs->CR1 |= I2C_CR1_PEC;
+        }
+    }
+}
+
+/**
+ * @brief Record the answer to a SCAN probe and address the next target on the list.
+ *
+ * Every probe is a zero length write. Its address is ACKed or NACKed, then a repeated START
+ * readdresses the single segment to the next target without the servicer being involved. The
+ * last probe ends with the STOP.
+ */
+static void scan_next(i2c_bus_t *bus, bool present)
+{
+    hal_i2c_segment_t *segment = current_segment(bus);
+    volatile uint8_t *map = bus->isr_transaction.rx_data;
+
+    if (present)
+    {
+        map[segment->target_addr / 8U] |= (uint8_t)(1U << (segment->target_addr % 8U));
+    }
+
+    bus->scan_index++;
+    if (bus->scan_index < bus->isr_transaction.expected_bytes_to_tx)
+    {
+        segment->target_addr = bus->isr_transaction.tx_data[bus->scan_index];
+        bus->regs->CR1 |= I2C_CR1_START;
+    }
+    else
+    {
+        request_end_of_segment(bus);
+        advance_segment(bus);
+    }
+}
 
 void I2C1_EV_IRQHandler(void)
 {
+    event_irq_handler(&buses[HAL_I2C1]);
+}
+
+void I2C1_ER_IRQHandler(void)
+{
+    error_irq_handler(&buses[HAL_I2C1]);
+}
+
+void I2C2_EV_IRQHandler(void)
+{
+    event_irq_handler(&buses[HAL_I2C2]);
+}
+
+void I2C2_ER_IRQHandler(void)
+{
+    error_irq_handler(&buses[HAL_I2C2]);
+}
+
+void I2C3_EV_IRQHandler(void)
+{
+    event_irq_handler(&buses[HAL_I2C3]);
+}
+
+void I2C3_ER_IRQHandler(void)
+{
+    error_irq_handler(&buses[HAL_I2C3]);
+}
+
+static void event_irq_handler(i2c_bus_t *bus)
+{
+    // A bus in target mode is answering, not driving.
+    if (i2c_target_event_irq(get_bus_id(bus)))
+    {
+        return;
+    }
+
     // ************** START Phase **************
     // Start condition has been generated on the line.
     // Start bit has been set. It must be cleared and the
     // device address written to DR.
     // *****************************************
-    if (I2C1->SR1 & I2C_SR1_SB)
+    if (bus->regs->SR1 & I2C_SR1_SB)
     {
+        // When a read segment ends in a repeated START, its final byte and the
+        // new START can be pending together. Finish the read before addressing.
+        if (bus->rx_in_progress && bus->rx_counted && (bus->regs->SR1 & I2C_SR1_RXNE))
+        {
+            receive_counted_byte(bus);
+        }
+        else if (bus->rx_in_progress && (bus->regs->SR1 & I2C_SR1_RXNE) &&
+                 bus->rx_position == (current_segment(bus)->length - 1))
+        {
+            receive_final_byte(bus);
+        }
+
         // Reading SR1 clears SB.
-        (void)I2C1->SR1;
+        (void)bus->regs->SR1;
 
         // If we're transmitting data, append the WRITE bit to address. Otherwise,
         // append the READ bit.
-        if (_tx_in_progress && !_rx_in_progress)
+        if (bus->tx_in_progress && !bus->rx_in_progress)
         {
-            I2C1->DR = (_current_i2c_transaction.target_addr << 1) | I2C_DIRECTION_WRITE;
+            send_address(bus, I2C_DIRECTION_WRITE);
         }
-        else if (_rx_in_progress && !_tx_in_progress)
+        else if (bus->rx_in_progress && !bus->tx_in_progress)
         {
-            I2C1->DR = (_current_i2c_transaction.target_addr << 1) | I2C_DIRECTION_READ;
+            send_address(bus, I2C_DIRECTION_READ);
         }
         else
         {
-            // Error with mutual exclusion of _tx_in_progress and _rx_in_progress.
+            // Error with mutual exclusion of bus->tx_in_progress and bus->rx_in_progress.
             // Set error flag and bail.
-            _SET_ERROR_FLAG_AND_ABORT_TRANSACTION();
+            _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, HAL_I2C_ERROR_DRIVER);
         }
     }
 
+    // ************** 10-bit ADDRESS Phase **************
+    // A 10-bit target has acknowledged the header.
+    // Reading SR1 followed by writing the low byte of
+    // its address to DR clears ADD10.
+    // *****************************************
+    if (bus->regs->SR1 & I2C_SR1_ADD10)
+    {
+        bus->regs->DR = current_segment(bus)->target_addr & 0xFFU;
+    }
+
     // ************** ADDRESS Phase **************
     // The target address has been sent on the line and
     // the target has acknowledged the address. Need to
     // set up the rest of the transaction and clear the
     // ADDR bit.
     // *****************************************
-    if (I2C1->SR1 & I2C_SR1_ADDR)
+    if ((bus->regs->SR1 & I2C_SR1_ADDR) && addr10_turnaround_due(bus))
+    {
+        // The 10-bit target is addressed for writing. Turn around with a read header.
+        (void)bus->regs->SR1;
+        (void)bus->regs->SR2;
+        bus->addr10_reached = true;
+        bus->regs->CR1 |= I2C_CR1_START;
+    }
+    else if (bus->regs->SR1 & I2C_SR1_ADDR)
     {
         // Set up ACK hardware base on reception size.
-        if (_rx_in_progress)
+        if (bus->rx_in_progress)
         {
-            if (_current_i2c_transaction.expected_bytes_to_rx == 1)
+            if (bus->rx_counted)
+            {
+                // Acknowledge every byte until receive_counted_byte() nears the end.
+                bus->regs->CR1 &= ~I2C_CR1_POS;
+                bus->regs->CR1 |= I2C_CR1_ACK;
+            }
+            else if (current_segment(bus)->length == 1)
             {
                 // Reset ACK bit so that NACK is sent on the next byte reception.
-                I2C1->CR1 &= ~I2C_CR1_ACK;
+                bus->regs->CR1 &= ~I2C_CR1_ACK;
             }
-            else if (_current_i2c_transaction.expected_bytes_to_rx == 2)
+            else if (current_segment(bus)->length == 2)
             {
                 // Reset ACK bit.
-                I2C1->CR1 &= ~I2C_CR1_ACK;
+                bus->regs->CR1 &= ~I2C_CR1_ACK;
                 // Only set POS for 2-byte reception.
                 // ACK bit controls the NACK of the next byte which is received in the shift register.
                 // Therefore, the first byte will be ACK'd and the second NACK'd automatically.
-                I2C1->CR1 |= I2C_CR1_POS;
+                bus->regs->CR1 |= I2C_CR1_POS;
             }
-            else if (_current_i2c_transaction.expected_bytes_to_rx > 2)
+            else if (current_segment(bus)->length > 2)
             {
                 // Set ACK bit to acknowledge received bytes until further notice.
-                I2C1->CR1 |= I2C_CR1_ACK;
+                bus->regs->CR1 |= I2C_CR1_ACK;
             }
             else
             {
                 // In this scenario, an error occurred. Expected bytes to receive should be one or
                 // greater if an rx is in progress.
                 // Set STOP and reset ACK.
-                I2C1->CR1 |= I2C_CR1_STOP;
-                I2C1->CR1 &= ~I2C_CR1_ACK;
-                _rx_in_progress = false;
-                _tx_in_progress = false;
-                _error_occurred = true;
+                bus->regs->CR1 |= I2C_CR1_STOP;
+                bus->regs->CR1 &= ~I2C_CR1_ACK;
+                bus->rx_in_progress = false;
+                bus->tx_in_progress = false;
+                bus->error_occurred = true;
+                bus->error_cause = HAL_I2C_ERROR_DRIVER;
+                bus->transaction_end_us = hal_get_time_us();
             }
         }
 
         // Reading SR1 followed by SR1 clears ADDR.
         // SCL stretched low until this cleared.
-        (void)I2C1->SR1;
-        (void)I2C1->SR2;
+        (void)bus->regs->SR1;
+        (void)bus->regs->SR2;
 
+        if (bus->rx_in_progress && bus->rx_counted)
+        {
+            // A PEC checked read of two bytes starts with its last three. Anything longer, and any
+            // block, takes bytes on RxNE until receive_counted_byte() hands the rest to BTF.
+            bus->rx_counted_tail = (current_segment(bus)->direction != HAL_I2C_SEGMENT_BLOCK_READ) &&
+                                   (bus->rx_wire_length == 3);
+            if (!bus->rx_counted_tail)
+            {
+                bus->regs->CR2 |= I2C_CR2_ITBUFEN;
+            }
+        }
         // Setup STOP condition for single byte rx.
-        if (_rx_in_progress && _current_i2c_transaction.expected_bytes_to_rx == 1)
+        else if (bus->rx_in_progress && current_segment(bus)->length == 1)
         {
             // If ADDR was cleared by reading SR1 and SR2, then the clock is no longer stretched low and
             // the reception of the single byte should be happening right now as we process this instruction.
             // Stop bit needs to be set while byte is still in flight so hardware can generate STOP on time.
-            I2C1->CR1 |= I2C_CR1_STOP;
+            request_end_of_segment(bus);
             // BTF will never be set for a single byte, in which case we must enable RxNE interrupt to
             // receive our byte.
-            I2C1->CR2 |= I2C_CR2_ITBUFEN;
+            bus->regs->CR2 |= I2C_CR2_ITBUFEN;
         }
 
-        if (_tx_in_progress)
+        if (bus->tx_in_progress && bus->scanning)
+        {
+            // A SCAN probe was answered. Nothing is written.
+            scan_next(bus, true);
+        }
+        else if (bus->tx_in_progress)
         {
             // Enable TxE interrupts for the transmit phase.
-            I2C1->CR2 |= I2C_CR2_ITBUFEN;
+            bus->regs->CR2 |= I2C_CR2_ITBUFEN;
         }
     }
 
@@ -152,357 +687,1410 @@ void I2C1_EV_IRQHandler(void)
     // hardware configured for either the tx or rx
     // phase. Need to monitor BTF, RxNE, and TxE.
     // *****************************************
-    if (I2C1->SR1 & I2C_SR1_BTF)
+    if (bus->regs->SR1 & I2C_SR1_BTF)
     {
-        if (_rx_in_progress)
+        if (bus->rx_in_progress && bus->rx_counted)
+        {
+            // The last three bytes of a counted read, or a handler that fell behind its RxNE.
+            receive_counted_byte(bus);
+        }
+        else if (bus->rx_in_progress)
         {
-            if (_current_i2c_transaction.expected_bytes_to_rx == 2)
+            if (current_segment(bus)->length == 2)
             {
                 // For the case of 2-byte reception and BTF set, byte 1 is
                 // in the DR and byte 2 is in the shift register and SCL is stretched
                 // low. Set the STOP bit and then read the two bytes.
                 // Reset POS for 2-byte read.
-                I2C1->CR1 |= I2C_CR1_STOP;
-                I2C1->CR1 &= ~I2C_CR1_POS;
-                _current_i2c_transaction.rx_data[_rx_position] = I2C1->DR;
-                _rx_position++;
+                request_end_of_segment(bus);
+                bus->regs->CR1 &= ~I2C_CR1_POS;
+                current_segment(bus)->data[bus->rx_position] = bus->regs->DR;
+                bus->rx_position++;
                 // Wait for the last byte to be read in the RxNE interrupt
                 // to give hardware time to move it from shift register.
-                I2C1->CR2 |= I2C_CR2_ITBUFEN;
+                bus->regs->CR2 |= I2C_CR2_ITBUFEN;
             }
-            else if (_current_i2c_transaction.expected_bytes_to_rx > 2)
+            else if (current_segment(bus)->length > 2)
             {
                 // Count starting from 1 instead of zero indexed array.
-                size_t byte_number = _rx_position + 1;
+                size_t byte_number = bus->rx_position + 1;
                 // Assuming rx bytes numbered 1, 2, ..., N
                 // If byte N-2 is in the DR, then byte N-1 is in the shift register since BTF
                 // bit is set. Target is waiting to send byte N while SCL is stretch low by our micro.
-                if (byte_number == (_current_i2c_transaction.expected_bytes_to_rx - 2))
+                if (byte_number == (current_segment(bus)->length - 2))
                 {
                     // Reset ACK bit before byte N is sent so the hardware can NACK in time.
-                    I2C1->CR1 &= ~I2C_CR1_ACK;
+                    bus->regs->CR1 &= ~I2C_CR1_ACK;
                     // Reading the DR clears BTF and unstretches the clock. Byte N should be on
                     // its way.
-                    _current_i2c_transaction.rx_data[_rx_position] = I2C1->DR;
-                    _rx_position++;
+                    current_segment(bus)->data[bus->rx_position] = bus->regs->DR;
+                    bus->rx_position++;
                     // Arm the flag. Next BTF will mean byte N-1 in DR and N in shift register.
-                    _rx_last_byte_read = true;
+                    bus->rx_last_byte_read = true;
                 }
-                else if (_rx_last_byte_read)
+                else if (bus->rx_last_byte_read)
                 {
                     // Byte N-1 in DR and byte N in shift register. SCL stretched low.
                     // Time to set STOP and read last two bytes.
-                    I2C1->CR1 |= I2C_CR1_STOP;
+                    request_end_of_segment(bus);
 
                     // Read byte N-1.
-                    _current_i2c_transaction.rx_data[_rx_position] = I2C1->DR;
-                    _rx_position++;
+                    current_segment(bus)->data[bus->rx_position] = bus->regs->DR;
+                    bus->rx_position++;
                     // Wait for the last byte to be read in the RxNE interrupt
                     // to give hardware time to move it from shift register.
-                    I2C1->CR2 |= I2C_CR2_ITBUFEN;
+                    bus->regs->CR2 |= I2C_CR2_ITBUFEN;
 
                     // Reset the flag.
-                    _rx_last_byte_read = false;
+                    bus->rx_last_byte_read = false;
                 }
                 else
                 {
                     // Normal read somewhere in the beginning or middle of the transaction.
-                    _current_i2c_transaction.rx_data[_rx_position] = I2C1->DR;
-                    _rx_position++;
+                    current_segment(bus)->data[bus->rx_position] = bus->regs->DR;
+                    bus->rx_position++;
                 }
             }
         }
-        else if (_tx_in_progress && _tx_last_byte_written)
+        else if (bus->tx_in_progress && bus->tx_last_byte_written)
         {
             // With BTF set during the transmit phase, and the last byte already written,
             // then both DR and shift register are empty and SCL is stretched low. Time to determine
-            // whether to begin a read phase or end the transaction. Either way, the transmit phase is over.
+            // whether to begin another segment or end the transaction. Either way, this segment is over.
+            bus->tx_last_byte_written = false;
 
-            // Reset transmit control variables
-            _tx_in_progress = false;
-            _tx_last_byte_written = false;
-
-            // Determine next phase.
-            if (_current_i2c_transaction.i2c_op == HAL_I2C_OP_WRITE)
-            {
-                // There is no read phase. End the transaction.
-                I2C1->CR1 |= I2C_CR1_STOP;
-            }
-            else if (_current_i2c_transaction.i2c_op == HAL_I2C_OP_WRITE_READ)
-            {
-                // There is a read phase. Generate a re-start.
-                _rx_in_progress = true;
-                I2C1->CR1 |= I2C_CR1_START;
-            }
+            // A repeated START leads into the next segment. Otherwise end the transaction.
+            request_end_of_segment(bus);
+            advance_segment(bus);
 
             // Clear BTF to prevent immediate refire.
-            (void)I2C1->DR;
+            (void)bus->regs->DR;
             // Disable TxE and RxNE interrupts.
-            I2C1->CR2 &= ~I2C_CR2_ITBUFEN;
+            bus->regs->CR2 &= ~I2C_CR2_ITBUFEN;
         }
     }
 
-    if (I2C1->SR1 & I2C_SR1_TXE)
+    // TXE stays set alongside BTF. Once the BTF branch has closed the segment and turned buffer
+    // interrupts off, the next segment's first byte must wait for its address.
+    if ((bus->regs->SR1 & I2C_SR1_TXE) && (bus->regs->CR2 & I2C_CR2_ITBUFEN))
     {
-        if (_tx_in_progress)
+        if (bus->tx_in_progress)
         {
-            if (_tx_position < _current_i2c_transaction.expected_bytes_to_tx)
+            if (bus->tx_position < current_segment(bus)->length)
             {
-                I2C1->DR = _current_i2c_transaction.tx_data[_tx_position];
-                _tx_position++;
-                if (_tx_position == _current_i2c_transaction.expected_bytes_to_tx)
+                bus->regs->DR = current_segment(bus)->data[bus->tx_position];
+                bus->tx_position++;
+                if (bus->tx_position == current_segment(bus)->length)
                 {
                     // we just queued the final byte; arm BTF to finish
-                    _tx_last_byte_written = true;
+                    bus->tx_last_byte_written = true;
+                    // The hardware sends the PEC behind it. BTF follows the PEC.
+                    if (segment_has_pec(bus))
+                    {
+                        bus->regs->CR1 |= I2C_CR1_PEC;
+                    }
                 }
             }
-            else if (_current_i2c_transaction.expected_bytes_to_tx == 0)
+            else if (current_segment(bus)->length == 0)
             {
                 // Zero length write.
-                // Disable TxE interrupt, generate STOP, and close out transaction.
-                I2C1->CR2 &= ~I2C_CR2_ITBUFEN;
-                I2C1->CR1 |= I2C_CR1_STOP;
-                _tx_in_progress = false;
+                // Disable TxE interrupt, generate STOP (or repeated START), and close out the segment.
+                bus->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+                request_end_of_segment(bus);
+                advance_segment(bus);
             }
         }
     }
 
-    if (I2C1->SR1 & I2C_SR1_RXNE)
+    // Counted reads take their bytes on RxNE until the last three.
+    if (bus->rx_in_progress && bus->rx_counted && (bus->regs->SR1 & I2C_SR1_RXNE))
+    {
+        receive_counted_byte(bus);
+    }
+    else if (bus->regs->SR1 & I2C_SR1_RXNE)
     {
         // In receive mode we only use RxNE to pick up the last byte.
-        if (_rx_in_progress && _rx_position == (_current_i2c_transaction.expected_bytes_to_rx - 1))
+        if (bus->rx_in_progress && bus->rx_position == (current_segment(bus)->length - 1))
         {
             // We are about to receive our last byte.
-            _current_i2c_transaction.rx_data[_rx_position] = I2C1->DR;
-            _rx_position++;
-
-            // Turn off buffer interrupt.
-            I2C1->CR2 &= ~I2C_CR2_ITBUFEN;
-
-            // Close out the transaction.
-            _rx_in_progress = false;
+            receive_final_byte(bus);
         }
     }
 }
 
-void I2C1_ER_IRQHandler()
+static void error_irq_handler(i2c_bus_t *bus)
 {
-    uint32_t sr1 = I2C1->SR1;  // volatile read ok
+    if (i2c_target_error_irq(get_bus_id(bus)))
+    {
+        return;
+    }
+
+    uint32_t sr1 = bus->regs->SR1;  // volatile read ok
 
     if (sr1 & I2C_SR1_AF)
     {
         // The target failed to acknowledge either address or data.
         // Reset flag.
-        I2C1->SR1 &= ~I2C_SR1_AF;
-        _SET_ERROR_FLAG_AND_ABORT_TRANSACTION();
+        bus->regs->SR1 &= ~I2C_SR1_AF;
+        if (bus->scanning && bus->tx_in_progress)
+        {
+            // Nobody at this SCAN address. Carry on with the next.
+            scan_next(bus, false);
+        }
+        else
+        {
+            _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, HAL_I2C_ERROR_NACK);
+        }
+    }
+
+    if (sr1 & I2C_SR1_ARLO)
+    {
+        // Another controller won arbitration. The hardware has already released the bus
+        // and dropped to target mode, so no STOP must be generated. The servicer queues
+        // the transaction again.
+        bus->regs->SR1 &= ~I2C_SR1_ARLO;
+        bus->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+        bus->error_occurred = true;
+        bus->error_cause = HAL_I2C_ERROR_ARBITRATION_LOST;
+        bus->tx_in_progress = false;
+        bus->rx_in_progress = false;
+        bus->transaction_end_us = hal_get_time_us();
+    }
+
+    if (sr1 & I2C_SR1_BERR)
+    {
+        // Misplaced START or STOP. The peripheral state can no longer be trusted.
+        bus->regs->SR1 &= ~I2C_SR1_BERR;
+        bus->bus_recovery_needed = true;
+        _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, HAL_I2C_ERROR_BUS);
+    }
+
+    if (sr1 & I2C_SR1_TIMEOUT)
+    {
+        // SCL held low too long. Only raised in SMBus mode.
+        bus->regs->SR1 &= ~I2C_SR1_TIMEOUT;
+        bus->bus_recovery_needed = true;
+        _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, HAL_I2C_ERROR_TIMEOUT);
+    }
+
+    if (sr1 & I2C_SR1_PECERR)
+    {
+        // Normally picked up with the PEC byte itself. Only seen here if this handler ran first.
+        bus->regs->SR1 &= ~I2C_SR1_PECERR;
+        _SET_ERROR_FLAG_AND_ABORT_TRANSACTION(bus, HAL_I2C_ERROR_PEC);
+    }
+
+    if (sr1 & I2C_SR1_SMBALERT)
+    {
+        // A device wants attention. The transaction on the bus, if any, carries on.
+        bus->regs->SR1 &= ~I2C_SR1_SMBALERT;
+        if (bus->smbus_on_alert)
+        {
+            bus->smbus_on_alert(get_bus_id(bus), bus->smbus_alert_context);
+        }
     }
 }
 
-hal_status_t hal_i2c_init()
+hal_status_t hal_i2c_init(hal_i2c_bus_t bus_id)
 {
-    configure_gpio();
-    configure_peripheral();
-    configure_interrupts();
+    i2c_bus_t *bus = get_bus(bus_id);
+    if (!bus)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    i2c_target_disable(bus_id);
+
+    configure_gpio(bus);
+    configure_peripheral(bus);
+    configure_interrupts(bus);
+    smbus_disable(bus);
+
+    memset(bus->queue_latency, 0, sizeof(bus->queue_latency));
+    reset_metrics(bus);
 
     return HAL_STATUS_OK;
 }
 
-hal_status_t hal_i2c_submit_transaction(hal_i2c_txn_t *txn)
+hal_status_t hal_i2c_smbus_enable(hal_i2c_bus_t bus_id, const hal_i2c_smbus_config_t *config)
 {
-    // @todo: Some transaction validation here.
-    return (i2c_transaction_queue_add(txn) == I2C_QUEUE_STATUS_SUCCESS) ? HAL_STATUS_OK : HAL_STATUS_ERROR;
-}
+    i2c_bus_t *bus = get_bus(bus_id);
 
-hal_status_t hal_i2c_transaction_servicer()
-{
-    hal_status_t status = HAL_STATUS_BUSY;
+    if (!bus || !config || i2c_target_is_enabled(bus_id) || bus->tx_in_progress || bus->rx_in_progress)
+    {
+        return HAL_STATUS_ERROR;
+    }
 
-    // CRITICAL SECTION ENTER
-    NVIC_DisableIRQ(I2C1_EV_IRQn);
-    NVIC_DisableIRQ(I2C1_ER_IRQn);
+    smbus_disable(bus);
 
-    // Check if there is currently no transaction in progress.
-    if (!_tx_in_progress && !_rx_in_progress)
+    bus->smbus = true;
+    bus->smbus_pec = config->pec;
+    bus->smbus_on_alert = config->on_alert;
+    bus->smbus_alert_context = config->context;
+
+    if (config->on_alert)
     {
-        status = HAL_STATUS_OK;
+        RCC->AHB1ENR |= bus->smba.port_clock_enable;
+        configure_pin(&bus->smba, GPIO_MODE_AF);
+        bus->regs->SR1 &= ~I2C_SR1_SMBALERT;
+    }
 
-        // Finish transaction that just completed.
-        if (current_i2c_transaction)
-        {
-            // Transfer the results back to the client's transaction object.
-            current_i2c_transaction->actual_bytes_transmitted = _tx_position;
-            current_i2c_transaction->actual_bytes_received = _rx_position;
-            memcpy(current_i2c_transaction->rx_data, (const void*)_current_i2c_transaction.rx_data, current_i2c_transaction->actual_bytes_received);
-            current_i2c_transaction->transaction_result = (_error_occurred) ? HAL_I2C_TXN_RESULT_FAIL : HAL_I2C_TXN_RESULT_SUCCESS;
+    configure_smbus(bus);
 
-            // Complete the transaction.
-            current_i2c_transaction->processing_state = HAL_I2C_TXN_STATE_COMPLETED;
+    return HAL_STATUS_OK;
+}
 
-            // Reset our pointer away from the completed transaction.
-            current_i2c_transaction = NULL;
-        }
+hal_status_t hal_i2c_submit_transaction(hal_i2c_bus_t bus_id, hal_i2c_txn_t *txn)
+{
+    i2c_queue_status_t queue_status;
+    i2c_bus_t *bus = get_bus(bus_id);
 
-        // Load in a new transaction if there is one.
-        if (load_new_transaction())
-        {
-            if (current_transaction_is_valid())
-            {
-                // Set state to processing.
-                current_i2c_transaction->processing_state = HAL_I2C_TXN_STATE_PROCESSING;
+    // A bus in target mode has no use for controller transactions.
+    if (!bus || i2c_target_is_enabled(bus_id))
+    {
+        return HAL_STATUS_ERROR;
+    }
 
-                // Copy the transaction to memory that belongs to the ISR.
-                _current_i2c_transaction = *current_i2c_transaction;
+    if (!txn)
+    {
+        return HAL_STATUS_ERROR;
+    }
 
-                // Set up the control variables.
-                _error_occurred = false;
-                _tx_position = 0;
-                _rx_position = 0;
+    // Claim it before touching any field. A transaction still queued or on the bus is linked
+    // into the queue, and pushing it again would link it to itself.
+    if (!claim_transaction(txn))
+    {
+        return HAL_STATUS_BUSY;
+    }
 
-                if (current_i2c_transaction->i2c_op == HAL_I2C_OP_WRITE ||
-                    current_i2c_transaction->i2c_op == HAL_I2C_OP_WRITE_READ)
-                {
-                    _tx_in_progress = true;
-                    _rx_in_progress = false;
-                }
-                else if (current_i2c_transaction->i2c_op == HAL_I2C_OP_READ)
-                {
-                    _tx_in_progress = false;
-                    _rx_in_progress = true;
+    txn->queued_tick = hal_get_tick();
+    txn->queued_us = hal_get_time_us();
+    txn->retries = 0;
+    txn->arbitration_requeues = 0;
+    txn->retry_delay_ms = 0;
+
+    // Lock-free. Transactions may be submitted from any context (e.g. a SysTick timer callback
+    // or an EXTI handler) while the servicer runs.
+    queue_status = i2c_transaction_queue_add(&bus->queue, txn);
+
+    return (queue_status == I2C_QUEUE_STATUS_SUCCESS) ? HAL_STATUS_OK : HAL_STATUS_ERROR;
+}
+
+hal_status_t hal_i2c_scan(hal_i2c_bus_t bus_id, hal_i2c_txn_t *txn)
+{
+    if (!txn)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    if (transaction_is_live(txn))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    hal_i2c_txn_callback_t on_complete = txn->on_complete;
+    void *context = txn->context;
+
+    memset(txn, 0, sizeof(*txn));
+    txn->i2c_op = HAL_I2C_OP_SCAN;
+    txn->on_complete = on_complete;
+    txn->context = context;
+    for (uint8_t addr = HAL_I2C_SCAN_FIRST_ADDR; addr <= HAL_I2C_SCAN_LAST_ADDR; addr++)
+    {
+        txn->tx_data[txn->expected_bytes_to_tx++] = addr;
+    }
+
+    return hal_i2c_submit_transaction(bus_id, txn);
+}
+
+hal_status_t hal_i2c_transaction_servicer(hal_i2c_bus_t bus_id)
+{
+    hal_status_t status = HAL_STATUS_BUSY;
+    hal_i2c_txn_t *completed_transaction = NULL;
+    i2c_bus_t *bus = get_bus(bus_id);
+
+    if (!bus)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // CRITICAL SECTION ENTER
+    // Only this bus's interrupts. The other buses keep running.
+    NVIC_DisableIRQ(bus->ev_irqn);
+    NVIC_DisableIRQ(bus->er_irqn);
+
+    // A target holding the bus would otherwise stall the queue forever.
+    if ((bus->tx_in_progress || bus->rx_in_progress) && transaction_timed_out(bus))
+    {
+        abort_timed_out_transaction(bus);
+    }
+
+    // Check if there is currently no transaction in progress.
+    if (!bus->tx_in_progress && !bus->rx_in_progress)
+    {
+        status = HAL_STATUS_OK;
+
+        // Finish transaction that just completed.
+        if (bus->current_i2c_transaction)
+        {
+            hal_i2c_txn_t *txn = bus->current_i2c_transaction;
+            bool done;
+
+            if (bus->ack_polling)
+            {
+                // The transaction itself finished earlier. This was a probe of its target.
+                done = ack_poll_answered(bus, txn);
+            }
+            else
+            {
+                // Transfer the results back to the client's transaction object.
+                finish_transaction(bus, txn);
+                record_target_metrics(bus, txn, bus->transaction_end_us - bus->transaction_start_us);
+
+                // A retried transaction is back in the queue, or waiting to go back.
+                done = !retry_transaction(bus, txn) && !start_ack_poll(bus, txn);
+                if (!bus->ack_polling)
+                {
+                    bus->current_i2c_transaction = NULL;
                 }
+            }
+
+            if (done)
+            {
+                // Complete the transaction.
+                txn->processing_state = HAL_I2C_TXN_STATE_COMPLETED;
+                completed_transaction = txn;
+
+                // Reset our pointer away from the completed transaction.
+                bus->current_i2c_transaction = NULL;
+            }
+        }
+
+        // Put the bus back in order before the next transaction uses it.
+        if (bus->bus_recovery_needed)
+        {
+            recover_bus(bus);
+            bus->bus_recovery_needed = false;
+        }
+
+        release_due_retries(bus);
+
+        if (bus->ack_polling)
+        {
+            // The target has not answered yet. Ask again.
+            send_ack_poll(bus, bus->current_i2c_transaction);
+        }
+        // Load in a new transaction if there is one.
+        else if (load_new_transaction(bus))
+        {
+            // Unsigned subtraction survives timer rollover.
+            bus->transaction_start_us = hal_get_time_us();
+            bus->transaction_wait_us = bus->transaction_start_us - bus->current_i2c_transaction->queued_us;
+
+            if (current_transaction_is_valid(bus))
+            {
+                record_queue_latency(bus, bus->current_i2c_transaction);
+
+                // Set state to processing.
+                bus->current_i2c_transaction->processing_state = HAL_I2C_TXN_STATE_PROCESSING;
 
-                // Send start
-                I2C1->CR1 |= I2C_CR1_START;
+                // Describe the transaction to the ISR as a list of segments.
+                prepare_segments(bus, bus->current_i2c_transaction);
+                set_bus_speed(bus, bus->current_i2c_transaction->speed);
+                start_transfer(bus, transaction_timeout_ms(bus, bus->current_i2c_transaction));
             }
             else
             {
                 // Close out the invalid transaction and set error.
                 status = HAL_STATUS_ERROR;
-                current_i2c_transaction->actual_bytes_transmitted = 0;
-                current_i2c_transaction->actual_bytes_received = 0;
-                current_i2c_transaction->transaction_result = HAL_I2C_TXN_RESULT_FAIL;
-                current_i2c_transaction->processing_state = HAL_I2C_TXN_STATE_COMPLETED;
-                current_i2c_transaction = NULL;
+                bus->current_i2c_transaction->actual_bytes_transmitted = 0;
+                bus->current_i2c_transaction->actual_bytes_received = 0;
+                bus->current_i2c_transaction->transaction_result = HAL_I2C_TXN_RESULT_FAIL;
+                bus->current_i2c_transaction->error = HAL_I2C_ERROR_INVALID;
+                bus->current_i2c_transaction->processing_state = HAL_I2C_TXN_STATE_COMPLETED;
+                record_target_metrics(bus, bus->current_i2c_transaction, 0);
+                completed_transaction = bus->current_i2c_transaction;
+                bus->current_i2c_transaction = NULL;
             }
         }
     }
 
-    NVIC_EnableIRQ(I2C1_EV_IRQn);
-    NVIC_EnableIRQ(I2C1_ER_IRQn);
+    NVIC_EnableIRQ(bus->ev_irqn);
+    NVIC_EnableIRQ(bus->er_irqn);
     // CRITICAL SECTION EXIT
 
+    // Notify the client outside the critical section so the callback is free to submit more work.
+    if (completed_transaction && completed_transaction->on_complete)
+    {
+        completed_transaction->on_complete(completed_transaction);
+    }
+
     return status;
 }
 
+hal_status_t hal_i2c_get_queue_latency(hal_i2c_bus_t bus_id, hal_i2c_priority_t priority, hal_i2c_queue_latency_t *latency)
+{
+    i2c_bus_t *bus = get_bus(bus_id);
+
+    if (!bus || !latency || !ENUM_IN_RANGE(priority, _HAL_I2C_PRIORITY_MIN, _HAL_I2C_PRIORITY_MAX))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    *latency = bus->queue_latency[priority];
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_i2c_get_target_metrics(hal_i2c_bus_t bus_id, uint16_t target_addr, hal_i2c_target_metrics_t *metrics)
+{
+    i2c_bus_t *bus = get_bus(bus_id);
+    const hal_i2c_target_metrics_t *found = bus ? find_target_metrics(bus, target_addr, false) : NULL;
+
+    if (!found || !metrics)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    *metrics = *found;
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_i2c_get_bus_utilization(hal_i2c_bus_t bus_id, hal_i2c_bus_utilization_t *utilization)
+{
+    i2c_bus_t *bus = get_bus(bus_id);
+
+    if (!bus || !utilization)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    utilization->window_ms = hal_get_tick() - bus->metrics_start_tick;
+    utilization->busy_us = bus->busy_us;
+    utilization->untracked_transactions = bus->untracked_transactions;
+    utilization->busy_percent = 0;
+
+    if (utilization->window_ms)
+    {
+        // busy_us * 100 / (window_ms * 1000)
+        uint64_t percent = bus->busy_us / ((uint64_t)utilization->window_ms * 10U);
+        utilization->busy_percent = (uint8_t)((percent > 100U) ? 100U : percent);
+    }
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_i2c_reset_metrics(hal_i2c_bus_t bus_id)
+{
+    i2c_bus_t *bus = get_bus(bus_id);
+
+    if (!bus)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    reset_metrics(bus);
+
+    return HAL_STATUS_OK;
+}
+
 /// @brief Just for testing.
 /// @warning Grave consequences if used in production code.
 void _test_fixture_hal_i2c_reset_internals()
 {
-    current_i2c_transaction = NULL;
-
-    _current_i2c_transaction.target_addr = 0;
-    _current_i2c_transaction.i2c_op = HAL_I2C_OP_WRITE;
-    _current_i2c_transaction.expected_bytes_to_tx = 0;
-    _current_i2c_transaction.expected_bytes_to_rx = 0;
-    _current_i2c_transaction.processing_state = HAL_I2C_TXN_STATE_CREATED;
-    _current_i2c_transaction.transaction_result = HAL_I2C_TXN_RESULT_NONE;
-    _current_i2c_transaction.actual_bytes_received = 0;
-    _current_i2c_transaction.actual_bytes_transmitted = 0;
-    memset((void*)_current_i2c_transaction.tx_data, 0, sizeof(_current_i2c_transaction.tx_data));
-    memset((void*)_current_i2c_transaction.rx_data, 0, sizeof(_current_i2c_transaction.rx_data));
-
-    _tx_position = 0;
-    _rx_position = 0;
-    _tx_last_byte_written = false;
-    _rx_last_byte_read = false;
-    _tx_in_progress = false;
-    _rx_in_progress = false;
-    _error_occurred = false;
-}
-
-// These pins are broken out right next to each other on the dev board.
-// And no interference from other peripherals.
-// PB8 - I2C1 SCL
-// PB9 - I2C1 SDA
-// Need to bring up bus from port B, set these pins in AF4.
-static void configure_gpio()
-{
-    // Enable Bus.
-    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN;
-
-    // Set PB8 (i2c1 SCL pin) mode to alternate function.
-    GPIOB->MODER &= ~BIT_16;
-    GPIOB->MODER |= BIT_17;
-
-    // Set PB9 (i2c1 SDA pin) mode to alternate function.
-    GPIOB->MODER &= ~BIT_18;
-    GPIOB->MODER |= BIT_19;
-
-    // Set PB8 alternate function type to I2C (AF04)
-    GPIOB->AFR[1] &= ~(0xF << (PIN_0 * AF_SHIFT_WIDTH));
-    GPIOB->AFR[1] |= (AF4_MASK << (PIN_0 * AF_SHIFT_WIDTH));
-
-    // Set PB9 alternate function type to I2C (AF04)
-    GPIOB->AFR[1] &= ~(0xF << (PIN_1 * AF_SHIFT_WIDTH));
-    GPIOB->AFR[1] |= (AF4_MASK << (PIN_1 * AF_SHIFT_WIDTH));
+    for (size_t i = 0; i < ARRAY_SIZE(buses); i++)
+    {
+        reset_bus_internals(&buses[i]);
+        i2c_target_disable((hal_i2c_bus_t)i);
+    }
+}
+
+I2C_TypeDef *i2c_bus_registers(hal_i2c_bus_t bus_id)
+{
+    i2c_bus_t *bus = get_bus(bus_id);
+    return bus ? bus->regs : NULL;
+}
+
+bool i2c_request_is_valid(const hal_i2c_txn_t *txn)
+{
+    if (!txn || !transaction_is_valid(txn))
+    {
+        return false;
+    }
+
+    switch (txn->i2c_op)
+    {
+        case HAL_I2C_OP_WRITE:
+            return txn->expected_bytes_to_tx >= 1 && txn->expected_bytes_to_tx <= TX_MESSAGE_MAX_LENGTH;
+        case HAL_I2C_OP_READ:
+            return txn->expected_bytes_to_rx >= 1 && txn->expected_bytes_to_rx <= RX_MESSAGE_MAX_LENGTH;
+        case HAL_I2C_OP_WRITE_READ:
+            return txn->expected_bytes_to_tx >= 1 && txn->expected_bytes_to_tx <= TX_MESSAGE_MAX_LENGTH &&
+                   txn->expected_bytes_to_rx >= 1 && txn->expected_bytes_to_rx <= RX_MESSAGE_MAX_LENGTH;
+        default:
+            return true;
+    }
+}
+
+static i2c_bus_t *get_bus(hal_i2c_bus_t bus_id)
+{
+    return ENUM_IN_RANGE(bus_id, _HAL_I2C_BUS_MIN, _HAL_I2C_BUS_MAX) ? &buses[bus_id] : NULL;
+}
+
+static hal_i2c_bus_t get_bus_id(const i2c_bus_t *bus)
+{
+    return (hal_i2c_bus_t)(bus - buses);
+}
+
+static void reset_bus_internals(i2c_bus_t *bus)
+{
+    i2c_transaction_queue_reset(&bus->queue);
+    bus->current_i2c_transaction = NULL;
+    bus->retries_waiting = NULL;
+    bus->ack_polling = false;
+    bus->ack_poll_deadline = 0;
+    bus->bus_held = false;
+    bus->scanning = false;
+    bus->scan_index = 0;
+    bus->hold_bus = false;
+    bus->addr10_reached = false;
+    memset(bus->queue_latency, 0, sizeof(bus->queue_latency));
+    bus->transaction_start_tick = 0;
+    bus->transaction_timeout = 0;
+    reset_metrics(bus);
+    bus->transaction_wait_us = 0;
+    bus->transaction_start_us = 0;
+    bus->transaction_end_us = 0;
+
+    bus->isr_transaction.target_addr = 0;
+    bus->isr_transaction.i2c_op = HAL_I2C_OP_WRITE;
+    bus->isr_transaction.expected_bytes_to_tx = 0;
+    bus->isr_transaction.expected_bytes_to_rx = 0;
+    bus->isr_transaction.processing_state = HAL_I2C_TXN_STATE_CREATED;
+    bus->isr_transaction.transaction_result = HAL_I2C_TXN_RESULT_NONE;
+    bus->isr_transaction.actual_bytes_received = 0;
+    bus->isr_transaction.actual_bytes_transmitted = 0;
+    memset((void*)bus->isr_transaction.tx_data, 0, sizeof(bus->isr_transaction.tx_data));
+    memset((void*)bus->isr_transaction.rx_data, 0, sizeof(bus->isr_transaction.rx_data));
+
+    memset(bus->op_segments, 0, sizeof(bus->op_segments));
+    bus->segments = bus->op_segments;
+    bus->segment_count = 0;
+    bus->segment_index = 0;
+    bus->tx_position = 0;
+    bus->rx_position = 0;
+    bus->tx_last_byte_written = false;
+    bus->rx_last_byte_read = false;
+    bus->tx_in_progress = false;
+    bus->rx_in_progress = false;
+    bus->rx_counted = false;
+    bus->rx_counted_tail = false;
+    bus->rx_wire_position = 0;
+    bus->rx_wire_length = 0;
+    bus->error_occurred = false;
+    bus->error_cause = HAL_I2C_ERROR_NONE;
+    bus->bus_recovery_needed = false;
+
+    bus->smbus = false;
+    bus->smbus_pec = false;
+    bus->smbus_on_alert = NULL;
+    bus->smbus_alert_context = NULL;
+}
+
+// I2C1 pins are broken out right next to each other on the dev board,
+// with no interference from other peripherals.
+// I2C1: PB8  SCL, PB9  SDA
+// I2C2: PB10 SCL, PC12 SDA
+// I2C3: PA8  SCL, PC9  SDA
+// All of them on AF4, open drain.
+static void configure_gpio(i2c_bus_t *bus)
+{
+    // Enable the ports.
+    RCC->AHB1ENR |= bus->scl.port_clock_enable | bus->sda.port_clock_enable;
+
+    configure_pin(&bus->scl, GPIO_MODE_AF);
+    configure_pin(&bus->sda, GPIO_MODE_AF);
+}
+
+static void configure_pin(const i2c_pin_t *pin, uint32_t mode)
+{
+    GPIO_TypeDef *port = pin->port;
+    uint32_t afr_index = pin->pin / 8;
+    uint32_t afr_shift = (pin->pin % 8) * AF_SHIFT_WIDTH;
+
+    // Set the alternate function type to I2C (AF04). Only takes effect in AF mode.
+    port->AFR[afr_index] &= ~(0xFU << afr_shift);
+    port->AFR[afr_index] |= (AF4_MASK << afr_shift);
 
     // Open drain
-    GPIOB->OTYPER |= (GPIO_OTYPER_OT_8 | GPIO_OTYPER_OT_9);
+    port->OTYPER |= (1U << pin->pin);
+
+    port->MODER &= ~(GPIO_MODE_MASK << (pin->pin * GPIO_MODE_WIDTH));
+    port->MODER |= (mode << (pin->pin * GPIO_MODE_WIDTH));
 }
 
-static void configure_peripheral()
+static void configure_peripheral(i2c_bus_t *bus)
 {
-    // Send the clock to I2C1
-    RCC->APB1ENR |= RCC_APB1ENR_I2C1EN;
+    // Send the clock to the peripheral.
+    RCC->APB1ENR |= bus->peripheral_clock_enable;
 
     // Need to set the APB1 Clock frequency in the CR2 register.
     // With no dividers, it is the same as the System Frequency of 16 MHz.
-    I2C1->CR2 &= ~(I2C_CR2_FREQ);
-    I2C1->CR2 |= (SYS_FREQ_MHZ & I2C_CR2_FREQ);
-
-    // Time to rise (TRISE) register. Set to 17 via the calculation
-    // Assumed 1000 ns SCL clock rise time (maximum permitted for I2C Standard Mode)
-    // Peripheral's clock period (1 / SYSTEM_FREQ_MHZ)
-    // (1000ns / 62.5) = 17 OR SYSTEM_FREQ_MHZ + 1 = 17. Either calc works.
-    size_t trise_reg_val = SYS_FREQ_MHZ + 1;
-    I2C1->TRISE &= ~(I2C_TRISE_TRISE);
-    I2C1->TRISE |= (trise_reg_val & I2C_TRISE_TRISE);
-
-    // Set CCR.
-    // We want to setup CCR so that the peripheral can count up ticks of the
-    // peripheral bus clock, and use that count to create the SCL clock at 100kHz for
-    // Standard Mode.
-    // 100 kHz SCL means 1 / 100kHz period of 10 microseconds.
-    // So we need to transition the SCL clock every ~5 microseconds.
-    // On a 16 MHz bus clock with a tick every 62.5 nanoseconds, this means
-    // we need to transition the SCL line every 80 ticks to achieve 100kHz SCL line.
-    size_t ticks_between_scl_transitions = 80;
-    I2C1->CCR &= ~(I2C_CCR_CCR);
-    I2C1->CCR |= (ticks_between_scl_transitions & I2C_CCR_CCR);
-
-    // Standard mode
-    I2C1->CCR &= ~I2C_CCR_FS;
+    bus->regs->CR2 &= ~(I2C_CR2_FREQ);
+    bus->regs->CR2 |= (SYS_FREQ_MHZ & I2C_CR2_FREQ);
+
+    // Standard mode until a transaction asks for more.
+    write_timing(bus, HAL_I2C_SPEED_STANDARD);
 
     // Enable the peripheral.
-    I2C1->CR1 |= I2C_CR1_PE;
+    bus->regs->CR1 |= I2C_CR1_PE;
+}
+
+/**
+ * @brief Program TRISE and CCR for an SCL speed. The peripheral must be disabled.
+ */
+static void write_timing(i2c_bus_t *bus, hal_i2c_speed_t speed)
+{
+    size_t trise_reg_val;
+    size_t ccr_reg_val;
+
+    if (speed == HAL_I2C_SPEED_FAST)
+    {
+        // 300 ns maximum rise time in Fast Mode. (300ns / 62.5ns) + 1 = 5.
+        trise_reg_val = ((SYS_FREQ_MHZ * 300) / 1000) + 1;
+
+        // With DUTY clear, SCL is high for CCR ticks and low for twice that.
+        // 16 MHz / (3 * 14) = 381 kHz. 13 ticks would overshoot 400 kHz.
+        ccr_reg_val = 14;
+        bus->regs->CCR |= I2C_CCR_FS;
+        bus->regs->CCR &= ~I2C_CCR_DUTY;
+    }
+    else
+    {
+        // Time to rise (TRISE) register. Set to 17 via the calculation
+        // Assumed 1000 ns SCL clock rise time (maximum permitted for I2C Standard Mode)
+        // Peripheral's clock period (1 / SYSTEM_FREQ_MHZ)
+        // (1000ns / 62.5) = 17 OR SYSTEM_FREQ_MHZ + 1 = 17. Either calc works.
+        trise_reg_val = SYS_FREQ_MHZ + 1;
+
+        // Set CCR.
+        // We want to setup CCR so that the peripheral can count up ticks of the
+        // peripheral bus clock, and use that count to create the SCL clock at 100kHz for
+        // Standard Mode.
+        // 100 kHz SCL means 1 / 100kHz period of 10 microseconds.
+        // So we need to transition the SCL clock every ~5 microseconds.
+        // On a 16 MHz bus clock with a tick every 62.5 nanoseconds, this means
+        // we need to transition the SCL line every 80 ticks to achieve 100kHz SCL line.
+        ccr_reg_val = 80;
+
+        // Standard mode
+        bus->regs->CCR &= ~I2C_CCR_FS;
+    }
+
+    bus->regs->TRISE &= ~(I2C_TRISE_TRISE);
+    bus->regs->TRISE |= (trise_reg_val & I2C_TRISE_TRISE);
+    bus->regs->CCR &= ~(I2C_CCR_CCR);
+    bus->regs->CCR |= (ccr_reg_val & I2C_CCR_CCR);
+
+    bus->speed = speed;
+}
+
+/**
+ * @brief Switch SCL to the speed a transaction asks for, between transactions.
+ *
+ * CCR only takes a new value while the peripheral is disabled. A held bus can not be let go of
+ * that way, so it keeps its speed.
+ */
+static void set_bus_speed(i2c_bus_t *bus, hal_i2c_speed_t speed)
+{
+    if (speed == bus->speed || bus->bus_held)
+    {
+        return;
+    }
+
+    bus->regs->CR1 &= ~I2C_CR1_PE;
+    write_timing(bus, speed);
+    bus->regs->CR1 |= I2C_CR1_PE;
+}
+
+static void configure_interrupts(i2c_bus_t *bus)
+{
+    bus->regs->CR2 |= I2C_CR2_ITEVTEN;
+    bus->regs->CR2 |= I2C_CR2_ITERREN;
+    NVIC_EnableIRQ(bus->ev_irqn);
+    NVIC_EnableIRQ(bus->er_irqn);
+}
+
+/**
+ * @brief True while the transaction is queued, on the bus or waiting for a retry.
+ */
+static bool transaction_is_live(const hal_i2c_txn_t *txn)
+{
+    hal_i2c_txn_state_t state = __atomic_load_n(&txn->processing_state, __ATOMIC_RELAXED);
+
+    return state == HAL_I2C_TXN_STATE_QUEUED || state == HAL_I2C_TXN_STATE_PROCESSING;
+}
+
+/**
+ * @brief Mark a transaction that is not live as QUEUED.
+ *
+ * Lock-free. Of two producers submitting the same transaction at once, only one gets it.
+ */
+static bool claim_transaction(hal_i2c_txn_t *txn)
+{
+    hal_i2c_txn_state_t state = __atomic_load_n(&txn->processing_state, __ATOMIC_RELAXED);
+
+    do
+    {
+        if (state == HAL_I2C_TXN_STATE_QUEUED || state == HAL_I2C_TXN_STATE_PROCESSING)
+        {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&txn->processing_state, &state, HAL_I2C_TXN_STATE_QUEUED, true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    return true;
 }
 
-static void configure_interrupts()
+static bool current_transaction_is_valid(i2c_bus_t *bus)
 {
-    I2C1->CR2 |= I2C_CR2_ITEVTEN;
-    I2C1->CR2 |= I2C_CR2_ITERREN;
-    NVIC_EnableIRQ(I2C1_EV_IRQn);
-    NVIC_EnableIRQ(I2C1_ER_IRQn);
+    const hal_i2c_txn_t *txn = bus->current_i2c_transaction;
+
+    return txn && txn->processing_state == HAL_I2C_TXN_STATE_QUEUED && transaction_is_valid(txn);
 }
 
-static bool current_transaction_is_valid()
+static bool transaction_is_valid(const hal_i2c_txn_t *txn)
 {
-    return (current_i2c_transaction &&
-            ENUM_IN_RANGE(current_i2c_transaction->i2c_op, _HAL_I2C_OP_MIN, _HAL_I2C_OP_MAX) &&
-            current_i2c_transaction->processing_state == HAL_I2C_TXN_STATE_QUEUED);
+    if (!ENUM_IN_RANGE(txn->i2c_op, _HAL_I2C_OP_MIN, _HAL_I2C_OP_MAX) ||
+        !ENUM_IN_RANGE(txn->priority, _HAL_I2C_PRIORITY_MIN, _HAL_I2C_PRIORITY_MAX) ||
+        !ENUM_IN_RANGE(txn->speed, _HAL_I2C_SPEED_MIN, _HAL_I2C_SPEED_MAX))
+    {
+        return false;
+    }
+
+    // Sequences and scans carry their addresses elsewhere.
+    if (txn->i2c_op != HAL_I2C_OP_SEQUENCE && txn->i2c_op != HAL_I2C_OP_SCAN &&
+        !address_is_valid(txn->target_addr, txn->addr_mode))
+    {
+        return false;
+    }
+
+    switch (txn->i2c_op)
+    {
+        case HAL_I2C_OP_SEQUENCE:
+            return segments_are_valid(txn->segments, txn->segment_count);
+        case HAL_I2C_OP_SMBUS_BLOCK_WRITE:
+            // The command, then 1 to 255 bytes of block.
+            return txn->expected_bytes_to_tx >= 2 && txn->expected_bytes_to_tx <= (HAL_I2C_SMBUS_BLOCK_MAX + 1);
+        case HAL_I2C_OP_SMBUS_BLOCK_READ:
+            return txn->expected_bytes_to_tx == 1 &&
+                   txn->expected_bytes_to_rx >= 1 && txn->expected_bytes_to_rx <= HAL_I2C_SMBUS_BLOCK_MAX;
+        case HAL_I2C_OP_SCAN:
+            return scan_addresses_are_valid(txn);
+        default:
+            return true;
+    }
 }
 
-static bool load_new_transaction()
+static bool segments_are_valid(const hal_i2c_segment_t *segments, size_t segment_count)
 {
-    return (I2C_QUEUE_STATUS_SUCCESS == i2c_transaction_queue_get_next(&current_i2c_transaction) &&
-            current_i2c_transaction);
+    if (!segments || segment_count == 0)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < segment_count; i++)
+    {
+        const hal_i2c_segment_t *segment = &segments[i];
+
+        // Reads must move at least one byte, and any data must have somewhere to live.
+        if (!ENUM_IN_RANGE(segment->direction, _HAL_I2C_SEGMENT_MIN, _HAL_I2C_SEGMENT_MAX) ||
+            !address_is_valid(segment->target_addr, segment->addr_mode) ||
+            (segment->direction != HAL_I2C_SEGMENT_WRITE && segment->length == 0) ||
+            (segment->length > 0 && !segment->data))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool address_is_valid(uint16_t target_addr, hal_i2c_addr_mode_t addr_mode)
+{
+    if (!ENUM_IN_RANGE(addr_mode, _HAL_I2C_ADDR_MIN, _HAL_I2C_ADDR_MAX))
+    {
+        return false;
+    }
+
+    return target_addr <= ((addr_mode == HAL_I2C_ADDR_10BIT) ? 0x3FFU : 0x7FU);
+}
+
+static bool scan_addresses_are_valid(const hal_i2c_txn_t *txn)
+{
+    // Each 7-bit address at most once, so the list can be no longer than the map.
+    if (txn->expected_bytes_to_tx == 0 || txn->expected_bytes_to_tx > (HAL_I2C_PRESENCE_MAP_BYTES * 8U))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < txn->expected_bytes_to_tx; i++)
+    {
+        if (txn->tx_data[i] > 0x7F)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void prepare_segments(i2c_bus_t *bus, const hal_i2c_txn_t *txn)
+{
+    bus->scanning = (txn->i2c_op == HAL_I2C_OP_SCAN);
+    bus->scan_index = 0;
+    bus->hold_bus = txn->no_stop;
+
+    if (txn->i2c_op == HAL_I2C_OP_SEQUENCE)
+    {
+        // Sequences run straight out of the client's segment buffers.
+        bus->segments = txn->segments;
+        bus->segment_count = txn->segment_count;
+    }
+    else
+    {
+        // Copy the transaction to memory that belongs to the ISR.
+        bus->isr_transaction = *txn;
+
+        hal_i2c_segment_t write = {
+            .target_addr = txn->target_addr,
+            .direction = HAL_I2C_SEGMENT_WRITE,
+            .data = (uint8_t*)bus->isr_transaction.tx_data,
+            .length = txn->expected_bytes_to_tx,
+            .addr_mode = txn->addr_mode,
+        };
+        hal_i2c_segment_t read = {
+            .target_addr = txn->target_addr,
+            .direction = (txn->i2c_op == HAL_I2C_OP_SMBUS_BLOCK_READ) ? HAL_I2C_SEGMENT_BLOCK_READ : HAL_I2C_SEGMENT_READ,
+            .data = (uint8_t*)bus->isr_transaction.rx_data,
+            .length = txn->expected_bytes_to_rx,
+            .addr_mode = txn->addr_mode,
+        };
+
+        if (txn->i2c_op == HAL_I2C_OP_SMBUS_BLOCK_WRITE)
+        {
+            // Insert the length byte between the command and the block.
+            uint8_t *data = (uint8_t*)bus->isr_transaction.tx_data;
+            size_t block_length = txn->expected_bytes_to_tx - 1;
+            memmove(&data[2], &data[1], block_length);
+            data[1] = (uint8_t)block_length;
+            write.length = txn->expected_bytes_to_tx + 1;
+        }
+        else if (txn->i2c_op == HAL_I2C_OP_SCAN)
+        {
+            // One address-only segment, pointed at each listed target in turn by scan_next().
+            memset((void*)bus->isr_transaction.rx_data, 0, HAL_I2C_PRESENCE_MAP_BYTES);
+            write.target_addr = txn->tx_data[0];
+            write.addr_mode = HAL_I2C_ADDR_7BIT;
+            write.length = 0;
+        }
+
+        bus->segments = bus->op_segments;
+        bus->segment_count = 0;
+
+        if (txn->i2c_op != HAL_I2C_OP_READ)
+        {
+            bus->op_segments[bus->segment_count++] = write;
+        }
+        if (txn->i2c_op == HAL_I2C_OP_READ || txn->i2c_op == HAL_I2C_OP_WRITE_READ ||
+            txn->i2c_op == HAL_I2C_OP_SMBUS_BLOCK_READ)
+        {
+            bus->op_segments[bus->segment_count++] = read;
+        }
+    }
+
+    for (size_t i = 0; i < bus->segment_count; i++)
+    {
+        bus->segments[i].actual_length = 0;
+    }
+}
+
+static void finish_transaction(i2c_bus_t *bus, hal_i2c_txn_t *txn)
+{
+    size_t transmitted = 0;
+    size_t received = 0;
+
+    // The segment the ISR stopped on may have been cut short. Record how far it got.
+    hal_i2c_segment_t *last = current_segment(bus);
+    last->actual_length = (last->direction == HAL_I2C_SEGMENT_WRITE) ? bus->tx_position : bus->rx_position;
+
+    for (size_t i = 0; i <= bus->segment_index && i < bus->segment_count; i++)
+    {
+        if (bus->segments[i].direction == HAL_I2C_SEGMENT_WRITE)
+        {
+            transmitted += bus->segments[i].actual_length;
+        }
+        else
+        {
+            received += bus->segments[i].actual_length;
+        }
+    }
+
+    // A SCAN sends addresses only. What it reads back is the presence map.
+    if (txn->i2c_op == HAL_I2C_OP_SCAN)
+    {
+        received = HAL_I2C_PRESENCE_MAP_BYTES;
+    }
+
+    txn->actual_bytes_transmitted = transmitted;
+    txn->actual_bytes_received = received;
+    if (txn->i2c_op != HAL_I2C_OP_SEQUENCE)
+    {
+        memcpy(txn->rx_data, (const void*)bus->isr_transaction.rx_data, received);
+    }
+    txn->transaction_result = (bus->error_occurred) ? HAL_I2C_TXN_RESULT_FAIL : HAL_I2C_TXN_RESULT_SUCCESS;
+    txn->error = (bus->error_occurred) ? bus->error_cause : HAL_I2C_ERROR_NONE;
+
+    // A failed transaction was ended with a STOP whatever it asked for.
+    bus->bus_held = bus->hold_bus && !bus->error_occurred;
+}
+
+/**
+ * @brief Set up the control variables and send the START of the segments in place.
+ */
+static void start_transfer(i2c_bus_t *bus, uint32_t timeout_ms)
+{
+    bus->error_occurred = false;
+    bus->error_cause = HAL_I2C_ERROR_NONE;
+    bus->segment_index = 0;
+    bus->transaction_start_tick = hal_get_tick();
+    bus->transaction_timeout = timeout_ms;
+    arm_segment(bus, current_segment(bus));
+
+    // Turned off if the previous transaction kept the bus.
+    bus->regs->CR2 |= I2C_CR2_ITEVTEN;
+
+    // Send start. A repeated START if the bus is still held.
+    bus->regs->CR1 |= I2C_CR1_START;
+}
+
+/**
+ * @brief Give a failed transaction another attempt, if it is due one.
+ *
+ * @return true if the transaction went back in the queue or is waiting to.
+ */
+static bool retry_transaction(i2c_bus_t *bus, hal_i2c_txn_t *txn)
+{
+    const hal_i2c_retry_policy_t *policy = txn->retry_policy;
+
+    if (txn->transaction_result != HAL_I2C_TXN_RESULT_FAIL)
+    {
+        return false;
+    }
+
+    // The other controller has had its turn by the time the transaction is loaded again.
+    if (txn->error == HAL_I2C_ERROR_ARBITRATION_LOST && txn->arbitration_requeues < HAL_I2C_ARBITRATION_REQUEUES)
+    {
+        txn->arbitration_requeues++;
+        requeue_transaction(bus, txn);
+        return true;
+    }
+
+    if (!policy || txn->retries >= policy->max_retries || !(policy->retry_on & HAL_I2C_RETRY_ON(txn->error)))
+    {
+        return false;
+    }
+
+    // Back off: delay_ms, then times backoff per retry, up to max_delay_ms.
+    uint32_t delay_ms = policy->delay_ms;
+    if (txn->retries > 0 && policy->backoff > 1)
+    {
+        delay_ms = (txn->retry_delay_ms > UINT32_MAX / policy->backoff) ? UINT32_MAX : txn->retry_delay_ms * policy->backoff;
+    }
+    if (policy->max_delay_ms && delay_ms > policy->max_delay_ms)
+    {
+        delay_ms = policy->max_delay_ms;
+    }
+
+    txn->retries++;
+    txn->retry_delay_ms = delay_ms;
+
+    if (delay_ms == 0)
+    {
+        requeue_transaction(bus, txn);
+    }
+    else
+    {
+        // The servicer is the only user of the waiting list. No atomics are needed.
+        txn->retry_due_tick = hal_get_tick() + delay_ms;
+        txn->next = bus->retries_waiting;
+        bus->retries_waiting = txn;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Put a transaction back in the queue, behind the others of its priority.
+ */
+static void requeue_transaction(i2c_bus_t *bus, hal_i2c_txn_t *txn)
+{
+    // Queue figures count the wait of this attempt only.
+    txn->queued_tick = hal_get_tick();
+    txn->queued_us = hal_get_time_us();
+    (void)i2c_transaction_queue_add(&bus->queue, txn);
+}
+
+/**
+ * @brief Queue every waiting retry whose delay has run out.
+ */
+static void release_due_retries(i2c_bus_t *bus)
+{
+    hal_i2c_txn_t **link = &bus->retries_waiting;
+    uint32_t now = hal_get_tick();
+
+    while (*link)
+    {
+        hal_i2c_txn_t *txn = *link;
+
+        // Signed difference survives tick counter rollover.
+        if ((int32_t)(now - txn->retry_due_tick) >= 0)
+        {
+            *link = txn->next;
+            requeue_transaction(bus, txn);
+        }
+        else
+        {
+            link = &txn->next;
+        }
+    }
+}
+
+/**
+ * @brief Hold a successful transaction back until its target acknowledges again, if asked to.
+ *
+ * @return true if acknowledge polling started.
+ */
+static bool start_ack_poll(i2c_bus_t *bus, const hal_i2c_txn_t *txn)
+{
+    if (txn->ack_poll_timeout_ms == 0 || txn->transaction_result != HAL_I2C_TXN_RESULT_SUCCESS)
+    {
+        return false;
+    }
+
+    bus->ack_polling = true;
+    bus->ack_poll_deadline = hal_get_tick() + txn->ack_poll_timeout_ms;
+
+    return true;
+}
+
+/**
+ * @brief Look at the probe that just finished.
+ *
+ * @return true if polling is over and the transaction complete: the target acknowledged, or
+ * time ran out and the transaction failed.
+ */
+static bool ack_poll_answered(i2c_bus_t *bus, hal_i2c_txn_t *txn)
+{
+    if (bus->error_occurred && (int32_t)(hal_get_tick() - bus->ack_poll_deadline) < 0)
+    {
+        return false;
+    }
+
+    if (bus->error_occurred)
+    {
+        txn->transaction_result = HAL_I2C_TXN_RESULT_FAIL;
+        txn->error = HAL_I2C_ERROR_TIMEOUT;
+    }
+
+    bus->ack_polling = false;
+
+    return true;
+}
+
+/**
+ * @brief Address the target of the transaction with a zero length write. It ACKs once it is ready.
+ */
+static void send_ack_poll(i2c_bus_t *bus, const hal_i2c_txn_t *txn)
+{
+    hal_i2c_segment_t probe = {
+        .direction = HAL_I2C_SEGMENT_WRITE,
+        .data = NULL,
+        .length = 0,
+    };
+    transaction_target(txn, &probe.target_addr, &probe.addr_mode);
+
+    bus->op_segments[0] = probe;
+    bus->segments = bus->op_segments;
+    bus->segment_count = 1;
+    bus->scanning = false;
+    bus->hold_bus = false;
+
+    start_transfer(bus, I2C_TIMEOUT_BASE_MS);
+}
+
+static bool load_new_transaction(i2c_bus_t *bus)
+{
+    // The servicer is the queue's only consumer. No critical section is needed.
+    i2c_queue_status_t queue_status = i2c_transaction_queue_get_next(&bus->queue, &bus->current_i2c_transaction);
+
+    return (I2C_QUEUE_STATUS_SUCCESS == queue_status && bus->current_i2c_transaction);
+}
+
+static void record_queue_latency(i2c_bus_t *bus, const hal_i2c_txn_t *txn)
+{
+    // Unsigned subtraction survives tick counter rollover.
+    uint32_t wait_ms = hal_get_tick() - txn->queued_tick;
+    hal_i2c_queue_latency_t *stats = &bus->queue_latency[txn->priority];
+
+    stats->transactions_loaded++;
+    stats->total_wait_ms += wait_ms;
+    if (wait_ms > stats->max_wait_ms)
+    {
+        stats->max_wait_ms = wait_ms;
+    }
+}
+
+/**
+ * @brief The target a transaction is addressed to. For a SEQUENCE, that of its first segment.
+ */
+static void transaction_target(const hal_i2c_txn_t *txn, uint16_t *target_addr, hal_i2c_addr_mode_t *addr_mode)
+{
+    if (txn->i2c_op == HAL_I2C_OP_SEQUENCE && txn->segments && txn->segment_count)
+    {
+        *target_addr = txn->segments[0].target_addr;
+        *addr_mode = txn->segments[0].addr_mode;
+        return;
+    }
+
+    *target_addr = txn->target_addr;
+    *addr_mode = txn->addr_mode;
+}
+
+static uint16_t metrics_target_addr(const hal_i2c_txn_t *txn)
+{
+    uint16_t target_addr;
+    hal_i2c_addr_mode_t addr_mode;
+
+    transaction_target(txn, &target_addr, &addr_mode);
+
+    return (addr_mode == HAL_I2C_ADDR_10BIT) ? (uint16_t)(target_addr | HAL_I2C_METRICS_ADDR_10BIT) : target_addr;
+}
+
+static hal_i2c_target_metrics_t *find_target_metrics(i2c_bus_t *bus, uint16_t target_addr, bool create)
+{
+    for (size_t i = 0; i < bus->target_metrics_count; i++)
+    {
+        if (bus->target_metrics[i].target_addr == target_addr)
+        {
+            return &bus->target_metrics[i];
+        }
+    }
+
+    if (!create || bus->target_metrics_count == HAL_I2C_METRICS_MAX_TARGETS)
+    {
+        return NULL;
+    }
+
+    hal_i2c_target_metrics_t *metrics = &bus->target_metrics[bus->target_metrics_count++];
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->target_addr = target_addr;
+
+    return metrics;
+}
+
+static void record_target_metrics(i2c_bus_t *bus, const hal_i2c_txn_t *txn, uint32_t bus_us)
+{
+    bus->busy_us += bus_us;
+
+    // A SCAN addresses many targets and belongs to none of them.
+    if (txn->i2c_op == HAL_I2C_OP_SCAN)
+    {
+        return;
+    }
+
+    hal_i2c_target_metrics_t *metrics = find_target_metrics(bus, metrics_target_addr(txn), true);
+    if (!metrics)
+    {
+        bus->untracked_transactions++;
+        return;
+    }
+
+    metrics->transactions++;
+    metrics->total_wait_us += bus->transaction_wait_us;
+    if (bus->transaction_wait_us > metrics->max_wait_us)
+    {
+        metrics->max_wait_us = bus->transaction_wait_us;
+    }
+    metrics->total_bus_us += bus_us;
+    if (bus_us > metrics->max_bus_us)
+    {
+        metrics->max_bus_us = bus_us;
+    }
+    metrics->bytes_transmitted += (uint32_t)txn->actual_bytes_transmitted;
+    metrics->bytes_received += (uint32_t)txn->actual_bytes_received;
+
+    if (txn->transaction_result == HAL_I2C_TXN_RESULT_FAIL)
+    {
+        if (txn->error == HAL_I2C_ERROR_NACK)
+        {
+            metrics->nacks++;
+        }
+        else
+        {
+            metrics->errors++;
+        }
+    }
+}
+
+static void reset_metrics(i2c_bus_t *bus)
+{
+    memset(bus->target_metrics, 0, sizeof(bus->target_metrics));
+    bus->target_metrics_count = 0;
+    bus->untracked_transactions = 0;
+    bus->busy_us = 0;
+    bus->metrics_start_tick = hal_get_tick();
+}
+
+static uint32_t transaction_timeout_ms(i2c_bus_t *bus, const hal_i2c_txn_t *txn)
+{
+    if (txn->timeout_ms)
+    {
+        return txn->timeout_ms;
+    }
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < bus->segment_count; i++)
+    {
+        // Every segment also costs an address byte. A 10-bit address up to three.
+        bytes += bus->segments[i].length + 1;
+        if (bus->segments[i].addr_mode == HAL_I2C_ADDR_10BIT)
+        {
+            bytes += 2;
+        }
+    }
+    if (txn->i2c_op == HAL_I2C_OP_SCAN)
+    {
+        // Every probe after the first.
+        bytes += txn->expected_bytes_to_tx - 1;
+    }
+
+    return I2C_TIMEOUT_BASE_MS + (uint32_t)(bytes / I2C_TIMEOUT_BYTES_PER_MS);
+}
+
+static bool transaction_timed_out(i2c_bus_t *bus)
+{
+    // Unsigned subtraction survives tick counter rollover.
+    return (hal_get_tick() - bus->transaction_start_tick) > bus->transaction_timeout;
+}
+
+static void abort_timed_out_transaction(i2c_bus_t *bus)
+{
+    bus->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+    bus->error_occurred = true;
+    bus->error_cause = HAL_I2C_ERROR_TIMEOUT;
+    bus->tx_in_progress = false;
+    bus->rx_in_progress = false;
+    bus->tx_last_byte_written = false;
+    bus->rx_last_byte_read = false;
+    bus->bus_recovery_needed = true;
+    bus->transaction_end_us = hal_get_time_us();
+}
+
+/**
+ * @brief Free a stuck bus and return the peripheral to a known state.
+ *
+ * A target that was interrupted mid-byte keeps driving SDA low until it has clocked out
+ * the rest of that byte. The pins are taken away from the peripheral and SCL is pulsed by
+ * hand until SDA is released, then a STOP is generated so every target resynchronizes.
+ * Finally the peripheral is software-reset and configured again.
+ *
+ * @note Called with the I2C interrupts disabled.
+ */
+static void recover_bus(i2c_bus_t *bus)
+{
+    GPIO_TypeDef *scl_port = bus->scl.port;
+    GPIO_TypeDef *sda_port = bus->sda.port;
+    uint32_t scl = (1U << bus->scl.pin);
+    uint32_t sda = (1U << bus->sda.pin);
+
+    // Take SCL and SDA away from the peripheral as open-drain outputs, released high.
+    bus->regs->CR1 &= ~I2C_CR1_PE;
+    scl_port->ODR |= scl;
+    sda_port->ODR |= sda;
+    configure_pin(&bus->scl, GPIO_MODE_OUTPUT);
+    configure_pin(&bus->sda, GPIO_MODE_OUTPUT);
+
+    // Clock SCL until the target lets go of SDA.
+    for (size_t i = 0; i < BUS_RECOVERY_SCL_PULSES && !(sda_port->IDR & sda); i++)
+    {
+        scl_port->ODR &= ~scl;
+        bus_recovery_delay();
+        scl_port->ODR |= scl;
+        bus_recovery_delay();
+    }
+
+    // STOP: SDA rises while SCL is high.
+    scl_port->ODR &= ~scl;
+    bus_recovery_delay();
+    sda_port->ODR &= ~sda;
+    bus_recovery_delay();
+    scl_port->ODR |= scl;
+    bus_recovery_delay();
+    sda_port->ODR |= sda;
+    bus_recovery_delay();
+
+    // Give the pins back to the peripheral.
+    configure_gpio(bus);
+
+    // Software reset clears every register, so the peripheral must be configured again.
+    bus->regs->CR1 = I2C_CR1_SWRST;
+    bus->regs->CR1 = 0;
+    configure_peripheral(bus);
+    bus->regs->CR2 |= (I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+    if (bus->smbus)
+    {
+        configure_smbus(bus);
+    }
+}
+
+static void bus_recovery_delay()
+{
+    for (volatile uint32_t i = 0; i < BUS_RECOVERY_DELAY_LOOPS; i++);
+}
+
+/**
+ * @brief Apply the SMBus settings of the bus to CR1.
+ *
+ * The F4 has no PECPOS bit. POS doubles as the PEC position in reception, and the driver keeps it
+ * clear for every PEC checked read, see receive_counted_byte().
+ */
+static void configure_smbus(i2c_bus_t *bus)
+{
+    // The mode bits are only changed with the peripheral off.
+    bus->regs->CR1 &= ~I2C_CR1_PE;
+    bus->regs->CR1 |= (I2C_CR1_SMBUS | I2C_CR1_SMBTYPE);
+    if (bus->smbus_pec)
+    {
+        bus->regs->CR1 |= I2C_CR1_ENPEC;
+    }
+    if (bus->smbus_on_alert)
+    {
+        bus->regs->CR1 |= I2C_CR1_ALERT;
+    }
+    bus->regs->CR1 |= I2C_CR1_PE;
+}
+
+/**
+ * @brief Return the bus to plain I2C. The SMBA pin is left as it is.
+ */
+static void smbus_disable(i2c_bus_t *bus)
+{
+    bus->smbus = false;
+    bus->smbus_pec = false;
+    bus->smbus_on_alert = NULL;
+    bus->smbus_alert_context = NULL;
+
+    bus->regs->CR1 &= ~(I2C_CR1_SMBUS | I2C_CR1_SMBTYPE | I2C_CR1_ENPEC | I2C_CR1_ALERT | I2C_CR1_PEC);
 }
@@ -0,0 +1,366 @@
+/**
+ * @file stm32f4_i2c_target.c
+ * @brief STM32F4 I2C target mode with register map emulation.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+
+#ifdef DESKTOP_BUILD
+#include "registers.h"
+#else
+#include "stm32f4xx.h"
+#endif
+
+#include "hal/i2c.h"
+#include "hal/i2c_target.h"
+#include "stm32f4_i2c_target.h"
+#include "stm32f4_hal.h"
+
+#include <string.h>
+
+#define I2C_ADDRESS_7BIT_MAX 0x7F
+
+// Reference manual: bit 14 of OAR1 must always be kept at 1 by software.
+#define I2C_OAR1_KEEP_SET (1U << 14)
+
+/**
+ * @brief Target mode state of one bus.
+ */
+typedef struct {
+    I2C_TypeDef            *regs;
+    bool                    enabled;
+    hal_i2c_target_config_t config;
+
+    // ISR variables.
+    volatile bool   fresh;            // Published since the last read completed.
+    volatile bool   stretching;       // Holding SCL on a read until the next publish.
+    volatile bool   reading;          // The controller is reading from the map.
+    volatile bool   pointer_received; // The register pointer of the current write has arrived.
+    volatile bool   preloaded;        // DR holds a register the controller has not clocked out yet.
+    volatile size_t pointer;          // Next register to read or write.
+    volatile size_t read_start;       // Pointer at the start of the current read.
+    volatile size_t write_start;      // Pointer at the start of the current write.
+    volatile size_t write_length;     // Registers written by the current write.
+} i2c_target_t;
+
+static i2c_target_t *get_target(hal_i2c_bus_t bus);
+static bool config_is_valid(const hal_i2c_target_config_t *config);
+static void begin_transfer(i2c_target_t *target);
+static void end_of_write(i2c_target_t *target);
+static void end_of_read(i2c_target_t *target);
+static void transmit_byte(i2c_target_t *target);
+static void receive_byte(i2c_target_t *target, uint8_t byte);
+static bool register_is_writable(const i2c_target_t *target, size_t reg);
+
+/* Private variables */
+static i2c_target_t targets[_HAL_I2C_BUS_MAX];
+
+hal_status_t hal_i2c_target_init(hal_i2c_bus_t bus, const hal_i2c_target_config_t *config)
+{
+    i2c_target_t *target = get_target(bus);
+
+    if (!target || !config_is_valid(config))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // Bring the bus up in controller mode first. This also leaves any previous target mode.
+    if (hal_i2c_init(bus) != HAL_STATUS_OK)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    target->regs = i2c_bus_registers(bus);
+    target->config = *config;
+    target->fresh = false;
+    target->stretching = false;
+    target->pointer = 0;
+    begin_transfer(target);
+
+    target->regs->OAR1 = I2C_OAR1_KEEP_SET | ((uint32_t)config->own_address << I2C_OAR1_ADD1_Pos);
+    target->regs->OAR2 = 0;
+    if (config->second_address)
+    {
+        target->regs->OAR2 = I2C_OAR2_ENDUAL | ((uint32_t)config->second_address << I2C_OAR2_ADD2_Pos);
+    }
+
+    if (config->general_call)
+    {
+        target->regs->CR1 |= I2C_CR1_ENGC;
+    }
+
+    // Acknowledge our addresses and every byte written to us. Clock stretching stays enabled.
+    target->regs->CR1 &= ~(I2C_CR1_NOSTRETCH | I2C_CR1_POS);
+    target->regs->CR1 |= I2C_CR1_ACK;
+
+    target->enabled = true;
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_i2c_target_publish(hal_i2c_bus_t bus)
+{
+    i2c_target_t *target = get_target(bus);
+
+    if (!target || !target->enabled)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    CRITICAL_SECTION_ENTER();
+    target->fresh = true;
+    if (target->stretching)
+    {
+        // TXE has been pending since the address. Unmasking it loads the first byte,
+        // which releases SCL.
+        target->stretching = false;
+        target->regs->CR2 |= I2C_CR2_ITBUFEN;
+    }
+    CRITICAL_SECTION_EXIT();
+
+    return HAL_STATUS_OK;
+}
+
+bool i2c_target_is_enabled(hal_i2c_bus_t bus)
+{
+    i2c_target_t *target = get_target(bus);
+    return target && target->enabled;
+}
+
+void i2c_target_disable(hal_i2c_bus_t bus)
+{
+    i2c_target_t *target = get_target(bus);
+
+    if (!target)
+    {
+        return;
+    }
+
+    if (target->enabled)
+    {
+        target->regs->CR1 &= ~(I2C_CR1_ENGC | I2C_CR1_ACK);
+        target->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+        target->regs->OAR1 = I2C_OAR1_KEEP_SET;
+        target->regs->OAR2 = 0;
+    }
+
+    memset(target, 0, sizeof(*target));
+}
+
+bool i2c_target_event_irq(hal_i2c_bus_t bus)
+{
+    i2c_target_t *target = get_target(bus);
+
+    if (!target || !target->enabled)
+    {
+        return false;
+    }
+
+    uint32_t sr1 = target->regs->SR1;
+
+    // ************** ADDRESS Phase **************
+    // One of our addresses matched. Reading SR1 followed by SR2 clears ADDR.
+    // A repeated START lands here too, so close out the write that came before it.
+    // *****************************************
+    if (sr1 & I2C_SR1_ADDR)
+    {
+        uint32_t sr2 = target->regs->SR2;
+
+        end_of_write(target);
+        begin_transfer(target);
+
+        if (sr2 & I2C_SR2_TRA)
+        {
+            target->reading = true;
+            target->read_start = target->pointer;
+
+            if (target->config.stretch_until_published && !target->fresh)
+            {
+                // Leave DR empty. The hardware holds SCL low until the first byte is loaded.
+                target->stretching = true;
+                target->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+            }
+            else
+            {
+                target->regs->CR2 |= I2C_CR2_ITBUFEN;
+            }
+        }
+        else
+        {
+            target->regs->CR2 |= I2C_CR2_ITBUFEN;
+        }
+    }
+
+    // ************** DATA Phase **************
+    // TXE asks for the next byte of a read, RXNE holds the next byte of a write.
+    // BTF is only ever set alongside one of them and is cleared by the same DR access.
+    // *****************************************
+    if ((sr1 & I2C_SR1_TXE) && target->reading && !target->stretching)
+    {
+        transmit_byte(target);
+    }
+
+    if (sr1 & I2C_SR1_RXNE)
+    {
+        receive_byte(target, (uint8_t)target->regs->DR);
+    }
+
+    // ************** STOP Phase **************
+    // Cleared by the SR1 read above followed by a write to CR1.
+    // *****************************************
+    if (sr1 & I2C_SR1_STOPF)
+    {
+        target->regs->CR1 |= I2C_CR1_PE;
+        target->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+
+        if (target->reading)
+        {
+            end_of_read(target);
+        }
+        else
+        {
+            end_of_write(target);
+        }
+    }
+
+    return true;
+}
+
+bool i2c_target_error_irq(hal_i2c_bus_t bus)
+{
+    i2c_target_t *target = get_target(bus);
+
+    if (!target || !target->enabled)
+    {
+        return false;
+    }
+
+    uint32_t sr1 = target->regs->SR1;
+
+    if (sr1 & I2C_SR1_AF)
+    {
+        // The controller NACKs the last byte it wants. This is how every read ends.
+        target->regs->SR1 &= ~I2C_SR1_AF;
+        target->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+
+        if (target->reading)
+        {
+            end_of_read(target);
+        }
+    }
+
+    if (sr1 & I2C_SR1_BERR)
+    {
+        // Misplaced START or STOP. The hardware has already released the lines.
+        // Keep what was written so far and wait for the next address.
+        target->regs->SR1 &= ~I2C_SR1_BERR;
+        target->regs->CR2 &= ~I2C_CR2_ITBUFEN;
+        end_of_write(target);
+        target->reading = false;
+        target->stretching = false;
+    }
+
+    if (sr1 & I2C_SR1_OVR)
+    {
+        // Only possible with clock stretching disabled, which target mode never does.
+        target->regs->SR1 &= ~I2C_SR1_OVR;
+    }
+
+    return true;
+}
+
+static i2c_target_t *get_target(hal_i2c_bus_t bus)
+{
+    return ENUM_IN_RANGE(bus, _HAL_I2C_BUS_MIN, _HAL_I2C_BUS_MAX) ? &targets[bus] : NULL;
+}
+
+static bool config_is_valid(const hal_i2c_target_config_t *config)
+{
+    return (config &&
+            config->registers &&
+            config->register_count > 0 &&
+            config->register_count <= HAL_I2C_TARGET_MAX_REGISTERS &&
+            config->own_address != 0 &&
+            config->own_address <= I2C_ADDRESS_7BIT_MAX &&
+            config->second_address <= I2C_ADDRESS_7BIT_MAX);
+}
+
+static void begin_transfer(i2c_target_t *target)
+{
+    target->reading = false;
+    target->pointer_received = false;
+    target->preloaded = false;
+    target->write_start = target->pointer;
+    target->write_length = 0;
+}
+
+static void end_of_write(i2c_target_t *target)
+{
+    if (target->write_length && target->config.on_write)
+    {
+        target->config.on_write((uint8_t)target->write_start, target->write_length, target->config.context);
+    }
+
+    target->write_length = 0;
+}
+
+static void end_of_read(i2c_target_t *target)
+{
+    // The byte after the last acknowledged one was already loaded into DR and is never sent.
+    // Step back so the next read starts with it.
+    if (target->preloaded && target->pointer > target->read_start)
+    {
+        target->pointer--;
+    }
+
+    target->reading = false;
+    target->stretching = false;
+    target->fresh = false;
+}
+
+static void transmit_byte(i2c_target_t *target)
+{
+    if (target->pointer < target->config.register_count)
+    {
+        target->regs->DR = target->config.registers[target->pointer];
+        target->pointer++;
+        target->preloaded = true;
+    }
+    else
+    {
+        target->preloaded = false;
+        target->regs->DR = HAL_I2C_TARGET_FILL_BYTE;
+    }
+}
+
+static void receive_byte(i2c_target_t *target, uint8_t byte)
+{
+    // The first byte of a write selects the register.
+    if (!target->pointer_received)
+    {
+        target->pointer_received = true;
+        target->pointer = byte;
+        target->write_start = byte;
+        return;
+    }
+
+    // Bytes past the end of the map are acknowledged and dropped.
+    if (target->pointer >= target->config.register_count)
+    {
+        return;
+    }
+
+    if (register_is_writable(target, target->pointer))
+    {
+        target->config.registers[target->pointer] = byte;
+    }
+
+    target->pointer++;
+    target->write_length++;
+}
+
+static bool register_is_writable(const i2c_target_t *target, size_t reg)
+{
+    return !target->config.writable || ((target->config.writable[reg / 8] >> (reg % 8)) & 1U);
+}
@@ -0,0 +1,80 @@
+/**
+ * @file systick_periodic.h
+ *
+ * @brief Shared scheduling for the engines that run a job per client at the client's own period.
+ *
+ * Each engine keeps a table of clients. One 1 ms SysTick timer serves every table: it counts
+ * each client down and calls the table's engine when the client is due. The timer is
+ * registered with the first client of any table and released with the last.
+ *
+ * @code
+ * static periodic_slot_t sampler_slots[HAL_I2C_SAMPLER_MAX_CLIENTS];
+ * static periodic_table_t samplers = PERIODIC_TABLE(sampler_slots, sample_due);
+ * @endcode
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _SYSTICK_PERIODIC_H
+#define _SYSTICK_PERIODIC_H
+
+#include "hal/hal_types.h"
+#include "stm32f4_hal.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Called for a client that is due. Runs in the SysTick interrupt.
+ */
+typedef void (*periodic_due_t)(void *client);
+
+/**
+ * @brief One client of a table.
+ */
+typedef struct {
+    void *volatile client; /*!< NULL for a free slot. */
+    uint32_t period_ms;    /*!< Time between calls. */
+    uint32_t remaining_ms; /*!< Time until the next call. */
+} periodic_slot_t;
+
+/**
+ * @brief The clients of one engine. Static storage, set up with @ref PERIODIC_TABLE.
+ */
+typedef struct periodic_table {
+    periodic_slot_t *slots;      /*!< Client storage. */
+    size_t capacity;             /*!< Entries in slots. */
+    periodic_due_t due;          /*!< The engine's job. */
+    struct periodic_table *next; /*!< Tables the tick walks, linked on first use. */
+    bool linked;                 /*!< True once the tick knows the table. */
+} periodic_table_t;
+
+/**
+ * @brief Initializer of a table over a static slot array.
+ */
+#define PERIODIC_TABLE(slot_array, due_fn) { (slot_array), ARRAY_SIZE(slot_array), (due_fn), NULL, false }
+
+/**
+ * @brief Check if a client is in a table.
+ */
+bool periodic_contains(const periodic_table_t *table, const void *client);
+
+/**
+ * @brief Start calling the table's engine for client every period_ms. The first call is period_ms away.
+ *
+ * @return @ref HAL_STATUS_OK on success, @ref HAL_STATUS_ERROR on bad arguments, if client is
+ * already in the table, the table is full or no SysTick timer is free.
+ */
+hal_status_t periodic_add(periodic_table_t *table, void *client, uint32_t period_ms);
+
+/**
+ * @brief Stop calling the table's engine for client. No-op if client is not in the table.
+ */
+void periodic_remove(periodic_table_t *table, const void *client);
+
+/// @brief Just for testing. Forgets the clients of every table, for the engines' own fixtures.
+/// @warning Grave consequences if used in production code.
+void _test_fixture_systick_periodic_reset_internals(void);
+
+#endif /* _SYSTICK_PERIODIC_H */
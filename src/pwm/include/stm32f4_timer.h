@@ -0,0 +1,66 @@
+/**
+ * @file stm32f4_timer.h
+ *
+ * @brief Glue between the PWM driver and the other users of the timers.
+ *
+ * The PWM driver owns the timer descriptors: registers, clocks and channel pins. Input capture
+ * and the encoder interface borrow a timer through the functions below. A timer does one of
+ * these jobs at a time: the driver records who has borrowed it and turns everyone else away
+ * until it is released.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _STM32F4_TIMER_H
+#define _STM32F4_TIMER_H
+
+// Expects the device header (or registers.h on desktop) to be included first.
+#include "hal/pwm.h"
+
+#include <stdint.h>
+
+/**
+ * @brief Who has borrowed a timer from the PWM driver.
+ */
+typedef enum {
+  PWM_TIMER_OWNER_NONE,    /*!< Not borrowed. The timer generates PWM. */
+  PWM_TIMER_OWNER_CAPTURE, /*!< Measuring an input, see capture.h. */
+  PWM_TIMER_OWNER_ENCODER, /*!< Decoding an encoder, see encoder.h. */
+} pwm_timer_owner_t;
+
+/**
+ * @brief Get the registers of a timer. Provided by the PWM driver.
+ *
+ * @return The peripheral registers, or NULL if timer is out of range.
+ */
+TIM_TypeDef *pwm_timer_registers(hal_pwm_timer_t timer);
+
+/**
+ * @brief The clock the timer counts before its prescaler, from the current RCC configuration.
+ *
+ * @return The clock in Hz, or 0 if timer is out of range.
+ */
+uint32_t pwm_timer_clock_hz(hal_pwm_timer_t timer);
+
+/**
+ * @brief Largest value ARR and CCRx can hold: 0xFFFF, or 0xFFFFFFFF on TIM2 and TIM5.
+ *
+ * @return The maximum, or 0 if timer is out of range.
+ */
+uint32_t pwm_timer_arr_max(hal_pwm_timer_t timer);
+
+/**
+ * @brief Borrow a timer for owner, clock it and route one channel pin to it as an input.
+ * The channel stops being a PWM output. An owner may connect more channels of a timer it holds.
+ *
+ * @return HAL_STATUS_BUSY if the waveform stream or another owner has the timer,
+ *         HAL_STATUS_ERROR if out of range.
+ */
+hal_status_t pwm_timer_connect_input(hal_pwm_timer_t timer, hal_pwm_channel_t channel, pwm_timer_owner_t owner);
+
+/**
+ * @brief Give a timer back to the PWM driver. No-op unless owner holds it.
+ */
+void pwm_timer_release(hal_pwm_timer_t timer, pwm_timer_owner_t owner);
+
+#endif /* _STM32F4_TIMER_H */
@@ -0,0 +1,447 @@
+/**
+ * @file stm32f4_capture.c
+ * @brief STM32F4 implementation of input capture.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#include "hal/capture.h"
+#include "stm32f4_hal.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef DESKTOP_BUILD
+#include "registers.h"
+#else
+#include "stm32f4xx.h"
+#endif
+
+#include "stm32f4_timer.h"
+
+/// @brief PSC is 16 bits on every timer.
+#define PSC_SPAN 0x10000u
+
+/// @brief CCxS: IC1 mapped on TI1, IC2 mapped on TI1 (the indirect input).
+#define CC1S_TI1 0b01u
+#define CC2S_TI1 0b10u
+
+/// @brief SMCR.TS: filtered timer input 1 (TI1FP1) as trigger.
+#define TS_TI1FP1 0b101u
+/// @brief SMCR.SMS: reset mode. The trigger clears the counter.
+#define SMS_RESET 0b100u
+
+/// @brief FEIF, DMEIF, TEIF, HTIF and TCIF of one stream, before shifting into place.
+#define DMA_STREAM_FLAGS 0x3Du
+/// @brief TCIF, before shifting into place. Set each time the ring wraps.
+#define DMA_STREAM_TCIF  0x20u
+
+/**
+ * @brief The DMA stream that serves CH1 captures of a timer.
+ */
+typedef struct {
+    DMA_TypeDef        *dma;
+    DMA_Stream_TypeDef *stream;
+    uint32_t            clock_enable; // RCC AHB1ENR bit of the DMA.
+    uint32_t            channel;      // CHSEL of the request.
+    uint32_t            number;       // Stream number, locates the flags in LISR/HISR.
+} capture_dma_t;
+
+/**
+ * @brief How far a PWM input measurement is, see read_pwm_input().
+ */
+typedef enum {
+    CAPTURE_WAITING,    // Nothing captured since the start or the last timeout.
+    CAPTURE_FIRST_EDGE, // CCR1 holds the time to the first edge. Discarded.
+    CAPTURE_VALID,      // CCR1 and CCR2 hold a whole period.
+} capture_state_t;
+
+typedef struct {
+    // Hardware description. Fixed at compile time.
+    capture_dma_t dma;
+
+    // State.
+    bool               active;
+    hal_capture_mode_t mode;
+    capture_state_t    state;    // PWM input only.
+    uint32_t          *buffer;   // Periods only.
+    size_t             length;
+} capture_t;
+
+static capture_t captures[_HAL_PWM_TIMER_MAX] = {
+    [HAL_PWM_TIM1] = { .dma = { .dma = DMA2, .stream = DMA2_Stream1, .clock_enable = RCC_AHB1ENR_DMA2EN, .channel = 6, .number = 1 } },
+    [HAL_PWM_TIM2] = { .dma = { .dma = DMA1, .stream = DMA1_Stream5, .clock_enable = RCC_AHB1ENR_DMA1EN, .channel = 3, .number = 5 } },
+    [HAL_PWM_TIM3] = { .dma = { .dma = DMA1, .stream = DMA1_Stream4, .clock_enable = RCC_AHB1ENR_DMA1EN, .channel = 5, .number = 4 } },
+    [HAL_PWM_TIM4] = { .dma = { .dma = DMA1, .stream = DMA1_Stream0, .clock_enable = RCC_AHB1ENR_DMA1EN, .channel = 2, .number = 0 } },
+    [HAL_PWM_TIM5] = { .dma = { .dma = DMA1, .stream = DMA1_Stream2, .clock_enable = RCC_AHB1ENR_DMA1EN, .channel = 6, .number = 2 } },
+    [HAL_PWM_TIM8] = { .dma = { .dma = DMA2, .stream = DMA2_Stream2, .clock_enable = RCC_AHB1ENR_DMA2EN, .channel = 7, .number = 2 } },
+};
+
+static capture_t *get_capture(hal_pwm_timer_t timer);
+static bool config_is_valid(const hal_capture_config_t *config);
+static uint32_t dma_flag_shift(const capture_dma_t *d);
+static void dma_stop(const capture_dma_t *d);
+static void ring_restart(capture_t *c, TIM_TypeDef *regs);
+static hal_status_t read_pwm_input(capture_t *c, TIM_TypeDef *regs, uint32_t clock_hz, hal_capture_result_t *result);
+static hal_status_t read_periods(capture_t *c, TIM_TypeDef *regs, uint32_t clock_hz, hal_capture_result_t *result);
+static uint64_t to_millihz(uint32_t clock_hz, uint32_t psc, uint64_t periods, uint64_t ticks);
+
+/*********************************************************************************************/
+// Public Functions
+/*********************************************************************************************/
+
+hal_status_t hal_capture_start(hal_pwm_timer_t timer, const hal_capture_config_t *config)
+{
+    capture_t *c = get_capture(timer);
+
+    if (!c || !config_is_valid(config))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // The slowest period must fit in the counter: psc + 1 = ceil(clock / min_frequency / span).
+    uint64_t span  = (uint64_t)pwm_timer_arr_max(timer) + 1u;
+    uint64_t ticks = ((uint64_t)pwm_timer_clock_hz(timer) + config->min_frequency_hz - 1u) / config->min_frequency_hz;
+    uint64_t psc   = (ticks + span - 1u) / span;
+
+    if (psc > PSC_SPAN)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    psc = psc ? psc - 1u : 0u;
+
+    // A running measurement is stopped and the timer borrowed again.
+    hal_capture_stop(timer);
+
+    hal_status_t status = pwm_timer_connect_input(timer, HAL_PWM_CH1, PWM_TIMER_OWNER_CAPTURE);
+    if (status != HAL_STATUS_OK)
+    {
+        return status;
+    }
+
+    TIM_TypeDef *regs = pwm_timer_registers(timer);
+
+    c->mode   = config->mode;
+    c->state  = CAPTURE_WAITING;
+    c->buffer = config->buffer;
+    c->length = config->length;
+
+    regs->PSC = (uint32_t)psc;
+    regs->ARR = pwm_timer_arr_max(timer);
+
+    // CC1 captures the edge that starts a period. In PWM input mode CC2 captures the opposite
+    // edge from the same pin, the end of the pulse.
+    uint32_t filter  = config->filter;
+    uint32_t ccmr1   = (CC1S_TI1 << TIM_CCMR1_CC1S_Pos) | (filter << TIM_CCMR1_IC1F_Pos);
+    uint32_t ccer    = TIM_CCER_CC1E;
+    bool     falling = (config->polarity == HAL_CAPTURE_FALLING);
+
+    if (config->mode == HAL_CAPTURE_PWM_INPUT)
+    {
+        ccmr1 |= (CC2S_TI1 << TIM_CCMR1_CC2S_Pos) | (filter << TIM_CCMR1_IC2F_Pos);
+        ccer  |= TIM_CCER_CC2E | (falling ? 0u : TIM_CCER_CC2P);
+    }
+    else
+    {
+        ccmr1 |= ((uint32_t)config->prescaler << TIM_CCMR1_IC1PSC_Pos);
+    }
+
+    regs->CCMR1 = ccmr1;
+    regs->CCER  = ccer | (falling ? TIM_CCER_CC1P : 0u);
+
+    // The edge that latches CCR1 also clears the counter, so CCR1 is the period itself.
+    regs->SMCR = (TS_TI1FP1 << TIM_SMCR_TS_Pos) | (SMS_RESET << TIM_SMCR_SMS_Pos);
+
+    // URS: only an overflow sets UIF, not the resets. An overflow means no edge for a whole
+    // counter span, the input is slower than min_frequency_hz or gone.
+    regs->CR1  = TIM_CR1_URS;
+    regs->DIER = 0;
+    regs->EGR  = TIM_EGR_UG;
+
+    if (config->mode == HAL_CAPTURE_PERIODS)
+    {
+        ring_restart(c, regs);
+
+        // CC1DE: every capture becomes a DMA request. From here on the DMA does all the work.
+        regs->DIER = TIM_DIER_CC1DE;
+    }
+
+    regs->SR = 0;
+    c->active = true;
+
+    regs->CR1 |= TIM_CR1_CEN;
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_capture_read(hal_pwm_timer_t timer, hal_capture_result_t *result)
+{
+    capture_t *c = get_capture(timer);
+
+    if (!c || !c->active || !result)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    TIM_TypeDef *regs = pwm_timer_registers(timer);
+
+    if (regs->SR & TIM_SR_UIF)
+    {
+        // Whatever is latched now spans an overflow. Start over from the next edge.
+        regs->SR = (uint32_t)~(TIM_SR_UIF | TIM_SR_CC1IF | TIM_SR_CC1OF | TIM_SR_CC2IF | TIM_SR_CC2OF);
+        c->state = CAPTURE_WAITING;
+
+        if (c->mode == HAL_CAPTURE_PERIODS)
+        {
+            ring_restart(c, regs);
+        }
+
+        return HAL_STATUS_TIMEOUT;
+    }
+
+    uint32_t clock_hz = pwm_timer_clock_hz(timer);
+
+    *result = (hal_capture_result_t){ 0 };
+    result->tick_hz = clock_hz / (regs->PSC + 1u);
+
+    if (c->mode == HAL_CAPTURE_PWM_INPUT)
+    {
+        return read_pwm_input(c, regs, clock_hz, result);
+    }
+
+    return read_periods(c, regs, clock_hz, result);
+}
+
+hal_status_t hal_capture_stop(hal_pwm_timer_t timer)
+{
+    capture_t *c = get_capture(timer);
+
+    if (!c)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // Leave a timer generating PWM alone.
+    if (!c->active)
+    {
+        return HAL_STATUS_OK;
+    }
+
+    TIM_TypeDef *regs = pwm_timer_registers(timer);
+
+    regs->CR1   = 0;
+    regs->DIER  = 0;
+    regs->SMCR  = 0;
+    regs->CCER  = 0;
+    regs->CCMR1 = 0;
+    regs->SR    = 0;
+
+    if (c->mode == HAL_CAPTURE_PERIODS)
+    {
+        dma_stop(&c->dma);
+    }
+
+    c->active = false;
+    pwm_timer_release(timer, PWM_TIMER_OWNER_CAPTURE);
+
+    return HAL_STATUS_OK;
+}
+
+/// @brief Just for testing.
+/// @warning Grave consequences if used in production code.
+void _test_fixture_hal_capture_reset_internals()
+{
+    for (int t = 0; t < _HAL_PWM_TIMER_MAX; t++)
+    {
+        captures[t].active = false;
+        captures[t].state  = CAPTURE_WAITING;
+        captures[t].buffer = NULL;
+        captures[t].length = 0;
+    }
+}
+
+/*********************************************************************************************/
+// Private Functions
+/*********************************************************************************************/
+
+static capture_t *get_capture(hal_pwm_timer_t timer)
+{
+    return ENUM_IN_RANGE(timer, _HAL_PWM_TIMER_MIN, _HAL_PWM_TIMER_MAX) ? &captures[timer] : NULL;
+}
+
+static bool config_is_valid(const hal_capture_config_t *config)
+{
+    if (!config || !ENUM_IN_RANGE(config->mode, _HAL_CAPTURE_MODE_MIN, _HAL_CAPTURE_MODE_MAX) ||
+        !ENUM_IN_RANGE(config->polarity, _HAL_CAPTURE_POLARITY_MIN, _HAL_CAPTURE_POLARITY_MAX) ||
+        !ENUM_IN_RANGE(config->prescaler, _HAL_CAPTURE_PRESCALER_MIN, _HAL_CAPTURE_PRESCALER_MAX))
+    {
+        return false;
+    }
+
+    if (config->filter > HAL_CAPTURE_FILTER_MAX || config->min_frequency_hz == 0)
+    {
+        return false;
+    }
+
+    if (config->mode == HAL_CAPTURE_PWM_INPUT)
+    {
+        // Skipping edges would leave CCR2 from a different period than CCR1.
+        return config->prescaler == HAL_CAPTURE_EVERY_PERIOD;
+    }
+
+    return config->buffer && config->length >= 2u && config->length <= HAL_CAPTURE_MAX_LENGTH;
+}
+
+/**
+ * @brief Position of a stream's flags in LISR/LIFCR (streams 0-3) or HISR/HIFCR (streams 4-7).
+ */
+static uint32_t dma_flag_shift(const capture_dma_t *d)
+{
+    static const uint8_t shifts[4] = { 0u, 6u, 16u, 22u };
+    return shifts[d->number % 4u];
+}
+
+static void dma_stop(const capture_dma_t *d)
+{
+    d->stream->CR &= ~DMA_SxCR_EN;
+    while (d->stream->CR & DMA_SxCR_EN)
+    {
+    }
+
+    if (d->number < 4u)
+    {
+        d->dma->LIFCR = DMA_STREAM_FLAGS << dma_flag_shift(d);
+    }
+    else
+    {
+        d->dma->HIFCR = DMA_STREAM_FLAGS << dma_flag_shift(d);
+    }
+}
+
+/**
+ * @brief (Re)start the DMA from the top of the ring. Entry 0 will hold the time to the first edge.
+ */
+static void ring_restart(capture_t *c, TIM_TypeDef *regs)
+{
+    const capture_dma_t *d = &c->dma;
+
+    RCC->AHB1ENR |= d->clock_enable;
+
+    // The stream must be off before it can be reprogrammed.
+    dma_stop(d);
+
+    // Peripheral to memory, words on both sides so CCR1 of the 32-bit timers fits. Circular,
+    // and no interrupts: the ring simply keeps the latest periods.
+    d->stream->PAR  = (uint32_t)(uintptr_t)&regs->CCR1;
+    d->stream->M0AR = (uint32_t)(uintptr_t)c->buffer;
+    d->stream->NDTR = (uint32_t)c->length;
+    d->stream->FCR  = 0;
+    d->stream->CR   = (d->channel << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1 | DMA_SxCR_MINC |
+                      DMA_SxCR_CIRC;
+    d->stream->CR  |= DMA_SxCR_EN;
+}
+
+/**
+ * @brief CCR1 holds the last period and CCR2 the pulse within it, once two edges have been seen.
+ */
+static hal_status_t read_pwm_input(capture_t *c, TIM_TypeDef *regs, uint32_t clock_hz, hal_capture_result_t *result)
+{
+    uint32_t sr = regs->SR;
+
+    if (c->state != CAPTURE_VALID)
+    {
+        if (sr & TIM_SR_CC1OF)
+        {
+            // Overcapture: at least two edges since the start, so CCR1 has been overwritten
+            // with a whole period.
+            regs->SR = (uint32_t)~TIM_SR_CC1OF;
+            c->state = CAPTURE_VALID;
+        }
+        else if ((sr & TIM_SR_CC1IF) && c->state == CAPTURE_FIRST_EDGE)
+        {
+            c->state = CAPTURE_VALID;
+        }
+        else if (sr & TIM_SR_CC1IF)
+        {
+            // Reading CCR1 clears CC1IF, so the next capture can be told apart.
+            (void)regs->CCR1;
+            c->state = CAPTURE_FIRST_EDGE;
+            return HAL_STATUS_BUSY;
+        }
+        else
+        {
+            return HAL_STATUS_BUSY;
+        }
+    }
+
+    uint32_t pulse  = regs->CCR2;
+    uint32_t period = regs->CCR1;
+
+    if (period == 0u)
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    // The pulse may be from the period before if the edge falls between the two reads.
+    pulse = (pulse > period) ? period : pulse;
+
+    uint64_t duty = ((uint64_t)pulse << 16) / period;
+
+    result->period_ticks      = period;
+    result->pulse_ticks       = pulse;
+    result->duty_q16          = (uint16_t)((duty > 0xFFFFu) ? 0xFFFFu : duty);
+    result->frequency_millihz = to_millihz(clock_hz, regs->PSC, 1u, period);
+    result->periods           = 1u;
+
+    return HAL_STATUS_OK;
+}
+
+/**
+ * @brief Averages the periods in the ring, without the one the DMA is about to overwrite.
+ */
+static hal_status_t read_periods(capture_t *c, TIM_TypeDef *regs, uint32_t clock_hz, hal_capture_result_t *result)
+{
+    const capture_dma_t *d = &c->dma;
+
+    // NDTR counts down to the end of the ring and reloads.
+    size_t   next  = (c->length - d->stream->NDTR) % c->length;
+    uint32_t flags = (d->number < 4u) ? d->dma->LISR : d->dma->HISR;
+    bool     full  = (flags >> dma_flag_shift(d)) & DMA_STREAM_TCIF;
+
+    // Until the ring wraps for the first time, entry 0 is the time to the first edge.
+    size_t first = full ? (next + 1u) % c->length : 1u;
+    size_t count = full ? c->length - 1u : ((next > 1u) ? next - 1u : 0u);
+
+    if (count == 0u)
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += c->buffer[(first + i) % c->length];
+    }
+
+    if (sum == 0u)
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    result->period_ticks      = (uint32_t)((sum + count / 2u) / count);
+    result->frequency_millihz = to_millihz(clock_hz, regs->PSC, count, sum);
+    result->periods           = count;
+
+    return HAL_STATUS_OK;
+}
+
+/**
+ * @brief periods / (ticks x (psc + 1) / clock) in mHz, rounded. Every term fits in 64 bits.
+ */
+static uint64_t to_millihz(uint32_t clock_hz, uint32_t psc, uint64_t periods, uint64_t ticks)
+{
+    uint64_t divider = ticks * (psc + 1u);
+    return ((uint64_t)clock_hz * 1000u * periods + divider / 2u) / divider;
+}
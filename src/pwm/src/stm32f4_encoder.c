@@ -0,0 +1,267 @@
+/**
+ * @file stm32f4_encoder.c
+ * @brief STM32F4 implementation of the quadrature encoder interface.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#include "hal/encoder.h"
+#include "stm32f4_hal.h"
+#include "systick_periodic.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef DESKTOP_BUILD
+#include "registers.h"
+#else
+#include "stm32f4xx.h"
+#endif
+
+#include "stm32f4_timer.h"
+
+/// @brief CCxS: IC1 mapped on TI1, IC2 mapped on TI2.
+#define CC1S_TI1 0b01u
+#define CC2S_TI2 0b01u
+
+/// @brief SMCR.SMS of HAL_ENCODER_COUNT_TI1. The other modes follow.
+#define SMS_ENCODER_MODE_1 0b001u
+
+typedef struct {
+    bool     active;
+    hal_pwm_timer_t timer;
+    uint32_t arr_max;          // Counter width, for the wrap-around of the differences.
+    uint32_t period_ms;
+
+    // Written by the snapshot interrupt, read under a critical section.
+    uint32_t last_count;       // CNT at the last snapshot.
+    int64_t  position;         // Position at the last snapshot.
+    int32_t  velocity_cps;
+    uint32_t snapshots;
+} encoder_t;
+
+static encoder_t *get_encoder(hal_pwm_timer_t timer);
+static bool config_is_valid(const hal_encoder_config_t *config);
+static int64_t count_difference(const encoder_t *e, uint32_t count);
+static void disconnect(hal_pwm_timer_t timer);
+static void snapshot_due(void *client);
+
+static encoder_t encoders[_HAL_PWM_TIMER_MAX];
+static periodic_slot_t encoder_slots[_HAL_PWM_TIMER_MAX];
+static periodic_table_t snapshots = PERIODIC_TABLE(encoder_slots, snapshot_due);
+
+/*********************************************************************************************/
+// Public Functions
+/*********************************************************************************************/
+
+hal_status_t hal_encoder_start(hal_pwm_timer_t timer, const hal_encoder_config_t *config)
+{
+    encoder_t *e = get_encoder(timer);
+
+    if (!e || !config_is_valid(config))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    hal_status_t status = pwm_timer_connect_input(timer, HAL_PWM_CH1, PWM_TIMER_OWNER_ENCODER);
+    if (status == HAL_STATUS_OK)
+    {
+        status = pwm_timer_connect_input(timer, HAL_PWM_CH2, PWM_TIMER_OWNER_ENCODER);
+    }
+
+    if (status != HAL_STATUS_OK)
+    {
+        return status;
+    }
+
+    CRITICAL_SECTION_ENTER();
+    e->active = false;
+    CRITICAL_SECTION_EXIT();
+
+    // A restart takes a new period, which starts counting now.
+    periodic_remove(&snapshots, e);
+    if (periodic_add(&snapshots, e, config->sample_period_ms) != HAL_STATUS_OK)
+    {
+        disconnect(timer);
+        return HAL_STATUS_ERROR;
+    }
+
+    TIM_TypeDef *regs = pwm_timer_registers(timer);
+
+    regs->CR1  = 0;
+    regs->DIER = 0;
+    regs->PSC  = 0;
+    regs->ARR  = pwm_timer_arr_max(timer);
+
+    // A on TI1 and B on TI2, both filtered. CC1P inverts A, which reverses the direction.
+    uint32_t filter = config->filter;
+    regs->CCMR1 = (CC1S_TI1 << TIM_CCMR1_CC1S_Pos) | (filter << TIM_CCMR1_IC1F_Pos) |
+                  (CC2S_TI2 << TIM_CCMR1_CC2S_Pos) | (filter << TIM_CCMR1_IC2F_Pos);
+    regs->CCER  = config->reverse ? TIM_CCER_CC1P : 0u;
+
+    // The encoder interface is the clock of the counter and sets its direction.
+    regs->SMCR = ((SMS_ENCODER_MODE_1 + (uint32_t)config->mode) << TIM_SMCR_SMS_Pos);
+
+    regs->EGR = TIM_EGR_UG;
+    regs->CNT = 0;
+    regs->SR  = 0;
+
+    e->timer        = timer;
+    e->arr_max      = pwm_timer_arr_max(timer);
+    e->period_ms    = config->sample_period_ms;
+    e->last_count   = 0;
+    e->position     = 0;
+    e->velocity_cps = 0;
+    e->snapshots    = 0;
+
+    regs->CR1 = TIM_CR1_CEN;
+
+    CRITICAL_SECTION_ENTER();
+    e->active = true;
+    CRITICAL_SECTION_EXIT();
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_encoder_read(hal_pwm_timer_t timer, hal_encoder_reading_t *reading)
+{
+    encoder_t *e = get_encoder(timer);
+
+    if (!e || !e->active || !reading)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    TIM_TypeDef *regs = pwm_timer_registers(timer);
+
+    CRITICAL_SECTION_ENTER();
+    reading->position     = e->position + count_difference(e, regs->CNT);
+    reading->velocity_cps = e->velocity_cps;
+    reading->snapshots    = e->snapshots;
+    CRITICAL_SECTION_EXIT();
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_encoder_set_position(hal_pwm_timer_t timer, int64_t position)
+{
+    encoder_t *e = get_encoder(timer);
+
+    if (!e || !e->active)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    TIM_TypeDef *regs = pwm_timer_registers(timer);
+
+    // The counter keeps running. Only the reference it is measured from moves.
+    CRITICAL_SECTION_ENTER();
+    e->last_count = regs->CNT;
+    e->position   = position;
+    CRITICAL_SECTION_EXIT();
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_encoder_stop(hal_pwm_timer_t timer)
+{
+    encoder_t *e = get_encoder(timer);
+
+    if (!e)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // Leave a timer doing something else alone.
+    if (!e->active)
+    {
+        return HAL_STATUS_OK;
+    }
+
+    CRITICAL_SECTION_ENTER();
+    e->active = false;
+    CRITICAL_SECTION_EXIT();
+
+    periodic_remove(&snapshots, e);
+    disconnect(timer);
+
+    return HAL_STATUS_OK;
+}
+
+/// @brief Just for testing.
+/// @warning Grave consequences if used in production code.
+void _test_fixture_hal_encoder_reset_internals()
+{
+    for (int t = 0; t < _HAL_PWM_TIMER_MAX; t++)
+    {
+        encoders[t] = (encoder_t){ 0 };
+    }
+    _test_fixture_systick_periodic_reset_internals();
+}
+
+/*********************************************************************************************/
+// Private Functions
+/*********************************************************************************************/
+
+static encoder_t *get_encoder(hal_pwm_timer_t timer)
+{
+    return ENUM_IN_RANGE(timer, _HAL_PWM_TIMER_MIN, _HAL_PWM_TIMER_MAX) ? &encoders[timer] : NULL;
+}
+
+static bool config_is_valid(const hal_encoder_config_t *config)
+{
+    return config && ENUM_IN_RANGE(config->mode, _HAL_ENCODER_MODE_MIN, _HAL_ENCODER_MODE_MAX) &&
+           config->filter <= HAL_ENCODER_FILTER_MAX && config->sample_period_ms != 0;
+}
+
+/**
+ * @brief Signed counts from the last snapshot to count, the shorter way around the counter.
+ */
+static int64_t count_difference(const encoder_t *e, uint32_t count)
+{
+    uint32_t difference = count - e->last_count;
+
+    if (e->arr_max == 0xFFFFu)
+    {
+        return (int16_t)(uint16_t)difference;
+    }
+
+    return (int32_t)difference;
+}
+
+/**
+ * @brief Stops the counter and gives the timer back.
+ */
+static void disconnect(hal_pwm_timer_t timer)
+{
+    TIM_TypeDef *regs = pwm_timer_registers(timer);
+
+    regs->CR1   = 0;
+    regs->SMCR  = 0;
+    regs->CCER  = 0;
+    regs->CCMR1 = 0;
+    regs->SR    = 0;
+
+    pwm_timer_release(timer, PWM_TIMER_OWNER_ENCODER);
+}
+
+/// @brief Periodic table callback. Runs in the SysTick interrupt when a snapshot is due.
+static void snapshot_due(void *client)
+{
+    encoder_t *e = (encoder_t *)client;
+
+    // Still being set up by hal_encoder_start().
+    if (!e->active)
+    {
+        return;
+    }
+
+    uint32_t count = pwm_timer_registers(e->timer)->CNT;
+    int64_t  moved = count_difference(e, count);
+
+    e->last_count   = count;
+    e->position    += moved;
+    e->velocity_cps = (int32_t)(moved * 1000 / (int64_t)e->period_ms);
+    e->snapshots++;
+}
@@ -9,6 +9,8 @@
 #include "stm32f4_hal.h"
 
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef DESKTOP_BUILD
 #include "registers.h"
@@ -17,69 +19,316 @@
 #include "stm32f4xx.h"
 #endif
 
-// @todo Calculate this smartly starting from SYSCLK
-#define TIM1_FREQ_HZ 16000000
+#include "stm32f4_timer.h"
+
+/*********************************************************************************************/
+// Clock tree: SYSCLK -> AHB prescaler -> APBx prescaler -> timer clock
+/*********************************************************************************************/
+/// @brief Internal RC oscillator, the clock after reset.
+#define HSI_CLOCK_HZ 16000000u
+/// @brief External clock. The ST-LINK of the Nucleo boards drives 8 MHz into OSC_IN.
+#define HSE_CLOCK_HZ 8000000u
 
 /*********************************************************************************************/
 // Common Output Compare Modes used to configure the pin's behavior when counting events occur.
 /*********************************************************************************************/
 /// @brief PWM Mode 1: In upcounting, channel is active as long as CNT<CCR else inactive. Classic PWM.
 #define OC_MODE_PWM_1       0b110u
+/// @brief PWM Mode 2: Channel is inactive as long as CNT<CCR else active. Used for the ADC trigger.
+#define OC_MODE_PWM_2       0b111u
 /// @brief Forced low: Output pin forced low. (0% duty cycle)
 #define OC_MODE_FORCED_LOW  0b100u
 /// @brief Forced high: Output pin forced high (100% duty cycle)
 #define OC_MODE_FORCED_HIGH 0b101u
 
-// Per-channel enabled state. Indexed by hal_pwm_channel_t (CH1=0 ... CH4=3).
-static bool pwm_channel_enabled[4] = { false, false, false, false };
-static_assert(ARRAY_SIZE(pwm_channel_enabled) == _HAL_PWM_CH_MAX, "The size of channels enabled does not match number of channels");
+/*********************************************************************************************/
+// Complementary outputs and break input
+/*********************************************************************************************/
+#define GPIO_MODE_WIDTH 2u
+#define GPIO_MODE_MASK  0x3u
+#define GPIO_MODE_AF    0x2u
+/// @brief Alternate functions of the timers. TIM1/TIM2 on AF1, TIM3-TIM5 on AF2, TIM8 on AF3.
+#define AF_TIM1_TIM2    1u
+#define AF_TIM3_TIM5    2u
+#define AF_TIM8         3u
+/// @brief CH1N-CH3N on PB13-PB15.
+#define CHN_FIRST_PIN   13u
+/// @brief BKIN on PA6.
+#define BKIN_PIN        6u
+/// @brief Largest dead-time the generator can express, in dead-time clock ticks (DTG = 0xFF).
+#define DEAD_TIME_MAX_TICKS 1008u
+/// @brief Highest clock division (CKD = 0b10, tDTS = 4 x tCK_INT).
+#define CKD_MAX         2u
+
+static hal_pwm_break_callback_t break_callback = NULL;
+static void *break_context = NULL;
+
+/*********************************************************************************************/
+// Alignment and trigger output
+/*********************************************************************************************/
+/// @brief MMS: TRGO source. Reset (UG only), update event, or OC4REF.
+#define MMS_RESET  0b000u
+#define MMS_UPDATE 0b010u
+#define MMS_OC4REF 0b111u
+
+// CH4 of TIM1 drives TRGO through OC4REF and is not available as an output.
+static bool ch4_is_trigger = false;
+static uint16_t trigger_point = 0;
+
+/*********************************************************************************************/
+// Ramps: the TIM1 update interrupt steps each ramping channel every ramp_divider update events
+/*********************************************************************************************/
+/// @brief A duty cycle of HAL_PWM_DUTY_Q16_FULL in Q16.16, a Q16 duty cycle with 16 more bits of fraction.
+#define RAMP_FULL ((int64_t)HAL_PWM_DUTY_Q16_FULL << 16)
+
+typedef struct {
+    bool     active;
+    int64_t  value;      // Duty cycle now, Q16.16.
+    int64_t  step;       // Added to value at every step, Q16.16.
+    uint32_t steps_left; // The last step lands on target exactly.
+    uint16_t target;
+    uint32_t slew_limit; // Q16 per second, 0 for none. Outlives the ramps.
+} pwm_ramp_t;
+
+static pwm_ramp_t ramps[4] = { 0 };
+static uint32_t ramp_divider = 1;   // Update events per step, shared by all channels.
+static uint32_t ramp_countdown = 1; // Update events to the next step.
+
+/*********************************************************************************************/
+// Waveform streaming: TIM1_UP requests a DMA burst into CCR1-CCR4 at every update event.
+/*********************************************************************************************/
+/// @brief DMA2 Stream 5 Channel 6 is wired to the TIM1 update request.
+#define STREAM_DMA_CHANNEL  6u
+/// @brief Transfers per burst, one per compare register.
+#define STREAM_BURST_LENGTH 4u
+/// @brief DCR.DBA counts 32-bit registers from the start of the timer. CCR1 is the first target.
+#define STREAM_BURST_BASE   (offsetof(TIM_TypeDef, CCR1) / 4u)
+/// @brief Stream 5 flags handled by the driver. The HIFCR clear bits sit at the same positions.
+#define STREAM_FLAGS        (DMA_HISR_TCIF5 | DMA_HISR_HTIF5 | DMA_HISR_TEIF5 | DMA_HISR_DMEIF5 | DMA_HISR_FEIF5)
+
+static_assert(sizeof(hal_pwm_frame_t) == STREAM_BURST_LENGTH * sizeof(uint16_t), "A frame must be exactly one DMA burst");
+
+typedef struct {
+    volatile bool active;               /*!< True while the DMA is feeding the timer. */
+    hal_pwm_stream_mode_t mode;         /*!< Circular or double-buffered. */
+    hal_pwm_frame_t *buffers[2];        /*!< Circular: [0] only. Double: the buffers behind M0AR and M1AR. */
+    size_t frames;                      /*!< Frames per buffer. */
+    hal_pwm_stream_callback_t on_event; /*!< Optional. */
+    void *context;                      /*!< Passed to on_event. */
+} pwm_stream_t;
+
+static pwm_stream_t stream = { 0 };
+
+/*********************************************************************************************/
+// Timers
+/*********************************************************************************************/
+/// @brief ARR width of the 16-bit timers and of the 32-bit TIM2 and TIM5.
+#define ARR_MAX_16 0xFFFFu
+#define ARR_MAX_32 0xFFFFFFFFu
+/// @brief PSC is 16 bits on every timer.
+#define PSC_MAX    0xFFFFu
+
+/**
+ * @brief One channel pin.
+ */
+typedef struct {
+    GPIO_TypeDef *port;
+    uint32_t      pin;
+    uint32_t      port_clock_enable; // RCC AHB1ENR bit of the port.
+} pwm_pin_t;
+
+/**
+ * @brief Everything the driver knows about one timer: its hardware and the state of its channels.
+ */
+typedef struct {
+    // Hardware description. Fixed at compile time.
+    TIM_TypeDef *regs;
+    bool         apb2;                    // Clocked from APB2 (TIM1, TIM8), else from APB1.
+    uint32_t     peripheral_clock_enable; // RCC APB1ENR or APB2ENR bit of the timer.
+    uint32_t     af;                      // Alternate function of all four channel pins.
+    uint32_t     arr_max;                 // Largest value ARR and CCRx can hold.
+    bool         advanced;                // TIM1 and TIM8: outputs are gated by BDTR.MOE.
+    pwm_pin_t    pins[4];                 // CH1 through CH4.
+
+    // State.
+    uint32_t frequency;                   // Last requested base frequency, to recompute timing.
+    bool     channel_enabled[4];          // Indexed by hal_pwm_channel_t (CH1=0 ... CH4=3).
+    pwm_timer_owner_t owner;              // Capture or encoder while borrowed, see stm32f4_timer.h.
+} pwm_timer_t;
+
+static_assert(ARRAY_SIZE(((pwm_timer_t *)0)->channel_enabled) == _HAL_PWM_CH_MAX, "The size of channels enabled does not match number of channels");
+
+static pwm_timer_t timers[_HAL_PWM_TIMER_MAX] = {
+    [HAL_PWM_TIM1] = {
+        .regs = TIM1,
+        .apb2 = true,
+        .peripheral_clock_enable = RCC_APB2ENR_TIM1EN,
+        .af = AF_TIM1_TIM2,
+        .arr_max = ARR_MAX_16,
+        .advanced = true,
+        .pins = {
+            { .port = GPIOA, .pin = 8,  .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+            { .port = GPIOA, .pin = 9,  .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+            { .port = GPIOA, .pin = 10, .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+            { .port = GPIOA, .pin = 11, .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+        },
+    },
+    [HAL_PWM_TIM2] = {
+        .regs = TIM2,
+        .peripheral_clock_enable = RCC_APB1ENR_TIM2EN,
+        .af = AF_TIM1_TIM2,
+        .arr_max = ARR_MAX_32,
+        .pins = {
+            { .port = GPIOA, .pin = 5,  .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+            { .port = GPIOB, .pin = 3,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+            { .port = GPIOB, .pin = 10, .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+            { .port = GPIOB, .pin = 2,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+        },
+    },
+    [HAL_PWM_TIM3] = {
+        .regs = TIM3,
+        .peripheral_clock_enable = RCC_APB1ENR_TIM3EN,
+        .af = AF_TIM3_TIM5,
+        .arr_max = ARR_MAX_16,
+        .pins = {
+            { .port = GPIOB, .pin = 4,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+            { .port = GPIOB, .pin = 5,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+            { .port = GPIOB, .pin = 0,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+            { .port = GPIOB, .pin = 1,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+        },
+    },
+    [HAL_PWM_TIM4] = {
+        .regs = TIM4,
+        .peripheral_clock_enable = RCC_APB1ENR_TIM4EN,
+        .af = AF_TIM3_TIM5,
+        .arr_max = ARR_MAX_16,
+        .pins = {
+            { .port = GPIOB, .pin = 6,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+            { .port = GPIOB, .pin = 7,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+            { .port = GPIOB, .pin = 8,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+            { .port = GPIOB, .pin = 9,  .port_clock_enable = RCC_AHB1ENR_GPIOBEN },
+        },
+    },
+    [HAL_PWM_TIM5] = {
+        .regs = TIM5,
+        .peripheral_clock_enable = RCC_APB1ENR_TIM5EN,
+        .af = AF_TIM3_TIM5,
+        .arr_max = ARR_MAX_32,
+        .pins = {
+            { .port = GPIOA, .pin = 0,  .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+            { .port = GPIOA, .pin = 1,  .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+            { .port = GPIOA, .pin = 2,  .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+            { .port = GPIOA, .pin = 3,  .port_clock_enable = RCC_AHB1ENR_GPIOAEN },
+        },
+    },
+    [HAL_PWM_TIM8] = {
+        .regs = TIM8,
+        .apb2 = true,
+        .peripheral_clock_enable = RCC_APB2ENR_TIM8EN,
+        .af = AF_TIM8,
+        .arr_max = ARR_MAX_16,
+        .advanced = true,
+        .pins = {
+            { .port = GPIOC, .pin = 6,  .port_clock_enable = RCC_AHB1ENR_GPIOCEN },
+            { .port = GPIOC, .pin = 7,  .port_clock_enable = RCC_AHB1ENR_GPIOCEN },
+            { .port = GPIOC, .pin = 8,  .port_clock_enable = RCC_AHB1ENR_GPIOCEN },
+            { .port = GPIOC, .pin = 9,  .port_clock_enable = RCC_AHB1ENR_GPIOCEN },
+        },
+    },
+};
+
+/// @brief TIM1 hosts the stream, the trigger output, the complementary outputs and the break input.
+#define PWM_TIM1 (&timers[HAL_PWM_TIM1])
 
 /*********************************************************************************************/
 // Forward declarations
 /*********************************************************************************************/
-static void configure_timer_clocks(void);
-static void configure_channel_gpio(hal_pwm_channel_t channel);
-static void configure_channel_preload(hal_pwm_channel_t channel);
-static void configure_channel_ccer(hal_pwm_channel_t channel);
-static void compute_psc_arr(uint32_t pwm_frequency_hz, uint16_t* psc_out, uint16_t* arr_out);
+static pwm_timer_t *get_timer(hal_pwm_timer_t timer_id);
+static void configure_timer_clocks(const pwm_timer_t *t);
+static void configure_channel_preload(const pwm_timer_t *t, hal_pwm_channel_t channel);
+static void configure_channel_ccer(const pwm_timer_t *t, hal_pwm_channel_t channel);
+static uint32_t timer_clock_hz(const pwm_timer_t *t);
+static void compute_psc_arr(uint32_t clock_hz, uint32_t arr_max, uint32_t pwm_frequency_hz, uint32_t* psc_out, uint32_t* arr_out);
+static hal_status_t apply_duty_counts(pwm_timer_t *t, hal_pwm_channel_t channel, uint32_t ccr);
+static void retime(pwm_timer_t *t, uint32_t pwm_frequency_hz, uint32_t cms);
+static void apply_trigger_point(void);
+static uint32_t q16_to_counts(const pwm_timer_t *t, uint16_t duty);
+static void configure_af_pin(GPIO_TypeDef *port, uint32_t pin, uint32_t af);
+static bool encode_dead_time(uint32_t ticks, uint8_t *dtg_out, uint32_t *ticks_out);
+static bool stream_config_is_valid(const hal_pwm_stream_config_t *config);
+static void stream_shutdown(void);
+static void stream_notify(hal_pwm_stream_event_t event, hal_pwm_frame_t *done, size_t count);
+static int64_t ramp_start_value(hal_pwm_channel_t channel);
+static void ramp_apply(hal_pwm_channel_t channel, int64_t value);
+static void ramp_cancel(hal_pwm_channel_t channel);
+static void ramp_cancel_all(void);
 
 /*********************************************************************************************/
 // Inline helpers
 /*********************************************************************************************/
+/**
+ * @brief Returns true while the stream owns the compare registers of this timer.
+ */
+static inline bool stream_owns(const pwm_timer_t *t)
+{
+    return t == PWM_TIM1 && stream.active;
+}
+
+/**
+ * @brief Returns true while capture or the encoder has borrowed the timer.
+ *
+ * The PWM setters then keep their hands off: OCxM is ICxF in input mode, CCxNP selects the
+ * input edge, and a forced update or retime resets the counter the borrower is reading.
+ */
+static inline bool timer_is_borrowed(const pwm_timer_t *t)
+{
+    return t->owner != PWM_TIMER_OWNER_NONE;
+}
+
 /**
  * @brief Force an update event: load preloaded ARR/CCR/PSC
  */
-static inline void tim1_force_update(void)
+static inline void tim_force_update(const pwm_timer_t *t)
 {
+    // While streaming an update event would also request a DMA burst and skip a frame.
+    // Preloaded values latch at the next natural update instead.
+    if (stream_owns(t))
+    {
+        return;
+    }
+
     // EGR: Event Generation Register
     //  UG: Update Generate
-    TIM1->EGR = TIM_EGR_UG;
+    t->regs->EGR = TIM_EGR_UG;
 }
 
 /**
  * @brief Sets the output compare mode for the given channel.
+ * @param t   Target timer.
  * @param ch  Target channel.
  * @param ocm Output compare mode - The important modes of operation are:
  *   1. @ref OC_MODE_PWM_1       Classic PWM signal. Valid duty cycles of 1% - 99%.
  *   2. @ref OC_MODE_FORCED_LOW  Output forced low. Duty cycle is 0%.
  *   3. @ref OC_MODE_FORCED_HIGH Output forced high. Duty cycle is 100%.
  */
-static inline void tim1_ch_set_ocmode(hal_pwm_channel_t ch, uint32_t ocm)
+static inline void tim_ch_set_ocmode(const pwm_timer_t *t, hal_pwm_channel_t ch, uint32_t ocm)
 {
+    TIM_TypeDef *tim = t->regs;
+
     // CCMR: Capture/Compare Mode Register
     switch (ch)
     {
         case HAL_PWM_CH1:
-            TIM1->CCMR1 = (TIM1->CCMR1 & ~TIM_CCMR1_OC1M) | (ocm << TIM_CCMR1_OC1M_Pos);
+            tim->CCMR1 = (tim->CCMR1 & ~TIM_CCMR1_OC1M) | (ocm << TIM_CCMR1_OC1M_Pos);
             break;
         case HAL_PWM_CH2:
-            TIM1->CCMR1 = (TIM1->CCMR1 & ~TIM_CCMR1_OC2M) | (ocm << TIM_CCMR1_OC2M_Pos);
+            tim->CCMR1 = (tim->CCMR1 & ~TIM_CCMR1_OC2M) | (ocm << TIM_CCMR1_OC2M_Pos);
             break;
         case HAL_PWM_CH3:
-            TIM1->CCMR2 = (TIM1->CCMR2 & ~TIM_CCMR2_OC3M) | (ocm << TIM_CCMR2_OC3M_Pos);
+            tim->CCMR2 = (tim->CCMR2 & ~TIM_CCMR2_OC3M) | (ocm << TIM_CCMR2_OC3M_Pos);
             break;
         case HAL_PWM_CH4:
-            TIM1->CCMR2 = (TIM1->CCMR2 & ~TIM_CCMR2_OC4M) | (ocm << TIM_CCMR2_OC4M_Pos);
+            tim->CCMR2 = (tim->CCMR2 & ~TIM_CCMR2_OC4M) | (ocm << TIM_CCMR2_OC4M_Pos);
             break;
         default:
             break;
@@ -89,29 +338,32 @@ static inline void tim1_ch_set_ocmode(hal_pwm_channel_t ch, uint32_t ocm)
 /**
  * @brief Returns the current capture/compare register value for the given channel.
  */
-static inline uint32_t tim1_ch_get_ccr(hal_pwm_channel_t ch)
+static inline uint32_t tim_ch_get_ccr(const pwm_timer_t *t, hal_pwm_channel_t ch)
 {
     switch (ch)
     {
-        case HAL_PWM_CH1: return TIM1->CCR1;
-        case HAL_PWM_CH2: return TIM1->CCR2;
-        case HAL_PWM_CH3: return TIM1->CCR3;
-        case HAL_PWM_CH4: return TIM1->CCR4;
+        case HAL_PWM_CH1: return t->regs->CCR1;
+        case HAL_PWM_CH2: return t->regs->CCR2;
+        case HAL_PWM_CH3: return t->regs->CCR3;
+        case HAL_PWM_CH4: return t->regs->CCR4;
         default:          return 0;
     }
 }
 
 /**
  * @brief Writes the capture/compare register for the given channel.
+ * 16 bits on most timers, 32 bits on TIM2 and TIM5.
  */
-static inline void tim1_ch_set_ccr(hal_pwm_channel_t ch, uint32_t ccr)
+static inline void tim_ch_set_ccr(const pwm_timer_t *t, hal_pwm_channel_t ch, uint32_t ccr)
 {
+    ccr &= t->arr_max;
+
     switch (ch)
     {
-        case HAL_PWM_CH1: TIM1->CCR1 = (uint16_t)ccr; break;
-        case HAL_PWM_CH2: TIM1->CCR2 = (uint16_t)ccr; break;
-        case HAL_PWM_CH3: TIM1->CCR3 = (uint16_t)ccr; break;
-        case HAL_PWM_CH4: TIM1->CCR4 = (uint16_t)ccr; break;
+        case HAL_PWM_CH1: t->regs->CCR1 = ccr; break;
+        case HAL_PWM_CH2: t->regs->CCR2 = ccr; break;
+        case HAL_PWM_CH3: t->regs->CCR3 = ccr; break;
+        case HAL_PWM_CH4: t->regs->CCR4 = ccr; break;
         default:          break;
     }
 }
@@ -119,379 +371,1659 @@ static inline void tim1_ch_set_ccr(hal_pwm_channel_t ch, uint32_t ccr)
 /**
  * @brief Returns true if the channel is currently in PWM Mode 1.
  */
-static inline bool tim1_ch_is_pwm_mode1(hal_pwm_channel_t ch)
+static inline bool tim_ch_is_pwm_mode1(const pwm_timer_t *t, hal_pwm_channel_t ch)
+{
+    TIM_TypeDef *tim = t->regs;
+
+    switch (ch)
+    {
+        case HAL_PWM_CH1: return (tim->CCMR1 & TIM_CCMR1_OC1M) == (OC_MODE_PWM_1 << TIM_CCMR1_OC1M_Pos);
+        case HAL_PWM_CH2: return (tim->CCMR1 & TIM_CCMR1_OC2M) == (OC_MODE_PWM_1 << TIM_CCMR1_OC2M_Pos);
+        case HAL_PWM_CH3: return (tim->CCMR2 & TIM_CCMR2_OC3M) == (OC_MODE_PWM_1 << TIM_CCMR2_OC3M_Pos);
+        case HAL_PWM_CH4: return (tim->CCMR2 & TIM_CCMR2_OC4M) == (OC_MODE_PWM_1 << TIM_CCMR2_OC4M_Pos);
+        default:          return false;
+    }
+}
+
+/**
+ * @brief Returns true if the channel is currently forced high (100%).
+ */
+static inline bool tim_ch_is_forced_high(const pwm_timer_t *t, hal_pwm_channel_t ch)
 {
+    TIM_TypeDef *tim = t->regs;
+
     switch (ch)
     {
-        case HAL_PWM_CH1: return (TIM1->CCMR1 & TIM_CCMR1_OC1M) == (OC_MODE_PWM_1 << TIM_CCMR1_OC1M_Pos);
-        case HAL_PWM_CH2: return (TIM1->CCMR1 & TIM_CCMR1_OC2M) == (OC_MODE_PWM_1 << TIM_CCMR1_OC2M_Pos);
-        case HAL_PWM_CH3: return (TIM1->CCMR2 & TIM_CCMR2_OC3M) == (OC_MODE_PWM_1 << TIM_CCMR2_OC3M_Pos);
-        case HAL_PWM_CH4: return (TIM1->CCMR2 & TIM_CCMR2_OC4M) == (OC_MODE_PWM_1 << TIM_CCMR2_OC4M_Pos);
+        case HAL_PWM_CH1: return (tim->CCMR1 & TIM_CCMR1_OC1M) == (OC_MODE_FORCED_HIGH << TIM_CCMR1_OC1M_Pos);
+        case HAL_PWM_CH2: return (tim->CCMR1 & TIM_CCMR1_OC2M) == (OC_MODE_FORCED_HIGH << TIM_CCMR1_OC2M_Pos);
+        case HAL_PWM_CH3: return (tim->CCMR2 & TIM_CCMR2_OC3M) == (OC_MODE_FORCED_HIGH << TIM_CCMR2_OC3M_Pos);
+        case HAL_PWM_CH4: return (tim->CCMR2 & TIM_CCMR2_OC4M) == (OC_MODE_FORCED_HIGH << TIM_CCMR2_OC4M_Pos);
         default:          return false;
     }
 }
 
+/**
+ * @brief Returns the number of counts in one PWM period.
+ * Edge-aligned: the counter runs 0 -> ARR, ARR+1 counts. Center-aligned: 0 -> ARR -> 0, and
+ * a channel in PWM Mode 1 is active for CCR counts on each slope, so CCR/ARR is the duty.
+ * 64 bits, as ARR+1 overflows a 32-bit timer at its widest.
+ */
+static inline uint64_t tim_period_counts(const pwm_timer_t *t)
+{
+    if (t->regs->CR1 & TIM_CR1_CMS)
+    {
+        return (uint64_t)t->regs->ARR;
+    }
+
+    return (uint64_t)t->regs->ARR + 1u;
+}
+
+/**
+ * @brief Returns true if CH4 of this timer drives the trigger output.
+ */
+static inline bool is_trigger_channel(const pwm_timer_t *t, hal_pwm_channel_t ch)
+{
+    return t == PWM_TIM1 && ch == HAL_PWM_CH4 && ch4_is_trigger;
+}
+
+/**
+ * @brief Compute PSC and ARR for a frequency, taking the counting mode into account.
+ * @param cms The CR1.CMS bits the timer will count with.
+ */
+static inline void compute_timing(const pwm_timer_t *t, uint32_t pwm_frequency_hz, uint32_t cms, uint32_t* psc_out, uint32_t* arr_out)
+{
+    uint32_t clock_hz = timer_clock_hz(t);
+
+    if (!(cms & TIM_CR1_CMS))
+    {
+        compute_psc_arr(clock_hz, t->arr_max, pwm_frequency_hz, psc_out, arr_out);
+        return;
+    }
+
+    // Counting up and back down takes twice as long, so count half as far: (PSC+1) * 2 * ARR
+    // timer clocks per period. compute_psc_arr() gives (PSC+1) * (ARR+1) for twice the frequency.
+    uint32_t doubled = (pwm_frequency_hz > clock_hz / 2u) ? clock_hz : pwm_frequency_hz * 2u;
+    compute_psc_arr(clock_hz, t->arr_max, doubled, psc_out, arr_out);
+    if (*arr_out < t->arr_max)
+    {
+        *arr_out += 1u;
+    }
+}
+
 /**
  * @brief Apply prescaler (psc) and auto-reload (arr) values to their registers.
- * Determines the frequency of the PWM signal.
+ * Determines the frequency of the PWM signal. Both are preloaded, so the counter runs on
+ * and the forced update loads them together and starts a fresh period.
  */
-static inline void apply_psc_arr(uint16_t psc, uint16_t arr)
+static inline void apply_psc_arr(const pwm_timer_t *t, uint32_t psc, uint32_t arr)
 {
-    TIM1->CR1 &= ~TIM_CR1_CEN;      // stop counter during reprogram (optional, safer)
-    TIM1->PSC  = psc;
-    TIM1->ARR  = arr;
-    tim1_force_update();
-    TIM1->CR1 |= TIM_CR1_CEN;
+    t->regs->PSC  = psc;
+    t->regs->ARR  = arr;
+    tim_force_update(t);
+    t->regs->CR1 |= TIM_CR1_CEN;
 }
 
 /**
  * @brief Set a channel's output to 0% (hold output low).
  */
-static inline void set_forced_inactive(hal_pwm_channel_t ch)
+static inline void set_forced_inactive(const pwm_timer_t *t, hal_pwm_channel_t ch)
 {
-    tim1_ch_set_ocmode(ch, OC_MODE_FORCED_LOW);
-    tim1_force_update();
+    tim_ch_set_ocmode(t, ch, OC_MODE_FORCED_LOW);
+    tim_force_update(t);
 }
 
 /**
  * @brief Set a channel's output to 100% (hold output high).
  */
-static inline void set_forced_active(hal_pwm_channel_t ch)
+static inline void set_forced_active(const pwm_timer_t *t, hal_pwm_channel_t ch)
 {
-    tim1_ch_set_ocmode(ch, OC_MODE_FORCED_HIGH);
-    tim1_force_update();
+    tim_ch_set_ocmode(t, ch, OC_MODE_FORCED_HIGH);
+    tim_force_update(t);
 }
 
 /**
  * @brief Set a channel to classic PWM Mode 1 (1%-99% duty cycle).
  */
-static inline void set_pwm_mode1(hal_pwm_channel_t ch)
+static inline void set_pwm_mode1(const pwm_timer_t *t, hal_pwm_channel_t ch)
 {
-    tim1_ch_set_ocmode(ch, OC_MODE_PWM_1);
-    tim1_force_update();
+    tim_ch_set_ocmode(t, ch, OC_MODE_PWM_1);
+    tim_force_update(t);
 }
 
 /*********************************************************************************************/
 // Public Interface
 /*********************************************************************************************/
 
-hal_status_t hal_pwm_timer_init(uint32_t pwm_frequency_hz)
+hal_status_t hal_pwm_tim_init(hal_pwm_timer_t timer, uint32_t pwm_frequency_hz)
 {
-    uint16_t psc = 0;
-    uint16_t arr = 1;
+    pwm_timer_t *t = get_timer(timer);
+    uint32_t psc = 0;
+    uint32_t arr = 1;
+
+    if (!t)
+    {
+        return HAL_STATUS_ERROR;
+    }
 
-    configure_timer_clocks();
-    compute_psc_arr(pwm_frequency_hz, &psc, &arr);
+    if (timer_is_borrowed(t))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    if (t == PWM_TIM1)
+    {
+        ramp_cancel_all();
+    }
+
+    configure_timer_clocks(t);
 
-    TIM1->CR1 = 0;
-    TIM1->PSC = psc;
-    TIM1->ARR = arr;
+    // Edge-aligned, counting up.
+    t->regs->CR1 = 0;
+    compute_timing(t, pwm_frequency_hz, 0u, &psc, &arr);
+    t->frequency = pwm_frequency_hz;
+    t->regs->PSC = psc;
+    t->regs->ARR = arr;
 
     // Enable preload for ARR so software updates latch on update events.
-    TIM1->CR1 |= TIM_CR1_ARPE;
-    tim1_force_update();
+    t->regs->CR1 |= TIM_CR1_ARPE;
+    tim_force_update(t);
 
-    // MOE: Main output enable. Necessary to get output out of the timer and to the pins.
-    TIM1->BDTR |= TIM_BDTR_MOE;
+    // MOE: Main output enable. Necessary to get output out of an advanced timer and to the pins.
+    if (t->advanced)
+    {
+        t->regs->BDTR |= TIM_BDTR_MOE;
+    }
 
     // Start the counter.
-    TIM1->CR1 |= TIM_CR1_CEN;
+    t->regs->CR1 |= TIM_CR1_CEN;
 
     return HAL_STATUS_OK;
 }
 
-hal_status_t hal_pwm_channel_init(hal_pwm_channel_t channel)
+hal_status_t hal_pwm_tim_channel_init(hal_pwm_timer_t timer, hal_pwm_channel_t channel)
 {
-    if (!ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX))
+    pwm_timer_t *t = get_timer(timer);
+
+    if (!t || !ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX))
     {
         return HAL_STATUS_ERROR;
     }
 
-    configure_channel_gpio(channel);
+    if (timer_is_borrowed(t))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    if (t == PWM_TIM1)
+    {
+        ramp_cancel(channel);
+    }
+
+    const pwm_pin_t *pin = &t->pins[(int)channel];
+    RCC->AHB1ENR |= pin->port_clock_enable;
+    configure_af_pin(pin->port, pin->pin, t->af);
 
     // Enable CCR preload so compare register updates latch on update events.
-    configure_channel_preload(channel);
+    configure_channel_preload(t, channel);
 
     // Start in a safe state. (0% PWM)
-    set_forced_inactive(channel);
+    set_forced_inactive(t, channel);
 
     // Set polarity to active high and enable the channel output.
-    configure_channel_ccer(channel);
+    configure_channel_ccer(t, channel);
 
-    pwm_channel_enabled[(int)channel] = false;
+    t->channel_enabled[(int)channel] = false;
 
     return HAL_STATUS_OK;
 }
 
-hal_status_t hal_pwm_enable(hal_pwm_channel_t channel, bool enable)
+hal_status_t hal_pwm_tim_enable(hal_pwm_timer_t timer, hal_pwm_channel_t channel, bool enable)
 {
-    if (!ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX))
+    pwm_timer_t *t = get_timer(timer);
+
+    if (!t || !ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX))
     {
         return HAL_STATUS_ERROR;
     }
 
+    if (is_trigger_channel(t, channel) || timer_is_borrowed(t))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
     int idx = (int)channel;
     if (enable)
     {
-        pwm_channel_enabled[idx] = true;
+        t->channel_enabled[idx] = true;
         // Resume the previous setting if there was one.
-        if (tim1_ch_get_ccr(channel) != 0)
+        if (tim_ch_get_ccr(t, channel) != 0)
         {
-            set_pwm_mode1(channel);
+            set_pwm_mode1(t, channel);
         }
     }
     else
     {
-        pwm_channel_enabled[idx] = false;
-        set_forced_inactive(channel);
+        if (t == PWM_TIM1)
+        {
+            ramp_cancel(channel);
+        }
+
+        t->channel_enabled[idx] = false;
+        set_forced_inactive(t, channel);
     }
 
     return HAL_STATUS_OK;
 }
 
-hal_status_t hal_pwm_set_duty_cycle(hal_pwm_channel_t channel, uint8_t percent)
+hal_status_t hal_pwm_tim_set_duty_cycle(hal_pwm_timer_t timer, hal_pwm_channel_t channel, uint8_t percent)
 {
-    if (!ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX))
+    pwm_timer_t *t = get_timer(timer);
+
+    if (!t)
     {
         return HAL_STATUS_ERROR;
     }
 
-    // Always set low if called with 0%, regardless of pwm_channel_enabled, for safety.
     if (percent == 0)
     {
-        set_forced_inactive(channel);
-        tim1_ch_set_ccr(channel, 0);
-        return HAL_STATUS_OK;
+        return apply_duty_counts(t, channel, 0);
     }
 
-    if (pwm_channel_enabled[(int)channel])
+    if (percent >= 100)
     {
-        if (percent >= 100)
-        {
-            set_forced_active(channel);
-            return HAL_STATUS_OK;
-        }
+        return apply_duty_counts(t, channel, (uint32_t)t->regs->ARR + 1u);
+    }
 
-        // percent is something between 1%-99%.
-        set_pwm_mode1(channel);
+    // CCR = round(percent/100 * (ARR+1))
+    // Common rounding trick for integers:
+    // result = (numerator * scale + divisor/2) / divisor;
+    uint64_t period = tim_period_counts(t);
+    uint32_t ccr    = (uint32_t)(((uint64_t)percent * period + 50u) / 100u);
 
-        // CCR = round(percent/100 * (ARR+1))
-        // Common rounding trick for integers:
-        // result = (numerator * scale + divisor/2) / divisor;
-        uint32_t arrp1 = (uint32_t)TIM1->ARR + 1u;
-        uint32_t ccr   = ((uint32_t)percent * arrp1 + 50u) / 100u;
+    // Avoid accidental 0%.
+    if (ccr == 0u)
+    {
+        ccr = 1u;
+    }
 
-        // Avoid accidental 0%.
-        if (ccr == 0u)
-        {
-            ccr = 1u;
-        }
+    // Keep within [1..ARR]
+    if (ccr > t->regs->ARR)
+    {
+        ccr = t->regs->ARR;
+    }
 
-        // Keep within [1..ARR]
-        if (ccr > TIM1->ARR)
-        {
-            ccr = TIM1->ARR;
-        }
+    return apply_duty_counts(t, channel, ccr);
+}
+
+hal_status_t hal_pwm_tim_set_duty_q16(hal_pwm_timer_t timer, hal_pwm_channel_t channel, uint16_t duty)
+{
+    pwm_timer_t *t = get_timer(timer);
 
-        tim1_ch_set_ccr(channel, ccr);
-        // With OCxPE=1, CCR update latches on next UG/overflow. Force UG to apply now:
-        tim1_force_update();
+    if (!t)
+    {
+        return HAL_STATUS_ERROR;
     }
 
-    return HAL_STATUS_OK;
+    return apply_duty_counts(t, channel, q16_to_counts(t, duty));
 }
 
-void hal_pwm_set_frequency(uint32_t pwm_frequency_hz)
+hal_status_t hal_pwm_tim_set_duty_counts(hal_pwm_timer_t timer, hal_pwm_channel_t channel, uint32_t counts)
 {
-    uint16_t psc = 0;
-    uint16_t arr = 1;
-    compute_psc_arr(pwm_frequency_hz, &psc, &arr);
+    pwm_timer_t *t = get_timer(timer);
 
-    // Capture each enabled channel's duty-cycle ratio before ARR changes.
-    float ratios[4]   = { 0.0f, 0.0f, 0.0f, 0.0f };
-    bool  was_pwm_mode[4] = { false, false, false, false };
+    if (!t)
+    {
+        return HAL_STATUS_ERROR;
+    }
 
-    for (int i = 0; i < 4; i++)
+    return apply_duty_counts(t, channel, counts);
+}
+
+hal_status_t hal_pwm_tim_set_duty_all(hal_pwm_timer_t timer, const uint16_t duties[4])
+{
+    pwm_timer_t *t = get_timer(timer);
+
+    if (!t || !duties)
     {
-        hal_pwm_channel_t ch = (hal_pwm_channel_t)i;
-        if (pwm_channel_enabled[i] && tim1_ch_is_pwm_mode1(ch))
-        {
-            was_pwm_mode[i] = true;
-            ratios[i]   = (float)tim1_ch_get_ccr(ch) / (float)(TIM1->ARR + 1u);
-        }
+        return HAL_STATUS_ERROR;
     }
 
-    apply_psc_arr(psc, arr);
+    // The stream owns the compare registers, a borrower the whole timer.
+    if (stream_owns(t) || timer_is_borrowed(t))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    if (t == PWM_TIM1)
+    {
+        ramp_cancel_all();
+    }
+
+    // UDIS: Update disable. No update event, and so no preload transfer, can happen while the
+    // compare registers are half written. The counter keeps running, and once UDIS is cleared
+    // the next natural overflow latches all four values together.
+    t->regs->CR1 |= TIM_CR1_UDIS;
 
-    // Rescale CCR for any channel that was in PWM Mode 1 to preserve its duty-cycle ratio.
     for (int i = 0; i < 4; i++)
     {
-        if (!pwm_channel_enabled[i] || !was_pwm_mode[i])
+        hal_pwm_channel_t ch = (hal_pwm_channel_t)i;
+
+        if (is_trigger_channel(t, ch))
         {
             continue;
         }
 
-        hal_pwm_channel_t ch    = (hal_pwm_channel_t)i;
-        float             ratio = ratios[i];
-
-        if (ratio > 0.0f && ratio < 1.0f)
+        // 0 is always accepted, as in hal_pwm_set_duty_cycle(). Other values wait for the channel.
+        if (duties[i] != 0u && !t->channel_enabled[i])
         {
-            uint32_t arrp1 = (uint32_t)TIM1->ARR + 1u;
-            uint32_t ccr   = (uint32_t)(ratio * (float)arrp1 + 0.5f);
-
-            // Avoid accidental 0%.
-            if (ccr == 0u)
-            {
-                ccr = 1u;
-            }
+            continue;
+        }
 
-            // Keep within [1..ARR]
-            if (ccr > TIM1->ARR)
-            {
-                ccr = TIM1->ARR;
-            }
+        // 0% and 100% are expressed through CCR as well (0 and ARR+1), so the level lands with the
+        // update event like any other. The width of CCR caps the top.
+        uint32_t ccr = q16_to_counts(t, duties[i]);
+        tim_ch_set_ccr(t, ch, (ccr > t->arr_max) ? t->arr_max : ccr);
 
-            tim1_ch_set_ccr(ch, ccr);
-            set_pwm_mode1(ch);
-            tim1_force_update();
-        }
-        else if (ratio >= 1.0f)
+        // An enabled channel left forced low or high by a single-channel setter goes back to PWM
+        // Mode 1 to follow its CCR. A disabled one stays forced low.
+        if (t->channel_enabled[i] && !tim_ch_is_pwm_mode1(t, ch))
         {
-            set_forced_active(ch);
-        }
-        else
-        { // ratio == 0.0f
-            set_forced_inactive(ch);
+            tim_ch_set_ocmode(t, ch, OC_MODE_PWM_1);
         }
     }
-}
 
-/*********************************************************************************************/
-// Private Functions
-/*********************************************************************************************/
+    t->regs->CR1 &= ~TIM_CR1_UDIS;
 
-static void configure_timer_clocks(void)
-{
-    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN;
-    RCC->APB2ENR |= RCC_APB2ENR_TIM1EN;
+    return HAL_STATUS_OK;
 }
 
-static void configure_channel_gpio(hal_pwm_channel_t channel)
+uint32_t hal_pwm_tim_get_period_counts(hal_pwm_timer_t timer)
 {
-    // TIM1 channels CH1-CH4 map to PA8-PA11 on alternate function AF1.
-    switch (channel)
+    pwm_timer_t *t = get_timer(timer);
+
+    if (!t)
     {
-        case HAL_PWM_CH1:
-            // PA8: MODER bits [17:16] = 0b10 (alternate function)
-            GPIOA->MODER |=  BIT_17;
-            GPIOA->MODER &= ~BIT_16;
-            GPIOA->OTYPER &= ~BIT_8;                          // push-pull
-            GPIOA->PUPDR  &= ~(BIT_17 | BIT_16);             // no pull
-            GPIOA->AFR[1] &= ~(0xFu << 0);
-            GPIOA->AFR[1] |=  (1u   << 0);                   // AF1 (TIM1)
-            break;
+        return 0;
+    }
 
-        case HAL_PWM_CH2:
-            // PA9: MODER bits [19:18] = 0b10
-            GPIOA->MODER |=  BIT_19;
-            GPIOA->MODER &= ~BIT_18;
-            GPIOA->OTYPER &= ~BIT_9;
-            GPIOA->PUPDR  &= ~(BIT_19 | BIT_18);
-            GPIOA->AFR[1] &= ~(0xFu << 4);
-            GPIOA->AFR[1] |=  (1u   << 4);
-            break;
+    // Saturates for a 32-bit timer at its widest.
+    uint64_t period = tim_period_counts(t);
+    return (period > ARR_MAX_32) ? ARR_MAX_32 : (uint32_t)period;
+}
 
-        case HAL_PWM_CH3:
-            // PA10: MODER bits [21:20] = 0b10
-            GPIOA->MODER |=  BIT_21;
-            GPIOA->MODER &= ~BIT_20;
-            GPIOA->OTYPER &= ~BIT_10;
-            GPIOA->PUPDR  &= ~(BIT_21 | BIT_20);
-            GPIOA->AFR[1] &= ~(0xFu << 8);
-            GPIOA->AFR[1] |=  (1u   << 8);
-            break;
+uint8_t hal_pwm_tim_get_resolution_bits(hal_pwm_timer_t timer)
+{
+    pwm_timer_t *t = get_timer(timer);
 
-        case HAL_PWM_CH4:
-            // PA11: MODER bits [23:22] = 0b10
-            GPIOA->MODER |=  BIT_23;
-            GPIOA->MODER &= ~BIT_22;
-            GPIOA->OTYPER &= ~BIT_11;
-            GPIOA->PUPDR  &= ~(BIT_23 | BIT_22);
-            GPIOA->AFR[1] &= ~(0xFu << 12);
-            GPIOA->AFR[1] |=  (1u   << 12);
-            break;
+    if (!t)
+    {
+        return 0;
+    }
 
-        default:
-            break;
+    // floor(log2(period)): the number of whole bits of duty the period can express.
+    uint64_t steps = tim_period_counts(t);
+    uint8_t bits = 0;
+
+    while (steps > 1u)
+    {
+        steps >>= 1;
+        bits++;
     }
 
-    // Optional: Set high speed?
+    return bits;
 }
 
-static void configure_channel_preload(hal_pwm_channel_t channel)
+hal_status_t hal_pwm_tim_get_timing(hal_pwm_timer_t timer, hal_pwm_timing_t *timing)
 {
-    // Enable CCR preload (OCxPE) so compare register updates latch on update events.
-    switch (channel)
+    pwm_timer_t *t = get_timer(timer);
+
+    if (!t || !timing)
     {
-        case HAL_PWM_CH1: TIM1->CCMR1 |= TIM_CCMR1_OC1PE; break;
-        case HAL_PWM_CH2: TIM1->CCMR1 |= TIM_CCMR1_OC2PE; break;
-        case HAL_PWM_CH3: TIM1->CCMR2 |= TIM_CCMR2_OC3PE; break;
-        case HAL_PWM_CH4: TIM1->CCMR2 |= TIM_CCMR2_OC4PE; break;
-        default:          break;
+        return HAL_STATUS_ERROR;
     }
+
+    // Timer clocks per PWM period: (PSC+1) * (ARR+1) edge-aligned, (PSC+1) * 2 * ARR center-aligned.
+    uint64_t clocks_per_period = ((uint64_t)t->regs->PSC + 1u) * tim_period_counts(t);
+    if (t->regs->CR1 & TIM_CR1_CMS)
+    {
+        clocks_per_period *= 2u;
+    }
+
+    uint32_t clock_hz  = timer_clock_hz(t);
+    uint64_t achieved_uhz = ((uint64_t)clock_hz * 1000000u + clocks_per_period / 2u) / clocks_per_period;
+    uint64_t requested_uhz = (uint64_t)t->frequency * 1000000u;
+    // uHz of error per Hz requested is parts per million.
+    int64_t  error_ppm = ((int64_t)achieved_uhz - (int64_t)requested_uhz) / (int64_t)(t->frequency ? t->frequency : 1u);
+
+    timing->timer_clock_hz  = clock_hz;
+    timing->requested_hz    = t->frequency;
+    timing->achieved_hz     = (uint32_t)((achieved_uhz + 500000u) / 1000000u);
+    timing->error_ppm       = (error_ppm > INT32_MAX) ? INT32_MAX : (error_ppm < INT32_MIN) ? INT32_MIN : (int32_t)error_ppm;
+    timing->period_counts   = hal_pwm_tim_get_period_counts(timer);
+    timing->resolution_bits = hal_pwm_tim_get_resolution_bits(timer);
+
+    return HAL_STATUS_OK;
 }
 
-static void configure_channel_ccer(hal_pwm_channel_t channel)
+hal_status_t hal_pwm_tim_set_frequency(hal_pwm_timer_t timer, uint32_t pwm_frequency_hz)
 {
-    // CCER: Capture/Compare Enable Register
-    // Set polarity to active high (CC1P=0, CC1NP=0) then enable the channel output.
-    switch (channel)
+    pwm_timer_t *t = get_timer(timer);
+
+    if (!t)
     {
-        case HAL_PWM_CH1:
-            TIM1->CCER &= ~(TIM_CCER_CC1P | TIM_CCER_CC1NP);
-            TIM1->CCER |=   TIM_CCER_CC1E;
-            break;
-        case HAL_PWM_CH2:
-            TIM1->CCER &= ~(TIM_CCER_CC2P | TIM_CCER_CC2NP);
-            TIM1->CCER |=   TIM_CCER_CC2E;
-            break;
-        case HAL_PWM_CH3:
-            TIM1->CCER &= ~(TIM_CCER_CC3P | TIM_CCER_CC3NP);
-            TIM1->CCER |=   TIM_CCER_CC3E;
-            break;
-        case HAL_PWM_CH4:
-            TIM1->CCER &= ~(TIM_CCER_CC4P | TIM_CCER_CC4NP);
-            TIM1->CCER |=   TIM_CCER_CC4E;
-            break;
-        default:
-            break;
+        return HAL_STATUS_ERROR;
+    }
+
+    if (timer_is_borrowed(t))
+    {
+        return HAL_STATUS_BUSY;
     }
+
+    t->frequency = pwm_frequency_hz;
+    retime(t, pwm_frequency_hz, t->regs->CR1 & TIM_CR1_CMS);
+
+    return HAL_STATUS_OK;
 }
 
-static void compute_psc_arr(uint32_t pwm_frequency_hz, uint16_t* psc_out, uint16_t* arr_out)
+/*********************************************************************************************/
+// TIM1
+/*********************************************************************************************/
+
+hal_status_t hal_pwm_timer_init(uint32_t pwm_frequency_hz)
 {
-    // Ensure frequency is non-zero
-    pwm_frequency_hz = pwm_frequency_hz ? pwm_frequency_hz : 1;
-    // Ensure we clamp high side.
-    pwm_frequency_hz = (pwm_frequency_hz > TIM1_FREQ_HZ) ? TIM1_FREQ_HZ : pwm_frequency_hz;
+    return hal_pwm_tim_init(HAL_PWM_TIM1, pwm_frequency_hz);
+}
 
-    // target_count: The number of ticks of the timer 1 clock we must count in
-    // order to create a pwm of the requested hz.
-    // Eg: 20 khz pwm request -> 16,000,000 / 20,000 = 800
-    // This is used to generate a 20 khz clock by repeatedly counting from
-    // 0 -> 799 -> 0 -> 799 -> 0 -> 799 -> ...
-    // and counting each time we roll over.
-    // 0        -> 1        -> 2        -> ...
-    // The rollover count will be a 20 khz clock.
-    uint32_t target_count = TIM1_FREQ_HZ / pwm_frequency_hz;
+hal_status_t hal_pwm_channel_init(hal_pwm_channel_t channel)
+{
+    return hal_pwm_tim_channel_init(HAL_PWM_TIM1, channel);
+}
 
-    // Determine the prescaler (psc): For slow pwm signals (say 200 Hz), we would need
-    // to count very high. For a 16,000,000 timer 1 clock, this would mean repeatedly
-    // counting to 16,000,000 / 200 = 80,000 ticks. The problem is that the counting
-    // register (ARR) is only 16 bits. 80,000 = 0x13880 > 0xFFFF means we can't count
-    // high enough using the 16 bit register. In order to solve this, the prescaler
-    // allows us to divide the input clock when counting. For example, if we set psc to
-    // 1, we get: 80,000 / (1 + 1) = 40,000 which is less than 0xFFFF = 65,535. Now we have
+hal_status_t hal_pwm_enable(hal_pwm_channel_t channel, bool enable)
+{
+    return hal_pwm_tim_enable(HAL_PWM_TIM1, channel, enable);
+}
+
+hal_status_t hal_pwm_set_duty_cycle(hal_pwm_channel_t channel, uint8_t percent)
+{
+    return hal_pwm_tim_set_duty_cycle(HAL_PWM_TIM1, channel, percent);
+}
+
+hal_status_t hal_pwm_set_duty_q16(hal_pwm_channel_t channel, uint16_t duty)
+{
+    return hal_pwm_tim_set_duty_q16(HAL_PWM_TIM1, channel, duty);
+}
+
+hal_status_t hal_pwm_set_duty_all(const uint16_t duties[4])
+{
+    return hal_pwm_tim_set_duty_all(HAL_PWM_TIM1, duties);
+}
+
+hal_status_t hal_pwm_set_duty_counts(hal_pwm_channel_t channel, uint32_t counts)
+{
+    return hal_pwm_tim_set_duty_counts(HAL_PWM_TIM1, channel, counts);
+}
+
+uint32_t hal_pwm_get_period_counts(void)
+{
+    return hal_pwm_tim_get_period_counts(HAL_PWM_TIM1);
+}
+
+uint8_t hal_pwm_get_resolution_bits(void)
+{
+    return hal_pwm_tim_get_resolution_bits(HAL_PWM_TIM1);
+}
+
+hal_status_t hal_pwm_get_timing(hal_pwm_timing_t *timing)
+{
+    return hal_pwm_tim_get_timing(HAL_PWM_TIM1, timing);
+}
+
+void hal_pwm_set_frequency(uint32_t pwm_frequency_hz)
+{
+    (void)hal_pwm_tim_set_frequency(HAL_PWM_TIM1, pwm_frequency_hz);
+}
+
+hal_status_t hal_pwm_set_alignment(hal_pwm_alignment_t alignment)
+{
+    if (!ENUM_IN_RANGE(alignment, _HAL_PWM_ALIGN_MIN, _HAL_PWM_ALIGN_MAX))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // Changing the counting mode restarts the counter, which a stream or a borrower must not see.
+    if (stream.active || timer_is_borrowed(PWM_TIM1))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    // The enum follows the CMS encoding: 00 edge, 01/10/11 center-aligned 1/2/3.
+    retime(PWM_TIM1, PWM_TIM1->frequency, (uint32_t)alignment << TIM_CR1_CMS_Pos);
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_pwm_set_trigger_output(hal_pwm_trigger_t trigger, uint16_t point_q16)
+{
+    if (!ENUM_IN_RANGE(trigger, _HAL_PWM_TRIGGER_MIN, _HAL_PWM_TRIGGER_MAX))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // Every stream burst rewrites CCR4, which would move the trigger point each period.
+    if ((trigger == HAL_PWM_TRIGGER_OC4REF && stream.active) || timer_is_borrowed(PWM_TIM1))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    uint32_t mms = MMS_RESET;
+
+    if (trigger == HAL_PWM_TRIGGER_OC4REF)
+    {
+        // CH4 becomes the trigger. Its output, if initialized, shows the trigger waveform.
+        mms = MMS_OC4REF;
+        ramp_cancel(HAL_PWM_CH4);
+        ch4_is_trigger = true;
+        trigger_point = point_q16;
+        PWM_TIM1->channel_enabled[(int)HAL_PWM_CH4] = false;
+
+        TIM1->CCMR2 |= TIM_CCMR2_OC4PE;
+        tim_ch_set_ocmode(PWM_TIM1, HAL_PWM_CH4, OC_MODE_PWM_2);
+        apply_trigger_point();
+    }
+    else
+    {
+        if (trigger == HAL_PWM_TRIGGER_UPDATE)
+        {
+            mms = MMS_UPDATE;
+        }
+
+        // Hand CH4 back in its safe state.
+        if (ch4_is_trigger)
+        {
+            ch4_is_trigger = false;
+            set_forced_inactive(PWM_TIM1, HAL_PWM_CH4);
+        }
+    }
+
+    // CR2: Control Register 2. MMS: Master mode selection, the source of TRGO.
+    TIM1->CR2 = (TIM1->CR2 & ~TIM_CR2_MMS) | (mms << TIM_CR2_MMS_Pos);
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_pwm_complementary_init(hal_pwm_channel_t channel)
+{
+    if (!ENUM_IN_RANGE(channel, HAL_PWM_CH1, HAL_PWM_CH4))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    if (timer_is_borrowed(PWM_TIM1))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN;
+    configure_af_pin(GPIOB, CHN_FIRST_PIN + (uint32_t)channel, AF_TIM1_TIM2);
+
+    // CCER: The CCxNE/CCxNP pair of each channel sits two bits above CCxE.
+    // Active high, like the main output, then enable.
+    uint32_t shift = 4u * (uint32_t)channel;
+    TIM1->CCER &= ~(TIM_CCER_CC1NP << shift);
+    TIM1->CCER |=  (TIM_CCER_CC1NE << shift);
+
+    // OSSR/OSSI: While an output pair is disabled, or the main output is off, drive the
+    // pins to their inactive level instead of letting them float.
+    TIM1->BDTR |= TIM_BDTR_OSSR | TIM_BDTR_OSSI;
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_pwm_set_dead_time(uint32_t dead_time_ns, uint32_t *actual_ns)
+{
+    // CKD also sets the sampling clock of the input filters.
+    if (timer_is_borrowed(PWM_TIM1))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    for (uint32_t ckd = 0; ckd <= CKD_MAX; ckd++)
+    {
+        // tDTS = 2^CKD timer clock periods. Round up so the gap is never shorter than asked.
+        uint64_t dts_hz = (uint64_t)timer_clock_hz(PWM_TIM1) >> ckd;
+        uint64_t ticks  = ((uint64_t)dead_time_ns * dts_hz + 999999999u) / 1000000000u;
+        uint8_t  dtg     = 0;
+        uint32_t encoded = 0;
+
+        if (ticks > DEAD_TIME_MAX_TICKS || !encode_dead_time((uint32_t)ticks, &dtg, &encoded))
+        {
+            continue;
+        }
+
+        TIM1->CR1  = (TIM1->CR1 & ~TIM_CR1_CKD) | (ckd << TIM_CR1_CKD_Pos);
+        TIM1->BDTR = (TIM1->BDTR & ~TIM_BDTR_DTG) | ((uint32_t)dtg << TIM_BDTR_DTG_Pos);
+
+        if (actual_ns)
+        {
+            *actual_ns = (uint32_t)(((uint64_t)encoded * 1000000000u + dts_hz / 2u) / dts_hz);
+        }
+
+        return HAL_STATUS_OK;
+    }
+
+    return HAL_STATUS_ERROR;
+}
+
+hal_status_t hal_pwm_break_init(const hal_pwm_break_config_t *config)
+{
+    if (!config || !ENUM_IN_RANGE(config->polarity, _HAL_PWM_BREAK_POLARITY_MIN, _HAL_PWM_BREAK_POLARITY_MAX))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN;
+    configure_af_pin(GPIOA, BKIN_PIN, AF_TIM1_TIM2);
+
+    break_callback = config->on_break;
+    break_context  = config->context;
+
+    // BDTR: Break and Dead-Time Register.
+    //  BKE: Break enable. BKP: Break polarity, 1 = active high.
+    //  AOE: Automatic output enable, MOE is set again by the next update event.
+    //  OSSR/OSSI: Outputs driven inactive, not floating, while MOE is off.
+    uint32_t bdtr = TIM1->BDTR & ~(TIM_BDTR_BKP | TIM_BDTR_AOE);
+    bdtr |= TIM_BDTR_BKE | TIM_BDTR_OSSR | TIM_BDTR_OSSI;
+    if (config->polarity == HAL_PWM_BREAK_ACTIVE_HIGH)
+    {
+        bdtr |= TIM_BDTR_BKP;
+    }
+    if (config->auto_restart)
+    {
+        bdtr |= TIM_BDTR_AOE;
+    }
+    TIM1->BDTR = bdtr;
+
+    // A break may already be latched from before the input was configured. SR flags clear
+    // on a written 0, the 1s leave the other flags alone.
+    TIM1->SR = (uint32_t)~TIM_SR_BIF;
+
+    if (break_callback)
+    {
+        TIM1->DIER |= TIM_DIER_BIE;
+        NVIC_EnableIRQ(TIM1_BRK_TIM9_IRQn);
+    }
+    else
+    {
+        TIM1->DIER &= ~TIM_DIER_BIE;
+        NVIC_DisableIRQ(TIM1_BRK_TIM9_IRQn);
+    }
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_pwm_main_output_enable(bool enable)
+{
+    if (!enable)
+    {
+        TIM1->BDTR &= ~TIM_BDTR_MOE;
+        return HAL_STATUS_OK;
+    }
+
+    TIM1->SR = (uint32_t)~TIM_SR_BIF;
+    TIM1->BDTR |= TIM_BDTR_MOE;
+
+    // MOE cannot be set while the break input is still active.
+    if (!(TIM1->BDTR & TIM_BDTR_MOE))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    if (break_callback)
+    {
+        TIM1->DIER |= TIM_DIER_BIE;
+    }
+
+    return HAL_STATUS_OK;
+}
+
+bool hal_pwm_main_output_is_enabled(void)
+{
+    return (TIM1->BDTR & TIM_BDTR_MOE) != 0;
+}
+
+void TIM1_BRK_TIM9_IRQHandler(void)
+{
+    if (!(TIM1->SR & TIM_SR_BIF))
+    {
+        return;
+    }
+
+    // BIF cannot be cleared while the break input is active. Stop listening until the
+    // outputs are turned back on, rather than re-entering for as long as the fault lasts.
+    TIM1->SR = (uint32_t)~TIM_SR_BIF;
+    TIM1->DIER &= ~TIM_DIER_BIE;
+
+    if (break_callback)
+    {
+        break_callback(break_context);
+    }
+}
+
+hal_status_t hal_pwm_ramp_to(hal_pwm_channel_t channel, uint16_t target, uint32_t duration_ms)
+{
+    if (!ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // The stream owns the compare registers, the trigger owns CH4. A borrowed timer has no ramps.
+    if (stream.active || is_trigger_channel(PWM_TIM1, channel) || timer_is_borrowed(PWM_TIM1))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    // Disabled channels only take 0, as with the setters.
+    if (!PWM_TIM1->channel_enabled[(int)channel])
+    {
+        return hal_pwm_set_duty_q16(channel, target);
+    }
+
+    pwm_ramp_t *r    = &ramps[(int)channel];
+    int64_t    start = ramp_start_value(channel);
+    int64_t    end   = (int64_t)target << 16;
+
+    // Stretch the ramp to respect the slew limit.
+    if (r->slew_limit != 0u)
+    {
+        uint64_t distance = (uint64_t)(((start > end) ? start - end : end - start) >> 16);
+        uint64_t min_ms   = (distance * 1000u + r->slew_limit - 1u) / r->slew_limit;
+
+        if (min_ms > duration_ms)
+        {
+            duration_ms = (min_ms > UINT32_MAX) ? UINT32_MAX : (uint32_t)min_ms;
+        }
+    }
+
+    if (duration_ms == 0u || start == end)
+    {
+        return hal_pwm_set_duty_q16(channel, target);
+    }
+
+    // Update events come once per period, or twice when counting up and down.
+    uint64_t updates_per_s = (uint64_t)PWM_TIM1->frequency * ((TIM1->CR1 & TIM_CR1_CMS) ? 2u : 1u);
+    bool     idle          = !(TIM1->DIER & TIM_DIER_UIE);
+
+    CRITICAL_SECTION_ENTER();
+    if (idle)
+    {
+        // Step about HAL_PWM_RAMP_STEP_HZ times a second, but at most once per update event.
+        uint64_t divider = (updates_per_s + HAL_PWM_RAMP_STEP_HZ / 2u) / HAL_PWM_RAMP_STEP_HZ;
+        ramp_divider   = (divider == 0u) ? 1u : (uint32_t)divider;
+        ramp_countdown = ramp_divider;
+    }
+
+    uint64_t steps = ((uint64_t)duration_ms * updates_per_s / 1000u + ramp_divider / 2u) / ramp_divider;
+    steps = (steps == 0u) ? 1u : ((steps > UINT32_MAX) ? UINT32_MAX : steps);
+
+    r->value      = start;
+    r->target     = target;
+    r->steps_left = (uint32_t)steps;
+    r->step       = (end - start) / (int64_t)steps;
+    r->active     = true;
+    CRITICAL_SECTION_EXIT();
+
+    if (idle)
+    {
+        // UIF is set at every update whether or not anyone listens. Only count from here on.
+        TIM1->SR = (uint32_t)~TIM_SR_UIF;
+        TIM1->DIER |= TIM_DIER_UIE;
+        NVIC_EnableIRQ(TIM1_UP_TIM10_IRQn);
+    }
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_pwm_set_slew_limit(hal_pwm_channel_t channel, uint32_t q16_per_second)
+{
+    if (!ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    ramps[(int)channel].slew_limit = q16_per_second;
+
+    return HAL_STATUS_OK;
+}
+
+bool hal_pwm_ramp_is_active(hal_pwm_channel_t channel)
+{
+    return ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX) && ramps[(int)channel].active;
+}
+
+void TIM1_UP_TIM10_IRQHandler(void)
+{
+    if (!(TIM1->SR & TIM_SR_UIF))
+    {
+        return;
+    }
+
+    TIM1->SR = (uint32_t)~TIM_SR_UIF;
+
+    if (--ramp_countdown != 0u)
+    {
+        return;
+    }
+
+    ramp_countdown = ramp_divider;
+
+    // The compare registers are preloaded, so each step takes effect at the next update
+    // event, on a period boundary.
+    bool ramping = false;
+
+    for (int i = 0; i < 4; i++)
+    {
+        pwm_ramp_t *r = &ramps[i];
+
+        if (!r->active)
+        {
+            continue;
+        }
+
+        if (--r->steps_left == 0u)
+        {
+            r->value  = (int64_t)r->target << 16;
+            r->active = false;
+        }
+        else
+        {
+            r->value += r->step;
+        }
+
+        ramp_apply((hal_pwm_channel_t)i, r->value);
+        ramping |= r->active;
+    }
+
+    if (!ramping)
+    {
+        ramp_cancel_all();
+    }
+}
+
+hal_status_t hal_pwm_stream_start(const hal_pwm_stream_config_t *config)
+{
+    if (!stream_config_is_valid(config))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // The burst covers CCR4, so it can not run while CH4 holds the trigger point.
+    if (stream.active || ch4_is_trigger || timer_is_borrowed(PWM_TIM1))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    bool circular = (config->mode == HAL_PWM_STREAM_CIRCULAR);
+
+    ramp_cancel_all();
+
+    stream.mode       = config->mode;
+    stream.buffers[0] = config->buffer;
+    stream.buffers[1] = circular ? NULL : config->second_buffer;
+    stream.frames     = config->frames;
+    stream.on_event   = config->on_event;
+    stream.context    = config->context;
+
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+
+    // The stream must be off before it can be reprogrammed.
+    DMA2_Stream5->CR &= ~DMA_SxCR_EN;
+    while (DMA2_Stream5->CR & DMA_SxCR_EN)
+    {
+    }
+    DMA2->HIFCR = STREAM_FLAGS;
+
+    // Memory to peripheral, half-words on both sides, so no FIFO (direct mode).
+    DMA2_Stream5->PAR  = (uint32_t)(uintptr_t)&TIM1->DMAR;
+    DMA2_Stream5->M0AR = (uint32_t)(uintptr_t)stream.buffers[0];
+    DMA2_Stream5->M1AR = (uint32_t)(uintptr_t)stream.buffers[1];
+    DMA2_Stream5->NDTR = (uint32_t)(stream.frames * STREAM_BURST_LENGTH);
+    DMA2_Stream5->FCR  = 0;
+    DMA2_Stream5->CR   = (STREAM_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_PL_1 | DMA_SxCR_MSIZE_0 |
+                         DMA_SxCR_PSIZE_0 | DMA_SxCR_MINC | DMA_SxCR_DIR_0 | DMA_SxCR_CIRC | DMA_SxCR_TCIE |
+                         DMA_SxCR_TEIE | (circular ? DMA_SxCR_HTIE : DMA_SxCR_DBM);
+
+    // DCR: DMA Control Register. Each request from the update event becomes a burst of
+    // DBL + 1 writes to DMAR, landing on CCR1, CCR2, CCR3 and CCR4 in turn.
+    TIM1->DCR = ((STREAM_BURST_LENGTH - 1u) << TIM_DCR_DBL_Pos) | (STREAM_BURST_BASE << TIM_DCR_DBA_Pos);
+
+    // Enabled channels follow their column of the frames. Output compare mode is not
+    // preloaded, so no update event is needed.
+    for (int i = 0; i < 4; i++)
+    {
+        if (PWM_TIM1->channel_enabled[i])
+        {
+            tim_ch_set_ocmode(PWM_TIM1, (hal_pwm_channel_t)i, OC_MODE_PWM_1);
+        }
+    }
+
+    stream.active = true;
+
+    NVIC_EnableIRQ(DMA2_Stream5_IRQn);
+    DMA2_Stream5->CR |= DMA_SxCR_EN;
+
+    // UDE: Update DMA request enable. From here on the DMA does all the work.
+    TIM1->DIER |= TIM_DIER_UDE;
+
+    return HAL_STATUS_OK;
+}
+
+hal_status_t hal_pwm_stream_queue(hal_pwm_frame_t *next)
+{
+    if (!next || !stream.active || stream.mode != HAL_PWM_STREAM_DOUBLE_BUFFER)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // CT: Current target. Only the address register the DMA is not reading may be written.
+    CRITICAL_SECTION_ENTER();
+    if (DMA2_Stream5->CR & DMA_SxCR_CT)
+    {
+        stream.buffers[0] = next;
+        DMA2_Stream5->M0AR = (uint32_t)(uintptr_t)next;
+    }
+    else
+    {
+        stream.buffers[1] = next;
+        DMA2_Stream5->M1AR = (uint32_t)(uintptr_t)next;
+    }
+    CRITICAL_SECTION_EXIT();
+
+    return HAL_STATUS_OK;
+}
+
+void hal_pwm_stream_stop(void)
+{
+    if (stream.active)
+    {
+        stream_shutdown();
+    }
+}
+
+bool hal_pwm_stream_active(void)
+{
+    return stream.active;
+}
+
+void DMA2_Stream5_IRQHandler(void)
+{
+    uint32_t flags = DMA2->HISR & STREAM_FLAGS;
+    DMA2->HIFCR = flags;
+
+    if (!stream.active)
+    {
+        return;
+    }
+
+    // The DMA disables the stream on a transfer error.
+    if (flags & DMA_HISR_TEIF5)
+    {
+        stream_shutdown();
+        stream_notify(HAL_PWM_STREAM_EVENT_ERROR, NULL, 0);
+        return;
+    }
+
+    size_t half = stream.frames / 2u;
+
+    if (flags & DMA_HISR_HTIF5)
+    {
+        stream_notify(HAL_PWM_STREAM_EVENT_HALF, stream.buffers[0], half);
+    }
+
+    if (flags & DMA_HISR_TCIF5)
+    {
+        if (stream.mode == HAL_PWM_STREAM_CIRCULAR)
+        {
+            stream_notify(HAL_PWM_STREAM_EVENT_COMPLETE, stream.buffers[0] + half, stream.frames - half);
+        }
+        else
+        {
+            // CT has already moved on to the other buffer.
+            size_t finished = (DMA2_Stream5->CR & DMA_SxCR_CT) ? 0u : 1u;
+            stream_notify(HAL_PWM_STREAM_EVENT_COMPLETE, stream.buffers[finished], stream.frames);
+        }
+    }
+}
+
+/*********************************************************************************************/
+// Glue for the other timer users (stm32f4_timer.h)
+/*********************************************************************************************/
+
+TIM_TypeDef *pwm_timer_registers(hal_pwm_timer_t timer)
+{
+    pwm_timer_t *t = get_timer(timer);
+    return t ? t->regs : NULL;
+}
+
+uint32_t pwm_timer_clock_hz(hal_pwm_timer_t timer)
+{
+    pwm_timer_t *t = get_timer(timer);
+    return t ? timer_clock_hz(t) : 0u;
+}
+
+uint32_t pwm_timer_arr_max(hal_pwm_timer_t timer)
+{
+    pwm_timer_t *t = get_timer(timer);
+    return t ? t->arr_max : 0u;
+}
+
+hal_status_t pwm_timer_connect_input(hal_pwm_timer_t timer, hal_pwm_channel_t channel, pwm_timer_owner_t owner)
+{
+    pwm_timer_t *t = get_timer(timer);
+
+    if (!t || !ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX) || owner == PWM_TIMER_OWNER_NONE)
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    if (stream_owns(t) || (t->owner != PWM_TIMER_OWNER_NONE && t->owner != owner))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    t->owner = owner;
+
+    // The update interrupt of a ramp would take UIF from the new user.
+    if (t == PWM_TIM1)
+    {
+        ramp_cancel_all();
+    }
+
+    configure_timer_clocks(t);
+
+    // The input stage is behind the same alternate function as the output.
+    const pwm_pin_t *pin = &t->pins[(int)channel];
+    configure_af_pin(pin->port, pin->pin, t->af);
+
+    t->channel_enabled[(int)channel] = false;
+
+    return HAL_STATUS_OK;
+}
+
+void pwm_timer_release(hal_pwm_timer_t timer, pwm_timer_owner_t owner)
+{
+    pwm_timer_t *t = get_timer(timer);
+
+    if (t && t->owner == owner)
+    {
+        t->owner = PWM_TIMER_OWNER_NONE;
+    }
+}
+
+/// @brief Just for testing.
+/// @warning Grave consequences if used in production code.
+void _test_fixture_hal_pwm_reset_internals()
+{
+    for (int t = 0; t < _HAL_PWM_TIMER_MAX; t++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            timers[t].channel_enabled[i] = false;
+        }
+        timers[t].frequency = 1;
+        timers[t].owner = PWM_TIMER_OWNER_NONE;
+    }
+    stream = (pwm_stream_t){ 0 };
+    for (int i = 0; i < 4; i++)
+    {
+        ramps[i] = (pwm_ramp_t){ 0 };
+    }
+    ramp_divider = 1;
+    ramp_countdown = 1;
+    break_callback = NULL;
+    break_context = NULL;
+    ch4_is_trigger = false;
+    trigger_point = 0;
+}
+
+/*********************************************************************************************/
+// Private Functions
+/*********************************************************************************************/
+
+/**
+ * @brief Reprogram the period for a frequency and counting mode, preserving duty ratios.
+ * @param cms The CR1.CMS bits to count with.
+ */
+static void retime(pwm_timer_t *t, uint32_t pwm_frequency_hz, uint32_t cms)
+{
+    uint32_t psc = 0;
+    uint32_t arr = 1;
+
+    // Frames are raw counts, so rescaling them is up to the caller. PSC and ARR are both
+    // preloaded and take effect at the next update without disturbing the burst sequence.
+    if (stream_owns(t))
+    {
+        compute_timing(t, pwm_frequency_hz, t->regs->CR1 & TIM_CR1_CMS, &psc, &arr);
+        t->regs->PSC = psc;
+        t->regs->ARR = arr;
+        return;
+    }
+
+    // Capture each enabled channel's duty-cycle ratio before the period changes.
+    float ratios[4]   = { 0.0f, 0.0f, 0.0f, 0.0f };
+    bool  was_pwm_mode[4] = { false, false, false, false };
+
+    for (int i = 0; i < 4; i++)
+    {
+        hal_pwm_channel_t ch = (hal_pwm_channel_t)i;
+        if (t->channel_enabled[i] && tim_ch_is_pwm_mode1(t, ch))
+        {
+            was_pwm_mode[i] = true;
+            ratios[i]   = (float)tim_ch_get_ccr(t, ch) / (float)tim_period_counts(t);
+        }
+    }
+
+    // The prescaler search runs while the outputs are still switching.
+    compute_timing(t, pwm_frequency_hz, cms, &psc, &arr);
+
+    // CMS may only change while the counter is stopped. Otherwise it keeps running.
+    if ((t->regs->CR1 & TIM_CR1_CMS) != (cms & TIM_CR1_CMS))
+    {
+        t->regs->CR1 &= ~TIM_CR1_CEN;
+        t->regs->CR1 = (t->regs->CR1 & ~TIM_CR1_CMS) | (cms & TIM_CR1_CMS);
+    }
+
+    apply_psc_arr(t, psc, arr);
+
+    if (t == PWM_TIM1 && ch4_is_trigger)
+    {
+        apply_trigger_point();
+    }
+
+    // Rescale CCR for any channel that was in PWM Mode 1 to preserve its duty-cycle ratio.
+    for (int i = 0; i < 4; i++)
+    {
+        if (!t->channel_enabled[i] || !was_pwm_mode[i])
+        {
+            continue;
+        }
+
+        hal_pwm_channel_t ch    = (hal_pwm_channel_t)i;
+        float             ratio = ratios[i];
+
+        if (ratio > 0.0f && ratio < 1.0f)
+        {
+            uint64_t period = tim_period_counts(t);
+            uint32_t ccr    = (uint32_t)(ratio * (float)period + 0.5f);
+
+            // Avoid accidental 0%.
+            if (ccr == 0u)
+            {
+                ccr = 1u;
+            }
+
+            // Keep within [1..ARR]
+            if (ccr > t->regs->ARR)
+            {
+                ccr = t->regs->ARR;
+            }
+
+            tim_ch_set_ccr(t, ch, ccr);
+            set_pwm_mode1(t, ch);
+            tim_force_update(t);
+        }
+        else if (ratio >= 1.0f)
+        {
+            set_forced_active(t, ch);
+        }
+        else
+        { // ratio == 0.0f
+            set_forced_inactive(t, ch);
+        }
+    }
+}
+
+/**
+ * @brief Place OC4REF's rising edge at trigger_point of TIM1's period, within [1..ARR].
+ *
+ * In PWM Mode 2 OC4REF rises when the counter reaches CCR4 counting up. At 0 it would never
+ * rise, above ARR never either.
+ */
+static void apply_trigger_point(void)
+{
+    uint32_t ccr = (uint32_t)(((uint64_t)trigger_point * tim_period_counts(PWM_TIM1) + 0x8000u) >> 16);
+
+    if (ccr == 0u)
+    {
+        ccr = 1u;
+    }
+
+    if (ccr > TIM1->ARR)
+    {
+        ccr = TIM1->ARR;
+    }
+
+    tim_ch_set_ccr(PWM_TIM1, HAL_PWM_CH4, ccr);
+    tim_force_update(PWM_TIM1);
+}
+
+/**
+ * @brief Common end of every duty cycle setter.
+ *
+ * 0 holds the output low whether or not the channel is enabled, for safety. Anything above
+ * ARR holds it high. Other values are written to CCR with the channel in PWM Mode 1.
+ * Non-zero values are dropped while the channel is disabled.
+ */
+static hal_status_t apply_duty_counts(pwm_timer_t *t, hal_pwm_channel_t channel, uint32_t ccr)
+{
+    if (!ENUM_IN_RANGE(channel, _HAL_PWM_CH_MIN, _HAL_PWM_CH_MAX))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // The stream owns the compare registers, the trigger owns CH4, a borrower the whole timer.
+    if (stream_owns(t) || is_trigger_channel(t, channel) || timer_is_borrowed(t))
+    {
+        return HAL_STATUS_BUSY;
+    }
+
+    // A value set directly ends a ramp.
+    if (t == PWM_TIM1)
+    {
+        ramp_cancel(channel);
+    }
+
+    if (ccr == 0u)
+    {
+        set_forced_inactive(t, channel);
+        tim_ch_set_ccr(t, channel, 0);
+        return HAL_STATUS_OK;
+    }
+
+    if (!t->channel_enabled[(int)channel])
+    {
+        return HAL_STATUS_OK;
+    }
+
+    if (ccr > t->regs->ARR)
+    {
+        set_forced_active(t, channel);
+        return HAL_STATUS_OK;
+    }
+
+    set_pwm_mode1(t, channel);
+    tim_ch_set_ccr(t, channel, ccr);
+    // With OCxPE=1, CCR update latches on next UG/overflow. Force UG to apply now:
+    tim_force_update(t);
+
+    return HAL_STATUS_OK;
+}
+
+/**
+ * @brief Put a pin in the given alternate function, push-pull, no pull.
+ */
+static void configure_af_pin(GPIO_TypeDef *port, uint32_t pin, uint32_t af)
+{
+    uint32_t afr_index = pin / 8u;
+    uint32_t afr_shift = (pin % 8u) * AF_SHIFT_WIDTH;
+
+    port->AFR[afr_index] &= ~(0xFu << afr_shift);
+    port->AFR[afr_index] |=  (af << afr_shift);
+    port->OTYPER &= ~(1u << pin);
+    port->PUPDR  &= ~(GPIO_MODE_MASK << (pin * GPIO_MODE_WIDTH));
+    port->MODER  &= ~(GPIO_MODE_MASK << (pin * GPIO_MODE_WIDTH));
+    port->MODER  |=  (GPIO_MODE_AF << (pin * GPIO_MODE_WIDTH));
+}
+
+/**
+ * @brief Encode a dead-time in tDTS ticks into BDTR.DTG, rounding up to the next step.
+ *
+ * DTG[7:5] selects the range:
+ *   0xx: DTG[7:0] x 1          0 .. 127
+ *   10x: (64 + DTG[5:0]) x 2   128 .. 254
+ *   110: (32 + DTG[4:0]) x 8   256 .. 504
+ *   111: (32 + DTG[4:0]) x 16  512 .. 1008
+ */
+static bool encode_dead_time(uint32_t ticks, uint8_t *dtg_out, uint32_t *ticks_out)
+{
+    uint32_t steps = 0;
+
+    if (ticks <= 127u)
+    {
+        *dtg_out   = (uint8_t)ticks;
+        *ticks_out = ticks;
+    }
+    else if (ticks <= 254u)
+    {
+        steps      = (ticks + 1u) / 2u - 64u;
+        *dtg_out   = (uint8_t)(0x80u | steps);
+        *ticks_out = (64u + steps) * 2u;
+    }
+    else if (ticks <= 504u)
+    {
+        steps      = (ticks + 7u) / 8u - 32u;
+        *dtg_out   = (uint8_t)(0xC0u | steps);
+        *ticks_out = (32u + steps) * 8u;
+    }
+    else if (ticks <= DEAD_TIME_MAX_TICKS)
+    {
+        steps      = (ticks + 15u) / 16u - 32u;
+        *dtg_out   = (uint8_t)(0xE0u | steps);
+        *ticks_out = (32u + steps) * 16u;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Converts a Q16 fraction of the period to timer counts, ARR+1 for full scale.
+ */
+static uint32_t q16_to_counts(const pwm_timer_t *t, uint16_t duty)
+{
+    // Anything above ARR is fully on, in either counting mode.
+    if (duty == HAL_PWM_DUTY_Q16_FULL)
+    {
+        return (uint32_t)t->regs->ARR + 1u;
+    }
+
+    // CCR = round(duty/65536 * period). Same rounding trick with a power of two divisor.
+    // 64-bit so the product cannot overflow whatever ARR holds.
+    return (uint32_t)(((uint64_t)duty * tim_period_counts(t) + 0x8000u) >> 16);
+}
+
+static bool stream_config_is_valid(const hal_pwm_stream_config_t *config)
+{
+    if (!config || !config->buffer || !ENUM_IN_RANGE(config->mode, _HAL_PWM_STREAM_MODE_MIN, _HAL_PWM_STREAM_MODE_MAX))
+    {
+        return false;
+    }
+
+    if (config->frames == 0 || config->frames > HAL_PWM_STREAM_MAX_FRAMES)
+    {
+        return false;
+    }
+
+    if (config->mode == HAL_PWM_STREAM_CIRCULAR)
+    {
+        // The half-transfer interrupt must fall on a frame boundary.
+        return (config->frames % 2u) == 0u;
+    }
+
+    return config->second_buffer && config->second_buffer != config->buffer;
+}
+
+static void stream_shutdown(void)
+{
+    TIM1->DIER &= ~TIM_DIER_UDE;
+    DMA2_Stream5->CR &= ~DMA_SxCR_EN;
+    NVIC_DisableIRQ(DMA2_Stream5_IRQn);
+    DMA2->HIFCR = STREAM_FLAGS;
+    TIM1->DCR = 0;
+    stream.active = false;
+}
+
+static void stream_notify(hal_pwm_stream_event_t event, hal_pwm_frame_t *done, size_t count)
+{
+    if (stream.on_event)
+    {
+        stream.on_event(event, done, count, stream.context);
+    }
+}
+
+/**
+ * @brief The duty cycle a ramp on TIM1 starts from, in Q16.16: where a running ramp is, else
+ * what the channel outputs now.
+ */
+static int64_t ramp_start_value(hal_pwm_channel_t channel)
+{
+    if (ramps[(int)channel].active)
+    {
+        return ramps[(int)channel].value;
+    }
+
+    if (tim_ch_is_forced_high(PWM_TIM1, channel))
+    {
+        return RAMP_FULL;
+    }
+
+    if (!tim_ch_is_pwm_mode1(PWM_TIM1, channel))
+    {
+        return 0;
+    }
+
+    uint64_t period = tim_period_counts(PWM_TIM1);
+    uint64_t ccr    = tim_ch_get_ccr(PWM_TIM1, channel);
+
+    if (ccr >= period)
+    {
+        return RAMP_FULL;
+    }
+
+    int64_t value = (int64_t)((ccr << 32) / period);
+    return (value > RAMP_FULL) ? RAMP_FULL : value;
+}
+
+/**
+ * @brief Write one step of a ramp behind the CCR preload. No update event is forced, so the
+ * counter runs on undisturbed, as in hal_pwm_set_duty_all().
+ */
+static void ramp_apply(hal_pwm_channel_t channel, int64_t value)
+{
+    uint32_t ccr = 0;
+
+    if (value >= RAMP_FULL)
+    {
+        ccr = q16_to_counts(PWM_TIM1, HAL_PWM_DUTY_Q16_FULL);
+    }
+    else if (value > 0)
+    {
+        // CCR = round(value / 2^32 * period). 64 bits hold the product for any 16-bit period.
+        ccr = (uint32_t)(((uint64_t)value * tim_period_counts(PWM_TIM1) + 0x80000000u) >> 32);
+    }
+
+    tim_ch_set_ccr(PWM_TIM1, channel, (ccr > PWM_TIM1->arr_max) ? PWM_TIM1->arr_max : ccr);
+
+    if (!tim_ch_is_pwm_mode1(PWM_TIM1, channel))
+    {
+        tim_ch_set_ocmode(PWM_TIM1, channel, OC_MODE_PWM_1);
+    }
+}
+
+/**
+ * @brief Leave a channel where its ramp got to. The interrupt stops with the last ramp.
+ */
+static void ramp_cancel(hal_pwm_channel_t channel)
+{
+    bool ramping = false;
+
+    if (!ramps[(int)channel].active)
+    {
+        return;
+    }
+
+    CRITICAL_SECTION_ENTER();
+    ramps[(int)channel].active = false;
+    for (int i = 0; i < 4; i++)
+    {
+        ramping |= ramps[i].active;
+    }
+    CRITICAL_SECTION_EXIT();
+
+    if (!ramping)
+    {
+        ramp_cancel_all();
+    }
+}
+
+static void ramp_cancel_all(void)
+{
+    TIM1->DIER &= ~TIM_DIER_UIE;
+    NVIC_DisableIRQ(TIM1_UP_TIM10_IRQn);
+
+    for (int i = 0; i < 4; i++)
+    {
+        ramps[i].active = false;
+    }
+}
+
+
+static pwm_timer_t *get_timer(hal_pwm_timer_t timer_id)
+{
+    return ENUM_IN_RANGE(timer_id, _HAL_PWM_TIMER_MIN, _HAL_PWM_TIMER_MAX) ? &timers[timer_id] : NULL;
+}
+
+static void configure_timer_clocks(const pwm_timer_t *t)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        RCC->AHB1ENR |= t->pins[i].port_clock_enable;
+    }
+
+    if (t->apb2)
+    {
+        RCC->APB2ENR |= t->peripheral_clock_enable;
+    }
+    else
+    {
+        RCC->APB1ENR |= t->peripheral_clock_enable;
+    }
+}
+
+static void configure_channel_preload(const pwm_timer_t *t, hal_pwm_channel_t channel)
+{
+    // Enable CCR preload (OCxPE) so compare register updates latch on update events.
+    switch (channel)
+    {
+        case HAL_PWM_CH1: t->regs->CCMR1 |= TIM_CCMR1_OC1PE; break;
+        case HAL_PWM_CH2: t->regs->CCMR1 |= TIM_CCMR1_OC2PE; break;
+        case HAL_PWM_CH3: t->regs->CCMR2 |= TIM_CCMR2_OC3PE; break;
+        case HAL_PWM_CH4: t->regs->CCMR2 |= TIM_CCMR2_OC4PE; break;
+        default:          break;
+    }
+}
+
+static void configure_channel_ccer(const pwm_timer_t *t, hal_pwm_channel_t channel)
+{
+    TIM_TypeDef *tim = t->regs;
+
+    // CCER: Capture/Compare Enable Register
+    // Set polarity to active high (CC1P=0, CC1NP=0) then enable the channel output.
+    switch (channel)
+    {
+        case HAL_PWM_CH1:
+            tim->CCER &= ~(TIM_CCER_CC1P | TIM_CCER_CC1NP);
+            tim->CCER |=   TIM_CCER_CC1E;
+            break;
+        case HAL_PWM_CH2:
+            tim->CCER &= ~(TIM_CCER_CC2P | TIM_CCER_CC2NP);
+            tim->CCER |=   TIM_CCER_CC2E;
+            break;
+        case HAL_PWM_CH3:
+            tim->CCER &= ~(TIM_CCER_CC3P | TIM_CCER_CC3NP);
+            tim->CCER |=   TIM_CCER_CC3E;
+            break;
+        case HAL_PWM_CH4:
+            tim->CCER &= ~(TIM_CCER_CC4P | TIM_CCER_CC4NP);
+            tim->CCER |=   TIM_CCER_CC4E;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Returns the clock the timer counts, from the current RCC configuration.
+ *
+ * SYSCLK is HSI, HSE or a PLL output, divided by the AHB prescaler into HCLK and by the APB1
+ * (TIM2-TIM5) or APB2 (TIM1, TIM8) prescaler into PCLK. The timers then run at PCLK if the APB
+ * prescaler is 1 and at twice PCLK otherwise. With DCKCFGR.TIMPRE set they run at HCLK for
+ * APB prescalers up to 4 and at four times PCLK above.
+ */
+static uint32_t timer_clock_hz(const pwm_timer_t *t)
+{
+    static const uint16_t ahb_divider[8] = { 2, 4, 8, 16, 64, 128, 256, 512 };
+    uint32_t cfgr = RCC->CFGR;
+    uint32_t sysclk = HSI_CLOCK_HZ;
+
+    switch (cfgr & RCC_CFGR_SWS)
+    {
+        case RCC_CFGR_SWS_HSE:
+            sysclk = HSE_CLOCK_HZ;
+            break;
+
+        case RCC_CFGR_SWS_PLL:
+        case RCC_CFGR_SWS_PLLR:
+        {
+            // VCO = source / PLLM * PLLN, then divided by PLLP (2, 4, 6, 8) or PLLR (2..7).
+            uint32_t pllcfgr = RCC->PLLCFGR;
+            uint32_t source  = (pllcfgr & RCC_PLLCFGR_PLLSRC) ? HSE_CLOCK_HZ : HSI_CLOCK_HZ;
+            uint32_t pllm    = (pllcfgr & RCC_PLLCFGR_PLLM) >> RCC_PLLCFGR_PLLM_Pos;
+            uint32_t plln    = (pllcfgr & RCC_PLLCFGR_PLLN) >> RCC_PLLCFGR_PLLN_Pos;
+            uint32_t divider = ((cfgr & RCC_CFGR_SWS) == RCC_CFGR_SWS_PLL)
+                                   ? (((pllcfgr & RCC_PLLCFGR_PLLP) >> RCC_PLLCFGR_PLLP_Pos) + 1u) * 2u
+                                   : (pllcfgr & RCC_PLLCFGR_PLLR) >> RCC_PLLCFGR_PLLR_Pos;
+
+            // PLLM, PLLN and PLLR of 0 or 1 are invalid settings. Stay on the reset clock.
+            if (pllm >= 2u && plln >= 2u && divider >= 2u)
+            {
+                sysclk = (uint32_t)((uint64_t)source / pllm * plln / divider);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    // HPRE: 0xxx is /1, 1000 to 1111 are /2 to /512, skipping /32.
+    uint32_t hpre = (cfgr & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos;
+    uint32_t hclk = (hpre & 0x8u) ? sysclk / ahb_divider[hpre & 0x7u] : sysclk;
+
+    // PPREx: 0xx is /1, 100 to 111 are /2 to /16.
+    uint32_t ppre = t->apb2 ? (cfgr & RCC_CFGR_PPRE2) >> RCC_CFGR_PPRE2_Pos
+                            : (cfgr & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos;
+    uint32_t apb_divider = (ppre & 0x4u) ? (2u << (ppre & 0x3u)) : 1u;
+    uint32_t pclk = hclk / apb_divider;
+
+    if (RCC->DCKCFGR & RCC_DCKCFGR_TIMPRE)
+    {
+        return (apb_divider <= 4u) ? hclk : pclk * 4u;
+    }
+
+    return (apb_divider == 1u) ? pclk : pclk * 2u;
+}
+
+/**
+ * @brief Plan PSC and ARR for a frequency: the most resolution first, the least frequency error second.
+ */
+static void compute_psc_arr(uint32_t clock_hz, uint32_t arr_max, uint32_t pwm_frequency_hz, uint32_t* psc_out, uint32_t* arr_out)
+{
+    // Ensure frequency is non-zero
+    pwm_frequency_hz = pwm_frequency_hz ? pwm_frequency_hz : 1;
+    // Ensure we clamp high side.
+    pwm_frequency_hz = (pwm_frequency_hz > clock_hz) ? clock_hz : pwm_frequency_hz;
+
+    // target_count: The number of ticks of the timer clock we must count in
+    // order to create a pwm of the requested hz.
+    // Eg: 20 khz pwm request -> 16,000,000 / 20,000 = 800
+    // This is used to generate a 20 khz clock by repeatedly counting from
+    // 0 -> 799 -> 0 -> 799 -> 0 -> 799 -> ...
+    // and counting each time we roll over.
+    // 0        -> 1        -> 2        -> ...
+    // The rollover count will be a 20 khz clock.
+    uint32_t target_count = clock_hz / pwm_frequency_hz;
+
+    // Determine the prescaler (psc): For slow pwm signals (say 200 Hz), we would need
+    // to count very high. For a 16,000,000 timer 1 clock, this would mean repeatedly
+    // counting to 16,000,000 / 200 = 80,000 ticks. The problem is that the counting
+    // register (ARR) is only 16 bits on most timers. 80,000 = 0x13880 > 0xFFFF means we can't count
+    // high enough using the 16 bit register. In order to solve this, the prescaler
+    // allows us to divide the input clock when counting. For example, if we set psc to
+    // 1, we get: 80,000 / (1 + 1) = 40,000 which is less than 0xFFFF = 65,535. Now we have
     // a number small enough that we can count to.
     //
     // The general formula is based on the following:
@@ -515,7 +2047,11 @@ static void compute_psc_arr(uint32_t pwm_frequency_hz, uint16_t* psc_out, uint16
     // Which can be proved using the fact that any integer `a` can be represented by
     // a = q*b + r, where r is the remainder. If r is 0, there is no problem, and the
     // answer is q. If r > 0, then the answer will be ceil(a/b) = q+1.
-    uint32_t psc = (target_count + 0xFFFF) / 0x10000;
+    //
+    // TIM2 and TIM5 have a 32-bit ARR, so b is arr_max + 1 rather than 0x10000, and the
+    // prescaler stays at 0 for every frequency: the full timer clock is used for resolution.
+    uint64_t arr_span = (uint64_t)arr_max + 1u;
+    uint32_t psc = (uint32_t)(((uint64_t)target_count + arr_span - 1u) / arr_span);
 
     // We need to subtract 1 because under the hood the prescaler performs it's job by
     // counting, but starting at zero. So if above, we got psc = 2, we subtract 1 so we
@@ -527,38 +2063,88 @@ static void compute_psc_arr(uint32_t pwm_frequency_hz, uint16_t* psc_out, uint16
     }
 
     // Ensure psc is in 16 bit bounds.
-    if (psc > 0xFFFF)
+    if (psc > PSC_MAX)
     {
-        psc = 0xFFFF;
+        psc = PSC_MAX;
     }
 
-    // Now derive (arr + 1) from psc:
-    uint32_t arr = (target_count / (psc + 1));
-
-    // Ensure ARR is positive before subtracting to get the true ARR.
-    if (arr > 0)
+    // That smallest prescaler gives the most counts per period, and so the most resolution.
+    // It rarely divides the clock exactly though: 100 Hz from 16 MHz takes psc = 2 and
+    // 53333.33 counts, 0.0006% off. A larger prescaler may fit better without costing
+    // a whole bit of resolution: psc = 3 and 40000 counts is exact, and still 15 bits.
+    // So try every prescaler up to the first that loses a bit, rounding the counts to
+    // the nearest whole number each time, and keep the one with the smallest error.
+    uint32_t best_psc    = psc;
+    uint64_t best_counts = 0;
+    uint64_t best_error  = 0;
+    uint64_t min_counts  = 0;
+
+    for (uint32_t candidate = psc; candidate <= PSC_MAX; candidate++)
     {
-        arr -= 1;
+        uint64_t divider = (uint64_t)(candidate + 1u) * pwm_frequency_hz;
+        uint64_t counts  = ((uint64_t)clock_hz + divider / 2u) / divider;
+
+        if (counts > arr_span)
+        {
+            counts = arr_span;
+        }
+
+        // ARR must never be zero, see below.
+        if (counts < 2u)
+        {
+            counts = 2u;
+        }
+
+        if (candidate == psc)
+        {
+            // The resolution of the smallest prescaler, in whole bits, is the floor for the rest.
+            min_counts = 1u;
+            while (min_counts * 2u <= counts)
+            {
+                min_counts *= 2u;
+            }
+        }
+        else if (counts < min_counts)
+        {
+            break;
+        }
+
+        // Relative error |clock - counts * divider| / (counts * divider). Compared across
+        // candidates by cross-multiplying, every term fits in 64 bits.
+        uint64_t produced = counts * divider;
+        uint64_t error    = (produced > clock_hz) ? produced - clock_hz : clock_hz - produced;
+
+        if (candidate == psc || error * (best_counts * (best_psc + 1u)) < best_error * (counts * (candidate + 1u)))
+        {
+            best_psc    = candidate;
+            best_counts = counts;
+            best_error  = error;
+        }
+
+        if (error == 0u)
+        {
+            break;
+        }
     }
 
-    // Ensure ARR is never zero. Only perform the subtraction if it doesn't take us to zero.
+    psc = best_psc;
+
+    // Now derive ARR from (arr + 1).
+    uint64_t arr = best_counts - 1u;
+
     // ARR must never be zero because it ruins the counting loop 0 -> ARR -> 0 -> ARR -> ... and
     // floods the system with constant update events. A genuine PWM cannot be generated at all in
-    // the case ARR = 0.
-    if (arr == 0)
-    {
-        arr = 1;
-    }
+    // the case ARR = 0. The search above never goes below two counts.
 
-    // Ensure arr is in 16 bit bounds.
-    if (arr > 0xFFFF)
+    // Ensure arr is in the bounds of the timer.
+    if (arr > arr_max)
     {
-        arr = 0xFFFF;
+        arr = arr_max;
     }
 
     if (psc_out && arr_out)
     {
-        *psc_out = (uint16_t)psc;
-        *arr_out = (uint16_t)arr;
+        *psc_out = psc;
+        *arr_out = (uint32_t)arr;
     }
 }
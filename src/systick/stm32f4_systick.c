@@ -15,6 +15,7 @@
 #include "stm32f4_hal.h"
 
 #define SYSTICK_LOAD_VAL (16000 - 1U)
+#define CYCLES_PER_US    16U
 #define CTRL_ENABLE      (1U << 0)
 #define CTRL_TICKINT     (1U << 1)
 #define CTRL_CLKSRC      (1U << 2)
@@ -74,6 +75,27 @@ uint32_t hal_get_tick(void)
     return tick_ms;
 }
 
+uint32_t hal_get_time_us(void)
+{
+    uint32_t ms;
+    uint32_t val;
+
+    // Retry if the tick moved while VAL was being read. VAL reloads with each tick.
+    do
+    {
+        ms = tick_ms;
+        val = SysTick->VAL;
+    } while (ms != tick_ms);
+
+    if (val > SYSTICK_LOAD_VAL)
+    {
+        val = SYSTICK_LOAD_VAL;
+    }
+
+    // VAL counts down from LOAD through the millisecond.
+    return (ms * 1000U) + ((SYSTICK_LOAD_VAL - val) / CYCLES_PER_US);
+}
+
 void hal_delay_ms(uint32_t delay_ms)
 {
     uint32_t start = tick_ms;
@@ -0,0 +1,178 @@
+/**
+ * @file systick_periodic.c
+ * @brief Client tables of the periodic engines, counted down by one SysTick software timer.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifdef DESKTOP_BUILD
+#include "registers.h"
+#else
+#include "stm32f4xx.h"
+#endif
+
+#include "systick_periodic.h"
+#include "hal/systick.h"
+
+#define PERIODIC_TICK_MS 1
+
+static void periodic_tick(void);
+static void release_timer_if_idle(void);
+
+/* Private variables */
+static periodic_table_t *volatile tables = NULL;
+static hal_timer_handle_t periodic_timer = HAL_TIMER_INVALID_HANDLE;
+
+bool periodic_contains(const periodic_table_t *table, const void *client)
+{
+    if (!table || !client)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->slots[i].client == client)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+hal_status_t periodic_add(periodic_table_t *table, void *client, uint32_t period_ms)
+{
+    hal_status_t status = HAL_STATUS_ERROR;
+
+    if (!table || !client || period_ms == 0 || periodic_contains(table, client))
+    {
+        return HAL_STATUS_ERROR;
+    }
+
+    // The timer driver has its own critical section, so the timer is registered outside of ours.
+    if (periodic_timer == HAL_TIMER_INVALID_HANDLE)
+    {
+        periodic_timer = hal_systick_timer_register(PERIODIC_TICK_MS, HAL_TIMER_PERIODIC, periodic_tick);
+        if (periodic_timer == HAL_TIMER_INVALID_HANDLE)
+        {
+            return HAL_STATUS_ERROR;
+        }
+    }
+
+    CRITICAL_SECTION_ENTER();
+    if (!table->linked)
+    {
+        table->next = tables;
+        table->linked = true;
+        tables = table;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        periodic_slot_t *slot = &table->slots[i];
+
+        if (!slot->client)
+        {
+            slot->period_ms = period_ms;
+            slot->remaining_ms = period_ms;
+            slot->client = client;
+            status = HAL_STATUS_OK;
+            break;
+        }
+    }
+    CRITICAL_SECTION_EXIT();
+
+    if (status != HAL_STATUS_OK)
+    {
+        release_timer_if_idle();
+    }
+
+    return status;
+}
+
+void periodic_remove(periodic_table_t *table, const void *client)
+{
+    if (!table || !client)
+    {
+        return;
+    }
+
+    CRITICAL_SECTION_ENTER();
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->slots[i].client == client)
+        {
+            table->slots[i].client = NULL;
+        }
+    }
+    CRITICAL_SECTION_EXIT();
+
+    release_timer_if_idle();
+}
+
+/// @brief Just for testing.
+/// @warning Grave consequences if used in production code.
+void _test_fixture_systick_periodic_reset_internals(void)
+{
+    periodic_table_t *table = tables;
+
+    while (table)
+    {
+        periodic_table_t *next = table->next;
+
+        for (size_t i = 0; i < table->capacity; i++)
+        {
+            table->slots[i].client = NULL;
+        }
+        table->next = NULL;
+        table->linked = false;
+        table = next;
+    }
+
+    tables = NULL;
+    periodic_timer = HAL_TIMER_INVALID_HANDLE;
+}
+
+/// @brief SysTick timer callback. Runs in interrupt context every PERIODIC_TICK_MS.
+static void periodic_tick(void)
+{
+    for (periodic_table_t *table = tables; table; table = table->next)
+    {
+        for (size_t i = 0; i < table->capacity; i++)
+        {
+            periodic_slot_t *slot = &table->slots[i];
+            void *client = slot->client;
+
+            if (!client || --slot->remaining_ms != 0)
+            {
+                continue;
+            }
+
+            slot->remaining_ms = slot->period_ms;
+            table->due(client);
+        }
+    }
+}
+
+static void release_timer_if_idle(void)
+{
+    if (periodic_timer == HAL_TIMER_INVALID_HANDLE)
+    {
+        return;
+    }
+
+    for (periodic_table_t *table = tables; table; table = table->next)
+    {
+        for (size_t i = 0; i < table->capacity; i++)
+        {
+            if (table->slots[i].client)
+            {
+                return;
+            }
+        }
+    }
+
+    hal_systick_timer_deregister(periodic_timer);
+    periodic_timer = HAL_TIMER_INVALID_HANDLE;
+}
@@ -0,0 +1,239 @@
+/**
+ * @file i2c_sim.h
+ * @brief Behavioral model of an I2C bus and its target devices for the desktop build.
+ *
+ * The model plays the part of the I2C peripheral and everything on the wire. It watches the
+ * simulated registers for what the driver asks for (START and STOP in CR1, bytes written to DR,
+ * ACK and POS for the bytes it receives), moves bytes to and from virtual target devices, raises
+ * the SR1/SR2 flags the reference manual describes and calls the interrupt handlers the driver
+ * enabled. Full transactions, including the queue and the servicer, then run without hand
+ * written register sequences.
+ *
+ * Time advances one bus event per step: a START, a STOP or a byte with its acknowledge. Bus time
+ * is accounted as at 100 kHz, or at 400 kHz while CCR.FS is set, so runs can be compared.
+ *
+ * 10-bit addressing is modelled. A write header is acknowledged by any 10-bit device with matching
+ * top bits and raises ADD10. The low address byte written next selects the device. A read header
+ * after a repeated START reaches the 10-bit device last selected that way, as long as no other
+ * address went out in between.
+ *
+ * The SMBus Packet Error Code is modelled as well. The CRC-8 of every byte since the last STOP is
+ * kept, a PEC byte goes out after the last byte written while CR1.PEC is set, and a byte received
+ * while CR1.PEC is set is checked against it, raising PECERR on a mismatch.
+ *
+ * Limitations, since plain memory stands in for the registers:
+ * - Reads of DR can not be observed. A handler call made while RXNE or, during reception, BTF is
+ *   set is taken to read DR once, which is what the reference manual sequences do. RXNE is reported
+ *   clear while BTF is set so that no call reads twice.
+ * - ADDR is taken to be cleared by the handler call that sees it.
+ * - Writes to DR are detected by parking @ref I2C_SIM_DR_EMPTY in DR whenever it is empty. Received
+ *   bytes carry a tag in the upper bits of DR for the same reason. The driver only keeps the low byte.
+ * - Only controller mode is modelled.
+ *
+ * @note Include registers.h before this header.
+ *
+ * Copyright (c) 2025 - 2026 Cory McKiel.
+ * Licensed under the MIT License. See LICENSE file in the project root.
+ */
+#ifndef _I2C_SIM_H
+#define _I2C_SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Parked in DR while it holds nothing. Any byte the driver writes replaces it.
+#define I2C_SIM_DR_EMPTY 0xFFFFFFFFU
+
+/// Bus time of one byte plus its acknowledge at 100 kHz.
+#define I2C_SIM_BYTE_TIME_US 90
+/// Bus time of one byte plus its acknowledge at 400 kHz.
+#define I2C_SIM_FAST_BYTE_TIME_US 23
+/// Bus time of a START or STOP condition at 100 kHz.
+#define I2C_SIM_CONDITION_TIME_US 5
+
+#define I2C_SIM_EEPROM_SIZE 256
+
+/// Commands of an SMBus device, each with its own block.
+#define I2C_SIM_SMBUS_COMMANDS  16
+/// Largest block an SMBus device holds per command.
+#define I2C_SIM_SMBUS_BLOCK_MAX 32
+
+typedef struct i2c_sim_device i2c_sim_device_t;
+
+/**
+ * @brief Behavior of a virtual target device.
+ */
+typedef struct {
+    bool (*start)(i2c_sim_device_t *device, bool read);    /*!< Addressed after a START or repeated START. Return true to ACK. */
+    bool (*write)(i2c_sim_device_t *device, uint8_t byte); /*!< Byte written by the controller. Return true to ACK. */
+    uint8_t (*read)(i2c_sim_device_t *device);             /*!< Next byte to send to the controller. */
+    void (*stop)(i2c_sim_device_t *device);                /*!< STOP condition after the device was addressed. */
+} i2c_sim_device_ops_t;
+
+/**
+ * @brief Common part of every virtual target device. Embedded first in each device type.
+ */
+struct i2c_sim_device {
+    const i2c_sim_device_ops_t *ops;
+    uint16_t address;         /*!< 7-bit address, or 10-bit with ten_bit set. */
+    bool ten_bit;             /*!< Answers to a 10-bit address. Set after the device's init function. */
+    i2c_sim_device_t *next;   /*!< Next device on the same bus. */
+    uint8_t bus_pec;          /*!< PEC of the message up to the byte being moved. Kept by the bus model. */
+};
+
+/**
+ * @brief A 24C02 style EEPROM.
+ *
+ * The first byte of a write sets the word address. Following bytes are written within the current
+ * page, wrapping at the page boundary. Reads are sequential over the whole memory. After a write,
+ * the internal write cycle NACKs the device address a set number of times.
+ */
+typedef struct {
+    i2c_sim_device_t base;
+    uint8_t memory[I2C_SIM_EEPROM_SIZE];
+    size_t page_size;
+    uint32_t write_cycle_nacks;  /*!< Address NACKs after every write. */
+    uint32_t busy_remaining;     /*!< Address NACKs left in the current write cycle. */
+    uint8_t pointer;
+    bool pointer_set;
+    bool wrote;
+} i2c_sim_eeprom_t;
+
+/**
+ * @brief A register based sensor. The first byte of a write sets the register pointer, which
+ * auto-increments over reads and writes.
+ */
+typedef struct {
+    i2c_sim_device_t base;
+    uint8_t registers[256];
+    uint8_t pointer;
+    bool pointer_set;
+} i2c_sim_register_device_t;
+
+/**
+ * @brief A device that acknowledges its address and a set number of bytes, then NACKs.
+ */
+typedef struct {
+    i2c_sim_device_t base;
+    size_t bytes_before_nack;  /*!< Data bytes acknowledged after each START. */
+    size_t bytes_received;
+} i2c_sim_nack_device_t;
+
+/**
+ * @brief An SMBus device such as a battery gauge, with one block per command.
+ *
+ * Block Write of a command replaces its block. Block Read of a command returns it, length byte first.
+ * With pec set, every read ends in a PEC, and a write whose PEC does not match is NACKed and dropped.
+ * Writes without a PEC are accepted either way.
+ */
+typedef struct {
+    i2c_sim_device_t base;
+    uint8_t blocks[I2C_SIM_SMBUS_COMMANDS][I2C_SIM_SMBUS_BLOCK_MAX];
+    uint8_t block_lengths[I2C_SIM_SMBUS_COMMANDS];  /*!< May be set beyond the block to announce a bogus length. */
+    bool pec;
+    bool corrupt_pec;            /*!< Send a wrong PEC on reads. */
+    uint32_t pecs_checked;       /*!< Writes that ended in a matching PEC. */
+    uint32_t pec_errors;         /*!< Writes that ended in a wrong PEC. */
+
+    // The message in progress.
+    uint8_t command;
+    size_t index;                /*!< Bytes moved since the device was addressed. */
+    uint8_t pending[I2C_SIM_SMBUS_BLOCK_MAX];
+    size_t pending_length;
+    bool pending_valid;
+} i2c_sim_smbus_device_t;
+
+typedef enum {
+    I2C_SIM_STATE_IDLE,
+    I2C_SIM_STATE_ADDRESS,      /*!< START sent, waiting for the address in DR. */
+    I2C_SIM_STATE_ADDRESS10,    /*!< 10-bit header acknowledged, waiting for the low address byte in DR. */
+    I2C_SIM_STATE_ADDR_WAIT,    /*!< Address acknowledged, waiting for ADDR to be cleared. */
+    I2C_SIM_STATE_TRANSMIT,
+    I2C_SIM_STATE_RECEIVE,
+    I2C_SIM_STATE_NACKED,       /*!< NACK received, waiting for STOP or repeated START. */
+} i2c_sim_state_t;
+
+/**
+ * @brief One simulated bus.
+ */
+typedef struct {
+    // Wiring.
+    I2C_TypeDef *regs;
+    void (*ev_handler)(void);
+    void (*er_handler)(void);
+    size_t ev_irqn;
+    size_t er_irqn;
+    i2c_sim_device_t *devices;
+
+    // Bus state.
+    i2c_sim_state_t state;
+    i2c_sim_device_t *addressed;
+    i2c_sim_device_t *addr10_target; // 10-bit device selected for writing. A read header after a repeated START reaches it.
+    uint8_t addr10_high;        // Top two address bits of the header being answered.
+    uint8_t shift;              // The shift register.
+    bool shift_full;
+    bool receive_nacked;        // The byte last received was NACKed. The target stops sending.
+    bool pos_ack;               // With POS set, the ACK programmed for the byte now being received.
+    uint8_t pec;                // CRC-8 of the message since the last STOP.
+
+    // Statistics.
+    uint32_t ev_irq_calls;
+    uint32_t er_irq_calls;
+    uint32_t starts;
+    uint32_t stops;
+    uint32_t bytes;             // Address and data bytes on the wire.
+    uint32_t bus_time_us;
+} i2c_sim_t;
+
+/**
+ * @brief Wire a model to one simulated peripheral and its interrupt handlers.
+ */
+void i2c_sim_init(i2c_sim_t *sim, I2C_TypeDef *regs, void (*ev_handler)(void), void (*er_handler)(void),
+                  size_t ev_irqn, size_t er_irqn);
+
+/**
+ * @brief Put a device on the bus.
+ */
+void i2c_sim_attach(i2c_sim_t *sim, i2c_sim_device_t *device);
+
+/**
+ * @brief Have another controller win arbitration during the current transfer.
+ *
+ * Raises ARLO and releases the bus the way the peripheral does when it drops out of controller mode.
+ */
+void i2c_sim_lose_arbitration(i2c_sim_t *sim);
+
+/**
+ * @brief Deliver pending interrupts, then advance the bus by one event.
+ *
+ * @return true if anything happened.
+ */
+bool i2c_sim_step(i2c_sim_t *sim);
+
+/**
+ * @brief Step until nothing happens any more or max_steps is reached.
+ *
+ * @return The number of steps that made progress.
+ */
+size_t i2c_sim_run(i2c_sim_t *sim, size_t max_steps);
+
+void i2c_sim_eeprom_init(i2c_sim_eeprom_t *eeprom, uint8_t address, size_t page_size, uint32_t write_cycle_nacks);
+void i2c_sim_register_device_init(i2c_sim_register_device_t *device, uint8_t address);
+void i2c_sim_nack_device_init(i2c_sim_nack_device_t *device, uint8_t address, size_t bytes_before_nack);
+void i2c_sim_smbus_device_init(i2c_sim_smbus_device_t *device, uint8_t address, bool pec);
+
+/**
+ * @brief The SMBus PEC: CRC-8 with polynomial x^8 + x^2 + x + 1, no reflection, initial value 0.
+ */
+uint8_t i2c_sim_crc8(uint8_t crc, uint8_t byte);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _I2C_SIM_H */
@@ -5,11 +5,18 @@ extern "C" {
 #include "stdlib.h"
 #include "stdbool.h"
 
+// Enough for every interrupt of the STM32F446.
+#define NVIC_IRQ_COUNT 97
+
 #define USART2_IRQn 38
 #define USART1_IRQn 37
 
 #define I2C1_EV_IRQn 31
 #define I2C1_ER_IRQn 32
+#define I2C2_EV_IRQn 33
+#define I2C2_ER_IRQn 34
+#define I2C3_EV_IRQn 72
+#define I2C3_ER_IRQn 73
 
 void NVIC_EnableIRQ(size_t interrupt_number);
 bool NVIC_IsIRQEnabled(size_t interrupt_number);
@@ -1030,10 +1030,10 @@ typedef struct
 /** @addtogroup Peripheral_declaration
   * @{
   */
-#define TIM2                ((TIM_TypeDef *) TIM2_BASE)
-#define TIM3                ((TIM_TypeDef *) TIM3_BASE)
-#define TIM4                ((TIM_TypeDef *) TIM4_BASE)
-#define TIM5                ((TIM_TypeDef *) TIM5_BASE)
+// #define TIM2                ((TIM_TypeDef *) TIM2_BASE)
+// #define TIM3                ((TIM_TypeDef *) TIM3_BASE)
+// #define TIM4                ((TIM_TypeDef *) TIM4_BASE)
+// #define TIM5                ((TIM_TypeDef *) TIM5_BASE)
 #define TIM6                ((TIM_TypeDef *) TIM6_BASE)
 #define TIM7                ((TIM_TypeDef *) TIM7_BASE)
 #define TIM12               ((TIM_TypeDef *) TIM12_BASE)
@@ -1050,8 +1050,8 @@ typedef struct
 #define UART4               ((USART_TypeDef *) UART4_BASE)
 #define UART5               ((USART_TypeDef *) UART5_BASE)
 // #define I2C1                ((I2C_TypeDef *) I2C1_BASE)
-#define I2C2                ((I2C_TypeDef *) I2C2_BASE)
-#define I2C3                ((I2C_TypeDef *) I2C3_BASE)
+// #define I2C2                ((I2C_TypeDef *) I2C2_BASE)
+// #define I2C3                ((I2C_TypeDef *) I2C3_BASE)
 #define FMPI2C1             ((FMPI2C_TypeDef *) FMPI2C1_BASE)
 #define CAN1                ((CAN_TypeDef *) CAN1_BASE)
 #define CAN2                ((CAN_TypeDef *) CAN2_BASE)
@@ -1060,7 +1060,7 @@ typedef struct
 #define DAC1                ((DAC_TypeDef *) DAC_BASE)
 #define DAC                 ((DAC_TypeDef *) DAC_BASE) /* Kept for legacy purpose */
 // #define TIM1                ((TIM_TypeDef *) TIM1_BASE)
-#define TIM8                ((TIM_TypeDef *) TIM8_BASE)
+// #define TIM8                ((TIM_TypeDef *) TIM8_BASE)
 // #define USART1              ((USART_TypeDef *) USART1_BASE)
 #define USART6              ((USART_TypeDef *) USART6_BASE)
 #define ADC1                ((ADC_TypeDef *) ADC1_BASE)
@@ -1085,7 +1085,7 @@ typedef struct
 #define SAI2_Block_B        ((SAI_Block_TypeDef *)SAI2_Block_B_BASE)
 // #define GPIOA               ((GPIO_TypeDef *) GPIOA_BASE)
 // #define GPIOB               ((GPIO_TypeDef *) GPIOB_BASE)
-#define GPIOC               ((GPIO_TypeDef *) GPIOC_BASE)
+// #define GPIOC               ((GPIO_TypeDef *) GPIOC_BASE)
 #define GPIOD               ((GPIO_TypeDef *) GPIOD_BASE)
 #define GPIOE               ((GPIO_TypeDef *) GPIOE_BASE)
 #define GPIOF               ((GPIO_TypeDef *) GPIOF_BASE)
@@ -1094,22 +1094,22 @@ typedef struct
 #define CRC                 ((CRC_TypeDef *) CRC_BASE)
 // #define RCC                 ((RCC_TypeDef *) RCC_BASE)
 #define FLASH               ((FLASH_TypeDef *) FLASH_R_BASE)
-#define DMA1                ((DMA_TypeDef *) DMA1_BASE)
-#define DMA1_Stream0        ((DMA_Stream_TypeDef *) DMA1_Stream0_BASE)
+// #define DMA1                ((DMA_TypeDef *) DMA1_BASE)
+// #define DMA1_Stream0        ((DMA_Stream_TypeDef *) DMA1_Stream0_BASE)
 #define DMA1_Stream1        ((DMA_Stream_TypeDef *) DMA1_Stream1_BASE)
-#define DMA1_Stream2        ((DMA_Stream_TypeDef *) DMA1_Stream2_BASE)
+// #define DMA1_Stream2        ((DMA_Stream_TypeDef *) DMA1_Stream2_BASE)
 #define DMA1_Stream3        ((DMA_Stream_TypeDef *) DMA1_Stream3_BASE)
-#define DMA1_Stream4        ((DMA_Stream_TypeDef *) DMA1_Stream4_BASE)
-#define DMA1_Stream5        ((DMA_Stream_TypeDef *) DMA1_Stream5_BASE)
+// #define DMA1_Stream4        ((DMA_Stream_TypeDef *) DMA1_Stream4_BASE)
+// #define DMA1_Stream5        ((DMA_Stream_TypeDef *) DMA1_Stream5_BASE)
 #define DMA1_Stream6        ((DMA_Stream_TypeDef *) DMA1_Stream6_BASE)
 #define DMA1_Stream7        ((DMA_Stream_TypeDef *) DMA1_Stream7_BASE)
-#define DMA2                ((DMA_TypeDef *) DMA2_BASE)
+// #define DMA2                ((DMA_TypeDef *) DMA2_BASE)
 #define DMA2_Stream0        ((DMA_Stream_TypeDef *) DMA2_Stream0_BASE)
-#define DMA2_Stream1        ((DMA_Stream_TypeDef *) DMA2_Stream1_BASE)
-#define DMA2_Stream2        ((DMA_Stream_TypeDef *) DMA2_Stream2_BASE)
+// #define DMA2_Stream1        ((DMA_Stream_TypeDef *) DMA2_Stream1_BASE)
+// #define DMA2_Stream2        ((DMA_Stream_TypeDef *) DMA2_Stream2_BASE)
 #define DMA2_Stream3        ((DMA_Stream_TypeDef *) DMA2_Stream3_BASE)
 #define DMA2_Stream4        ((DMA_Stream_TypeDef *) DMA2_Stream4_BASE)
-#define DMA2_Stream5        ((DMA_Stream_TypeDef *) DMA2_Stream5_BASE)
+// #define DMA2_Stream5        ((DMA_Stream_TypeDef *) DMA2_Stream5_BASE)
 #define DMA2_Stream6        ((DMA_Stream_TypeDef *) DMA2_Stream6_BASE)
 #define DMA2_Stream7        ((DMA_Stream_TypeDef *) DMA2_Stream7_BASE)
 #define DCMI                ((DCMI_TypeDef *) DCMI_BASE)
@@ -15960,6 +15960,9 @@ extern GPIO_TypeDef Sim_GPIOA;
 extern GPIO_TypeDef Sim_GPIOB;
 #define GPIOB (&Sim_GPIOB)
 
+extern GPIO_TypeDef Sim_GPIOC;
+#define GPIOC (&Sim_GPIOC)
+
 extern USART_TypeDef Sim_USART1;
 #define USART1 (&Sim_USART1)
 
@@ -15969,9 +15972,57 @@ extern USART_TypeDef Sim_USART2;
 extern I2C_TypeDef Sim_I2C1;
 #define I2C1 (&Sim_I2C1)
 
+extern I2C_TypeDef Sim_I2C2;
+#define I2C2 (&Sim_I2C2)
+
+extern I2C_TypeDef Sim_I2C3;
+#define I2C3 (&Sim_I2C3)
+
 extern TIM_TypeDef Sim_TIM1;
 #define TIM1 (&Sim_TIM1)
 
+extern TIM_TypeDef Sim_TIM2;
+#define TIM2 (&Sim_TIM2)
+
+extern TIM_TypeDef Sim_TIM3;
+#define TIM3 (&Sim_TIM3)
+
+extern TIM_TypeDef Sim_TIM4;
+#define TIM4 (&Sim_TIM4)
+
+extern TIM_TypeDef Sim_TIM5;
+#define TIM5 (&Sim_TIM5)
+
+extern TIM_TypeDef Sim_TIM8;
+#define TIM8 (&Sim_TIM8)
+
+extern DMA_TypeDef Sim_DMA1;
+#define DMA1 (&Sim_DMA1)
+
+extern DMA_Stream_TypeDef Sim_DMA1_Stream0;
+#define DMA1_Stream0 (&Sim_DMA1_Stream0)
+
+extern DMA_Stream_TypeDef Sim_DMA1_Stream2;
+#define DMA1_Stream2 (&Sim_DMA1_Stream2)
+
+extern DMA_Stream_TypeDef Sim_DMA1_Stream4;
+#define DMA1_Stream4 (&Sim_DMA1_Stream4)
+
+extern DMA_Stream_TypeDef Sim_DMA1_Stream5;
+#define DMA1_Stream5 (&Sim_DMA1_Stream5)
+
+extern DMA_TypeDef Sim_DMA2;
+#define DMA2 (&Sim_DMA2)
+
+extern DMA_Stream_TypeDef Sim_DMA2_Stream1;
+#define DMA2_Stream1 (&Sim_DMA2_Stream1)
+
+extern DMA_Stream_TypeDef Sim_DMA2_Stream2;
+#define DMA2_Stream2 (&Sim_DMA2_Stream2)
+
+extern DMA_Stream_TypeDef Sim_DMA2_Stream5;
+#define DMA2_Stream5 (&Sim_DMA2_Stream5)
+
 extern SysTick_Type Sim_SysTick;
 #define SysTick (&Sim_SysTick)
 
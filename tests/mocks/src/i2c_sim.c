@@ -0,0 +1,834 @@
+#include "registers.h"
+#include "nvic.h"
+#include "i2c_sim.h"
+
+#include <string.h>
+
+// Received bytes are parked in DR with a tag in the upper bits. A driver write never has any,
+// which is how writes to DR are told apart from what the model put there.
+#define DR_RECEIVED_TAG 0x5A000000U
+#define DR_BYTE_MASK    0xFFU
+
+// A 10-bit address header is 11110, the top two address bits, then the direction.
+#define ADDR10_HEADER      0xF0U
+#define ADDR10_HEADER_MASK 0xF8U
+
+#define SR1_EVENT_FLAGS  (I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_ADD10 | I2C_SR1_STOPF | I2C_SR1_BTF)
+#define SR1_BUFFER_FLAGS (I2C_SR1_TXE | I2C_SR1_RXNE)
+#define SR1_ERROR_FLAGS  (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR | I2C_SR1_PECERR | \
+                          I2C_SR1_TIMEOUT | I2C_SR1_SMBALERT)
+
+static bool dispatch(i2c_sim_t *sim);
+static void after_event_handler(i2c_sim_t *sim, uint32_t sr1_seen);
+static bool bus_event(i2c_sim_t *sim);
+static bool at_byte_boundary(i2c_sim_t *sim);
+static bool driver_wrote_dr(const i2c_sim_t *sim);
+static void generate_start(i2c_sim_t *sim);
+static void generate_stop(i2c_sim_t *sim);
+static void send_address(i2c_sim_t *sim);
+static void send_address10(i2c_sim_t *sim);
+static void begin_transfer(i2c_sim_t *sim);
+static bool transmit(i2c_sim_t *sim);
+static bool receive(i2c_sim_t *sim);
+static void update_receive_flags(i2c_sim_t *sim);
+static i2c_sim_device_t *find_device(i2c_sim_t *sim, uint16_t address, bool ten_bit);
+static bool addr10_header_matches(i2c_sim_t *sim, uint8_t high);
+static uint32_t byte_time_us(const i2c_sim_t *sim);
+
+void i2c_sim_init(i2c_sim_t *sim, I2C_TypeDef *regs, void (*ev_handler)(void), void (*er_handler)(void),
+                  size_t ev_irqn, size_t er_irqn)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->regs = regs;
+    sim->ev_handler = ev_handler;
+    sim->er_handler = er_handler;
+    sim->ev_irqn = ev_irqn;
+    sim->er_irqn = er_irqn;
+    sim->state = I2C_SIM_STATE_IDLE;
+}
+
+void i2c_sim_attach(i2c_sim_t *sim, i2c_sim_device_t *device)
+{
+    device->next = sim->devices;
+    sim->devices = device;
+}
+
+bool i2c_sim_step(i2c_sim_t *sim)
+{
+    bool handled = dispatch(sim);
+    bool moved = bus_event(sim);
+    return handled || moved;
+}
+
+size_t i2c_sim_run(i2c_sim_t *sim, size_t max_steps)
+{
+    size_t steps = 0;
+
+    while (steps < max_steps && i2c_sim_step(sim))
+    {
+        steps++;
+    }
+
+    return steps;
+}
+
+void i2c_sim_lose_arbitration(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+
+    // The winner carries on with its own message and ends it. The addressed device sees its STOP.
+    if (sim->addressed && sim->addressed->ops->stop)
+    {
+        sim->addressed->ops->stop(sim->addressed);
+    }
+
+    regs->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_RXNE | I2C_SR1_BTF | I2C_SR1_SB | I2C_SR1_ADDR);
+    regs->SR1 |= I2C_SR1_ARLO;
+    regs->SR2 &= ~(I2C_SR2_MSL | I2C_SR2_BUSY | I2C_SR2_TRA);
+    regs->DR = I2C_SIM_DR_EMPTY;
+
+    sim->addressed = NULL;
+    sim->addr10_target = NULL;
+    sim->state = I2C_SIM_STATE_IDLE;
+    sim->shift_full = false;
+    sim->receive_nacked = false;
+    sim->pec = 0;
+}
+
+/**
+ * @brief Call the interrupt handlers the current flags and enable bits ask for.
+ */
+static bool dispatch(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+    bool called = false;
+
+    uint32_t sr1 = regs->SR1;
+    bool event_pending = (regs->CR2 & I2C_CR2_ITEVTEN) &&
+                         ((sr1 & SR1_EVENT_FLAGS) || ((regs->CR2 & I2C_CR2_ITBUFEN) && (sr1 & SR1_BUFFER_FLAGS)));
+
+    if (event_pending && NVIC_IsIRQEnabled(sim->ev_irqn))
+    {
+        sim->ev_irq_calls++;
+        sim->ev_handler();
+        after_event_handler(sim, sr1);
+        called = true;
+    }
+
+    sr1 = regs->SR1;
+    if ((regs->CR2 & I2C_CR2_ITERREN) && (sr1 & SR1_ERROR_FLAGS) && NVIC_IsIRQEnabled(sim->er_irqn))
+    {
+        sim->er_irq_calls++;
+        sim->er_handler();
+        called = true;
+    }
+
+    return called;
+}
+
+/**
+ * @brief Apply the side effects of the register accesses the handler is assumed to have made.
+ */
+static void after_event_handler(i2c_sim_t *sim, uint32_t sr1_seen)
+{
+    I2C_TypeDef *regs = sim->regs;
+
+    // Reading SR1 then SR2 clears ADDR.
+    if (sr1_seen & I2C_SR1_ADDR)
+    {
+        regs->SR1 &= ~I2C_SR1_ADDR;
+    }
+
+    // Reading DR takes the received byte. The shift register moves up behind it.
+    if (sim->state != I2C_SIM_STATE_TRANSMIT && (regs->SR1 & (I2C_SR1_RXNE | I2C_SR1_BTF)) &&
+        (sr1_seen & (I2C_SR1_RXNE | I2C_SR1_BTF)))
+    {
+        regs->SR1 &= ~I2C_SR1_RXNE;
+        if (sim->shift_full)
+        {
+            regs->DR = DR_RECEIVED_TAG | sim->shift;
+            sim->shift_full = false;
+            regs->SR1 |= I2C_SR1_RXNE;
+        }
+        regs->SR1 &= ~I2C_SR1_BTF;
+    }
+
+    // Writing DR fills the data register. It drops straight into an idle shift register.
+    if (sim->state == I2C_SIM_STATE_TRANSMIT && driver_wrote_dr(sim))
+    {
+        regs->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+        if (!sim->shift_full)
+        {
+            sim->shift = (uint8_t)regs->DR;
+            sim->shift_full = true;
+            regs->DR = I2C_SIM_DR_EMPTY;
+            regs->SR1 |= I2C_SR1_TXE;
+        }
+    }
+}
+
+/**
+ * @brief Advance the bus by one START, STOP or byte, if the driver has asked for one.
+ */
+static bool bus_event(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+
+    if (!(regs->CR1 & I2C_CR1_PE))
+    {
+        return false;
+    }
+
+    if (at_byte_boundary(sim))
+    {
+        if (regs->CR1 & I2C_CR1_START)
+        {
+            generate_start(sim);
+            return true;
+        }
+
+        if (regs->CR1 & I2C_CR1_STOP)
+        {
+            generate_stop(sim);
+            return true;
+        }
+    }
+
+    switch (sim->state)
+    {
+        case I2C_SIM_STATE_ADDRESS:
+            if (driver_wrote_dr(sim))
+            {
+                send_address(sim);
+                return true;
+            }
+            return false;
+
+        case I2C_SIM_STATE_ADDRESS10:
+            if (driver_wrote_dr(sim))
+            {
+                send_address10(sim);
+                return true;
+            }
+            return false;
+
+        case I2C_SIM_STATE_ADDR_WAIT:
+            if (!(regs->SR1 & I2C_SR1_ADDR))
+            {
+                begin_transfer(sim);
+                return true;
+            }
+            return false;
+
+        case I2C_SIM_STATE_TRANSMIT:
+            return transmit(sim);
+
+        case I2C_SIM_STATE_RECEIVE:
+            return receive(sim);
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief True where the reference manual lets a requested START or STOP go out.
+ */
+static bool at_byte_boundary(i2c_sim_t *sim)
+{
+    switch (sim->state)
+    {
+        case I2C_SIM_STATE_IDLE:
+        case I2C_SIM_STATE_NACKED:
+            return true;
+        case I2C_SIM_STATE_TRANSMIT:
+            return !sim->shift_full && sim->regs->DR == I2C_SIM_DR_EMPTY;
+        case I2C_SIM_STATE_RECEIVE:
+            return sim->receive_nacked && !sim->shift_full;
+        default:
+            return false;
+    }
+}
+
+static bool driver_wrote_dr(const i2c_sim_t *sim)
+{
+    return (sim->regs->DR & ~DR_BYTE_MASK) == 0;
+}
+
+static void generate_start(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+
+    regs->CR1 &= ~I2C_CR1_START;
+    sim->starts++;
+    sim->bus_time_us += I2C_SIM_CONDITION_TIME_US;
+
+    // A received byte the driver has not read yet stays in DR.
+    if (!(regs->SR1 & I2C_SR1_RXNE))
+    {
+        regs->DR = I2C_SIM_DR_EMPTY;
+    }
+
+    regs->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+    regs->SR1 |= I2C_SR1_SB;
+    regs->SR2 |= (I2C_SR2_MSL | I2C_SR2_BUSY);
+    regs->SR2 &= ~I2C_SR2_TRA;
+
+    sim->state = I2C_SIM_STATE_ADDRESS;
+    sim->shift_full = false;
+    sim->receive_nacked = false;
+}
+
+static void generate_stop(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+
+    regs->CR1 &= ~I2C_CR1_STOP;
+
+    // Not holding the bus. Nothing goes on the wire.
+    if (sim->state == I2C_SIM_STATE_IDLE)
+    {
+        return;
+    }
+
+    sim->stops++;
+    sim->bus_time_us += I2C_SIM_CONDITION_TIME_US;
+
+    if (sim->addressed && sim->addressed->ops->stop)
+    {
+        sim->addressed->ops->stop(sim->addressed);
+    }
+
+    regs->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF | I2C_SR1_SB | I2C_SR1_ADDR);
+    regs->SR2 &= ~(I2C_SR2_MSL | I2C_SR2_BUSY | I2C_SR2_TRA);
+
+    sim->addressed = NULL;
+    sim->addr10_target = NULL;
+    sim->state = I2C_SIM_STATE_IDLE;
+    sim->shift_full = false;
+    sim->receive_nacked = false;
+    sim->pec = 0;
+}
+
+static void send_address(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+    uint8_t byte = (uint8_t)regs->DR;
+    bool read = (byte & 1U);
+
+    // Reading SR1 followed by the write to DR cleared SB.
+    regs->SR1 &= ~I2C_SR1_SB;
+    regs->DR = I2C_SIM_DR_EMPTY;
+    sim->bytes++;
+    sim->bus_time_us += byte_time_us(sim);
+    sim->pec = i2c_sim_crc8(sim->pec, byte);
+
+    i2c_sim_device_t *device;
+    if ((byte & ADDR10_HEADER_MASK) == ADDR10_HEADER)
+    {
+        uint8_t high = (byte >> 1) & 0x03U;
+
+        if (!read && addr10_header_matches(sim, high))
+        {
+            // Acknowledged by every 10-bit device with these top bits. The low byte picks one.
+            sim->addr10_high = high;
+            regs->SR1 |= I2C_SR1_ADD10;
+            sim->state = I2C_SIM_STATE_ADDRESS10;
+            return;
+        }
+
+        device = (read && sim->addr10_target && (sim->addr10_target->address >> 8) == high) ? sim->addr10_target : NULL;
+    }
+    else
+    {
+        // Another address deselects a 10-bit device.
+        sim->addr10_target = NULL;
+        device = find_device(sim, byte >> 1, false);
+    }
+
+    if (device && device->ops->start(device, read))
+    {
+        sim->addressed = device;
+        regs->SR1 |= I2C_SR1_ADDR;
+        if (read)
+        {
+            regs->SR2 &= ~I2C_SR2_TRA;
+        }
+        else
+        {
+            regs->SR2 |= I2C_SR2_TRA;
+        }
+        sim->state = I2C_SIM_STATE_ADDR_WAIT;
+    }
+    else
+    {
+        regs->SR1 |= I2C_SR1_AF;
+        sim->state = I2C_SIM_STATE_NACKED;
+    }
+}
+
+static void send_address10(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+    uint8_t byte = (uint8_t)regs->DR;
+
+    // Reading SR1 followed by the write to DR cleared ADD10.
+    regs->SR1 &= ~I2C_SR1_ADD10;
+    regs->DR = I2C_SIM_DR_EMPTY;
+    sim->bytes++;
+    sim->bus_time_us += byte_time_us(sim);
+    sim->pec = i2c_sim_crc8(sim->pec, byte);
+
+    i2c_sim_device_t *device = find_device(sim, (uint16_t)((sim->addr10_high << 8) | byte), true);
+    if (device && device->ops->start(device, false))
+    {
+        sim->addressed = device;
+        sim->addr10_target = device;
+        regs->SR1 |= I2C_SR1_ADDR;
+        regs->SR2 |= I2C_SR2_TRA;
+        sim->state = I2C_SIM_STATE_ADDR_WAIT;
+    }
+    else
+    {
+        regs->SR1 |= I2C_SR1_AF;
+        sim->state = I2C_SIM_STATE_NACKED;
+    }
+}
+
+static void begin_transfer(i2c_sim_t *sim)
+{
+    if (sim->regs->SR2 & I2C_SR2_TRA)
+    {
+        sim->state = I2C_SIM_STATE_TRANSMIT;
+        sim->regs->DR = I2C_SIM_DR_EMPTY;
+        sim->regs->SR1 |= I2C_SR1_TXE;
+    }
+    else
+    {
+        sim->state = I2C_SIM_STATE_RECEIVE;
+        // With POS set, the ACK bit applies to the byte after the one being received.
+        // The first byte is acknowledged.
+        sim->pos_ack = true;
+    }
+}
+
+static bool transmit(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+
+    if (!sim->shift_full)
+    {
+        return false;
+    }
+
+    sim->bytes++;
+    sim->bus_time_us += byte_time_us(sim);
+    sim->shift_full = false;
+
+    sim->addressed->bus_pec = sim->pec;
+    sim->pec = i2c_sim_crc8(sim->pec, sim->shift);
+
+    if (!sim->addressed->ops->write(sim->addressed, sim->shift))
+    {
+        regs->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+        regs->SR1 |= I2C_SR1_AF;
+        sim->state = I2C_SIM_STATE_NACKED;
+        return true;
+    }
+
+    if (driver_wrote_dr(sim))
+    {
+        sim->shift = (uint8_t)regs->DR;
+        sim->shift_full = true;
+        regs->DR = I2C_SIM_DR_EMPTY;
+        regs->SR1 |= I2C_SR1_TXE;
+    }
+    else if (regs->CR1 & I2C_CR1_PEC)
+    {
+        // The PEC goes out behind the last byte.
+        regs->CR1 &= ~I2C_CR1_PEC;
+        sim->shift = sim->pec;
+        sim->shift_full = true;
+    }
+    else
+    {
+        // Nothing to send next. SCL is stretched until DR is written or a START or STOP is requested.
+        regs->SR1 |= (I2C_SR1_TXE | I2C_SR1_BTF);
+    }
+
+    return true;
+}
+
+static bool receive(i2c_sim_t *sim)
+{
+    I2C_TypeDef *regs = sim->regs;
+
+    // Stretched with DR and the shift register both full, or the target was told to stop.
+    if (sim->shift_full || sim->receive_nacked)
+    {
+        return false;
+    }
+
+    sim->addressed->bus_pec = sim->pec;
+    uint8_t byte = sim->addressed->ops->read(sim->addressed);
+    bool ack;
+
+    // The byte received with CR1.PEC set is compared against the PEC so far.
+    if (regs->CR1 & I2C_CR1_PEC)
+    {
+        regs->CR1 &= ~I2C_CR1_PEC;
+        if (byte != sim->pec)
+        {
+            regs->SR1 |= I2C_SR1_PECERR;
+        }
+    }
+    sim->pec = i2c_sim_crc8(sim->pec, byte);
+
+    if (regs->CR1 & I2C_CR1_POS)
+    {
+        ack = sim->pos_ack;
+        sim->pos_ack = (regs->CR1 & I2C_CR1_ACK);
+    }
+    else
+    {
+        ack = (regs->CR1 & I2C_CR1_ACK);
+    }
+
+    sim->bytes++;
+    sim->bus_time_us += byte_time_us(sim);
+    sim->receive_nacked = !ack;
+
+    if (regs->SR1 & (I2C_SR1_RXNE | I2C_SR1_BTF))
+    {
+        sim->shift = byte;
+        sim->shift_full = true;
+    }
+    else
+    {
+        regs->DR = DR_RECEIVED_TAG | byte;
+        regs->SR1 |= I2C_SR1_RXNE;
+    }
+
+    update_receive_flags(sim);
+    return true;
+}
+
+/**
+ * @brief BTF when DR and the shift register are both full.
+ *
+ * RXNE is reported clear while BTF is set, so that every handler call takes at most one byte.
+ * Reads of DR can not be observed, so a second read in the same call would see the old byte.
+ */
+static void update_receive_flags(i2c_sim_t *sim)
+{
+    if (sim->shift_full)
+    {
+        sim->regs->SR1 &= ~I2C_SR1_RXNE;
+        sim->regs->SR1 |= I2C_SR1_BTF;
+    }
+}
+
+uint8_t i2c_sim_crc8(uint8_t crc, uint8_t byte)
+{
+    crc ^= byte;
+    for (int bit = 0; bit < 8; bit++)
+    {
+        crc = (crc & 0x80U) ? (uint8_t)((crc << 1) ^ 0x07U) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static i2c_sim_device_t *find_device(i2c_sim_t *sim, uint16_t address, bool ten_bit)
+{
+    for (i2c_sim_device_t *device = sim->devices; device; device = device->next)
+    {
+        if (device->address == address && device->ten_bit == ten_bit)
+        {
+            return device;
+        }
+    }
+
+    return NULL;
+}
+
+static bool addr10_header_matches(i2c_sim_t *sim, uint8_t high)
+{
+    for (i2c_sim_device_t *device = sim->devices; device; device = device->next)
+    {
+        if (device->ten_bit && (device->address >> 8) == high)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t byte_time_us(const i2c_sim_t *sim)
+{
+    return (sim->regs->CCR & I2C_CCR_FS) ? I2C_SIM_FAST_BYTE_TIME_US : I2C_SIM_BYTE_TIME_US;
+}
+
+// ************** EEPROM **************
+
+static bool eeprom_start(i2c_sim_device_t *device, bool read)
+{
+    i2c_sim_eeprom_t *eeprom = (i2c_sim_eeprom_t *)device;
+
+    // Busy with the internal write cycle.
+    if (eeprom->busy_remaining)
+    {
+        eeprom->busy_remaining--;
+        return false;
+    }
+
+    // A write starts with the word address. A read continues from the current one.
+    eeprom->pointer_set = read;
+    return true;
+}
+
+static bool eeprom_write(i2c_sim_device_t *device, uint8_t byte)
+{
+    i2c_sim_eeprom_t *eeprom = (i2c_sim_eeprom_t *)device;
+
+    if (!eeprom->pointer_set)
+    {
+        eeprom->pointer = byte;
+        eeprom->pointer_set = true;
+        return true;
+    }
+
+    // Writes roll over within the page.
+    size_t page_start = eeprom->pointer - (eeprom->pointer % eeprom->page_size);
+    eeprom->memory[eeprom->pointer] = byte;
+    eeprom->pointer = (uint8_t)(page_start + ((eeprom->pointer + 1 - page_start) % eeprom->page_size));
+    eeprom->wrote = true;
+
+    return true;
+}
+
+static uint8_t eeprom_read(i2c_sim_device_t *device)
+{
+    i2c_sim_eeprom_t *eeprom = (i2c_sim_eeprom_t *)device;
+    return eeprom->memory[eeprom->pointer++];
+}
+
+static void eeprom_stop(i2c_sim_device_t *device)
+{
+    i2c_sim_eeprom_t *eeprom = (i2c_sim_eeprom_t *)device;
+
+    if (eeprom->wrote)
+    {
+        eeprom->wrote = false;
+        eeprom->busy_remaining = eeprom->write_cycle_nacks;
+    }
+}
+
+static const i2c_sim_device_ops_t eeprom_ops = {
+    .start = eeprom_start,
+    .write = eeprom_write,
+    .read  = eeprom_read,
+    .stop  = eeprom_stop,
+};
+
+void i2c_sim_eeprom_init(i2c_sim_eeprom_t *eeprom, uint8_t address, size_t page_size, uint32_t write_cycle_nacks)
+{
+    memset(eeprom, 0, sizeof(*eeprom));
+    memset(eeprom->memory, 0xFF, sizeof(eeprom->memory));
+    eeprom->base.ops = &eeprom_ops;
+    eeprom->base.address = address;
+    eeprom->page_size = page_size ? page_size : 1;
+    eeprom->write_cycle_nacks = write_cycle_nacks;
+}
+
+// ************** Register device **************
+
+static bool register_device_start(i2c_sim_device_t *device, bool read)
+{
+    i2c_sim_register_device_t *reg_device = (i2c_sim_register_device_t *)device;
+    reg_device->pointer_set = read;
+    return true;
+}
+
+static bool register_device_write(i2c_sim_device_t *device, uint8_t byte)
+{
+    i2c_sim_register_device_t *reg_device = (i2c_sim_register_device_t *)device;
+
+    if (!reg_device->pointer_set)
+    {
+        reg_device->pointer = byte;
+        reg_device->pointer_set = true;
+    }
+    else
+    {
+        reg_device->registers[reg_device->pointer++] = byte;
+    }
+
+    return true;
+}
+
+static uint8_t register_device_read(i2c_sim_device_t *device)
+{
+    i2c_sim_register_device_t *reg_device = (i2c_sim_register_device_t *)device;
+    return reg_device->registers[reg_device->pointer++];
+}
+
+static const i2c_sim_device_ops_t register_device_ops = {
+    .start = register_device_start,
+    .write = register_device_write,
+    .read  = register_device_read,
+    .stop  = NULL,
+};
+
+void i2c_sim_register_device_init(i2c_sim_register_device_t *device, uint8_t address)
+{
+    memset(device, 0, sizeof(*device));
+    device->base.ops = &register_device_ops;
+    device->base.address = address;
+}
+
+// ************** NACKing device **************
+
+static bool nack_device_start(i2c_sim_device_t *device, bool read)
+{
+    (void)read;
+    ((i2c_sim_nack_device_t *)device)->bytes_received = 0;
+    return true;
+}
+
+static bool nack_device_write(i2c_sim_device_t *device, uint8_t byte)
+{
+    i2c_sim_nack_device_t *nack_device = (i2c_sim_nack_device_t *)device;
+    (void)byte;
+    return nack_device->bytes_received++ < nack_device->bytes_before_nack;
+}
+
+static uint8_t nack_device_read(i2c_sim_device_t *device)
+{
+    (void)device;
+    return 0xFF;
+}
+
+static const i2c_sim_device_ops_t nack_device_ops = {
+    .start = nack_device_start,
+    .write = nack_device_write,
+    .read  = nack_device_read,
+    .stop  = NULL,
+};
+
+void i2c_sim_nack_device_init(i2c_sim_nack_device_t *device, uint8_t address, size_t bytes_before_nack)
+{
+    memset(device, 0, sizeof(*device));
+    device->base.ops = &nack_device_ops;
+    device->base.address = address;
+    device->bytes_before_nack = bytes_before_nack;
+}
+
+// ************** SMBus device **************
+
+static bool smbus_device_start(i2c_sim_device_t *device, bool read)
+{
+    i2c_sim_smbus_device_t *smbus = (i2c_sim_smbus_device_t *)device;
+
+    // A write begins a new command. A read after a repeated START answers the last one.
+    if (!read)
+    {
+        smbus->pending_valid = false;
+        smbus->pending_length = 0;
+    }
+    smbus->index = 0;
+    return true;
+}
+
+static bool smbus_device_write(i2c_sim_device_t *device, uint8_t byte)
+{
+    i2c_sim_smbus_device_t *smbus = (i2c_sim_smbus_device_t *)device;
+    size_t index = smbus->index++;
+
+    if (index == 0)
+    {
+        smbus->command = byte % I2C_SIM_SMBUS_COMMANDS;
+        return true;
+    }
+
+    if (index == 1)
+    {
+        smbus->pending_length = byte;
+        smbus->pending_valid = (byte <= I2C_SIM_SMBUS_BLOCK_MAX);
+        return smbus->pending_valid;
+    }
+
+    if (index - 2 < smbus->pending_length)
+    {
+        smbus->pending[index - 2] = byte;
+        return true;
+    }
+
+    // The byte after the block is its PEC.
+    if (smbus->pec && index - 2 == smbus->pending_length)
+    {
+        if (byte != device->bus_pec)
+        {
+            smbus->pec_errors++;
+            smbus->pending_valid = false;
+            return false;
+        }
+        smbus->pecs_checked++;
+        return true;
+    }
+
+    return false;
+}
+
+static uint8_t smbus_device_read(i2c_sim_device_t *device)
+{
+    i2c_sim_smbus_device_t *smbus = (i2c_sim_smbus_device_t *)device;
+    size_t index = smbus->index++;
+    uint8_t length = smbus->block_lengths[smbus->command];
+
+    if (index == 0)
+    {
+        return length;
+    }
+
+    if (index - 1 < length)
+    {
+        return (index - 1 < I2C_SIM_SMBUS_BLOCK_MAX) ? smbus->blocks[smbus->command][index - 1] : 0xFF;
+    }
+
+    if (smbus->pec && index - 1 == length)
+    {
+        return smbus->corrupt_pec ? (uint8_t)~device->bus_pec : device->bus_pec;
+    }
+
+    return 0xFF;
+}
+
+static void smbus_device_stop(i2c_sim_device_t *device)
+{
+    i2c_sim_smbus_device_t *smbus = (i2c_sim_smbus_device_t *)device;
+
+    // A complete Block Write takes effect at the STOP.
+    if (smbus->pending_valid && smbus->index >= smbus->pending_length + 2)
+    {
+        memcpy(smbus->blocks[smbus->command], smbus->pending, smbus->pending_length);
+        smbus->block_lengths[smbus->command] = (uint8_t)smbus->pending_length;
+    }
+
+    smbus->pending_valid = false;
+}
+
+static const i2c_sim_device_ops_t smbus_device_ops = {
+    .start = smbus_device_start,
+    .write = smbus_device_write,
+    .read  = smbus_device_read,
+    .stop  = smbus_device_stop,
+};
+
+void i2c_sim_smbus_device_init(i2c_sim_smbus_device_t *device, uint8_t address, bool pec)
+{
+    memset(device, 0, sizeof(*device));
+    device->base.ops = &smbus_device_ops;
+    device->base.address = address;
+    device->pec = pec;
+}
@@ -1,29 +1,13 @@
 #include "nvic.h"
 
-// @todo make this an array of bools indexed by IRQn
-// if there is need for more.
-static bool uart1_isr_enabled = false;
-static bool uart2_isr_enabled = false;
-static bool i2c1_ev_isr_enabled = false;
-static bool i2c1_er_isr_enabled = false;
+// Indexed by IRQ number.
+static bool isr_enabled[NVIC_IRQ_COUNT];
 
 void NVIC_EnableIRQ(size_t interrupt_number)
 {
-    if (interrupt_number == USART1_IRQn)
+    if (interrupt_number < NVIC_IRQ_COUNT)
     {
-        uart1_isr_enabled = true;
-    }
-    else if (interrupt_number == USART2_IRQn)
-    {
-        uart2_isr_enabled = true;
-    }
-    else if (interrupt_number == I2C1_EV_IRQn)
-    {
-        i2c1_ev_isr_enabled = true;
-    }
-    else if (interrupt_number == I2C1_ER_IRQn)
-    {
-        i2c1_er_isr_enabled = true;
+        isr_enabled[interrupt_number] = true;
     }
 }
 
@@ -31,21 +15,9 @@ bool NVIC_IsIRQEnabled(size_t interrupt_number)
 {
     bool res = false;
 
-    if (interrupt_number == USART1_IRQn)
-    {
-        res = uart1_isr_enabled;
-    }
-    else if (interrupt_number == USART2_IRQn)
-    {
-        res = uart2_isr_enabled;
-    }
-    else if (interrupt_number == I2C1_EV_IRQn)
-    {
-        res = i2c1_ev_isr_enabled;
-    }
-    else if (interrupt_number == I2C1_ER_IRQn)
+    if (interrupt_number < NVIC_IRQ_COUNT)
     {
-        res = i2c1_er_isr_enabled;
+        res = isr_enabled[interrupt_number];
     }
 
     return res;
@@ -53,20 +25,8 @@ bool NVIC_IsIRQEnabled(size_t interrupt_number)
 
 void NVIC_DisableIRQ(size_t interrupt_number)
 {
-    if (interrupt_number == USART1_IRQn)
-    {
-        uart1_isr_enabled = false;
-    }
-    else if (interrupt_number == USART2_IRQn)
-    {
-        uart2_isr_enabled = false;
-    }
-    else if (interrupt_number == I2C1_EV_IRQn)
-    {
-        i2c1_ev_isr_enabled = false;
-    }
-    else if (interrupt_number == I2C1_ER_IRQn)
+    if (interrupt_number < NVIC_IRQ_COUNT)
     {
-        i2c1_er_isr_enabled = false;
+        isr_enabled[interrupt_number] = false;
     }
 }
@@ -4,8 +4,25 @@
 RCC_TypeDef Sim_RCC = {0};
 GPIO_TypeDef Sim_GPIOA = {0};
 GPIO_TypeDef Sim_GPIOB = {0};
+GPIO_TypeDef Sim_GPIOC = {0};
 USART_TypeDef Sim_USART1 = {0};
 USART_TypeDef Sim_USART2 = {0};
 I2C_TypeDef Sim_I2C1 = {0};
+I2C_TypeDef Sim_I2C2 = {0};
+I2C_TypeDef Sim_I2C3 = {0};
 TIM_TypeDef Sim_TIM1 = {0};
+TIM_TypeDef Sim_TIM2 = {0};
+TIM_TypeDef Sim_TIM3 = {0};
+TIM_TypeDef Sim_TIM4 = {0};
+TIM_TypeDef Sim_TIM5 = {0};
+TIM_TypeDef Sim_TIM8 = {0};
+DMA_TypeDef Sim_DMA1 = {0};
+DMA_Stream_TypeDef Sim_DMA1_Stream0 = {0};
+DMA_Stream_TypeDef Sim_DMA1_Stream2 = {0};
+DMA_Stream_TypeDef Sim_DMA1_Stream4 = {0};
+DMA_Stream_TypeDef Sim_DMA1_Stream5 = {0};
+DMA_TypeDef Sim_DMA2 = {0};
+DMA_Stream_TypeDef Sim_DMA2_Stream1 = {0};
+DMA_Stream_TypeDef Sim_DMA2_Stream2 = {0};
+DMA_Stream_TypeDef Sim_DMA2_Stream5 = {0};
 SysTick_Type Sim_SysTick = {0};
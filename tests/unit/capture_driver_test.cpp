@@ -0,0 +1,277 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/capture.h"
+#include "hal/pwm.h"
+#include "registers.h"
+#include "stm32f4_hal.h"
+
+void _test_fixture_hal_capture_reset_internals();
+void _test_fixture_hal_pwm_reset_internals();
+}
+
+// Input capture, with the edges played into the capture registers by hand.
+class CaptureDriverTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_RCC = { 0 };
+        Sim_GPIOA = { 0 };
+        Sim_GPIOB = { 0 };
+        Sim_TIM2 = { 0 };
+        Sim_TIM3 = { 0 };
+        Sim_TIM4 = { 0 };
+        Sim_TIM5 = { 0 };
+        Sim_DMA1 = { 0 };
+        Sim_DMA1_Stream2 = { 0 };
+
+        _test_fixture_hal_pwm_reset_internals();
+        _test_fixture_hal_capture_reset_internals();
+    }
+
+    static hal_capture_config_t pwm_input(uint32_t min_frequency_hz)
+    {
+        hal_capture_config_t config = {};
+        config.mode = HAL_CAPTURE_PWM_INPUT;
+        config.polarity = HAL_CAPTURE_RISING;
+        config.min_frequency_hz = min_frequency_hz;
+        return config;
+    }
+
+    // CCR1 latched at the end of a period with the pulse in CCR2.
+    static void edge(TIM_TypeDef &tim, uint32_t period, uint32_t pulse)
+    {
+        tim.SR |= (tim.SR & TIM_SR_CC1IF) ? TIM_SR_CC1OF : TIM_SR_CC1IF;
+        tim.CCR1 = period;
+        tim.CCR2 = pulse;
+    }
+};
+
+TEST_F(CaptureDriverTest, PWMInputResetsTheCounterOnEachPeriod)
+{
+    hal_capture_config_t config = pwm_input(250);
+    config.filter = 3;
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM3, &config));
+
+    // CH1 on PB4, alternate function 2.
+    ASSERT_TRUE(Sim_RCC.APB1ENR & RCC_APB1ENR_TIM3EN);
+    ASSERT_EQ((Sim_GPIOB.MODER >> 8) & 0x3u, 0x2u);
+    ASSERT_EQ((Sim_GPIOB.AFR[0] >> 16) & 0xFu, 2u);
+
+    // 16 MHz counts 64000 ticks at 250 Hz, no prescaler needed.
+    ASSERT_EQ(Sim_TIM3.PSC, 0u);
+    ASSERT_EQ(Sim_TIM3.ARR, 0xFFFFu);
+
+    // IC1 and IC2 both from TI1, filtered, CC2 on the falling edge.
+    ASSERT_EQ(Sim_TIM3.CCMR1 & TIM_CCMR1_CC1S, 1u << TIM_CCMR1_CC1S_Pos);
+    ASSERT_EQ(Sim_TIM3.CCMR1 & TIM_CCMR1_CC2S, 2u << TIM_CCMR1_CC2S_Pos);
+    ASSERT_EQ(Sim_TIM3.CCMR1 & TIM_CCMR1_IC1F, 3u << TIM_CCMR1_IC1F_Pos);
+    ASSERT_EQ(Sim_TIM3.CCMR1 & TIM_CCMR1_IC2F, 3u << TIM_CCMR1_IC2F_Pos);
+    ASSERT_EQ(Sim_TIM3.CCER, TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC2P);
+
+    // TI1FP1 resets the counter, only overflows set UIF.
+    ASSERT_EQ(Sim_TIM3.SMCR & TIM_SMCR_TS, 5u << TIM_SMCR_TS_Pos);
+    ASSERT_EQ(Sim_TIM3.SMCR & TIM_SMCR_SMS, 4u << TIM_SMCR_SMS_Pos);
+    ASSERT_EQ(Sim_TIM3.CR1, TIM_CR1_URS | TIM_CR1_CEN);
+    ASSERT_EQ(Sim_TIM3.DIER, 0u);
+
+    // Falling edges start the period instead.
+    config.polarity = HAL_CAPTURE_FALLING;
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM3, &config));
+    ASSERT_EQ(Sim_TIM3.CCER, TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC2E);
+}
+
+TEST_F(CaptureDriverTest, PWMInputReportsFrequencyAndDutyAfterTheFirstPeriod)
+{
+    hal_capture_config_t config = pwm_input(250);
+    hal_capture_result_t result;
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM3, &config));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_capture_read(HAL_PWM_TIM3, &result));
+
+    // The first edge only measures the time since the start.
+    edge(Sim_TIM3, 1234, 0);
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_capture_read(HAL_PWM_TIM3, &result));
+    Sim_TIM3.SR &= ~TIM_SR_CC1IF;
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_capture_read(HAL_PWM_TIM3, &result));
+
+    // 1 kHz at 25 %.
+    edge(Sim_TIM3, 16000, 4000);
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM3, &result));
+    ASSERT_EQ(result.tick_hz, 16000000u);
+    ASSERT_EQ(result.period_ticks, 16000u);
+    ASSERT_EQ(result.pulse_ticks, 4000u);
+    ASSERT_EQ(result.frequency_millihz, 1000000u);
+    ASSERT_EQ(result.duty_q16, 0x4000u);
+    ASSERT_EQ(result.periods, 1u);
+
+    // Later periods are read straight from the registers.
+    edge(Sim_TIM3, 16001, 16001);
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM3, &result));
+    ASSERT_EQ(result.frequency_millihz, 999938u);
+    ASSERT_EQ(result.duty_q16, 0xFFFFu);
+
+    // Two edges before the first read: the overcapture flag says CCR1 is a whole period.
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM3, &config));
+    edge(Sim_TIM3, 1234, 0);
+    edge(Sim_TIM3, 16000, 8000);
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM3, &result));
+    ASSERT_EQ(result.duty_q16, 0x8000u);
+    ASSERT_FALSE(Sim_TIM3.SR & TIM_SR_CC1OF);
+}
+
+TEST_F(CaptureDriverTest, PrescalerIsPickedForTheSlowestInput)
+{
+    hal_capture_config_t config = pwm_input(10);
+    hal_capture_result_t result;
+
+    // 1.6 M ticks at 10 Hz: 25 x 64000 fits 16 bits.
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM4, &config));
+    ASSERT_EQ(Sim_TIM4.PSC, 24u);
+
+    edge(Sim_TIM4, 0, 0);
+    edge(Sim_TIM4, 6399, 3200);
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM4, &result));
+    ASSERT_EQ(result.tick_hz, 640000u);
+    ASSERT_EQ(result.frequency_millihz, 100016u);
+
+    // The 32-bit timers keep the full clock down to 1 Hz.
+    config.min_frequency_hz = 1;
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM2, &config));
+    ASSERT_EQ(Sim_TIM2.PSC, 0u);
+    ASSERT_EQ(Sim_TIM2.ARR, 0xFFFFFFFFu);
+
+    edge(Sim_TIM2, 0, 0);
+    edge(Sim_TIM2, 32000000, 1);
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM2, &result));
+    ASSERT_EQ(result.frequency_millihz, 500u);
+}
+
+TEST_F(CaptureDriverTest, MissingInputTimesOutAndStartsOver)
+{
+    hal_capture_config_t config = pwm_input(250);
+    hal_capture_result_t result;
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM3, &config));
+    edge(Sim_TIM3, 0, 0);
+    edge(Sim_TIM3, 16000, 4000);
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM3, &result));
+
+    // The counter ran over without an edge.
+    Sim_TIM3.SR |= TIM_SR_UIF;
+    ASSERT_EQ(HAL_STATUS_TIMEOUT, hal_capture_read(HAL_PWM_TIM3, &result));
+    ASSERT_FALSE(Sim_TIM3.SR & TIM_SR_UIF);
+
+    // The next edge measures from wherever the counter was.
+    edge(Sim_TIM3, 50000, 0);
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_capture_read(HAL_PWM_TIM3, &result));
+    edge(Sim_TIM3, 16000, 4000);
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM3, &result));
+    ASSERT_EQ(result.period_ticks, 16000u);
+}
+
+TEST_F(CaptureDriverTest, PeriodsAreCopiedByDMAAndAveraged)
+{
+    uint32_t ring[4] = {};
+    hal_capture_config_t config = {};
+    hal_capture_result_t result;
+
+    config.mode = HAL_CAPTURE_PERIODS;
+    config.prescaler = HAL_CAPTURE_EVERY_4TH;
+    config.min_frequency_hz = 250;
+    config.buffer = ring;
+    config.length = 4;
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM5, &config));
+
+    // One in four periods latched, CC2 unused.
+    ASSERT_EQ(Sim_TIM5.CCMR1 & TIM_CCMR1_IC1PSC, 2u << TIM_CCMR1_IC1PSC_Pos);
+    ASSERT_EQ(Sim_TIM5.CCMR1 & TIM_CCMR1_CC2S, 0u);
+    ASSERT_EQ(Sim_TIM5.CCER, TIM_CCER_CC1E);
+    ASSERT_EQ(Sim_TIM5.DIER, TIM_DIER_CC1DE);
+
+    // TIM5_CH1 is DMA1 stream 2 channel 6: CCR1 words into the ring, circular, no interrupts.
+    ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_DMA1EN);
+    ASSERT_EQ(Sim_DMA1_Stream2.PAR, (uint32_t)(uintptr_t)&Sim_TIM5.CCR1);
+    ASSERT_EQ(Sim_DMA1_Stream2.M0AR, (uint32_t)(uintptr_t)ring);
+    ASSERT_EQ(Sim_DMA1_Stream2.NDTR, 4u);
+    ASSERT_EQ(Sim_DMA1_Stream2.CR, (6u << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1 |
+                                   DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_SxCR_EN);
+    ASSERT_EQ(Sim_DMA1.LIFCR, 0x3Du << 16);
+
+    // Entry 0 is the time to the first edge.
+    ring[0] = 1234;
+    Sim_DMA1_Stream2.NDTR = 3;
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_capture_read(HAL_PWM_TIM5, &result));
+
+    ring[1] = 16000;
+    ring[2] = 16002;
+    Sim_DMA1_Stream2.NDTR = 1;
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM5, &result));
+    ASSERT_EQ(result.periods, 2u);
+    ASSERT_EQ(result.period_ticks, 16001u);
+    ASSERT_EQ(result.frequency_millihz, 999938u);
+    ASSERT_EQ(result.pulse_ticks, 0u);
+
+    // Wrapped: all but the entry being overwritten next.
+    ring[3] = 16001;
+    ring[0] = 15999;
+    Sim_DMA1_Stream2.NDTR = 3;
+    Sim_DMA1.LISR = DMA_LISR_TCIF2;
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_read(HAL_PWM_TIM5, &result));
+    ASSERT_EQ(result.periods, 3u);
+    ASSERT_EQ(result.period_ticks, 16001u);
+    ASSERT_EQ(result.frequency_millihz, 999958u);
+
+    // A timeout starts the ring over.
+    Sim_TIM5.SR = TIM_SR_UIF;
+    Sim_DMA1.LIFCR = 0;
+    ASSERT_EQ(HAL_STATUS_TIMEOUT, hal_capture_read(HAL_PWM_TIM5, &result));
+    ASSERT_EQ(Sim_DMA1_Stream2.NDTR, 4u);
+    ASSERT_EQ(Sim_DMA1.LIFCR, 0x3Du << 16);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_stop(HAL_PWM_TIM5));
+    ASSERT_FALSE(Sim_DMA1_Stream2.CR & DMA_SxCR_EN);
+    ASSERT_EQ(Sim_TIM5.CR1, 0u);
+    ASSERT_EQ(Sim_TIM5.DIER, 0u);
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_read(HAL_PWM_TIM5, &result));
+}
+
+TEST_F(CaptureDriverTest, BadConfigsAreRejectedAndPWMIsLeftAlone)
+{
+    uint32_t ring[4] = {};
+    hal_capture_config_t config = pwm_input(250);
+    hal_capture_result_t result;
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_start(HAL_PWM_TIM3, NULL));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_start(_HAL_PWM_TIMER_MAX, &config));
+
+    config.min_frequency_hz = 0;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_start(HAL_PWM_TIM3, &config));
+    config.min_frequency_hz = 250;
+
+    config.filter = HAL_CAPTURE_FILTER_MAX + 1;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_start(HAL_PWM_TIM3, &config));
+    config.filter = 0;
+
+    // Skipping periods would pair CCR2 with the wrong CCR1.
+    config.prescaler = HAL_CAPTURE_EVERY_2ND;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_start(HAL_PWM_TIM3, &config));
+
+    config.mode = HAL_CAPTURE_PERIODS;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_start(HAL_PWM_TIM3, &config));
+    config.buffer = ring;
+    config.length = 1;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_start(HAL_PWM_TIM3, &config));
+    config.mode = _HAL_CAPTURE_MODE_MAX;
+    config.length = 4;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_start(HAL_PWM_TIM3, &config));
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_read(HAL_PWM_TIM3, &result));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_capture_stop(_HAL_PWM_TIMER_MAX));
+
+    // Nothing measuring on TIM3, so stopping does not touch its PWM.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM3, 1000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_stop(HAL_PWM_TIM3));
+    ASSERT_TRUE(Sim_TIM3.CR1 & TIM_CR1_CEN);
+}
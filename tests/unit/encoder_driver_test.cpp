@@ -0,0 +1,298 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/capture.h"
+#include "hal/encoder.h"
+#include "hal/pwm.h"
+#include "hal/systick.h"
+#include "registers.h"
+#include "stm32f4_hal.h"
+
+void SysTick_Handler(void);
+void hal_systick_reset_for_test();
+void _test_fixture_hal_capture_reset_internals();
+void _test_fixture_hal_encoder_reset_internals();
+void _test_fixture_hal_pwm_reset_internals();
+}
+
+static void tick(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        SysTick_Handler();
+    }
+}
+
+// The encoder interface, with the counter moved by hand between SysTick ticks.
+class EncoderDriverTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_RCC = { 0 };
+        Sim_GPIOA = { 0 };
+        Sim_GPIOB = { 0 };
+        Sim_GPIOC = { 0 };
+        Sim_TIM2 = { 0 };
+        Sim_TIM3 = { 0 };
+        Sim_TIM8 = { 0 };
+
+        hal_systick_reset_for_test();
+        _test_fixture_hal_pwm_reset_internals();
+        _test_fixture_hal_encoder_reset_internals();
+        _test_fixture_hal_capture_reset_internals();
+    }
+
+    static hal_encoder_config_t quadrature(uint32_t sample_period_ms)
+    {
+        hal_encoder_config_t config = {};
+        config.mode = HAL_ENCODER_COUNT_BOTH;
+        config.sample_period_ms = sample_period_ms;
+        return config;
+    }
+
+    static int64_t position(hal_pwm_timer_t timer)
+    {
+        hal_encoder_reading_t reading = {};
+        EXPECT_EQ(HAL_STATUS_OK, hal_encoder_read(timer, &reading));
+        return reading.position;
+    }
+};
+
+TEST_F(EncoderDriverTest, StartPutsTheTimerInEncoderMode)
+{
+    hal_encoder_config_t config = quadrature(1);
+    config.filter = 6;
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM8, &config));
+
+    // A on PC6 and B on PC7, alternate function 3.
+    ASSERT_TRUE(Sim_RCC.APB2ENR & RCC_APB2ENR_TIM8EN);
+    ASSERT_EQ((Sim_GPIOC.MODER >> 12) & 0xFu, 0xAu);
+    ASSERT_EQ((Sim_GPIOC.AFR[0] >> 24) & 0xFFu, 0x33u);
+
+    ASSERT_EQ(Sim_TIM8.CCMR1 & (TIM_CCMR1_CC1S | TIM_CCMR1_CC2S), (1u << TIM_CCMR1_CC1S_Pos) | (1u << TIM_CCMR1_CC2S_Pos));
+    ASSERT_EQ(Sim_TIM8.CCMR1 & TIM_CCMR1_IC1F, 6u << TIM_CCMR1_IC1F_Pos);
+    ASSERT_EQ(Sim_TIM8.CCMR1 & TIM_CCMR1_IC2F, 6u << TIM_CCMR1_IC2F_Pos);
+    ASSERT_EQ(Sim_TIM8.CCER, 0u);
+    ASSERT_EQ(Sim_TIM8.SMCR & TIM_SMCR_SMS, 3u << TIM_SMCR_SMS_Pos);
+    ASSERT_EQ(Sim_TIM8.ARR, 0xFFFFu);
+    ASSERT_EQ(Sim_TIM8.PSC, 0u);
+    ASSERT_TRUE(Sim_TIM8.CR1 & TIM_CR1_CEN);
+
+    // Encoder modes 1 and 2, and the reversed direction.
+    config.mode = HAL_ENCODER_COUNT_TI1;
+    config.reverse = true;
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM8, &config));
+    ASSERT_EQ(Sim_TIM8.SMCR & TIM_SMCR_SMS, 1u << TIM_SMCR_SMS_Pos);
+    ASSERT_EQ(Sim_TIM8.CCER, TIM_CCER_CC1P);
+
+    config.mode = HAL_ENCODER_COUNT_TI2;
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM8, &config));
+    ASSERT_EQ(Sim_TIM8.SMCR & TIM_SMCR_SMS, 2u << TIM_SMCR_SMS_Pos);
+}
+
+TEST_F(EncoderDriverTest, PositionIsExtendedPastTheCounterWidth)
+{
+    hal_encoder_config_t config = quadrature(1);
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM3, &config));
+
+    // Forward through several wraps of the 16-bit counter, 30000 counts per snapshot.
+    uint32_t count = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        count = (count + 30000u) & 0xFFFFu;
+        Sim_TIM3.CNT = count;
+        tick(1);
+    }
+    ASSERT_EQ(position(HAL_PWM_TIM3), 300000);
+
+    // Between snapshots the read adds what the counter moved since.
+    Sim_TIM3.CNT = (count + 5u) & 0xFFFFu;
+    ASSERT_EQ(position(HAL_PWM_TIM3), 300005);
+
+    // And back below zero.
+    for (int i = 0; i < 11; i++)
+    {
+        count = (count - 30000u) & 0xFFFFu;
+        Sim_TIM3.CNT = count;
+        tick(1);
+    }
+    ASSERT_EQ(position(HAL_PWM_TIM3), -30000);
+
+    // TIM2 counts to 32 bits.
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM2, &config));
+    ASSERT_EQ(Sim_TIM2.ARR, 0xFFFFFFFFu);
+    Sim_TIM2.CNT = 0x7FFFFFFFu;
+    tick(1);
+    Sim_TIM2.CNT = 0xFFFFFFFEu;
+    tick(1);
+    Sim_TIM2.CNT = 0x7FFFFFFDu;
+    tick(1);
+    ASSERT_EQ(position(HAL_PWM_TIM2), 3LL * 0x7FFFFFFF);
+}
+
+TEST_F(EncoderDriverTest, VelocityComesFromTheSnapshots)
+{
+    hal_encoder_config_t config = quadrature(10);
+    hal_encoder_reading_t reading = {};
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM3, &config));
+
+    Sim_TIM3.CNT = 250;
+    tick(9);
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_read(HAL_PWM_TIM3, &reading));
+    ASSERT_EQ(reading.snapshots, 0u);
+    ASSERT_EQ(reading.velocity_cps, 0);
+    ASSERT_EQ(reading.position, 250);
+
+    // 250 counts in 10 ms.
+    tick(1);
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_read(HAL_PWM_TIM3, &reading));
+    ASSERT_EQ(reading.snapshots, 1u);
+    ASSERT_EQ(reading.velocity_cps, 25000);
+
+    // Backwards across zero.
+    Sim_TIM3.CNT = 0xFFFFu - 49u;
+    tick(10);
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_read(HAL_PWM_TIM3, &reading));
+    ASSERT_EQ(reading.snapshots, 2u);
+    ASSERT_EQ(reading.velocity_cps, -30000);
+    ASSERT_EQ(reading.position, -50);
+
+    // Standing still.
+    tick(10);
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_read(HAL_PWM_TIM3, &reading));
+    ASSERT_EQ(reading.velocity_cps, 0);
+}
+
+TEST_F(EncoderDriverTest, PositionCanBeRedefined)
+{
+    hal_encoder_config_t config = quadrature(1);
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM3, &config));
+
+    Sim_TIM3.CNT = 1000;
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_set_position(HAL_PWM_TIM3, 5000000000LL));
+    ASSERT_EQ(position(HAL_PWM_TIM3), 5000000000LL);
+
+    Sim_TIM3.CNT = 900;
+    tick(1);
+    ASSERT_EQ(position(HAL_PWM_TIM3), 4999999900LL);
+
+    // The counter itself is left running.
+    ASSERT_EQ(Sim_TIM3.CNT, 900u);
+}
+
+TEST_F(EncoderDriverTest, BadArgumentsAreRejectedAndStopFreesTheTimer)
+{
+    hal_encoder_config_t config = quadrature(1);
+    hal_encoder_reading_t reading = {};
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_start(HAL_PWM_TIM3, NULL));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_start(_HAL_PWM_TIMER_MAX, &config));
+    config.sample_period_ms = 0;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_start(HAL_PWM_TIM3, &config));
+    config.sample_period_ms = 1;
+    config.filter = HAL_ENCODER_FILTER_MAX + 1;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_start(HAL_PWM_TIM3, &config));
+    config.filter = 0;
+    config.mode = _HAL_ENCODER_MODE_MAX;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_start(HAL_PWM_TIM3, &config));
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_read(HAL_PWM_TIM3, &reading));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_set_position(HAL_PWM_TIM3, 0));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_stop(_HAL_PWM_TIMER_MAX));
+
+    // Stopping a timer that is not decoding leaves its PWM running.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM3, 1000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_stop(HAL_PWM_TIM3));
+    ASSERT_TRUE(Sim_TIM3.CR1 & TIM_CR1_CEN);
+
+    config.mode = HAL_ENCODER_COUNT_BOTH;
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM3, &config));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_read(HAL_PWM_TIM3, NULL));
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_stop(HAL_PWM_TIM3));
+    ASSERT_EQ(Sim_TIM3.CR1, 0u);
+    ASSERT_EQ(Sim_TIM3.SMCR, 0u);
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_read(HAL_PWM_TIM3, &reading));
+
+    // Started again from zero.
+    Sim_TIM3.CNT = 77;
+    tick(5);
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM3, &config));
+    ASSERT_EQ(Sim_TIM3.CNT, 0u);
+    ASSERT_EQ(position(HAL_PWM_TIM3), 0);
+}
+
+TEST_F(EncoderDriverTest, TimerDoesOneJobAtATime)
+{
+    hal_encoder_config_t config = quadrature(1);
+    hal_capture_config_t capture = {};
+    hal_capture_result_t result = {};
+    capture.mode = HAL_CAPTURE_PWM_INPUT;
+    capture.min_frequency_hz = 250;
+
+    // A timer measuring an input turns the encoder away and keeps measuring.
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM2, &capture));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_encoder_start(HAL_PWM_TIM2, &config));
+    ASSERT_EQ(Sim_TIM2.SMCR & TIM_SMCR_SMS, 4u << TIM_SMCR_SMS_Pos);
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_encoder_read(HAL_PWM_TIM2, NULL));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_capture_read(HAL_PWM_TIM2, &result));
+
+    // And the other way around. Stopping the job the timer is not doing changes nothing.
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM3, &config));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_capture_start(HAL_PWM_TIM3, &capture));
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_stop(HAL_PWM_TIM3));
+    ASSERT_EQ(Sim_TIM3.SMCR & TIM_SMCR_SMS, 3u << TIM_SMCR_SMS_Pos);
+    ASSERT_TRUE(Sim_TIM3.CR1 & TIM_CR1_CEN);
+    Sim_TIM3.CNT = 42;
+    ASSERT_EQ(position(HAL_PWM_TIM3), 42);
+
+    // Stopping gives the timer back for the other job.
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_stop(HAL_PWM_TIM2));
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM2, &config));
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_stop(HAL_PWM_TIM3));
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM3, &capture));
+
+    // Restarting a job keeps the timer.
+    ASSERT_EQ(HAL_STATUS_OK, hal_capture_start(HAL_PWM_TIM3, &capture));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_encoder_start(HAL_PWM_TIM3, &config));
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM2, &config));
+}
+
+TEST_F(EncoderDriverTest, PwmKeepsItsHandsOffTheTimerUntilStopped)
+{
+    hal_encoder_config_t config = quadrature(1);
+    const uint16_t duties[4] = { 0, 0x8000, 0, 0 };
+    Sim_TIM1 = { 0 };
+    Sim_GPIOB = { 0 };
+
+    config.filter = 3;
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_start(HAL_PWM_TIM1, &config));
+    Sim_TIM1.CNT = 1234;
+    Sim_TIM1.EGR = 0;
+    const TIM_TypeDef before = Sim_TIM1;
+
+    // OCxM is the input filter here, and an update event would reset the count.
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_init(HAL_PWM_TIM1, 20000));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_channel_init(HAL_PWM_TIM1, HAL_PWM_CH1));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_enable(HAL_PWM_TIM1, HAL_PWM_CH1, false));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_set_duty_cycle(HAL_PWM_TIM1, HAL_PWM_CH1, 0));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_set_duty_q16(HAL_PWM_TIM1, HAL_PWM_CH2, 0x8000));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_set_duty_counts(HAL_PWM_TIM1, HAL_PWM_CH3, 10));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_set_duty_all(HAL_PWM_TIM1, duties));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_set_frequency(HAL_PWM_TIM1, 1000));
+    hal_pwm_set_frequency(1000);
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_UP));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_UPDATE, 0));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_complementary_init(HAL_PWM_CH1));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_dead_time(500, NULL));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_ramp_to(HAL_PWM_CH1, 0x8000, 100));
+    ASSERT_EQ(0, memcmp(&Sim_TIM1, &before, sizeof(before)));
+    ASSERT_EQ(Sim_GPIOB.MODER, 0u);
+    ASSERT_EQ(position(HAL_PWM_TIM1), 1234);
+
+    // Given back, the timer generates PWM again.
+    ASSERT_EQ(HAL_STATUS_OK, hal_encoder_stop(HAL_PWM_TIM1));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM1, 20000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_channel_init(HAL_PWM_TIM1, HAL_PWM_CH1));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(500, NULL));
+}
@@ -0,0 +1,293 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "registers.h"
+#include "nvic.h"
+#include "i2c_sim.h"
+#include "stm32f4_hal.h"
+
+void I2C1_ER_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void _test_fixture_hal_i2c_reset_internals();
+}
+
+#define WIDE_ADDR   0x2A5
+#define NARROW_ADDR 0x25
+#define ABSENT_WIDE_ADDR 0x3FF
+
+// 10-bit targets and per-transaction bus options against the bus model.
+class I2CAddressingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOB = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        _test_fixture_hal_i2c_reset_internals();
+        ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+        i2c_sim_init(&sim, &Sim_I2C1, I2C1_EV_IRQHandler, I2C1_ER_IRQHandler, I2C1_EV_IRQn, I2C1_ER_IRQn);
+
+        // A 10-bit device whose low address byte matches a 7-bit one's address byte.
+        i2c_sim_register_device_init(&wide, 0);
+        wide.base.address = WIDE_ADDR;
+        wide.base.ten_bit = true;
+        i2c_sim_register_device_init(&narrow, NARROW_ADDR);
+        i2c_sim_attach(&sim, &wide.base);
+        i2c_sim_attach(&sim, &narrow.base);
+
+        for (int i = 0; i < 256; i++)
+        {
+            wide.registers[i] = (uint8_t)(0xA0 + i);
+            narrow.registers[i] = (uint8_t)(0x50 + i);
+        }
+    }
+
+    static void make_read(hal_i2c_txn_t *txn, uint16_t addr, hal_i2c_addr_mode_t mode, size_t rx_len)
+    {
+        memset(txn, 0, sizeof(*txn));
+        txn->target_addr = addr;
+        txn->addr_mode = mode;
+        txn->i2c_op = HAL_I2C_OP_WRITE_READ;
+        txn->tx_data[0] = 0x10;
+        txn->expected_bytes_to_tx = 1;
+        txn->expected_bytes_to_rx = rx_len;
+    }
+
+    static void make_write(hal_i2c_txn_t *txn, uint16_t addr, hal_i2c_addr_mode_t mode)
+    {
+        memset(txn, 0, sizeof(*txn));
+        txn->target_addr = addr;
+        txn->addr_mode = mode;
+        txn->i2c_op = HAL_I2C_OP_WRITE;
+        txn->tx_data[0] = 0x20;
+        txn->tx_data[1] = 0x99;
+        txn->expected_bytes_to_tx = 2;
+    }
+
+    void service()
+    {
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        i2c_sim_run(&sim, 1000);
+        hal_i2c_transaction_servicer(HAL_I2C1);
+    }
+
+    i2c_sim_t sim;
+    i2c_sim_register_device_t wide;
+    i2c_sim_register_device_t narrow;
+};
+
+TEST_F(I2CAddressingTest, TenBitWriteReadUsesTheReadHeaderAlone)
+{
+    hal_i2c_txn_t txn;
+
+    make_read(&txn, WIDE_ADDR, HAL_I2C_ADDR_10BIT, 2);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.rx_data[0], 0xB0);
+    ASSERT_EQ(txn.rx_data[1], 0xB1);
+    // Header, low byte, register. Then header with the read bit and two data bytes.
+    ASSERT_EQ(sim.starts, 2u);
+    ASSERT_EQ(sim.stops, 1u);
+    ASSERT_EQ(sim.bytes, 6u);
+}
+
+TEST_F(I2CAddressingTest, TenBitReadTurnsTheBusAround)
+{
+    hal_i2c_txn_t txn;
+
+    make_read(&txn, WIDE_ADDR, HAL_I2C_ADDR_10BIT, 3);
+    txn.i2c_op = HAL_I2C_OP_READ;
+    txn.expected_bytes_to_tx = 0;
+    wide.pointer = 0x40;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.rx_data[0], 0xE0);
+    ASSERT_EQ(txn.rx_data[2], 0xE2);
+    // Addressed for writing first, then a repeated START with the read header.
+    ASSERT_EQ(sim.starts, 2u);
+    ASSERT_EQ(sim.bytes, 6u);
+}
+
+TEST_F(I2CAddressingTest, TenBitAndSevenBitTargetsShareTheQueue)
+{
+    hal_i2c_txn_t to_wide;
+    hal_i2c_txn_t to_narrow;
+    hal_i2c_txn_t from_narrow;
+
+    make_write(&to_wide, WIDE_ADDR, HAL_I2C_ADDR_10BIT);
+    make_write(&to_narrow, NARROW_ADDR, HAL_I2C_ADDR_7BIT);
+    to_narrow.tx_data[1] = 0x77;
+    make_read(&from_narrow, NARROW_ADDR, HAL_I2C_ADDR_7BIT, 1);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &to_wide), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &to_narrow), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &from_narrow), HAL_STATUS_OK);
+    service();
+    service();
+    service();
+
+    ASSERT_EQ(to_wide.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(to_narrow.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(wide.registers[0x20], 0x99);
+    ASSERT_EQ(narrow.registers[0x20], 0x77);
+    ASSERT_EQ(from_narrow.rx_data[0], 0x60);
+
+    // Booked apart.
+    hal_i2c_target_metrics_t metrics;
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, WIDE_ADDR | HAL_I2C_METRICS_ADDR_10BIT, &metrics), HAL_STATUS_OK);
+    ASSERT_EQ(metrics.transactions, 1u);
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, NARROW_ADDR, &metrics), HAL_STATUS_OK);
+    ASSERT_EQ(metrics.transactions, 2u);
+}
+
+TEST_F(I2CAddressingTest, SequenceMixesAddressWidths)
+{
+    uint8_t reg = 0x05;
+    uint8_t wide_value[1];
+    uint8_t narrow_value[1];
+    hal_i2c_segment_t segments[4] = {
+        { WIDE_ADDR,   HAL_I2C_SEGMENT_WRITE, &reg,         1, 0, HAL_I2C_ADDR_10BIT },
+        { WIDE_ADDR,   HAL_I2C_SEGMENT_READ,  wide_value,   1, 0, HAL_I2C_ADDR_10BIT },
+        { NARROW_ADDR, HAL_I2C_SEGMENT_WRITE, &reg,         1, 0, HAL_I2C_ADDR_7BIT },
+        { NARROW_ADDR, HAL_I2C_SEGMENT_READ,  narrow_value, 1, 0, HAL_I2C_ADDR_7BIT },
+    };
+    hal_i2c_txn_t txn = {};
+
+    txn.i2c_op = HAL_I2C_OP_SEQUENCE;
+    txn.segments = segments;
+    txn.segment_count = 4;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(wide_value[0], 0xA5);
+    ASSERT_EQ(narrow_value[0], 0x55);
+    ASSERT_EQ(sim.starts, 4u);
+    ASSERT_EQ(sim.stops, 1u);
+}
+
+TEST_F(I2CAddressingTest, TenBitAddressingFailures)
+{
+    hal_i2c_txn_t txn;
+
+    make_write(&txn, ABSENT_WIDE_ADDR, HAL_I2C_ADDR_10BIT);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+
+    // Right top bits, wrong low byte: the header is acknowledged, the low byte is not.
+    make_write(&txn, WIDE_ADDR + 1, HAL_I2C_ADDR_10BIT);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+
+    uint32_t starts = sim.starts;
+    make_write(&txn, 0x400, HAL_I2C_ADDR_10BIT);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    make_write(&txn, WIDE_ADDR, _HAL_I2C_ADDR_MAX);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    // A 7-bit address with the top bit set would lose it on the wire.
+    make_write(&txn, 0x80 | NARROW_ADDR, HAL_I2C_ADDR_7BIT);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+    ASSERT_EQ(sim.starts, starts);
+}
+
+TEST_F(I2CAddressingTest, SpeedIsSwitchedBetweenTransactions)
+{
+    hal_i2c_txn_t txn;
+
+    make_read(&txn, NARROW_ADDR, HAL_I2C_ADDR_7BIT, 1);
+    txn.speed = HAL_I2C_SPEED_FAST;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+
+    ASSERT_TRUE(Sim_I2C1.CCR & I2C_CCR_FS);
+    ASSERT_FALSE(Sim_I2C1.CCR & I2C_CCR_DUTY);
+    ASSERT_EQ(Sim_I2C1.CCR & I2C_CCR_CCR, 14u);
+    ASSERT_EQ(Sim_I2C1.TRISE, 5u);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_PE);
+
+    i2c_sim_run(&sim, 1000);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(sim.bus_time_us, 4u * I2C_SIM_FAST_BYTE_TIME_US + 3u * I2C_SIM_CONDITION_TIME_US);
+
+    // Zero initialized transactions go back to standard mode.
+    make_read(&txn, NARROW_ADDR, HAL_I2C_ADDR_7BIT, 1);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_FALSE(Sim_I2C1.CCR & I2C_CCR_FS);
+    ASSERT_EQ(Sim_I2C1.CCR & I2C_CCR_CCR, 80u);
+    ASSERT_EQ(Sim_I2C1.TRISE, 17u);
+
+    txn.speed = _HAL_I2C_SPEED_MAX;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+}
+
+TEST_F(I2CAddressingTest, NoStopKeepsTheBusForTheNextTransaction)
+{
+    hal_i2c_txn_t first;
+    hal_i2c_txn_t second;
+
+    make_write(&first, NARROW_ADDR, HAL_I2C_ADDR_7BIT);
+    first.no_stop = true;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &first), HAL_STATUS_OK);
+    service();
+
+    ASSERT_EQ(first.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(first.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(sim.stops, 0u);
+    ASSERT_TRUE(Sim_I2C1.SR2 & I2C_SR2_MSL);
+    // Nothing to handle while the bus waits.
+    ASSERT_FALSE(Sim_I2C1.CR2 & I2C_CR2_ITEVTEN);
+
+    // A different target, and a speed that can not be applied to a held bus.
+    make_read(&second, WIDE_ADDR, HAL_I2C_ADDR_10BIT, 1);
+    second.speed = HAL_I2C_SPEED_FAST;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &second), HAL_STATUS_OK);
+    service();
+
+    ASSERT_EQ(second.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(second.rx_data[0], 0xB0);
+    ASSERT_FALSE(Sim_I2C1.CCR & I2C_CCR_FS);
+    ASSERT_TRUE(Sim_I2C1.CR2 & I2C_CR2_ITEVTEN);
+    ASSERT_EQ(sim.starts, 3u);
+    ASSERT_EQ(sim.stops, 1u);
+    ASSERT_FALSE(Sim_I2C1.SR2 & I2C_SR2_MSL);
+}
+
+TEST_F(I2CAddressingTest, FailedNoStopTransactionStillEndsWithStop)
+{
+    hal_i2c_txn_t txn;
+
+    make_write(&txn, 0x7E, HAL_I2C_ADDR_7BIT);
+    txn.no_stop = true;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+    ASSERT_EQ(sim.stops, 1u);
+
+    // The bus was let go of, so the next transaction may change speed.
+    make_read(&txn, NARROW_ADDR, HAL_I2C_ADDR_7BIT, 1);
+    txn.speed = HAL_I2C_SPEED_FAST;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_TRUE(Sim_I2C1.CCR & I2C_CCR_FS);
+}
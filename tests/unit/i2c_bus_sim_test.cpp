@@ -0,0 +1,292 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "registers.h"
+#include "nvic.h"
+#include "i2c_sim.h"
+#include "stm32f4_hal.h"
+
+void I2C1_ER_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void _test_fixture_hal_i2c_reset_internals();
+
+extern uint32_t tick_ms;
+}
+
+#define EEPROM_ADDR 0x50
+#define SENSOR_ADDR 0x68
+#define NACK_ADDR   0x3C
+#define ABSENT_ADDR 0x77
+
+#define EEPROM_PAGE_SIZE  8
+#define EEPROM_BUSY_NACKS 3
+
+// End-to-end tests of the driver, queue and servicer against the bus model.
+class I2CBusSimTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOB = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        _test_fixture_hal_i2c_reset_internals();
+        tick_ms = 0;
+        ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+        i2c_sim_init(&sim, &Sim_I2C1, I2C1_EV_IRQHandler, I2C1_ER_IRQHandler, I2C1_EV_IRQn, I2C1_ER_IRQn);
+
+        i2c_sim_eeprom_init(&eeprom, EEPROM_ADDR, EEPROM_PAGE_SIZE, EEPROM_BUSY_NACKS);
+        i2c_sim_register_device_init(&sensor, SENSOR_ADDR);
+        i2c_sim_nack_device_init(&nacker, NACK_ADDR, 1);
+        i2c_sim_attach(&sim, &eeprom.base);
+        i2c_sim_attach(&sim, &sensor.base);
+        i2c_sim_attach(&sim, &nacker.base);
+
+        for (size_t i = 0; i < sizeof(sensor.registers); i++)
+        {
+            sensor.registers[i] = (uint8_t)(i ^ 0xA5);
+        }
+    }
+
+    static void make_txn(hal_i2c_txn_t *txn, uint8_t addr, hal_i2c_op_t op, const uint8_t *tx, size_t tx_len, size_t rx_len)
+    {
+        memset(txn, 0, sizeof(*txn));
+        txn->target_addr = addr;
+        txn->i2c_op = op;
+        if (tx_len)
+        {
+            memcpy(txn->tx_data, tx, tx_len);
+        }
+        txn->expected_bytes_to_tx = tx_len;
+        txn->expected_bytes_to_rx = rx_len;
+        txn->processing_state = HAL_I2C_TXN_STATE_CREATED;
+    }
+
+    // Alternate the servicer and the bus until the transaction completes.
+    void run_until_complete(hal_i2c_txn_t *txn)
+    {
+        for (int i = 0; i < 100 && txn->processing_state != HAL_I2C_TXN_STATE_COMPLETED; i++)
+        {
+            hal_i2c_transaction_servicer(HAL_I2C1);
+            i2c_sim_run(&sim, 1000);
+        }
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        ASSERT_EQ(txn->processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    }
+
+    void submit_and_run(hal_i2c_txn_t *txn)
+    {
+        ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, txn), HAL_STATUS_OK);
+        run_until_complete(txn);
+    }
+
+    i2c_sim_t sim;
+    i2c_sim_eeprom_t eeprom;
+    i2c_sim_register_device_t sensor;
+    i2c_sim_nack_device_t nacker;
+};
+
+TEST_F(I2CBusSimTest, EepromWriteThenReadBack)
+{
+    hal_i2c_txn_t txn;
+    const uint8_t write[] = {0x10, 1, 2, 3, 4};
+
+    make_txn(&txn, EEPROM_ADDR, HAL_I2C_OP_WRITE, write, sizeof(write), 0);
+    submit_and_run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_transmitted, sizeof(write));
+    ASSERT_EQ(memcmp(&eeprom.memory[0x10], &write[1], 4), 0);
+
+    // Busy with the write cycle. The address is NACKed.
+    const uint8_t pointer = 0x10;
+    make_txn(&txn, EEPROM_ADDR, HAL_I2C_OP_WRITE_READ, &pointer, 1, 4);
+    submit_and_run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+
+    // Poll until the write cycle is over.
+    int attempts = 1;
+    do
+    {
+        make_txn(&txn, EEPROM_ADDR, HAL_I2C_OP_WRITE_READ, &pointer, 1, 4);
+        submit_and_run(&txn);
+        attempts++;
+    } while (txn.transaction_result != HAL_I2C_TXN_RESULT_SUCCESS && attempts < 10);
+
+    ASSERT_EQ(attempts, EEPROM_BUSY_NACKS + 1);
+    ASSERT_EQ(txn.actual_bytes_received, 4u);
+    ASSERT_EQ(memcmp(txn.rx_data, &write[1], 4), 0);
+    ASSERT_EQ(sim.state, I2C_SIM_STATE_IDLE);
+    ASSERT_FALSE(Sim_I2C1.SR2 & I2C_SR2_BUSY);
+}
+
+TEST_F(I2CBusSimTest, EepromPageWriteWraps)
+{
+    hal_i2c_txn_t txn;
+    const uint8_t write[] = {EEPROM_PAGE_SIZE * 2 + 6, 0xA0, 0xA1, 0xA2, 0xA3};
+
+    make_txn(&txn, EEPROM_ADDR, HAL_I2C_OP_WRITE, write, sizeof(write), 0);
+    submit_and_run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+
+    ASSERT_EQ(eeprom.memory[EEPROM_PAGE_SIZE * 2 + 6], 0xA0);
+    ASSERT_EQ(eeprom.memory[EEPROM_PAGE_SIZE * 2 + 7], 0xA1);
+    ASSERT_EQ(eeprom.memory[EEPROM_PAGE_SIZE * 2 + 0], 0xA2);
+    ASSERT_EQ(eeprom.memory[EEPROM_PAGE_SIZE * 2 + 1], 0xA3);
+    ASSERT_EQ(eeprom.memory[EEPROM_PAGE_SIZE * 3], 0xFF);
+}
+
+TEST_F(I2CBusSimTest, ReadsOfEveryLengthFollowTheReferenceManualSequences)
+{
+    // 1 and 2 bytes take their own paths through the driver, 3 and up the BTF one.
+    for (size_t length = 1; length <= 6; length++)
+    {
+        hal_i2c_txn_t txn;
+        const uint8_t reg = 0x40;
+
+        make_txn(&txn, SENSOR_ADDR, HAL_I2C_OP_WRITE_READ, &reg, 1, length);
+        submit_and_run(&txn);
+
+        ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS) << "length " << length;
+        ASSERT_EQ(txn.actual_bytes_received, length) << "length " << length;
+        ASSERT_EQ(memcmp(txn.rx_data, &sensor.registers[reg], length), 0) << "length " << length;
+        ASSERT_EQ(sim.state, I2C_SIM_STATE_IDLE);
+    }
+
+    // Every read ended with a NACK and one STOP.
+    ASSERT_EQ(sim.starts, 12u);
+    ASSERT_EQ(sim.stops, 6u);
+}
+
+TEST_F(I2CBusSimTest, PlainReadContinuesFromTheRegisterPointer)
+{
+    hal_i2c_txn_t txn;
+    const uint8_t write[] = {0x80, 0x11, 0x22};
+
+    make_txn(&txn, SENSOR_ADDR, HAL_I2C_OP_WRITE, write, sizeof(write), 0);
+    submit_and_run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(sensor.registers[0x80], 0x11);
+    ASSERT_EQ(sensor.registers[0x81], 0x22);
+
+    make_txn(&txn, SENSOR_ADDR, HAL_I2C_OP_READ, NULL, 0, 2);
+    submit_and_run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.rx_data[0], sensor.registers[0x82]);
+    ASSERT_EQ(txn.rx_data[1], sensor.registers[0x83]);
+}
+
+TEST_F(I2CBusSimTest, DataNackFailsTheWrite)
+{
+    hal_i2c_txn_t txn;
+    const uint8_t write[] = {0x01, 0x02, 0x03};
+
+    make_txn(&txn, NACK_ADDR, HAL_I2C_OP_WRITE, write, sizeof(write), 0);
+    submit_and_run(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+    ASSERT_GE(sim.er_irq_calls, 1u);
+    ASSERT_EQ(sim.state, I2C_SIM_STATE_IDLE);
+    ASSERT_FALSE(Sim_I2C1.SR1 & I2C_SR1_AF);
+
+    // The bus is usable afterwards.
+    const uint8_t reg = 0x00;
+    make_txn(&txn, SENSOR_ADDR, HAL_I2C_OP_WRITE_READ, &reg, 1, 2);
+    submit_and_run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+}
+
+TEST_F(I2CBusSimTest, AbsentTargetNacksItsAddress)
+{
+    hal_i2c_txn_t txn;
+    const uint8_t reg = 0x00;
+
+    make_txn(&txn, ABSENT_ADDR, HAL_I2C_OP_WRITE_READ, &reg, 1, 2);
+    submit_and_run(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+    ASSERT_EQ(txn.actual_bytes_transmitted, 0u);
+    ASSERT_EQ(sim.bytes, 1u);
+}
+
+TEST_F(I2CBusSimTest, SequenceAddressesSeveralTargets)
+{
+    uint8_t eeprom_write[] = {0x30, 0x5A};
+    uint8_t sensor_reg = 0x10;
+    uint8_t sensor_data[3];
+
+    hal_i2c_segment_t segments[] = {
+        {EEPROM_ADDR, HAL_I2C_SEGMENT_WRITE, eeprom_write, sizeof(eeprom_write), 0},
+        {SENSOR_ADDR, HAL_I2C_SEGMENT_WRITE, &sensor_reg, 1, 0},
+        {SENSOR_ADDR, HAL_I2C_SEGMENT_READ, sensor_data, sizeof(sensor_data), 0},
+    };
+
+    hal_i2c_txn_t txn;
+    make_txn(&txn, 0, HAL_I2C_OP_SEQUENCE, NULL, 0, 0);
+    txn.segments = segments;
+    txn.segment_count = 3;
+    submit_and_run(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(eeprom.memory[0x30], 0x5A);
+    ASSERT_EQ(memcmp(sensor_data, &sensor.registers[0x10], 3), 0);
+    ASSERT_EQ(segments[2].actual_length, 3u);
+    ASSERT_EQ(sim.starts, 3u);
+    ASSERT_EQ(sim.stops, 1u);
+}
+
+TEST_F(I2CBusSimTest, QueueDrainsInPriorityOrder)
+{
+    hal_i2c_txn_t txns[3];
+    const uint8_t regs[3] = {0x00, 0x10, 0x20};
+    const hal_i2c_priority_t priorities[3] = {HAL_I2C_PRIORITY_LOW, HAL_I2C_PRIORITY_MEDIUM, HAL_I2C_PRIORITY_HIGH};
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        make_txn(&txns[i], SENSOR_ADDR, HAL_I2C_OP_WRITE_READ, &regs[i], 1, 1);
+        txns[i].priority = priorities[i];
+        ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txns[i]), HAL_STATUS_OK);
+    }
+
+    // One servicer call loads one transaction. The bus finishes it before the next call.
+    hal_i2c_transaction_servicer(HAL_I2C1);
+    ASSERT_EQ(txns[2].processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+    i2c_sim_run(&sim, 1000);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+    ASSERT_EQ(txns[2].processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(txns[1].processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+    ASSERT_EQ(txns[0].processing_state, HAL_I2C_TXN_STATE_QUEUED);
+
+    run_until_complete(&txns[0]);
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        ASSERT_EQ(txns[i].transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+        ASSERT_EQ(txns[i].rx_data[0], sensor.registers[regs[i]]);
+    }
+}
+
+TEST_F(I2CBusSimTest, BenchmarkBurstRead)
+{
+    // Interrupt cost and bus time of a 16 byte register read, the usual sensor burst.
+    hal_i2c_txn_t txn;
+    const uint8_t reg = 0x00;
+
+    make_txn(&txn, SENSOR_ADDR, HAL_I2C_OP_WRITE_READ, &reg, 1, 16);
+    submit_and_run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+
+    RecordProperty("ev_irq_calls", (int)sim.ev_irq_calls);
+    RecordProperty("bus_time_us", (int)sim.bus_time_us);
+
+    // Address and register, repeated START, address and 16 bytes.
+    ASSERT_EQ(sim.bytes, 19u);
+    ASSERT_EQ(sim.bus_time_us, 19u * I2C_SIM_BYTE_TIME_US + 3u * I2C_SIM_CONDITION_TIME_US);
+    ASSERT_EQ(sim.er_irq_calls, 0u);
+
+    // Reception is serviced on BTF, roughly one interrupt per byte. Guard against regressions.
+    ASSERT_LE(sim.ev_irq_calls, 24u);
+}
@@ -9,18 +9,28 @@ extern "C" {
 
 void I2C1_ER_IRQHandler(void);
 void I2C1_EV_IRQHandler(void);
+void I2C2_ER_IRQHandler(void);
+void I2C2_EV_IRQHandler(void);
 void _test_fixture_hal_i2c_reset_internals();
+
+/* Exposed for latency testing only — see systick.c DESKTOP_BUILD guard. */
+extern uint32_t tick_ms;
 }
 
 class I2CDriverTest : public ::testing::Test {
 protected:
     void SetUp() override {
         // Clear peripheral state before each test
+        Sim_GPIOA = {0};
         Sim_GPIOB = {0};
+        Sim_GPIOC = {0};
         Sim_RCC = {0};
         Sim_I2C1 = {0};
+        Sim_I2C2 = {0};
+        Sim_I2C3 = {0};
 
         _test_fixture_hal_i2c_reset_internals();
+        tick_ms = 0;
     }
 
     void TearDown() override {
@@ -34,7 +44,7 @@ protected:
 
 TEST_F(I2CDriverTest, InitsGPIOPinsCorrectly)
 {
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Clock enabled to port b.
     ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_GPIOBEN);
@@ -64,7 +74,7 @@ TEST_F(I2CDriverTest, InitsPeripheralCorrectly)
     // Set bit high to prove init() sets it low.
     Sim_I2C1.CCR |= I2C_CCR_FS;
 
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Clock is enabled to I2C1
     ASSERT_TRUE(Sim_RCC.APB1ENR & RCC_APB1ENR_I2C1EN);
@@ -87,7 +97,7 @@ TEST_F(I2CDriverTest, InitsPeripheralCorrectly)
 
 TEST_F(I2CDriverTest, InitsInterruptsCorrectly)
 {
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Event interrupt enabled in peripheral
     ASSERT_TRUE(Sim_I2C1.CR2 & I2C_CR2_ITEVTEN);
@@ -110,52 +120,53 @@ TEST_F(I2CDriverTest, TransactionServicerLoadsTransaction)
 {
     // Given an I2C transaction and an initialized I2C driver.
     hal_i2c_txn_t transaction = {0};
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given that the transaction has been submitted successfully.
-    ASSERT_EQ(hal_i2c_submit_transaction(&transaction), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &transaction), HAL_STATUS_OK);
     ASSERT_EQ(transaction.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the transaction servicer is called, then it should load the new transaction.
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(transaction.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
 
     // When the transaction servicer is called a second time, then it should be busy processing the current transaction.
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_BUSY);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_BUSY);
 }
 
 TEST_F(I2CDriverTest, TransactionServicerRejectsInvalidTransaction)
 {
     // Given an invalid I2C transaction and an initialized I2C driver.
-    hal_i2c_txn_t transaction;
+    hal_i2c_txn_t transaction = {0};
     transaction.i2c_op = _HAL_I2C_OP_MAX; // invalid operation value
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // @todo change how this the transaction is injected once this api also validates.
     // Given that the transaction has been submitted successfully.
-    ASSERT_EQ(hal_i2c_submit_transaction(&transaction), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &transaction), HAL_STATUS_OK);
     ASSERT_EQ(transaction.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the transaction servicer is called, then it should reject the new transaction.
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_ERROR);
     ASSERT_EQ(transaction.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(transaction.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(transaction.error, HAL_I2C_ERROR_INVALID);
 
     // When the transaction servicer is called a second time, then it should be ready for the next transaction.
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
 }
 
 TEST_F(I2CDriverTest, TransactionServicerSendsStartSignal)
 {
     // Given an I2C transaction and an initialized I2C driver.
     hal_i2c_txn_t transaction = {0};
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given that the transaction has been submitted successfully.
-    ASSERT_EQ(hal_i2c_submit_transaction(&transaction), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &transaction), HAL_STATUS_OK);
 
     // When the transaction servicer is called,
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
 
     // Then the start signal shall be sent.
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
@@ -165,13 +176,13 @@ TEST_F(I2CDriverTest, TransactionServicerSendsStartSignalOnlyOnce)
 {
     // Given an I2C transaction and an initialized I2C driver.
     hal_i2c_txn_t transaction = {0};
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given that the transaction has been submitted successfully.
-    ASSERT_EQ(hal_i2c_submit_transaction(&transaction), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &transaction), HAL_STATUS_OK);
 
     // Given that a transaction has been loaded and already sent the start signal.
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
     // Given that the start signal is artificially reset.
@@ -179,12 +190,119 @@ TEST_F(I2CDriverTest, TransactionServicerSendsStartSignalOnlyOnce)
     ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_START);
 
     // When the transaction servicer is called a second time.
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_BUSY);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_BUSY);
 
     // Then the start signal shall still be reset.
     ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_START);
 }
 
+TEST_F(I2CDriverTest, TransactionServicerLoadsHighestPriorityFirst)
+{
+    // Given an initialized I2C driver and transactions of every priority.
+    hal_i2c_txn_t low = {};
+    hal_i2c_txn_t high = {};
+    low.priority = HAL_I2C_PRIORITY_LOW;
+    high.priority = HAL_I2C_PRIORITY_HIGH;
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+    // Given the low priority transaction was submitted first.
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &low), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &high), HAL_STATUS_OK);
+
+    // When the servicer is called, then the high priority transaction is loaded.
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(high.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+    ASSERT_EQ(low.processing_state, HAL_I2C_TXN_STATE_QUEUED);
+}
+
+TEST_F(I2CDriverTest, SubmitRejectsTransactionStillInUse)
+{
+    // Given a queued transaction and a second one behind it.
+    hal_i2c_txn_t transaction = {};
+    hal_i2c_txn_t other = {};
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &transaction), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &other), HAL_STATUS_OK);
+    tick_ms = 5;
+
+    // When it is submitted again while queued, then it is refused and left alone.
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &transaction), HAL_STATUS_BUSY);
+    ASSERT_EQ(transaction.queued_tick, 0u);
+    ASSERT_EQ(hal_i2c_scan(HAL_I2C1, &transaction), HAL_STATUS_BUSY);
+    ASSERT_EQ(transaction.i2c_op, HAL_I2C_OP_WRITE);
+
+    // The same while it is on the bus.
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(transaction.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &transaction), HAL_STATUS_BUSY);
+
+    // The other transaction is still waiting behind it.
+    ASSERT_EQ(other.processing_state, HAL_I2C_TXN_STATE_QUEUED);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, NULL), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CDriverTest, TransactionServicerRejectsInvalidPriority)
+{
+    // Given a transaction with an out of range priority.
+    hal_i2c_txn_t transaction = {};
+    transaction.priority = _HAL_I2C_PRIORITY_MAX;
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &transaction), HAL_STATUS_OK);
+
+    // When the servicer is called, then the transaction is failed without touching the bus.
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_ERROR);
+    ASSERT_EQ(transaction.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(transaction.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_START);
+}
+
+TEST_F(I2CDriverTest, QueueLatencyIsReportedPerPriority)
+{
+    hal_i2c_txn_t low = {};
+    hal_i2c_txn_t high = {};
+    hal_i2c_queue_latency_t latency = {};
+    low.priority = HAL_I2C_PRIORITY_LOW;
+    high.priority = HAL_I2C_PRIORITY_HIGH;
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+    // Given both transactions are submitted at tick 100.
+    tick_ms = 100;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &low), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &high), HAL_STATUS_OK);
+
+    // Given the high priority transaction is loaded 3 ms later.
+    tick_ms = 103;
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+
+    // Given the high priority transaction finishes and the low one is loaded at 110 ms.
+    Sim_I2C1.SR1 |= I2C_SR1_AF;
+    I2C1_ER_IRQHandler();
+    tick_ms = 110;
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(low.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+
+    // Then each priority reports its own wait.
+    ASSERT_EQ(hal_i2c_get_queue_latency(HAL_I2C1, HAL_I2C_PRIORITY_HIGH, &latency), HAL_STATUS_OK);
+    ASSERT_EQ(latency.transactions_loaded, 1u);
+    ASSERT_EQ(latency.total_wait_ms, 3u);
+    ASSERT_EQ(latency.max_wait_ms, 3u);
+
+    ASSERT_EQ(hal_i2c_get_queue_latency(HAL_I2C1, HAL_I2C_PRIORITY_LOW, &latency), HAL_STATUS_OK);
+    ASSERT_EQ(latency.transactions_loaded, 1u);
+    ASSERT_EQ(latency.total_wait_ms, 10u);
+    ASSERT_EQ(latency.max_wait_ms, 10u);
+
+    ASSERT_EQ(hal_i2c_get_queue_latency(HAL_I2C1, HAL_I2C_PRIORITY_MEDIUM, &latency), HAL_STATUS_OK);
+    ASSERT_EQ(latency.transactions_loaded, 0u);
+}
+
+TEST_F(I2CDriverTest, QueueLatencyRejectsBadArguments)
+{
+    hal_i2c_queue_latency_t latency = {};
+    ASSERT_EQ(hal_i2c_get_queue_latency(HAL_I2C1, _HAL_I2C_PRIORITY_MAX, &latency), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_get_queue_latency(HAL_I2C1, HAL_I2C_PRIORITY_LOW, nullptr), HAL_STATUS_ERROR);
+}
+
 /***********************************************/
 // ISR Tests
 /***********************************************/
@@ -192,7 +310,7 @@ TEST_F(I2CDriverTest, TransactionServicerSendsStartSignalOnlyOnce)
 TEST_F(I2CDriverTest, ISRHandlesZeroLengthTransmit)
 {
     // Given an initialized I2C driver
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given a simple WRITE transaction of 0 bytes
     hal_i2c_txn_t txn = {};
@@ -207,11 +325,11 @@ TEST_F(I2CDriverTest, ISRHandlesZeroLengthTransmit)
     memset(txn.rx_data, 0, sizeof(txn.rx_data));
 
     // Given the transaction was submitted successfully
-    ASSERT_EQ(hal_i2c_submit_transaction(&txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the servicer loads the transaction and issues START
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
@@ -250,7 +368,7 @@ TEST_F(I2CDriverTest, ISRHandlesZeroLengthTransmit)
 
     // --------- Assert results ---------
     // Then the next servicer call completes the transaction and copies results back
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
     ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(0));
@@ -260,7 +378,7 @@ TEST_F(I2CDriverTest, ISRHandlesZeroLengthTransmit)
 TEST_F(I2CDriverTest, ISRHandlesBasicWrite)
 {
     // Given an initialized I2C driver
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given a simple WRITE transaction of 2 bytes
     hal_i2c_txn_t txn = {};
@@ -277,11 +395,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicWrite)
     memset(txn.rx_data, 0, sizeof(txn.rx_data));
 
     // Given the transaction was submitted successfully
-    ASSERT_EQ(hal_i2c_submit_transaction(&txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the servicer loads the transaction and issues START
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
@@ -344,7 +462,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicWrite)
 
     // --------- Assert results ---------
     // Then the next servicer call completes the transaction and copies results back
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
     ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(2));
@@ -357,11 +475,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicWriteRead)
     uint32_t shift_register = 0;
 
     // Given an initialized I2C driver
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given a simple WRITE-READ transaction of 1 byte write, 2 byte read.
     hal_i2c_txn_t txn = {};
-    txn.target_addr               = 0xFE;
+    txn.target_addr               = 0x7E;
     txn.i2c_op                    = HAL_I2C_OP_WRITE_READ;
     txn.expected_bytes_to_tx      = 1;
     txn.tx_data[0]                = 0xF4;
@@ -373,11 +491,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicWriteRead)
     memset(txn.rx_data, 0, sizeof(txn.rx_data));
 
     // Given the transaction was submitted successfully
-    ASSERT_EQ(hal_i2c_submit_transaction(&txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the servicer loads the transaction and issues START
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
@@ -508,7 +626,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicWriteRead)
 
     // --------- Assert results ---------
     // Then the next servicer call completes the transaction and copies results back
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
     ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(1));
@@ -523,11 +641,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead4Bytes)
     uint32_t shift_register = 0;
 
     // Given an initialized I2C driver
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given a simple READ transaction of 4 bytes
     hal_i2c_txn_t txn = {};
-    txn.target_addr               = 0xDD;
+    txn.target_addr               = 0x5D;
     txn.i2c_op                    = HAL_I2C_OP_READ;
     txn.expected_bytes_to_tx      = 0;
     txn.expected_bytes_to_rx      = 4;
@@ -538,11 +656,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead4Bytes)
     memset(txn.rx_data, 0, sizeof(txn.rx_data));
 
     // Given the transaction was submitted successfully
-    ASSERT_EQ(hal_i2c_submit_transaction(&txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the servicer loads the transaction and issues START
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
@@ -648,7 +766,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead4Bytes)
 
     // --------- Assert results ---------
     // Then the next servicer call completes the transaction and copies results back
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
     ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(0));
@@ -665,7 +783,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead3Bytes)
     uint32_t shift_register = 0;
 
     // Given an initialized I2C driver
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given a simple READ transaction of 3 bytes
     hal_i2c_txn_t txn = {};
@@ -680,11 +798,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead3Bytes)
     memset(txn.rx_data, 0, sizeof(txn.rx_data));
 
     // Given the transaction was submitted successfully
-    ASSERT_EQ(hal_i2c_submit_transaction(&txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the servicer loads the transaction and issues START
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
@@ -774,7 +892,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead3Bytes)
 
     // --------- Assert results ---------
     // Then the next servicer call completes the transaction and copies results back
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
     ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(0));
@@ -790,7 +908,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead2Bytes)
     uint32_t shift_register = 0;
 
     // Given an initialized I2C driver
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given a simple READ transaction of 2 bytes
     hal_i2c_txn_t txn = {};
@@ -805,11 +923,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead2Bytes)
     memset(txn.rx_data, 0, sizeof(txn.rx_data));
 
     // Given the transaction was submitted successfully
-    ASSERT_EQ(hal_i2c_submit_transaction(&txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the servicer loads the transaction and issues START
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
@@ -893,7 +1011,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead2Bytes)
 
     // --------- Assert results ---------
     // Then the next servicer call completes the transaction and copies results back
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
     ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(0));
@@ -905,11 +1023,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead2Bytes)
 TEST_F(I2CDriverTest, ISRHandlesBasicRead1Byte)
 {
     // Given an initialized I2C driver
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Given a simple READ transaction of 1 byte
     hal_i2c_txn_t txn = {};
-    txn.target_addr               = 0xAA;
+    txn.target_addr               = 0x2A;
     txn.i2c_op                    = HAL_I2C_OP_READ;
     txn.expected_bytes_to_tx      = 0;
     txn.expected_bytes_to_rx      = 1;
@@ -920,11 +1038,11 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead1Byte)
     memset(txn.rx_data, 0, sizeof(txn.rx_data));
 
     // Given the transaction was submitted successfully
-    ASSERT_EQ(hal_i2c_submit_transaction(&txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // When the servicer loads the transaction and issues START
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
@@ -973,7 +1091,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead1Byte)
 
     // --------- Assert results ---------
     // Then the next servicer call completes the transaction and copies results back
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
     ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(0));
@@ -984,7 +1102,7 @@ TEST_F(I2CDriverTest, ISRHandlesBasicRead1Byte)
 TEST_F(I2CDriverTest, ISRHandlesAddressNACK)
 {
     // Given an initialized I2C driver
-    ASSERT_EQ(hal_i2c_init(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
 
     // Prepare a simple 1-byte WRITE so we can hit the address phase.
     hal_i2c_txn_t txn = {};
@@ -1000,11 +1118,11 @@ TEST_F(I2CDriverTest, ISRHandlesAddressNACK)
     memset(txn.rx_data, 0, sizeof(txn.rx_data));
 
     // Given the transaction was submitted successfully
-    ASSERT_EQ(hal_i2c_submit_transaction(&txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 
     // Given the servicer loads the transaction and asserts START
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
     ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
 
@@ -1033,9 +1151,473 @@ TEST_F(I2CDriverTest, ISRHandlesAddressNACK)
     ASSERT_FALSE(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN);
 
     // Finalize: servicer should complete the transaction with FAIL
-    ASSERT_EQ(hal_i2c_transaction_servicer(), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
     ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
     ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
     ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(0));
     ASSERT_EQ(txn.actual_bytes_received,   static_cast<size_t>(0));
 }
+
+/***********************************************/
+// Timeout and Bus Error Tests
+/***********************************************/
+
+TEST_F(I2CDriverTest, TimedOutTransactionFailsAndBusIsRecovered)
+{
+    // Given an initialized I2C driver and a 1 byte WRITE (default timeout 10 ms).
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    hal_i2c_txn_t txn = {};
+    txn.target_addr          = 0x2A;
+    txn.i2c_op               = HAL_I2C_OP_WRITE;
+    txn.expected_bytes_to_tx = 1;
+
+    hal_i2c_txn_t next = {};
+    next.target_addr          = 0x2B;
+    next.i2c_op               = HAL_I2C_OP_WRITE;
+    next.expected_bytes_to_tx = 1;
+
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &next), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+
+    // Given the target holds the bus after the address phase.
+    Sim_I2C1.SR1 |= I2C_SR1_SB;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_SB;
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+    Sim_GPIOB.IDR = 0; // SDA stuck low.
+
+    // While within the timeout, the servicer keeps waiting.
+    tick_ms = 10;
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_BUSY);
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+
+    // When the timeout expires.
+    tick_ms = 11;
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+
+    // Then only the stuck transaction fails.
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_TIMEOUT);
+
+    // Then the pins were released high and returned to the peripheral in AF mode.
+    ASSERT_TRUE(Sim_GPIOB.ODR & GPIO_ODR_OD8);
+    ASSERT_TRUE(Sim_GPIOB.ODR & GPIO_ODR_OD9);
+    ASSERT_FALSE(Sim_GPIOB.MODER & BIT_16);
+    ASSERT_TRUE(Sim_GPIOB.MODER & BIT_17);
+    ASSERT_FALSE(Sim_GPIOB.MODER & BIT_18);
+    ASSERT_TRUE(Sim_GPIOB.MODER & BIT_19);
+
+    // Then the peripheral was reset, configured again and the queue moved on.
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_PE);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_SWRST);
+    ASSERT_TRUE(Sim_I2C1.CR2 & I2C_CR2_ITEVTEN);
+    ASSERT_TRUE(Sim_I2C1.CR2 & I2C_CR2_ITERREN);
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_FREQ, 16U);
+    ASSERT_EQ(next.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
+}
+
+TEST_F(I2CDriverTest, TransactionTimeoutCanBeSetPerTransaction)
+{
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    hal_i2c_txn_t txn = {};
+    txn.target_addr          = 0x2A;
+    txn.i2c_op               = HAL_I2C_OP_WRITE;
+    txn.expected_bytes_to_tx = 1;
+    txn.timeout_ms           = 2;
+
+    tick_ms = 100;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+
+    tick_ms = 102;
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_BUSY);
+
+    tick_ms = 103;
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_TIMEOUT);
+}
+
+TEST_F(I2CDriverTest, ArbitrationLostRequeuesWithoutStop)
+{
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    hal_i2c_txn_t txn = {};
+    txn.target_addr          = 0x2A;
+    txn.i2c_op               = HAL_I2C_OP_WRITE;
+    txn.expected_bytes_to_tx = 1;
+
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+
+    // HW-SIM: another controller wins arbitration.
+    Sim_I2C1.SR1 |= I2C_SR1_ARLO;
+    I2C1_ER_IRQHandler();
+
+    ASSERT_FALSE(Sim_I2C1.SR1 & I2C_SR1_ARLO);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_STOP);
+
+    // Queued again and straight back on the bus.
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+    ASSERT_EQ(txn.arbitration_requeues, 1);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
+}
+
+TEST_F(I2CDriverTest, BusErrorFailsTransactionAndResetsPeripheral)
+{
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    hal_i2c_txn_t txn = {};
+    txn.target_addr          = 0x2A;
+    txn.i2c_op               = HAL_I2C_OP_WRITE;
+    txn.expected_bytes_to_tx = 1;
+
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+
+    // HW-SIM: misplaced START/STOP on the bus.
+    Sim_I2C1.SR1 |= I2C_SR1_BERR;
+    I2C1_ER_IRQHandler();
+    ASSERT_FALSE(Sim_I2C1.SR1 & I2C_SR1_BERR);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_STOP);
+
+    // The peripheral reset happens in the servicer. It clears the pending STOP.
+    Sim_GPIOB.IDR = GPIO_IDR_ID9;
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_BUS);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_STOP);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_PE);
+}
+
+TEST_F(I2CDriverTest, TransactionServicerNotifiesCompletion)
+{
+    static hal_i2c_txn_t *notified;
+    static int notifications;
+    notified = NULL;
+    notifications = 0;
+
+    // Given an initialized I2C driver and a transaction with a completion callback.
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    int context = 0;
+    hal_i2c_txn_t txn = {};
+    txn.target_addr          = 0x2A;
+    txn.i2c_op               = HAL_I2C_OP_WRITE;
+    txn.expected_bytes_to_tx = 1;
+    txn.on_complete          = [](hal_i2c_txn_t *t) { notified = t; notifications++; };
+    txn.context              = &context;
+
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(notifications, 0);
+
+    // When the address is NACKed and the servicer closes out the transaction.
+    Sim_I2C1.SR1 |= I2C_SR1_SB;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_SB;
+    Sim_I2C1.SR1 |= I2C_SR1_AF;
+    I2C1_ER_IRQHandler();
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+
+    // Then the callback ran exactly once with the completed transaction.
+    ASSERT_EQ(notifications, 1);
+    ASSERT_EQ(notified, &txn);
+    ASSERT_EQ(notified->context, &context);
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(notifications, 1);
+}
+
+/***********************************************/
+// Sequence Tests
+/***********************************************/
+
+TEST_F(I2CDriverTest, ISRRunsSequenceWithRepeatedStarts)
+{
+    // Given an initialized I2C driver
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+    // Given a sequence: write a register address to 0x10, read one byte back from 0x10,
+    // then write two bytes to 0x20.
+    uint8_t reg_addr[1] = { 0x01 };
+    uint8_t reg_value[1] = { 0 };
+    uint8_t config[2] = { 0xAA, 0xBB };
+    hal_i2c_segment_t segments[3] = {
+        { 0x10, HAL_I2C_SEGMENT_WRITE, reg_addr,  sizeof(reg_addr),  0 },
+        { 0x10, HAL_I2C_SEGMENT_READ,  reg_value, sizeof(reg_value), 0 },
+        { 0x20, HAL_I2C_SEGMENT_WRITE, config,    sizeof(config),    0 },
+    };
+    hal_i2c_txn_t txn = {};
+    txn.i2c_op        = HAL_I2C_OP_SEQUENCE;
+    txn.segments      = segments;
+    txn.segment_count = 3;
+
+    // Given the transaction was submitted and loaded.
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
+
+    // --------- Segment 1: write 0x01 to 0x10 ---------
+    Sim_I2C1.SR1 |= I2C_SR1_SB;
+    I2C1_EV_IRQHandler();
+    ASSERT_EQ(Sim_I2C1.DR, static_cast<uint32_t>((0x10 << 1) | 0));
+    Sim_I2C1.SR1 &= ~I2C_SR1_SB;
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+
+    Sim_I2C1.SR1 |= I2C_SR1_ADDR;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_ADDR;
+
+    Sim_I2C1.SR1 |= I2C_SR1_TXE;
+    I2C1_EV_IRQHandler();
+    ASSERT_EQ(Sim_I2C1.DR, static_cast<uint32_t>(0x01));
+    Sim_I2C1.SR1 &= ~I2C_SR1_TXE;
+
+    // HW-SIM: Last byte shifted out -> BTF. A repeated START, not a STOP, must follow.
+    Sim_I2C1.SR1 |= I2C_SR1_BTF;
+    I2C1_EV_IRQHandler();
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_STOP);
+    ASSERT_FALSE(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN);
+    Sim_I2C1.SR1 &= ~I2C_SR1_BTF;
+
+    // Servicer sees the transaction still in flight between segments.
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_BUSY);
+
+    // --------- Segment 2: read one byte from 0x10 ---------
+    Sim_I2C1.SR1 |= I2C_SR1_SB;
+    I2C1_EV_IRQHandler();
+    ASSERT_EQ(Sim_I2C1.DR, static_cast<uint32_t>((0x10 << 1) | 1));
+    Sim_I2C1.SR1 &= ~I2C_SR1_SB;
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+
+    Sim_I2C1.SR1 |= I2C_SR1_ADDR;
+    I2C1_EV_IRQHandler();
+    // Single byte read: NACK armed and the repeated START requested while the byte is in flight.
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_ACK);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_STOP);
+    ASSERT_TRUE(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN);
+    Sim_I2C1.SR1 &= ~I2C_SR1_ADDR;
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+
+    Sim_I2C1.DR = 0x5A;
+    Sim_I2C1.SR1 |= I2C_SR1_RXNE;
+    I2C1_EV_IRQHandler();
+    ASSERT_FALSE(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN);
+    Sim_I2C1.SR1 &= ~I2C_SR1_RXNE;
+
+    // --------- Segment 3: write two bytes to 0x20 ---------
+    Sim_I2C1.SR1 |= I2C_SR1_SB;
+    I2C1_EV_IRQHandler();
+    ASSERT_EQ(Sim_I2C1.DR, static_cast<uint32_t>((0x20 << 1) | 0));
+    Sim_I2C1.SR1 &= ~I2C_SR1_SB;
+
+    Sim_I2C1.SR1 |= I2C_SR1_ADDR;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_ADDR;
+
+    Sim_I2C1.SR1 |= I2C_SR1_TXE;
+    I2C1_EV_IRQHandler();
+    ASSERT_EQ(Sim_I2C1.DR, static_cast<uint32_t>(0xAA));
+    I2C1_EV_IRQHandler();
+    ASSERT_EQ(Sim_I2C1.DR, static_cast<uint32_t>(0xBB));
+    Sim_I2C1.SR1 &= ~I2C_SR1_TXE;
+
+    // Final segment ends with STOP.
+    Sim_I2C1.SR1 |= I2C_SR1_BTF;
+    I2C1_EV_IRQHandler();
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_STOP);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_START);
+    Sim_I2C1.SR1 &= ~I2C_SR1_BTF;
+
+    // --------- Assert results ---------
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(3));
+    ASSERT_EQ(txn.actual_bytes_received, static_cast<size_t>(1));
+    ASSERT_EQ(segments[0].actual_length, static_cast<size_t>(1));
+    ASSERT_EQ(segments[1].actual_length, static_cast<size_t>(1));
+    ASSERT_EQ(segments[2].actual_length, static_cast<size_t>(2));
+    // Received data lands straight in the client's buffer.
+    ASSERT_EQ(reg_value[0], static_cast<uint8_t>(0x5A));
+}
+
+TEST_F(I2CDriverTest, SequenceNACKStopsRemainingSegments)
+{
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+    // Given a sequence of two zero length probes.
+    hal_i2c_segment_t segments[2] = {
+        { 0x30, HAL_I2C_SEGMENT_WRITE, nullptr, 0, 0 },
+        { 0x31, HAL_I2C_SEGMENT_WRITE, nullptr, 0, 0 },
+    };
+    hal_i2c_txn_t txn = {};
+    txn.i2c_op        = HAL_I2C_OP_SEQUENCE;
+    txn.segments      = segments;
+    txn.segment_count = 2;
+
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+
+    // The first target NACKs its address.
+    Sim_I2C1.SR1 |= I2C_SR1_SB;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_SB;
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+    Sim_I2C1.SR1 |= I2C_SR1_AF;
+    I2C1_ER_IRQHandler();
+
+    // Then the whole sequence ends with STOP and completes as failed.
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_STOP);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_START);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.actual_bytes_transmitted, static_cast<size_t>(0));
+}
+
+TEST_F(I2CDriverTest, TransactionServicerRejectsInvalidSequences)
+{
+    uint8_t buffer[1] = { 0 };
+    hal_i2c_segment_t zero_length_read[1] = { { 0x10, HAL_I2C_SEGMENT_READ, buffer, 0, 0 } };
+    hal_i2c_segment_t missing_buffer[1] = { { 0x10, HAL_I2C_SEGMENT_WRITE, nullptr, 1, 0 } };
+    hal_i2c_segment_t bad_direction[1] = { { 0x10, _HAL_I2C_SEGMENT_MAX, buffer, 1, 0 } };
+
+    struct { hal_i2c_segment_t *segments; size_t count; } cases[] = {
+        { nullptr, 1 },
+        { zero_length_read, 0 },
+        { zero_length_read, 1 },
+        { missing_buffer, 1 },
+        { bad_direction, 1 },
+    };
+
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+    for (size_t i = 0; i < ARRAY_SIZE(cases); i++)
+    {
+        hal_i2c_txn_t txn = {};
+        txn.i2c_op        = HAL_I2C_OP_SEQUENCE;
+        txn.segments      = cases[i].segments;
+        txn.segment_count = cases[i].count;
+
+        ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+        ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_ERROR);
+        ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+        ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    }
+}
+
+/***********************************************/
+// Multi-bus Tests
+/***********************************************/
+
+TEST_F(I2CDriverTest, RejectsInvalidBus)
+{
+    hal_i2c_txn_t txn = {};
+    hal_i2c_queue_latency_t latency;
+
+    ASSERT_EQ(hal_i2c_init(_HAL_I2C_BUS_MAX), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_submit_transaction(_HAL_I2C_BUS_MAX, &txn), HAL_STATUS_ERROR);
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_CREATED);
+    ASSERT_EQ(hal_i2c_transaction_servicer(_HAL_I2C_BUS_MAX), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_get_queue_latency(_HAL_I2C_BUS_MAX, HAL_I2C_PRIORITY_LOW, &latency), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CDriverTest, InitsSecondBusOnItsOwnPins)
+{
+    ASSERT_EQ(hal_i2c_init(HAL_I2C2), HAL_STATUS_OK);
+
+    // Clocks to port B, port C and I2C2 only.
+    ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_GPIOBEN);
+    ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_GPIOCEN);
+    ASSERT_TRUE(Sim_RCC.APB1ENR & RCC_APB1ENR_I2C2EN);
+    ASSERT_FALSE(Sim_RCC.APB1ENR & RCC_APB1ENR_I2C1EN);
+
+    // PB10 SCL and PC12 SDA in open drain AF4.
+    ASSERT_EQ((Sim_GPIOB.MODER >> (10 * 2)) & 0x3, 0x2U);
+    ASSERT_EQ((Sim_GPIOC.MODER >> (12 * 2)) & 0x3, 0x2U);
+    ASSERT_EQ((Sim_GPIOB.AFR[1] >> (PIN_2 * AF_SHIFT_WIDTH)) & 0xF, AF4_MASK);
+    ASSERT_EQ((Sim_GPIOC.AFR[1] >> (PIN_4 * AF_SHIFT_WIDTH)) & 0xF, AF4_MASK);
+    ASSERT_TRUE(Sim_GPIOB.OTYPER & GPIO_OTYPER_OT_10);
+    ASSERT_TRUE(Sim_GPIOC.OTYPER & GPIO_OTYPER_OT_12);
+
+    // I2C1 pins untouched.
+    ASSERT_EQ(Sim_GPIOB.MODER & (BIT_16 | BIT_17 | BIT_18 | BIT_19), 0U);
+
+    // Peripheral and interrupts.
+    ASSERT_TRUE(Sim_I2C2.CR1 & I2C_CR1_PE);
+    ASSERT_EQ(Sim_I2C2.CR2 & I2C_CR2_FREQ, 16U);
+    ASSERT_TRUE(Sim_I2C2.CR2 & I2C_CR2_ITEVTEN);
+    ASSERT_TRUE(NVIC_IsIRQEnabled(I2C2_EV_IRQn));
+    ASSERT_TRUE(NVIC_IsIRQEnabled(I2C2_ER_IRQn));
+    ASSERT_EQ(Sim_I2C1.CR1, 0U);
+}
+
+TEST_F(I2CDriverTest, InitsThirdBusOnItsOwnPins)
+{
+    ASSERT_EQ(hal_i2c_init(HAL_I2C3), HAL_STATUS_OK);
+
+    ASSERT_TRUE(Sim_RCC.APB1ENR & RCC_APB1ENR_I2C3EN);
+    ASSERT_EQ((Sim_GPIOA.MODER >> (8 * 2)) & 0x3, 0x2U);
+    ASSERT_EQ((Sim_GPIOC.MODER >> (9 * 2)) & 0x3, 0x2U);
+    ASSERT_TRUE(Sim_I2C3.CR1 & I2C_CR1_PE);
+    ASSERT_TRUE(NVIC_IsIRQEnabled(I2C3_EV_IRQn));
+    ASSERT_TRUE(NVIC_IsIRQEnabled(I2C3_ER_IRQn));
+}
+
+TEST_F(I2CDriverTest, BusesRunTransactionsInParallel)
+{
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_init(HAL_I2C2), HAL_STATUS_OK);
+
+    hal_i2c_txn_t slow = {};
+    slow.target_addr          = 0x50;
+    slow.i2c_op               = HAL_I2C_OP_WRITE;
+    slow.expected_bytes_to_tx = 1;
+
+    hal_i2c_txn_t fast = {};
+    fast.target_addr          = 0x68;
+    fast.i2c_op               = HAL_I2C_OP_READ;
+    fast.expected_bytes_to_rx = 1;
+
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &slow), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C2, &fast), HAL_STATUS_OK);
+
+    // Both buses start their own transaction.
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C2), HAL_STATUS_OK);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_START);
+    ASSERT_TRUE(Sim_I2C2.CR1 & I2C_CR1_START);
+
+    // The fast read completes on I2C2 while I2C1 is still busy.
+    Sim_I2C2.SR1 |= I2C_SR1_SB;
+    I2C2_EV_IRQHandler();
+    ASSERT_EQ(Sim_I2C2.DR, static_cast<uint32_t>((0x68 << 1) | 1));
+    ASSERT_EQ(Sim_I2C1.DR, 0U);
+    Sim_I2C2.SR1 &= ~I2C_SR1_SB;
+    Sim_I2C2.SR1 |= I2C_SR1_ADDR;
+    I2C2_EV_IRQHandler();
+    Sim_I2C2.SR1 &= ~I2C_SR1_ADDR;
+    Sim_I2C2.DR = 0x42;
+    Sim_I2C2.SR1 |= I2C_SR1_RXNE;
+    I2C2_EV_IRQHandler();
+
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C2), HAL_STATUS_OK);
+    ASSERT_EQ(fast.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(fast.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(fast.rx_data[0], 0x42);
+
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_BUSY);
+    ASSERT_EQ(slow.processing_state, HAL_I2C_TXN_STATE_PROCESSING);
+}
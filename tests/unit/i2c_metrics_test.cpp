@@ -0,0 +1,178 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "registers.h"
+#include "nvic.h"
+#include "i2c_sim.h"
+#include "stm32f4_hal.h"
+
+void I2C1_ER_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void _test_fixture_hal_i2c_reset_internals();
+
+extern uint32_t tick_ms;
+}
+
+#define SENSOR_ADDR 0x68
+#define ABSENT_ADDR 0x77
+
+class I2CMetricsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOB = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        // Whole milliseconds only. The counter sits at the top of its reload.
+        Sim_SysTick.VAL = 15999;
+        tick_ms = 0;
+
+        _test_fixture_hal_i2c_reset_internals();
+        ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+        i2c_sim_init(&sim, &Sim_I2C1, I2C1_EV_IRQHandler, I2C1_ER_IRQHandler, I2C1_EV_IRQn, I2C1_ER_IRQn);
+        i2c_sim_register_device_init(&sensor, SENSOR_ADDR);
+        i2c_sim_attach(&sim, &sensor.base);
+    }
+
+    static void make_read(hal_i2c_txn_t *txn, uint8_t addr, size_t rx_len)
+    {
+        memset(txn, 0, sizeof(*txn));
+        txn->target_addr = addr;
+        txn->i2c_op = HAL_I2C_OP_WRITE_READ;
+        txn->tx_data[0] = 0x10;
+        txn->expected_bytes_to_tx = 1;
+        txn->expected_bytes_to_rx = rx_len;
+    }
+
+    // Submit at submit_ms, load at load_ms, let the bus run at end_ms and collect the result.
+    void run(hal_i2c_txn_t *txn, uint32_t submit_ms, uint32_t load_ms, uint32_t end_ms)
+    {
+        tick_ms = submit_ms;
+        ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, txn), HAL_STATUS_OK);
+        tick_ms = load_ms;
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        tick_ms = end_ms;
+        i2c_sim_run(&sim, 1000);
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        ASSERT_EQ(txn->processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    }
+
+    i2c_sim_t sim;
+    i2c_sim_register_device_t sensor;
+};
+
+TEST_F(I2CMetricsTest, RecordsWaitBusTimeAndBytesPerTarget)
+{
+    hal_i2c_txn_t txn;
+    hal_i2c_target_metrics_t metrics;
+
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, SENSOR_ADDR, &metrics), HAL_STATUS_ERROR);
+
+    make_read(&txn, SENSOR_ADDR, 4);
+    run(&txn, 0, 3, 5);
+    make_read(&txn, SENSOR_ADDR, 2);
+    run(&txn, 10, 11, 15);
+
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, SENSOR_ADDR, &metrics), HAL_STATUS_OK);
+    ASSERT_EQ(metrics.target_addr, SENSOR_ADDR);
+    ASSERT_EQ(metrics.transactions, 2u);
+    ASSERT_EQ(metrics.total_wait_us, 4000u);
+    ASSERT_EQ(metrics.max_wait_us, 3000u);
+    ASSERT_EQ(metrics.total_bus_us, 6000u);
+    ASSERT_EQ(metrics.max_bus_us, 4000u);
+    ASSERT_EQ(metrics.bytes_transmitted, 2u);
+    ASSERT_EQ(metrics.bytes_received, 6u);
+    ASSERT_EQ(metrics.nacks, 0u);
+    ASSERT_EQ(metrics.errors, 0u);
+}
+
+TEST_F(I2CMetricsTest, CountsNacksApartFromOtherErrors)
+{
+    hal_i2c_txn_t txn;
+    hal_i2c_target_metrics_t metrics;
+
+    make_read(&txn, ABSENT_ADDR, 2);
+    run(&txn, 0, 0, 1);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+
+    // Rejected by validation. Never reaches the bus.
+    make_read(&txn, ABSENT_ADDR, 1);
+    txn.i2c_op = _HAL_I2C_OP_MAX;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, ABSENT_ADDR, &metrics), HAL_STATUS_OK);
+    ASSERT_EQ(metrics.transactions, 2u);
+    ASSERT_EQ(metrics.nacks, 1u);
+    ASSERT_EQ(metrics.errors, 1u);
+    ASSERT_EQ(metrics.total_bus_us, 1000u);
+    ASSERT_EQ(metrics.bytes_received, 0u);
+}
+
+TEST_F(I2CMetricsTest, ReportsBusBusyShareOfTheWindow)
+{
+    hal_i2c_txn_t txn;
+    hal_i2c_bus_utilization_t utilization;
+
+    make_read(&txn, SENSOR_ADDR, 1);
+    run(&txn, 0, 2, 4);
+    make_read(&txn, SENSOR_ADDR, 1);
+    run(&txn, 5, 5, 6);
+
+    tick_ms = 20;
+    ASSERT_EQ(hal_i2c_get_bus_utilization(HAL_I2C1, &utilization), HAL_STATUS_OK);
+    ASSERT_EQ(utilization.window_ms, 20u);
+    ASSERT_EQ(utilization.busy_us, 3000u);
+    ASSERT_EQ(utilization.busy_percent, 15);
+    ASSERT_EQ(utilization.untracked_transactions, 0u);
+
+    // Reset starts a new window.
+    ASSERT_EQ(hal_i2c_reset_metrics(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_get_bus_utilization(HAL_I2C1, &utilization), HAL_STATUS_OK);
+    ASSERT_EQ(utilization.window_ms, 0u);
+    ASSERT_EQ(utilization.busy_us, 0u);
+    ASSERT_EQ(utilization.busy_percent, 0);
+
+    hal_i2c_target_metrics_t metrics;
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, SENSOR_ADDR, &metrics), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CMetricsTest, TargetsBeyondTheTableAreOnlyCountedAsUntracked)
+{
+    hal_i2c_txn_t txn;
+    hal_i2c_target_metrics_t metrics;
+    hal_i2c_bus_utilization_t utilization;
+
+    for (uint8_t i = 0; i <= HAL_I2C_METRICS_MAX_TARGETS; i++)
+    {
+        make_read(&txn, (uint8_t)(0x20 + i), 1);
+        run(&txn, 0, 0, 0);
+    }
+
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, 0x20 + HAL_I2C_METRICS_MAX_TARGETS - 1, &metrics), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, 0x20 + HAL_I2C_METRICS_MAX_TARGETS, &metrics), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_get_bus_utilization(HAL_I2C1, &utilization), HAL_STATUS_OK);
+    ASSERT_EQ(utilization.untracked_transactions, 1u);
+}
+
+TEST_F(I2CMetricsTest, RejectsBadArguments)
+{
+    hal_i2c_target_metrics_t metrics;
+    hal_i2c_bus_utilization_t utilization;
+    hal_i2c_txn_t txn;
+
+    make_read(&txn, SENSOR_ADDR, 1);
+    run(&txn, 0, 0, 1);
+
+    ASSERT_EQ(hal_i2c_get_target_metrics(_HAL_I2C_BUS_MAX, SENSOR_ADDR, &metrics), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, SENSOR_ADDR, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_get_bus_utilization(_HAL_I2C_BUS_MAX, &utilization), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_get_bus_utilization(HAL_I2C1, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_reset_metrics(_HAL_I2C_BUS_MAX), HAL_STATUS_ERROR);
+
+    // Figures on one bus say nothing about another.
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C2, SENSOR_ADDR, &metrics), HAL_STATUS_ERROR);
+}
@@ -0,0 +1,220 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "hal/i2c_regcache.h"
+#include "registers.h"
+#include "stm32f4_hal.h"
+
+void _test_fixture_hal_i2c_reset_internals();
+}
+
+#define TARGET_ADDR 0x1E
+#define BASE_REG    0x20
+
+class I2CRegcacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOB = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        _test_fixture_hal_i2c_reset_internals();
+        ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+        ASSERT_EQ(hal_i2c_regcache_init(&cache, HAL_I2C1, TARGET_ADDR, BASE_REG, 8, HAL_I2C_PRIORITY_MEDIUM), HAL_STATUS_OK);
+    }
+
+    // Stand in for the bus. Take the cache's transaction back from the driver
+    // and complete it as the servicer would.
+    void complete(bool success, const uint8_t *rx = NULL)
+    {
+        ASSERT_TRUE(cache.busy);
+        ASSERT_EQ(cache.txn.processing_state, HAL_I2C_TXN_STATE_QUEUED);
+        _test_fixture_hal_i2c_reset_internals();
+
+        cache.txn.processing_state = HAL_I2C_TXN_STATE_COMPLETED;
+        cache.txn.transaction_result = success ? HAL_I2C_TXN_RESULT_SUCCESS : HAL_I2C_TXN_RESULT_FAIL;
+        cache.txn.error = success ? HAL_I2C_ERROR_NONE : HAL_I2C_ERROR_NACK;
+        cache.txn.actual_bytes_transmitted = success ? cache.txn.expected_bytes_to_tx : 0;
+        cache.txn.actual_bytes_received = success ? cache.txn.expected_bytes_to_rx : 0;
+        if (rx)
+        {
+            memcpy(cache.txn.rx_data, rx, cache.txn.expected_bytes_to_rx);
+        }
+
+        cache.txn.on_complete(&cache.txn);
+        ASSERT_FALSE(cache.busy);
+    }
+
+    hal_i2c_regcache_t cache;
+};
+
+TEST_F(I2CRegcacheTest, InitRejectsBadArguments)
+{
+    hal_i2c_regcache_t other;
+
+    ASSERT_EQ(hal_i2c_regcache_init(NULL, HAL_I2C1, TARGET_ADDR, BASE_REG, 8, HAL_I2C_PRIORITY_LOW), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, _HAL_I2C_BUS_MAX, TARGET_ADDR, BASE_REG, 8, HAL_I2C_PRIORITY_LOW), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, HAL_I2C1, 0x80, BASE_REG, 8, HAL_I2C_PRIORITY_LOW), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, HAL_I2C1, 0x90, BASE_REG, 8, HAL_I2C_PRIORITY_LOW), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, HAL_I2C1, TARGET_ADDR, BASE_REG, 8, _HAL_I2C_PRIORITY_MAX), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, HAL_I2C1, TARGET_ADDR, BASE_REG, 0, HAL_I2C_PRIORITY_LOW), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, HAL_I2C1, TARGET_ADDR, BASE_REG, HAL_I2C_REGCACHE_MAX_REGISTERS + 1, HAL_I2C_PRIORITY_LOW), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, HAL_I2C1, TARGET_ADDR, 0xF0, 17, HAL_I2C_PRIORITY_LOW), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, HAL_I2C1, TARGET_ADDR, 0xF0, 16, HAL_I2C_PRIORITY_LOW), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_init(&other, HAL_I2C1, 0x7F, BASE_REG, 8, HAL_I2C_PRIORITY_LOW), HAL_STATUS_OK);
+
+    uint8_t value;
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG - 1, &value), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 8, &value), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 8, 0), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_flush(NULL), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CRegcacheTest, MissFetchesUnknownRegistersInOneBurst)
+{
+    uint8_t value;
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 5, &value), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.txn.target_addr, TARGET_ADDR);
+    ASSERT_EQ(cache.txn.i2c_op, HAL_I2C_OP_WRITE_READ);
+    ASSERT_EQ(cache.txn.priority, HAL_I2C_PRIORITY_MEDIUM);
+    ASSERT_EQ(cache.txn.tx_data[0], BASE_REG + 5);
+    ASSERT_EQ(cache.txn.expected_bytes_to_tx, 1U);
+    ASSERT_EQ(cache.txn.expected_bytes_to_rx, 3U);
+
+    // Polling while the fetch is out does not submit another one.
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 5, &value), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.bus_reads, 1U);
+
+    const uint8_t rx[] = {0x55, 0x66, 0x77};
+    complete(true, rx);
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 5, &value), HAL_STATUS_OK);
+    ASSERT_EQ(value, 0x55);
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 7, &value), HAL_STATUS_OK);
+    ASSERT_EQ(value, 0x77);
+    ASSERT_EQ(cache.reads_skipped, 2U);
+    ASSERT_EQ(cache.bus_reads, 1U);
+}
+
+TEST_F(I2CRegcacheTest, FetchStopsAtKnownRegister)
+{
+    uint8_t value;
+
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 3, 0x33), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 1, &value), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.txn.tx_data[0], BASE_REG + 1);
+    ASSERT_EQ(cache.txn.expected_bytes_to_rx, 2U);
+
+    // A write while the fetch is on the bus wins over the fetched value.
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 2, 0x22), HAL_STATUS_OK);
+    const uint8_t rx[] = {0x11, 0xEE};
+    complete(true, rx);
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 1, &value), HAL_STATUS_OK);
+    ASSERT_EQ(value, 0x11);
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 2, &value), HAL_STATUS_OK);
+    ASSERT_EQ(value, 0x22);
+}
+
+TEST_F(I2CRegcacheTest, FlushMergesAdjacentDirtyRegisters)
+{
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_OK);
+
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 1, 0xA1), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 2, 0xA2), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 3, 0xA3), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 6, 0xA6), HAL_STATUS_OK);
+
+    // First run: registers 1 to 3 in one write.
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.txn.i2c_op, HAL_I2C_OP_WRITE);
+    ASSERT_EQ(cache.txn.expected_bytes_to_tx, 4U);
+    ASSERT_EQ(cache.txn.tx_data[0], BASE_REG + 1);
+    ASSERT_EQ(cache.txn.tx_data[1], 0xA1);
+    ASSERT_EQ(cache.txn.tx_data[2], 0xA2);
+    ASSERT_EQ(cache.txn.tx_data[3], 0xA3);
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_BUSY);
+    complete(true);
+
+    // Second run: register 6 alone.
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.txn.expected_bytes_to_tx, 2U);
+    ASSERT_EQ(cache.txn.tx_data[0], BASE_REG + 6);
+    ASSERT_EQ(cache.txn.tx_data[1], 0xA6);
+    complete(true);
+
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_OK);
+    ASSERT_EQ(cache.bus_writes, 2U);
+}
+
+TEST_F(I2CRegcacheTest, UnchangedValueIsNotWrittenAgain)
+{
+    uint8_t value;
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG, &value), HAL_STATUS_BUSY);
+    uint8_t rx[8] = {0x0F};
+    complete(true, rx);
+
+    // Read-modify-write that changes nothing.
+    ASSERT_EQ(hal_i2c_regcache_update_bits(&cache, BASE_REG, 0x0F, 0x0F), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_OK);
+
+    // Read-modify-write that does, with no read on the bus.
+    ASSERT_EQ(hal_i2c_regcache_update_bits(&cache, BASE_REG, 0xF0, 0x50), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.txn.tx_data[1], 0x5F);
+    ASSERT_EQ(cache.bus_reads, 1U);
+}
+
+TEST_F(I2CRegcacheTest, FailedWriteStaysDirty)
+{
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 4, 0x44), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_BUSY);
+    complete(false);
+
+    ASSERT_EQ(cache.failures, 1U);
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_ERROR);
+
+    // The next flush tries again.
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.txn.tx_data[0], BASE_REG + 4);
+    ASSERT_EQ(cache.txn.tx_data[1], 0x44);
+    complete(true);
+    ASSERT_EQ(hal_i2c_regcache_flush(&cache), HAL_STATUS_OK);
+}
+
+TEST_F(I2CRegcacheTest, FailedFetchIsReportedOnce)
+{
+    uint8_t value;
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG, &value), HAL_STATUS_BUSY);
+    complete(false);
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG, &value), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG, &value), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.bus_reads, 2U);
+}
+
+TEST_F(I2CRegcacheTest, InvalidatedRegisterIsReadFromBusAgain)
+{
+    uint8_t value;
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG, &value), HAL_STATUS_BUSY);
+    uint8_t rx[8] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+    complete(true, rx);
+
+    // Register 7 is dirty, so invalidating it keeps the pending value.
+    ASSERT_EQ(hal_i2c_regcache_write(&cache, BASE_REG + 7, 0x70), HAL_STATUS_OK);
+    hal_i2c_regcache_invalidate(&cache, BASE_REG + 2, 100);
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 1, &value), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 7, &value), HAL_STATUS_OK);
+    ASSERT_EQ(value, 0x70);
+
+    ASSERT_EQ(hal_i2c_regcache_read(&cache, BASE_REG + 2, &value), HAL_STATUS_BUSY);
+    ASSERT_EQ(cache.txn.tx_data[0], BASE_REG + 2);
+    ASSERT_EQ(cache.txn.expected_bytes_to_rx, 5U);
+}
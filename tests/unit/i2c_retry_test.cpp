@@ -0,0 +1,277 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "registers.h"
+#include "nvic.h"
+#include "i2c_sim.h"
+#include "stm32f4_hal.h"
+
+void I2C1_ER_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void _test_fixture_hal_i2c_reset_internals();
+
+extern uint32_t tick_ms;
+}
+
+#define EEPROM_ADDR 0x50
+#define ABSENT_ADDR 0x77
+
+#define EEPROM_PAGE_SIZE 8
+
+static int completions;
+
+static void count_completion(hal_i2c_txn_t *txn)
+{
+    (void)txn;
+    completions++;
+}
+
+// Retries, arbitration loss and acknowledge polling against the bus model.
+class I2CRetryTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOB = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        _test_fixture_hal_i2c_reset_internals();
+        tick_ms = 0;
+        completions = 0;
+        ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+        i2c_sim_init(&sim, &Sim_I2C1, I2C1_EV_IRQHandler, I2C1_ER_IRQHandler, I2C1_EV_IRQn, I2C1_ER_IRQn);
+        i2c_sim_eeprom_init(&eeprom, EEPROM_ADDR, EEPROM_PAGE_SIZE, 0);
+        i2c_sim_attach(&sim, &eeprom.base);
+    }
+
+    static void make_write(hal_i2c_txn_t *txn, uint8_t addr)
+    {
+        memset(txn, 0, sizeof(*txn));
+        txn->target_addr = addr;
+        txn->i2c_op = HAL_I2C_OP_WRITE;
+        txn->tx_data[0] = 0x10;
+        txn->tx_data[1] = 0xC0;
+        txn->tx_data[2] = 0xDE;
+        txn->expected_bytes_to_tx = 3;
+        txn->on_complete = count_completion;
+    }
+
+    static void make_read(hal_i2c_txn_t *txn, uint8_t addr)
+    {
+        memset(txn, 0, sizeof(*txn));
+        txn->target_addr = addr;
+        txn->i2c_op = HAL_I2C_OP_WRITE_READ;
+        txn->tx_data[0] = 0x10;
+        txn->expected_bytes_to_tx = 1;
+        txn->expected_bytes_to_rx = 2;
+        txn->on_complete = count_completion;
+    }
+
+    // One pass of the main loop at the given time. Whatever went on the bus is collected.
+    void service_at(uint32_t now)
+    {
+        tick_ms = now;
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        i2c_sim_run(&sim, 1000);
+        hal_i2c_transaction_servicer(HAL_I2C1);
+    }
+
+    // Alternate the servicer and the bus without letting time pass.
+    void service_until_idle(hal_i2c_txn_t *txn)
+    {
+        for (int i = 0; i < 100 && txn->processing_state != HAL_I2C_TXN_STATE_COMPLETED; i++)
+        {
+            service_at(tick_ms);
+        }
+        hal_i2c_transaction_servicer(HAL_I2C1);
+    }
+
+    i2c_sim_t sim;
+    i2c_sim_eeprom_t eeprom;
+};
+
+TEST_F(I2CRetryTest, NackedTransactionIsRetriedWithBackoff)
+{
+    hal_i2c_txn_t txn;
+    const hal_i2c_retry_policy_t policy = {
+        .max_retries = 5, .delay_ms = 2, .backoff = 2, .max_delay_ms = 5,
+        .retry_on = HAL_I2C_RETRY_ON(HAL_I2C_ERROR_NACK),
+    };
+
+    // In its write cycle for three more address attempts.
+    eeprom.busy_remaining = 3;
+    eeprom.memory[0x10] = 0x5A;
+    make_read(&txn, EEPROM_ADDR);
+    txn.retry_policy = &policy;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+
+    // Attempt 1 at 0 ms. Retries due at 2 ms, then 2 + 4 ms, then 6 + 5 ms (capped).
+    service_at(0);
+    service_at(1);
+    ASSERT_EQ(txn.retries, 1);
+    ASSERT_NE(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(sim.starts, 1u);
+
+    service_at(2);
+    service_at(5);
+    ASSERT_EQ(sim.starts, 2u);
+    ASSERT_EQ(txn.retry_delay_ms, 4u);
+    service_at(6);
+    service_at(10);
+    ASSERT_EQ(sim.starts, 3u);
+    ASSERT_EQ(txn.retry_delay_ms, 5u);
+    service_at(11);
+
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.retries, 3);
+    ASSERT_EQ(txn.rx_data[0], 0x5A);
+    ASSERT_EQ(completions, 1);
+
+    hal_i2c_target_metrics_t metrics;
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, EEPROM_ADDR, &metrics), HAL_STATUS_OK);
+    ASSERT_EQ(metrics.transactions, 4u);
+    ASSERT_EQ(metrics.nacks, 3u);
+}
+
+TEST_F(I2CRetryTest, LastErrorStandsOnceRetriesRunOut)
+{
+    hal_i2c_txn_t txn;
+    const hal_i2c_retry_policy_t policy = {
+        .max_retries = 2, .delay_ms = 0, .backoff = 0, .max_delay_ms = 0,
+        .retry_on = HAL_I2C_RETRY_ON(HAL_I2C_ERROR_NACK),
+    };
+
+    make_write(&txn, ABSENT_ADDR);
+    txn.retry_policy = &policy;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service_until_idle(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+    ASSERT_EQ(txn.retries, 2);
+    ASSERT_EQ(sim.starts, 3u);
+    ASSERT_EQ(completions, 1);
+
+    // Submitting again starts the count over.
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    ASSERT_EQ(txn.retries, 0);
+}
+
+TEST_F(I2CRetryTest, OnlyTheListedErrorsAreRetried)
+{
+    hal_i2c_txn_t txn;
+    const hal_i2c_retry_policy_t policy = {
+        .max_retries = 3, .delay_ms = 0, .backoff = 0, .max_delay_ms = 0,
+        .retry_on = HAL_I2C_RETRY_ON(HAL_I2C_ERROR_TIMEOUT),
+    };
+
+    make_write(&txn, ABSENT_ADDR);
+    txn.retry_policy = &policy;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service_until_idle(&txn);
+
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_NACK);
+    ASSERT_EQ(txn.retries, 0);
+    ASSERT_EQ(sim.starts, 1u);
+}
+
+TEST_F(I2CRetryTest, LostArbitrationPutsTheTransactionBackInTheQueue)
+{
+    hal_i2c_txn_t txn;
+
+    eeprom.memory[0x10] = 0x11;
+    eeprom.memory[0x11] = 0x22;
+    make_read(&txn, EEPROM_ADDR);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+
+    // Lose the bus part way through the first attempt.
+    hal_i2c_transaction_servicer(HAL_I2C1);
+    i2c_sim_run(&sim, 4);
+    i2c_sim_lose_arbitration(&sim);
+    service_until_idle(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.arbitration_requeues, 1);
+    ASSERT_EQ(txn.retries, 0);
+    ASSERT_EQ(txn.rx_data[0], 0x11);
+    ASSERT_EQ(txn.rx_data[1], 0x22);
+    ASSERT_EQ(completions, 1);
+}
+
+TEST_F(I2CRetryTest, ArbitrationLossFailsAfterTheRequeueLimit)
+{
+    hal_i2c_txn_t txn;
+
+    make_read(&txn, EEPROM_ADDR);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+
+    for (int attempt = 0; attempt <= HAL_I2C_ARBITRATION_REQUEUES; attempt++)
+    {
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        i2c_sim_run(&sim, 2);
+        i2c_sim_lose_arbitration(&sim);
+        i2c_sim_run(&sim, 1000);
+    }
+    hal_i2c_transaction_servicer(HAL_I2C1);
+
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_ARBITRATION_LOST);
+    ASSERT_EQ(txn.arbitration_requeues, HAL_I2C_ARBITRATION_REQUEUES);
+    ASSERT_EQ(completions, 1);
+}
+
+TEST_F(I2CRetryTest, AckPollingCompletesOnceTheWriteCycleIsOver)
+{
+    hal_i2c_txn_t write;
+    hal_i2c_txn_t read;
+
+    i2c_sim_eeprom_init(&eeprom, EEPROM_ADDR, EEPROM_PAGE_SIZE, 3);
+    make_write(&write, EEPROM_ADDR);
+    write.ack_poll_timeout_ms = 10;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &write), HAL_STATUS_OK);
+
+    // A read queued behind the write waits for the polling to end.
+    make_read(&read, EEPROM_ADDR);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &read), HAL_STATUS_OK);
+
+    service_until_idle(&write);
+
+    ASSERT_EQ(write.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(write.actual_bytes_transmitted, 3u);
+    ASSERT_EQ(eeprom.busy_remaining, 0u);
+
+    // Without a retry policy the read only works after the write cycle.
+    service_until_idle(&read);
+    ASSERT_EQ(read.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    // The write, three unanswered probes, the one that got its ACK, then the read's two.
+    ASSERT_EQ(sim.starts, 7u);
+    ASSERT_EQ(read.rx_data[0], 0xC0);
+    ASSERT_EQ(read.rx_data[1], 0xDE);
+    ASSERT_EQ(completions, 2);
+}
+
+TEST_F(I2CRetryTest, AckPollingGivesUpOnASilentTarget)
+{
+    hal_i2c_txn_t write;
+
+    i2c_sim_eeprom_init(&eeprom, EEPROM_ADDR, EEPROM_PAGE_SIZE, 1000);
+    make_write(&write, EEPROM_ADDR);
+    write.ack_poll_timeout_ms = 5;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &write), HAL_STATUS_OK);
+
+    for (uint32_t now = 0; now < 5; now++)
+    {
+        service_at(now);
+    }
+    ASSERT_NE(write.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+
+    service_at(5);
+    ASSERT_EQ(write.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(write.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(write.error, HAL_I2C_ERROR_TIMEOUT);
+    // The data itself went out.
+    ASSERT_EQ(write.actual_bytes_transmitted, 3u);
+    ASSERT_EQ(completions, 1);
+}
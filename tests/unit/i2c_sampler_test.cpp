@@ -0,0 +1,352 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "hal/i2c_sampler.h"
+#include "hal/systick.h"
+#include "registers.h"
+#include "stm32f4_hal.h"
+
+void I2C1_ER_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void SysTick_Handler(void);
+void _test_fixture_hal_i2c_reset_internals();
+void _test_fixture_hal_i2c_sampler_reset_internals();
+void hal_systick_reset_for_test();
+}
+
+static void tick(int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        SysTick_Handler();
+    }
+}
+
+// Drive the loaded 1 byte READ through the ISR, delivering value.
+static void run_one_byte_read(uint8_t value)
+{
+    Sim_I2C1.SR1 |= I2C_SR1_SB;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_SB;
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+
+    Sim_I2C1.SR1 |= I2C_SR1_ADDR;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_ADDR;
+
+    Sim_I2C1.DR  = value;
+    Sim_I2C1.SR1 |= I2C_SR1_RXNE;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_RXNE;
+    Sim_I2C1.CR1 &= ~I2C_CR1_STOP;
+}
+
+// Drive the loaded transaction into an address NACK.
+static void run_address_nack()
+{
+    Sim_I2C1.SR1 |= I2C_SR1_SB;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_SB;
+    Sim_I2C1.CR1 &= ~I2C_CR1_START;
+
+    Sim_I2C1.SR1 |= I2C_SR1_AF;
+    I2C1_ER_IRQHandler();
+    Sim_I2C1.CR1 &= ~I2C_CR1_STOP;
+}
+
+class I2CSamplerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOB = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        hal_systick_reset_for_test();
+        _test_fixture_hal_i2c_reset_internals();
+        _test_fixture_hal_i2c_sampler_reset_internals();
+        ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+        request = {};
+        request.target_addr = 0x68;
+        request.i2c_op = HAL_I2C_OP_READ;
+        request.expected_bytes_to_rx = 1;
+        request.priority = HAL_I2C_PRIORITY_HIGH;
+    }
+
+    // Let one sample come due, then service it through the bus.
+    void sample(hal_i2c_sampler_t *sampler, uint8_t value)
+    {
+        tick(sampler->period_ms);
+        ASSERT_TRUE(sampler->in_flight);
+        ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+        run_one_byte_read(value);
+        ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+        ASSERT_FALSE(sampler->in_flight);
+    }
+
+    hal_i2c_txn_t request;
+};
+
+TEST_F(I2CSamplerTest, RegisterRejectsBadArguments)
+{
+    hal_i2c_sampler_t sampler = {};
+
+    ASSERT_EQ(hal_i2c_sampler_register(NULL, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, NULL, 10), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 0), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, _HAL_I2C_BUS_MAX, &request, 10), HAL_STATUS_ERROR);
+
+    request.i2c_op = HAL_I2C_OP_SEQUENCE;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+
+    request.i2c_op = _HAL_I2C_OP_MAX;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CSamplerTest, RegisterRejectsRequestsTheServicerWould)
+{
+    hal_i2c_sampler_t sampler = {};
+    hal_i2c_txn_t good = request;
+
+    request.target_addr = 0x90;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+    request.addr_mode = HAL_I2C_ADDR_10BIT;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_OK);
+    hal_i2c_sampler_deregister(&sampler);
+
+    request = good;
+    request.addr_mode = _HAL_I2C_ADDR_MAX;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+
+    request = good;
+    request.speed = _HAL_I2C_SPEED_MAX;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+
+    request = good;
+    request.priority = _HAL_I2C_PRIORITY_MAX;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+
+    request = good;
+    request.expected_bytes_to_rx = 0;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+    request.expected_bytes_to_rx = RX_MESSAGE_MAX_LENGTH + 1;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+
+    request = good;
+    request.i2c_op = HAL_I2C_OP_WRITE_READ;
+    request.expected_bytes_to_tx = 0;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+
+    // The other whole-transaction operations are fine.
+    request = good;
+    request.i2c_op = HAL_I2C_OP_SMBUS_BLOCK_READ;
+    request.expected_bytes_to_tx = 1;
+    request.expected_bytes_to_rx = 32;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_OK);
+    hal_i2c_sampler_deregister(&sampler);
+
+    request.i2c_op = HAL_I2C_OP_SMBUS_BLOCK_WRITE;
+    request.expected_bytes_to_tx = 0;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+
+    request = good;
+    request.i2c_op = HAL_I2C_OP_SCAN;
+    request.tx_data[0] = 0x68;
+    request.expected_bytes_to_tx = 1;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_OK);
+}
+
+TEST_F(I2CSamplerTest, RegisterRejectsDuplicatesAndFullTable)
+{
+    hal_i2c_sampler_t samplers[HAL_I2C_SAMPLER_MAX_CLIENTS + 1] = {};
+
+    for (int i = 0; i < HAL_I2C_SAMPLER_MAX_CLIENTS; i++)
+    {
+        ASSERT_EQ(hal_i2c_sampler_register(&samplers[i], HAL_I2C1, &request, 10), HAL_STATUS_OK);
+    }
+
+    ASSERT_EQ(hal_i2c_sampler_register(&samplers[0], HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_sampler_register(&samplers[HAL_I2C_SAMPLER_MAX_CLIENTS], HAL_I2C1, &request, 10), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CSamplerTest, NothingToReadBeforeFirstSample)
+{
+    hal_i2c_sampler_t sampler = {};
+    const uint8_t *data;
+    size_t length;
+    uint32_t sequence;
+
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_OK);
+
+    ASSERT_EQ(hal_i2c_sampler_read(&sampler, &data, &length, &sequence), HAL_STATUS_BUSY);
+    ASSERT_EQ(hal_i2c_sampler_read(&sampler, NULL, &length, &sequence), HAL_STATUS_ERROR);
+    ASSERT_FALSE(hal_i2c_sampler_read_is_valid(&sampler, 0));
+}
+
+TEST_F(I2CSamplerTest, SampleIsSubmittedFromSysTickEachPeriod)
+{
+    hal_i2c_sampler_t sampler = {};
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 10), HAL_STATUS_OK);
+
+    // Not due yet.
+    tick(9);
+    ASSERT_FALSE(sampler.in_flight);
+
+    // Due on the 10th tick. Queued with the priority of the request.
+    tick(1);
+    ASSERT_TRUE(sampler.in_flight);
+    ASSERT_EQ(sampler.buffers[1].processing_state, HAL_I2C_TXN_STATE_QUEUED);
+    ASSERT_EQ(sampler.buffers[1].priority, HAL_I2C_PRIORITY_HIGH);
+
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(Sim_I2C1.CR1 & I2C_CR1_START, I2C_CR1_START);
+    run_one_byte_read(0x5A);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+
+    const uint8_t *data;
+    size_t length;
+    uint32_t sequence;
+    ASSERT_EQ(hal_i2c_sampler_read(&sampler, &data, &length, &sequence), HAL_STATUS_OK);
+    ASSERT_EQ(sequence, 1U);
+    ASSERT_EQ(length, 1U);
+    ASSERT_EQ(data[0], 0x5A);
+    ASSERT_TRUE(hal_i2c_sampler_read_is_valid(&sampler, sequence));
+}
+
+TEST_F(I2CSamplerTest, PublishedSampleSurvivesTheNextWrite)
+{
+    hal_i2c_sampler_t sampler = {};
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 5), HAL_STATUS_OK);
+    sample(&sampler, 0x11);
+
+    const uint8_t *data;
+    size_t length;
+    uint32_t sequence;
+    ASSERT_EQ(hal_i2c_sampler_read(&sampler, &data, &length, &sequence), HAL_STATUS_OK);
+    ASSERT_EQ(data[0], 0x11);
+
+    // The next sample goes into the other buffer and leaves the one being read alone.
+    sample(&sampler, 0x22);
+    ASSERT_EQ(data[0], 0x11);
+    ASSERT_TRUE(hal_i2c_sampler_read_is_valid(&sampler, sequence));
+
+    // The one after that reuses the buffer, so the old read is no longer valid.
+    tick(5);
+    ASSERT_FALSE(hal_i2c_sampler_read_is_valid(&sampler, sequence));
+
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    run_one_byte_read(0x33);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+
+    ASSERT_EQ(hal_i2c_sampler_read(&sampler, &data, &length, &sequence), HAL_STATUS_OK);
+    ASSERT_EQ(sequence, 3U);
+    ASSERT_EQ(data[0], 0x33);
+}
+
+TEST_F(I2CSamplerTest, SampleStillInFlightCountsAsOverrun)
+{
+    hal_i2c_sampler_t sampler = {};
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 2), HAL_STATUS_OK);
+
+    // The first sample is submitted but the servicer never runs.
+    tick(2);
+    ASSERT_TRUE(sampler.in_flight);
+    ASSERT_EQ(sampler.claimed, 1U);
+
+    tick(4);
+    ASSERT_EQ(sampler.overruns, 2U);
+    ASSERT_EQ(sampler.claimed, 1U);
+}
+
+TEST_F(I2CSamplerTest, FailedSampleIsNotPublished)
+{
+    hal_i2c_sampler_t sampler = {};
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 3), HAL_STATUS_OK);
+    sample(&sampler, 0x44);
+
+    tick(3);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    run_address_nack();
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_FALSE(sampler.in_flight);
+    ASSERT_EQ(sampler.failures, 1U);
+
+    const uint8_t *data;
+    size_t length;
+    uint32_t sequence;
+    ASSERT_EQ(hal_i2c_sampler_read(&sampler, &data, &length, &sequence), HAL_STATUS_OK);
+    ASSERT_EQ(sequence, 1U);
+    ASSERT_EQ(data[0], 0x44);
+    ASSERT_TRUE(hal_i2c_sampler_read_is_valid(&sampler, sequence));
+
+    // The retry lands in the same buffer as the failed attempt.
+    sample(&sampler, 0x55);
+    ASSERT_EQ(hal_i2c_sampler_read(&sampler, &data, &length, &sequence), HAL_STATUS_OK);
+    ASSERT_EQ(sequence, 2U);
+    ASSERT_EQ(data[0], 0x55);
+}
+
+TEST_F(I2CSamplerTest, RejectedSampleCountsAsFailure)
+{
+    hal_i2c_sampler_t sampler = {};
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 2), HAL_STATUS_OK);
+
+    // Register turns such requests away, so spoil the copies behind its back.
+    // The servicer refuses them without putting them on the bus.
+    sampler.buffers[0].speed = _HAL_I2C_SPEED_MAX;
+    sampler.buffers[1].speed = _HAL_I2C_SPEED_MAX;
+
+    tick(2);
+    ASSERT_TRUE(sampler.in_flight);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_ERROR);
+    ASSERT_FALSE(sampler.in_flight);
+    ASSERT_EQ(sampler.failures, 1U);
+
+    // The next period is sampled again instead of counting as an overrun.
+    tick(2);
+    ASSERT_TRUE(sampler.in_flight);
+    ASSERT_EQ(sampler.overruns, 0U);
+}
+
+TEST_F(I2CSamplerTest, ReregisterWaitsForTheSampleInFlight)
+{
+    hal_i2c_sampler_t sampler = {};
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 2), HAL_STATUS_OK);
+    tick(2);
+    ASSERT_TRUE(sampler.in_flight);
+    hal_i2c_sampler_deregister(&sampler);
+
+    // The queued sample is left alone.
+    request.target_addr = 0x50;
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 2), HAL_STATUS_BUSY);
+    ASSERT_EQ(sampler.buffers[1].target_addr, 0x68);
+    ASSERT_EQ(sampler.buffers[1].processing_state, HAL_I2C_TXN_STATE_QUEUED);
+
+    // Once it has completed, the sampler can be registered again.
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    run_one_byte_read(0x11);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_FALSE(sampler.in_flight);
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 2), HAL_STATUS_OK);
+    sample(&sampler, 0x22);
+    ASSERT_EQ(sampler.buffers[1].target_addr, 0x50);
+}
+
+TEST_F(I2CSamplerTest, DeregisteredSamplerStopsSampling)
+{
+    hal_i2c_sampler_t sampler = {};
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 1), HAL_STATUS_OK);
+    hal_i2c_sampler_deregister(&sampler);
+
+    tick(10);
+    ASSERT_FALSE(sampler.in_flight);
+    ASSERT_EQ(hal_i2c_transaction_servicer(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_FALSE(Sim_I2C1.CR1 & I2C_CR1_START);
+
+    // The SysTick timer was released with the last sampler.
+    for (int i = 0; i < HAL_TIMER_MAX_CLIENTS; i++)
+    {
+        ASSERT_NE(hal_systick_timer_register(1, HAL_TIMER_PERIODIC, [](){}), HAL_TIMER_INVALID_HANDLE);
+    }
+}
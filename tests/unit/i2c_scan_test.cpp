@@ -0,0 +1,300 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "hal/i2c_sampler.h"
+#include "hal/i2c_watch.h"
+#include "hal/systick.h"
+#include "registers.h"
+#include "nvic.h"
+#include "i2c_sim.h"
+#include "stm32f4_hal.h"
+
+void I2C1_ER_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void SysTick_Handler(void);
+void _test_fixture_hal_i2c_reset_internals();
+void _test_fixture_hal_i2c_watch_reset_internals();
+void _test_fixture_hal_i2c_sampler_reset_internals();
+void hal_systick_reset_for_test();
+}
+
+#define EEPROM_ADDR 0x50
+#define SENSOR_ADDR 0x68
+#define ABSENT_ADDR 0x20
+
+#define EEPROM_PAGE_SIZE 8
+
+struct change {
+    uint8_t address;
+    bool present;
+    bool in_flight;
+};
+
+static change changes[8];
+static int change_count;
+
+static void record_change(hal_i2c_watch_t *watch, uint8_t address, bool present)
+{
+    if (change_count < 8)
+    {
+        changes[change_count] = { address, present, watch->in_flight };
+    }
+    change_count++;
+}
+
+static void tick(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        SysTick_Handler();
+    }
+}
+
+// Bus scans and presence watches against the bus model.
+class I2CScanTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOB = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        hal_systick_reset_for_test();
+        _test_fixture_hal_i2c_reset_internals();
+        _test_fixture_hal_i2c_watch_reset_internals();
+        _test_fixture_hal_i2c_sampler_reset_internals();
+        change_count = 0;
+        ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+        i2c_sim_init(&sim, &Sim_I2C1, I2C1_EV_IRQHandler, I2C1_ER_IRQHandler, I2C1_EV_IRQn, I2C1_ER_IRQn);
+        i2c_sim_eeprom_init(&eeprom, EEPROM_ADDR, EEPROM_PAGE_SIZE, 0);
+        i2c_sim_register_device_init(&sensor, SENSOR_ADDR);
+        i2c_sim_attach(&sim, &eeprom.base);
+        i2c_sim_attach(&sim, &sensor.base);
+    }
+
+    // Load whatever is queued, let the bus run it to the end and collect the result.
+    void service()
+    {
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        i2c_sim_run(&sim, 10000);
+        hal_i2c_transaction_servicer(HAL_I2C1);
+    }
+
+    i2c_sim_t sim;
+    i2c_sim_eeprom_t eeprom;
+    i2c_sim_register_device_t sensor;
+};
+
+TEST_F(I2CScanTest, ScanMapsEveryDeviceInOneTransaction)
+{
+    hal_i2c_txn_t txn = {};
+
+    ASSERT_EQ(hal_i2c_scan(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+
+    ASSERT_EQ(txn.processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_received, (size_t)HAL_I2C_PRESENCE_MAP_BYTES);
+    ASSERT_EQ(txn.actual_bytes_transmitted, 0u);
+
+    for (uint8_t addr = 0; addr < 0x80; addr++)
+    {
+        bool expected = (addr == EEPROM_ADDR || addr == SENSOR_ADDR);
+        ASSERT_EQ((bool)HAL_I2C_PRESENT(txn.rx_data, addr), expected) << "address " << (int)addr;
+    }
+
+    // One repeated START per probe and a single STOP. Only address bytes went out.
+    const uint32_t probes = HAL_I2C_SCAN_LAST_ADDR - HAL_I2C_SCAN_FIRST_ADDR + 1;
+    ASSERT_EQ(sim.starts, probes);
+    ASSERT_EQ(sim.stops, 1u);
+    ASSERT_EQ(sim.bytes, probes);
+    ASSERT_FALSE(eeprom.pointer_set);
+
+    // Not booked to any target.
+    hal_i2c_target_metrics_t metrics;
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, 0, &metrics), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_get_target_metrics(HAL_I2C1, EEPROM_ADDR, &metrics), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CScanTest, ScanProbesOnlyTheListedAddresses)
+{
+    hal_i2c_txn_t txn = {};
+
+    txn.i2c_op = HAL_I2C_OP_SCAN;
+    txn.tx_data[0] = SENSOR_ADDR;
+    txn.tx_data[1] = ABSENT_ADDR;
+    txn.tx_data[2] = EEPROM_ADDR;
+    txn.expected_bytes_to_tx = 3;
+    // Stale contents are cleared.
+    memset(txn.rx_data, 0xFF, HAL_I2C_PRESENCE_MAP_BYTES);
+
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_TRUE(HAL_I2C_PRESENT(txn.rx_data, SENSOR_ADDR));
+    ASSERT_TRUE(HAL_I2C_PRESENT(txn.rx_data, EEPROM_ADDR));
+    ASSERT_FALSE(HAL_I2C_PRESENT(txn.rx_data, ABSENT_ADDR));
+    ASSERT_FALSE(HAL_I2C_PRESENT(txn.rx_data, 0x7F));
+    ASSERT_EQ(sim.starts, 3u);
+    ASSERT_EQ(sim.stops, 1u);
+
+    // The bus is left ready for ordinary traffic.
+    hal_i2c_txn_t read = {};
+    sensor.registers[0x10] = 0xA5;
+    read.target_addr = SENSOR_ADDR;
+    read.i2c_op = HAL_I2C_OP_WRITE_READ;
+    read.tx_data[0] = 0x10;
+    read.expected_bytes_to_tx = 1;
+    read.expected_bytes_to_rx = 1;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &read), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(read.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(read.rx_data[0], 0xA5);
+}
+
+TEST_F(I2CScanTest, ScanRejectsBadAddressLists)
+{
+    hal_i2c_txn_t txn = {};
+
+    txn.i2c_op = HAL_I2C_OP_SCAN;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    txn.expected_bytes_to_tx = HAL_I2C_PRESENCE_MAP_BYTES * 8 + 1;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    txn.tx_data[0] = 0x80;
+    txn.expected_bytes_to_tx = 1;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    service();
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    ASSERT_EQ(sim.starts, 0u);
+    ASSERT_EQ(hal_i2c_scan(HAL_I2C1, NULL), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CScanTest, WatchReportsDevicesThatComeAndGo)
+{
+    const uint8_t expected[] = { EEPROM_ADDR, SENSOR_ADDR, ABSENT_ADDR };
+    hal_i2c_watch_t watch = {};
+    int marker;
+
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, expected, 3, 10, record_change, &marker), HAL_STATUS_OK);
+    ASSERT_EQ(watch.context, &marker);
+
+    // The first scan finds one expected device missing.
+    tick(9);
+    ASSERT_FALSE(watch.in_flight);
+    tick(1);
+    ASSERT_TRUE(watch.in_flight);
+    service();
+    ASSERT_FALSE(watch.in_flight);
+    ASSERT_EQ(watch.scans, 1u);
+    ASSERT_EQ(change_count, 1);
+    ASSERT_EQ(changes[0].address, ABSENT_ADDR);
+    ASSERT_FALSE(changes[0].present);
+    // No new scan can overwrite the results while they are being reported.
+    ASSERT_TRUE(changes[0].in_flight);
+    ASSERT_TRUE(HAL_I2C_PRESENT(watch.present, SENSOR_ADDR));
+
+    // Nothing changed, nothing reported.
+    tick(10);
+    service();
+    ASSERT_EQ(change_count, 1);
+
+    // The sensor drops off the bus, the missing device turns up.
+    sensor.base.address = 0;
+    i2c_sim_register_device_t late;
+    i2c_sim_register_device_init(&late, ABSENT_ADDR);
+    i2c_sim_attach(&sim, &late.base);
+    tick(10);
+    service();
+    ASSERT_EQ(change_count, 3);
+    ASSERT_EQ(changes[1].address, SENSOR_ADDR);
+    ASSERT_FALSE(changes[1].present);
+    ASSERT_EQ(changes[2].address, ABSENT_ADDR);
+    ASSERT_TRUE(changes[2].present);
+    ASSERT_FALSE(HAL_I2C_PRESENT(watch.present, SENSOR_ADDR));
+    ASSERT_TRUE(HAL_I2C_PRESENT(watch.present, ABSENT_ADDR));
+
+    // Each scan probes only the watched addresses.
+    ASSERT_EQ(sim.starts, 9u);
+    ASSERT_EQ(watch.scans, 3u);
+
+    // A scan left in the queue by a deregister blocks registering again.
+    tick(10);
+    ASSERT_TRUE(watch.in_flight);
+    hal_i2c_watch_deregister(&watch);
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, expected, 1, 10, NULL, NULL), HAL_STATUS_BUSY);
+    ASSERT_EQ(watch.txn.expected_bytes_to_tx, 3u);
+    service();
+    ASSERT_EQ(watch.scans, 4u);
+
+    tick(20);
+    ASSERT_FALSE(watch.in_flight);
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, expected, 1, 10, NULL, NULL), HAL_STATUS_OK);
+    hal_i2c_watch_deregister(&watch);
+}
+
+TEST_F(I2CScanTest, WatchCountsOverrunsAndRejectsBadArguments)
+{
+    const uint8_t expected[] = { EEPROM_ADDR };
+    const uint8_t bad[] = { 0x80 };
+    hal_i2c_watch_t watch = {};
+
+    ASSERT_EQ(hal_i2c_watch_register(NULL, HAL_I2C1, expected, 1, 10, NULL, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, NULL, 1, 10, NULL, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, expected, 0, 10, NULL, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, expected, 1, 0, NULL, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_watch_register(&watch, _HAL_I2C_BUS_MAX, expected, 1, 10, NULL, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, bad, 1, 10, NULL, NULL), HAL_STATUS_ERROR);
+
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, expected, 1, 5, NULL, NULL), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, expected, 1, 5, NULL, NULL), HAL_STATUS_ERROR);
+
+    // The servicer falls behind. The scan due meanwhile is skipped.
+    tick(10);
+    ASSERT_EQ(watch.overruns, 1u);
+    service();
+    ASSERT_EQ(watch.scans, 1u);
+    ASSERT_EQ(watch.failures, 0u);
+}
+
+TEST_F(I2CScanTest, WatchesAndSamplersShareOneSysTickTimer)
+{
+    const uint8_t expected[] = { EEPROM_ADDR };
+    hal_i2c_watch_t watch = {};
+    hal_i2c_sampler_t sampler = {};
+    hal_i2c_txn_t request = {};
+    hal_timer_handle_t others[HAL_TIMER_MAX_CLIENTS - 1];
+
+    request.i2c_op = HAL_I2C_OP_READ;
+    request.target_addr = SENSOR_ADDR;
+    request.expected_bytes_to_rx = 1;
+
+    for (size_t i = 0; i < ARRAY_SIZE(others); i++)
+    {
+        others[i] = hal_systick_timer_register(1, HAL_TIMER_PERIODIC, [](){});
+        ASSERT_NE(others[i], HAL_TIMER_INVALID_HANDLE);
+    }
+
+    // The last free timer is enough for both.
+    ASSERT_EQ(hal_i2c_watch_register(&watch, HAL_I2C1, expected, 1, 5, NULL, NULL), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_sampler_register(&sampler, HAL_I2C1, &request, 5), HAL_STATUS_OK);
+    ASSERT_EQ(hal_systick_timer_register(1, HAL_TIMER_PERIODIC, [](){}), HAL_TIMER_INVALID_HANDLE);
+
+    tick(5);
+    ASSERT_TRUE(watch.in_flight);
+    ASSERT_TRUE(sampler.in_flight);
+
+    // Released with the last client of either kind.
+    hal_i2c_watch_deregister(&watch);
+    ASSERT_EQ(hal_systick_timer_register(1, HAL_TIMER_PERIODIC, [](){}), HAL_TIMER_INVALID_HANDLE);
+    hal_i2c_sampler_deregister(&sampler);
+    ASSERT_NE(hal_systick_timer_register(1, HAL_TIMER_PERIODIC, [](){}), HAL_TIMER_INVALID_HANDLE);
+}
@@ -0,0 +1,385 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "registers.h"
+#include "nvic.h"
+#include "i2c_sim.h"
+#include "stm32f4_hal.h"
+
+void I2C1_ER_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void _test_fixture_hal_i2c_reset_internals();
+
+extern uint32_t tick_ms;
+}
+
+#define GAUGE_ADDR 0x0B
+
+#define CMD_NAME   0x01
+#define CMD_SERIAL 0x02
+
+static int alerts;
+static void *alert_context;
+
+static void on_alert(hal_i2c_bus_t bus, void *context)
+{
+    ASSERT_EQ(bus, HAL_I2C1);
+    alerts++;
+    alert_context = context;
+}
+
+// SMBus host mode against a battery gauge on the bus model.
+class I2CSmbusTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOB = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        _test_fixture_hal_i2c_reset_internals();
+        tick_ms = 0;
+        alerts = 0;
+        alert_context = NULL;
+        ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+
+        i2c_sim_init(&sim, &Sim_I2C1, I2C1_EV_IRQHandler, I2C1_ER_IRQHandler, I2C1_EV_IRQn, I2C1_ER_IRQn);
+        i2c_sim_smbus_device_init(&gauge, GAUGE_ADDR, true);
+        i2c_sim_attach(&sim, &gauge.base);
+
+        const uint8_t name[] = { 'b', 'q', '4', '0', 'z', '5', '0' };
+        memcpy(gauge.blocks[CMD_NAME], name, sizeof(name));
+        gauge.block_lengths[CMD_NAME] = sizeof(name);
+    }
+
+    void enable(bool pec)
+    {
+        hal_i2c_smbus_config_t config = { .pec = pec, .on_alert = NULL, .context = NULL };
+        gauge.pec = pec;
+        ASSERT_EQ(hal_i2c_smbus_enable(HAL_I2C1, &config), HAL_STATUS_OK);
+    }
+
+    static void make_block_read(hal_i2c_txn_t *txn, uint8_t command, size_t max_length)
+    {
+        memset(txn, 0, sizeof(*txn));
+        txn->target_addr = GAUGE_ADDR;
+        txn->i2c_op = HAL_I2C_OP_SMBUS_BLOCK_READ;
+        txn->tx_data[0] = command;
+        txn->expected_bytes_to_tx = 1;
+        txn->expected_bytes_to_rx = max_length;
+    }
+
+    void run(hal_i2c_txn_t *txn)
+    {
+        ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, txn), HAL_STATUS_OK);
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        i2c_sim_run(&sim, 1000);
+        hal_i2c_transaction_servicer(HAL_I2C1);
+        ASSERT_EQ(txn->processing_state, HAL_I2C_TXN_STATE_COMPLETED);
+    }
+
+    i2c_sim_t sim;
+    i2c_sim_smbus_device_t gauge;
+};
+
+TEST_F(I2CSmbusTest, EnableSelectsHostModeAndInitLeavesIt)
+{
+    hal_i2c_smbus_config_t config = { .pec = true, .on_alert = on_alert, .context = NULL };
+
+    ASSERT_EQ(hal_i2c_smbus_enable(HAL_I2C1, &config), HAL_STATUS_OK);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_PE);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_SMBUS);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_SMBTYPE);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_ENPEC);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_ALERT);
+
+    // SMBA on PB5, AF4.
+    ASSERT_EQ((Sim_GPIOB.MODER >> (5 * 2)) & 0x3U, 0x2U);
+    ASSERT_EQ((Sim_GPIOB.AFR[0] >> (5 * 4)) & 0xFU, 0x4U);
+
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_TRUE(Sim_I2C1.CR1 & I2C_CR1_PE);
+    ASSERT_FALSE(Sim_I2C1.CR1 & (I2C_CR1_SMBUS | I2C_CR1_SMBTYPE | I2C_CR1_ENPEC | I2C_CR1_ALERT));
+
+    ASSERT_EQ(hal_i2c_smbus_enable(HAL_I2C1, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_smbus_enable(_HAL_I2C_BUS_MAX, &config), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CSmbusTest, BlockReadTakesItsLengthFromTheTarget)
+{
+    hal_i2c_txn_t txn;
+    enable(false);
+
+    make_block_read(&txn, CMD_NAME, HAL_I2C_SMBUS_BLOCK_MAX);
+    run(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_transmitted, 1u);
+    ASSERT_EQ(txn.actual_bytes_received, 7u);
+    ASSERT_EQ(memcmp(txn.rx_data, "bq40z50", 7), 0);
+    // Command, repeated START, length and block. Nothing read past the end.
+    ASSERT_EQ(sim.bytes, 2u + 1u + 1u + 7u);
+    ASSERT_EQ(sim.stops, 1u);
+}
+
+TEST_F(I2CSmbusTest, BlockReadsOfOneAndTwoBytes)
+{
+    hal_i2c_txn_t txn;
+
+    for (uint8_t length = 1; length <= 2; length++)
+    {
+        for (int pec = 0; pec <= 1; pec++)
+        {
+            SCOPED_TRACE(testing::Message() << "length " << (int)length << " pec " << pec);
+            enable(pec);
+            gauge.blocks[CMD_SERIAL][0] = 0x12;
+            gauge.blocks[CMD_SERIAL][1] = 0x34;
+            gauge.block_lengths[CMD_SERIAL] = length;
+
+            make_block_read(&txn, CMD_SERIAL, 2);
+            run(&txn);
+
+            ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+            ASSERT_EQ(txn.actual_bytes_received, length);
+            ASSERT_EQ(txn.rx_data[0], 0x12);
+            if (length == 2)
+            {
+                ASSERT_EQ(txn.rx_data[1], 0x34);
+            }
+        }
+    }
+}
+
+TEST_F(I2CSmbusTest, BlockWriteSendsTheLengthAndPec)
+{
+    hal_i2c_txn_t txn;
+    enable(true);
+
+    memset(&txn, 0, sizeof(txn));
+    txn.target_addr = GAUGE_ADDR;
+    txn.i2c_op = HAL_I2C_OP_SMBUS_BLOCK_WRITE;
+    txn.tx_data[0] = CMD_SERIAL;
+    txn.tx_data[1] = 0xDE;
+    txn.tx_data[2] = 0xAD;
+    txn.tx_data[3] = 0xBE;
+    txn.expected_bytes_to_tx = 4;
+    run(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    // Command, length and block. The PEC is not counted.
+    ASSERT_EQ(txn.actual_bytes_transmitted, 5u);
+    ASSERT_EQ(gauge.pecs_checked, 1u);
+    ASSERT_EQ(gauge.pec_errors, 0u);
+    ASSERT_EQ(gauge.block_lengths[CMD_SERIAL], 3);
+    ASSERT_EQ(gauge.blocks[CMD_SERIAL][0], 0xDE);
+    ASSERT_EQ(gauge.blocks[CMD_SERIAL][2], 0xBE);
+
+    // Read it back, PEC checked.
+    make_block_read(&txn, CMD_SERIAL, 3);
+    run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_received, 3u);
+    ASSERT_EQ(txn.rx_data[1], 0xAD);
+}
+
+TEST_F(I2CSmbusTest, WrongPecFailsTheReadAndTheBusCarriesOn)
+{
+    hal_i2c_txn_t txn;
+    enable(true);
+
+    gauge.corrupt_pec = true;
+    make_block_read(&txn, CMD_NAME, 16);
+    run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_PEC);
+    ASSERT_FALSE(Sim_I2C1.SR1 & I2C_SR1_PECERR);
+
+    gauge.corrupt_pec = false;
+    make_block_read(&txn, CMD_NAME, 16);
+    run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_received, 7u);
+}
+
+TEST_F(I2CSmbusTest, PecIsCheckedOnPlainReadsToo)
+{
+    hal_i2c_txn_t txn;
+    enable(true);
+    gauge.blocks[CMD_SERIAL][0] = 0x55;
+    gauge.blocks[CMD_SERIAL][1] = 0xAA;
+    gauge.block_lengths[CMD_SERIAL] = 2;
+
+    // A Read Word style WRITE_READ: length byte and two data bytes, then the PEC.
+    memset(&txn, 0, sizeof(txn));
+    txn.target_addr = GAUGE_ADDR;
+    txn.i2c_op = HAL_I2C_OP_WRITE_READ;
+    txn.tx_data[0] = CMD_SERIAL;
+    txn.expected_bytes_to_tx = 1;
+    txn.expected_bytes_to_rx = 3;
+    run(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_received, 3u);
+    ASSERT_EQ(txn.rx_data[0], 2);
+    ASSERT_EQ(txn.rx_data[1], 0x55);
+    ASSERT_EQ(txn.rx_data[2], 0xAA);
+
+    gauge.corrupt_pec = true;
+    run(&txn);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_PEC);
+}
+
+TEST_F(I2CSmbusTest, BadBlockLengthsFailTheRead)
+{
+    hal_i2c_txn_t txn;
+    enable(false);
+
+    // Larger than the client accepts.
+    make_block_read(&txn, CMD_NAME, 4);
+    run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_BLOCK_LENGTH);
+    ASSERT_EQ(txn.actual_bytes_received, 0u);
+
+    // Empty.
+    make_block_read(&txn, CMD_SERIAL, 4);
+    run(&txn);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_BLOCK_LENGTH);
+
+    // The bus is still usable.
+    make_block_read(&txn, CMD_NAME, 7);
+    run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+}
+
+TEST_F(I2CSmbusTest, LateHandlerNeverReadsPastTheBlock)
+{
+    hal_i2c_txn_t txn;
+    enable(true);
+
+    // Held off for a byte in the middle of a long block. The last three bytes are taken at BTF,
+    // so the end is NACKed on time regardless.
+    make_block_read(&txn, CMD_NAME, 16);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+    while (sim.bytes < 2u + 1u + 4u)
+    {
+        ASSERT_TRUE(i2c_sim_step(&sim));
+    }
+    NVIC_DisableIRQ(I2C1_EV_IRQn);
+    i2c_sim_step(&sim);
+    i2c_sim_step(&sim);
+    NVIC_EnableIRQ(I2C1_EV_IRQn);
+    i2c_sim_run(&sim, 1000);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_received, 7u);
+    ASSERT_EQ(memcmp(txn.rx_data, "bq40z50", 7), 0);
+    // Command, repeated START, length, block and PEC.
+    ASSERT_EQ(sim.bytes, 2u + 1u + 1u + 7u + 1u);
+
+    // Held off while the length of a one byte block is in DR. The byte behind it is acknowledged
+    // before the driver knows it is the last, so the read fails instead of running on.
+    enable(false);
+    gauge.blocks[CMD_SERIAL][0] = 0x12;
+    gauge.block_lengths[CMD_SERIAL] = 1;
+    make_block_read(&txn, CMD_SERIAL, 2);
+    sim.bytes = 0;
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+    while (sim.bytes < 2u + 1u + 1u)
+    {
+        ASSERT_TRUE(i2c_sim_step(&sim));
+    }
+    NVIC_DisableIRQ(I2C1_EV_IRQn);
+    i2c_sim_step(&sim);
+    NVIC_EnableIRQ(I2C1_EV_IRQn);
+    i2c_sim_run(&sim, 1000);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_FAIL);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_BUS);
+
+    // The bus is recovered and carries on.
+    make_block_read(&txn, CMD_SERIAL, 2);
+    run(&txn);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_received, 1u);
+    ASSERT_EQ(txn.rx_data[0], 0x12);
+}
+
+TEST_F(I2CSmbusTest, BlockReadSegmentsRunInsideSequences)
+{
+    hal_i2c_txn_t txn;
+    uint8_t command = CMD_NAME;
+    uint8_t block[16] = {0};
+    hal_i2c_segment_t segments[2] = {
+        { .target_addr = GAUGE_ADDR, .direction = HAL_I2C_SEGMENT_WRITE, .data = &command, .length = 1, .actual_length = 0 },
+        { .target_addr = GAUGE_ADDR, .direction = HAL_I2C_SEGMENT_BLOCK_READ, .data = block, .length = sizeof(block), .actual_length = 0 },
+    };
+    enable(true);
+
+    memset(&txn, 0, sizeof(txn));
+    txn.i2c_op = HAL_I2C_OP_SEQUENCE;
+    txn.segments = segments;
+    txn.segment_count = 2;
+    run(&txn);
+
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(segments[1].actual_length, 7u);
+    ASSERT_EQ(memcmp(block, "bq40z50", 7), 0);
+}
+
+TEST_F(I2CSmbusTest, InvalidBlockTransactionsAreRejected)
+{
+    hal_i2c_txn_t txn;
+    enable(false);
+
+    // A block write needs a command and at least one byte.
+    memset(&txn, 0, sizeof(txn));
+    txn.target_addr = GAUGE_ADDR;
+    txn.i2c_op = HAL_I2C_OP_SMBUS_BLOCK_WRITE;
+    txn.expected_bytes_to_tx = 1;
+    run(&txn);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    txn.expected_bytes_to_tx = HAL_I2C_SMBUS_BLOCK_MAX + 2;
+    run(&txn);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    make_block_read(&txn, CMD_NAME, 0);
+    run(&txn);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    make_block_read(&txn, CMD_NAME, 8);
+    txn.expected_bytes_to_tx = 2;
+    run(&txn);
+    ASSERT_EQ(txn.error, HAL_I2C_ERROR_INVALID);
+
+    ASSERT_EQ(sim.bytes, 0u);
+}
+
+TEST_F(I2CSmbusTest, AlertCallsBackWithoutDisturbingTheBus)
+{
+    int context;
+    hal_i2c_txn_t txn;
+    hal_i2c_smbus_config_t config = { .pec = false, .on_alert = on_alert, .context = &context };
+    ASSERT_EQ(hal_i2c_smbus_enable(HAL_I2C1, &config), HAL_STATUS_OK);
+
+    make_block_read(&txn, CMD_NAME, 16);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+    i2c_sim_run(&sim, 5);
+
+    // SMBALERT# pulled low in the middle of the transaction.
+    Sim_I2C1.SR1 |= I2C_SR1_SMBALERT;
+    i2c_sim_run(&sim, 1000);
+    hal_i2c_transaction_servicer(HAL_I2C1);
+
+    ASSERT_EQ(alerts, 1);
+    ASSERT_EQ(alert_context, &context);
+    ASSERT_FALSE(Sim_I2C1.SR1 & I2C_SR1_SMBALERT);
+    ASSERT_EQ(txn.transaction_result, HAL_I2C_TXN_RESULT_SUCCESS);
+    ASSERT_EQ(txn.actual_bytes_received, 7u);
+}
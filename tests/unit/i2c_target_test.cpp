@@ -0,0 +1,298 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/i2c.h"
+#include "hal/i2c_target.h"
+#include "registers.h"
+#include "stm32f4_hal.h"
+
+void I2C1_ER_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void _test_fixture_hal_i2c_reset_internals();
+}
+
+#define OAR1_KEEP_SET (1U << 14)
+
+struct write_record {
+    int calls;
+    uint8_t first_register;
+    size_t length;
+};
+
+static void record_write(uint8_t first_register, size_t length, void *context)
+{
+    write_record *record = (write_record *)context;
+    record->calls++;
+    record->first_register = first_register;
+    record->length = length;
+}
+
+// The controller addresses us. TRA tells whether it is reading.
+static void address_matched(bool controller_reads)
+{
+    Sim_I2C1.SR2 = controller_reads ? I2C_SR2_TRA : 0;
+    Sim_I2C1.SR1 |= I2C_SR1_ADDR;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_ADDR;
+}
+
+static void controller_writes(uint8_t byte)
+{
+    Sim_I2C1.DR = byte;
+    Sim_I2C1.SR1 |= I2C_SR1_RXNE;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_RXNE;
+}
+
+// Ask the ISR for the next byte of a read and return what it loaded.
+static uint8_t controller_reads()
+{
+    Sim_I2C1.DR = 0;
+    Sim_I2C1.SR1 |= I2C_SR1_TXE;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_TXE;
+    return (uint8_t)Sim_I2C1.DR;
+}
+
+// The controller NACKs the byte it just received, ending the read.
+static void controller_nacks()
+{
+    Sim_I2C1.SR1 |= I2C_SR1_AF;
+    I2C1_ER_IRQHandler();
+}
+
+static void controller_stops()
+{
+    Sim_I2C1.SR1 |= I2C_SR1_STOPF;
+    I2C1_EV_IRQHandler();
+    Sim_I2C1.SR1 &= ~I2C_SR1_STOPF;
+}
+
+class I2CTargetTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_GPIOA = {0};
+        Sim_GPIOB = {0};
+        Sim_GPIOC = {0};
+        Sim_RCC = {0};
+        Sim_I2C1 = {0};
+
+        _test_fixture_hal_i2c_reset_internals();
+
+        for (size_t i = 0; i < sizeof(registers); i++)
+        {
+            registers[i] = (uint8_t)(0x10 + i);
+        }
+
+        record = {};
+        config = {};
+        config.own_address = 0x42;
+        config.registers = registers;
+        config.register_count = sizeof(registers);
+        config.on_write = record_write;
+        config.context = &record;
+    }
+
+    uint8_t registers[8];
+    write_record record;
+    hal_i2c_target_config_t config;
+};
+
+TEST_F(I2CTargetTest, InitRejectsBadConfig)
+{
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, NULL), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_target_init(_HAL_I2C_BUS_MAX, &config), HAL_STATUS_ERROR);
+
+    hal_i2c_target_config_t bad = config;
+    bad.registers = NULL;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &bad), HAL_STATUS_ERROR);
+
+    bad = config;
+    bad.register_count = 0;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &bad), HAL_STATUS_ERROR);
+
+    bad = config;
+    bad.register_count = HAL_I2C_TARGET_MAX_REGISTERS + 1;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &bad), HAL_STATUS_ERROR);
+
+    bad = config;
+    bad.own_address = 0x80;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &bad), HAL_STATUS_ERROR);
+
+    bad = config;
+    bad.second_address = 0x80;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &bad), HAL_STATUS_ERROR);
+
+    ASSERT_EQ(hal_i2c_target_publish(HAL_I2C1), HAL_STATUS_ERROR);
+}
+
+TEST_F(I2CTargetTest, InitConfiguresOwnAddresses)
+{
+    config.second_address = 0x43;
+    config.general_call = true;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &config), HAL_STATUS_OK);
+
+    ASSERT_EQ(Sim_I2C1.OAR1, OAR1_KEEP_SET | (0x42U << 1));
+    ASSERT_EQ(Sim_I2C1.OAR2, I2C_OAR2_ENDUAL | (0x43U << 1));
+    ASSERT_EQ(Sim_I2C1.CR1 & I2C_CR1_ENGC, I2C_CR1_ENGC);
+    ASSERT_EQ(Sim_I2C1.CR1 & I2C_CR1_ACK, I2C_CR1_ACK);
+    ASSERT_EQ(Sim_I2C1.CR1 & I2C_CR1_NOSTRETCH, 0U);
+    ASSERT_EQ(Sim_I2C1.CR1 & I2C_CR1_PE, I2C_CR1_PE);
+    ASSERT_EQ(Sim_I2C1.CR2 & (I2C_CR2_ITEVTEN | I2C_CR2_ITERREN), I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+}
+
+TEST_F(I2CTargetTest, ControllerModeIsRestoredByInit)
+{
+    hal_i2c_txn_t txn = {};
+    txn.target_addr = 0x20;
+    txn.i2c_op = HAL_I2C_OP_WRITE;
+    txn.expected_bytes_to_tx = 1;
+    txn.priority = HAL_I2C_PRIORITY_LOW;
+
+    config.general_call = true;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &config), HAL_STATUS_OK);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_ERROR);
+
+    ASSERT_EQ(hal_i2c_init(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(Sim_I2C1.OAR1, OAR1_KEEP_SET);
+    ASSERT_EQ(Sim_I2C1.CR1 & I2C_CR1_ENGC, 0U);
+    ASSERT_EQ(hal_i2c_target_publish(HAL_I2C1), HAL_STATUS_ERROR);
+    ASSERT_EQ(hal_i2c_submit_transaction(HAL_I2C1, &txn), HAL_STATUS_OK);
+}
+
+TEST_F(I2CTargetTest, WriteLandsInRegisterMap)
+{
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &config), HAL_STATUS_OK);
+
+    address_matched(false);
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN, I2C_CR2_ITBUFEN);
+
+    controller_writes(0x02);
+    controller_writes(0xAA);
+    controller_writes(0xBB);
+    ASSERT_EQ(registers[2], 0xAA);
+    ASSERT_EQ(registers[3], 0xBB);
+    ASSERT_EQ(record.calls, 0);
+
+    controller_stops();
+    ASSERT_EQ(record.calls, 1);
+    ASSERT_EQ(record.first_register, 2);
+    ASSERT_EQ(record.length, 2U);
+    ASSERT_EQ(registers[1], 0x11);
+    ASSERT_EQ(registers[4], 0x14);
+}
+
+TEST_F(I2CTargetTest, WritesToReadOnlyAndMissingRegistersAreDropped)
+{
+    // Registers 0 and 1 are read-only.
+    const uint8_t writable[] = {0xFC};
+    config.writable = writable;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &config), HAL_STATUS_OK);
+
+    address_matched(false);
+    controller_writes(0x00);
+    controller_writes(0xA0);
+    controller_writes(0xA1);
+    controller_writes(0xA2);
+    controller_stops();
+
+    ASSERT_EQ(registers[0], 0x10);
+    ASSERT_EQ(registers[1], 0x11);
+    ASSERT_EQ(registers[2], 0xA2);
+
+    // Past the end of the map.
+    address_matched(false);
+    controller_writes(0x07);
+    controller_writes(0xB7);
+    controller_writes(0xB8);
+    controller_stops();
+
+    ASSERT_EQ(registers[7], 0xB7);
+    ASSERT_EQ(record.first_register, 7);
+    ASSERT_EQ(record.length, 1U);
+}
+
+TEST_F(I2CTargetTest, ReadIsServedStraightFromRegisterMap)
+{
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &config), HAL_STATUS_OK);
+
+    // Write the register pointer, then read with a repeated START.
+    address_matched(false);
+    controller_writes(0x05);
+    address_matched(true);
+    ASSERT_EQ(record.calls, 0);
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN, I2C_CR2_ITBUFEN);
+
+    ASSERT_EQ(controller_reads(), 0x15);
+
+    // Not a copy. A value stored by the application shows up in the next byte.
+    registers[6] = 0x66;
+    ASSERT_EQ(controller_reads(), 0x66);
+    ASSERT_EQ(controller_reads(), 0x17);
+    ASSERT_EQ(controller_reads(), HAL_I2C_TARGET_FILL_BYTE);
+
+    controller_nacks();
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN, 0U);
+}
+
+TEST_F(I2CTargetTest, NextReadStartsAfterLastAcknowledgedByte)
+{
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &config), HAL_STATUS_OK);
+
+    address_matched(false);
+    controller_writes(0x01);
+    controller_stops();
+
+    // The controller takes two bytes. The third was loaded but never clocked out.
+    address_matched(true);
+    ASSERT_EQ(controller_reads(), 0x11);
+    ASSERT_EQ(controller_reads(), 0x12);
+    ASSERT_EQ(controller_reads(), 0x13);
+    controller_nacks();
+
+    address_matched(true);
+    ASSERT_EQ(controller_reads(), 0x13);
+}
+
+TEST_F(I2CTargetTest, ReadStretchesUntilPublished)
+{
+    config.stretch_until_published = true;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &config), HAL_STATUS_OK);
+
+    // Nothing published yet. DR stays empty and TXE stays masked, which holds SCL.
+    address_matched(true);
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN, 0U);
+    ASSERT_EQ(controller_reads(), 0x00);
+
+    // Publishing releases the read.
+    registers[0] = 0x99;
+    ASSERT_EQ(hal_i2c_target_publish(HAL_I2C1), HAL_STATUS_OK);
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN, I2C_CR2_ITBUFEN);
+    ASSERT_EQ(controller_reads(), 0x99);
+    ASSERT_EQ(controller_reads(), 0x11);
+    controller_nacks();
+
+    // Fresh data is served without stretching.
+    ASSERT_EQ(hal_i2c_target_publish(HAL_I2C1), HAL_STATUS_OK);
+    address_matched(true);
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN, I2C_CR2_ITBUFEN);
+    ASSERT_EQ(controller_reads(), 0x11);
+    controller_nacks();
+
+    // The same data is not served twice.
+    address_matched(true);
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN, 0U);
+}
+
+TEST_F(I2CTargetTest, WritesAreNeverStretched)
+{
+    config.stretch_until_published = true;
+    ASSERT_EQ(hal_i2c_target_init(HAL_I2C1, &config), HAL_STATUS_OK);
+
+    address_matched(false);
+    ASSERT_EQ(Sim_I2C1.CR2 & I2C_CR2_ITBUFEN, I2C_CR2_ITBUFEN);
+    controller_writes(0x03);
+    controller_writes(0x33);
+    controller_stops();
+    ASSERT_EQ(registers[3], 0x33);
+}
@@ -1,28 +1,34 @@
 #include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
+#include <vector>
 
 extern "C" {
     #include "i2c_transaction_queue.h"
+    #include "stm32f4_hal.h"
 }
 
 class I2CTransactionQueueTest : public ::testing::Test {
     protected:
         void SetUp() override {
-            i2c_transaction_queue_reset();
+            i2c_transaction_queue_reset(&queue);
         }
 
         void TearDown() override {
 
         }
+
+        i2c_transaction_queue_t queue;
 };
 
 TEST_F(I2CTransactionQueueTest, QueueAddRejectsNull)
 {
-    ASSERT_EQ(i2c_transaction_queue_add(nullptr), I2C_QUEUE_STATUS_FAIL);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, nullptr), I2C_QUEUE_STATUS_FAIL);
 }
 
 TEST_F(I2CTransactionQueueTest, QueueNextRejectsNull)
 {
-    ASSERT_EQ(i2c_transaction_queue_get_next(nullptr), I2C_QUEUE_STATUS_FAIL);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, nullptr), I2C_QUEUE_STATUS_FAIL);
 }
 
 TEST_F(I2CTransactionQueueTest, BasicPushPop)
@@ -36,10 +42,10 @@ TEST_F(I2CTransactionQueueTest, BasicPushPop)
     hal_i2c_txn_t *txn_out = nullptr;
 
     // Assert we can add the transaction to the queue.
-    ASSERT_EQ(i2c_transaction_queue_add(&txn_in), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &txn_in), I2C_QUEUE_STATUS_SUCCESS);
 
     // Assert we can grab it from the queue.
-    ASSERT_EQ(i2c_transaction_queue_get_next(&txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
 
     // Assert our handle is no longer NULL.
     ASSERT_NE(txn_out, nullptr);
@@ -51,19 +57,27 @@ TEST_F(I2CTransactionQueueTest, BasicPushPop)
     ASSERT_EQ(txn_out, &txn_in);
 }
 
-TEST_F(I2CTransactionQueueTest, ReturnsQueueFullStatus)
+TEST_F(I2CTransactionQueueTest, CapacityIsLimitedOnlyByClients)
 {
-    // Define one more transaction than can fit in the queue.
-    hal_i2c_txn_t transactions[I2C_TRANSACTION_QUEUE_SIZE + 1];
+    // Far more transactions than any fixed size table would hold.
+    const size_t NUM_OF_TRANSACTIONS = 500;
+    static hal_i2c_txn_t transactions[NUM_OF_TRANSACTIONS]; // Static because this data structure can be too large for the stack.
+    hal_i2c_txn_t *txn_out = nullptr;
+
+    // Assert every transaction can be queued.
+    for (size_t i = 0; i < NUM_OF_TRANSACTIONS; i++)
+    {
+        ASSERT_EQ(i2c_transaction_queue_add(&queue, &transactions[i]), I2C_QUEUE_STATUS_SUCCESS);
+    }
 
-    // Fill the queue.
-    for (int i = 0; i < I2C_TRANSACTION_QUEUE_SIZE; i++)
+    // Assert they all come back out in order.
+    for (size_t i = 0; i < NUM_OF_TRANSACTIONS; i++)
     {
-        ASSERT_EQ(i2c_transaction_queue_add(&transactions[i]), I2C_QUEUE_STATUS_SUCCESS);
+        ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+        ASSERT_EQ(txn_out, &transactions[i]);
     }
 
-    // Expect the next transaction to return QUEUE FULL
-    ASSERT_EQ(i2c_transaction_queue_add(&transactions[I2C_TRANSACTION_QUEUE_SIZE]), I2C_QUEUE_STATUS_QUEUE_FULL);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
 }
 
 TEST_F(I2CTransactionQueueTest, ReturnsQueueEmptyStatus)
@@ -71,25 +85,25 @@ TEST_F(I2CTransactionQueueTest, ReturnsQueueEmptyStatus)
     hal_i2c_txn_t *txn_out = nullptr;
 
     // Assert the queue is empty.
-    ASSERT_EQ(i2c_transaction_queue_get_next(&txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
 }
 
 TEST_F(I2CTransactionQueueTest, QueueCanBeReset)
 {
     hal_i2c_txn_t *txn_out = nullptr;
-    hal_i2c_txn_t transactions[I2C_TRANSACTION_QUEUE_SIZE];
+    hal_i2c_txn_t transactions[3];
 
     // Add a couple transactions.
-    for (int i = 0; i < 3 && i < I2C_TRANSACTION_QUEUE_SIZE; i++)
+    for (int i = 0; i < 3; i++)
     {
-        ASSERT_EQ(i2c_transaction_queue_add(&transactions[i]), I2C_QUEUE_STATUS_SUCCESS);
+        ASSERT_EQ(i2c_transaction_queue_add(&queue, &transactions[i]), I2C_QUEUE_STATUS_SUCCESS);
     }
 
     // Reset the queue.
-    i2c_transaction_queue_reset();
+    i2c_transaction_queue_reset(&queue);
 
     // Assert the queue is empty.
-    ASSERT_EQ(i2c_transaction_queue_get_next(&txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
 
     // Assert txn_out is still null.
     ASSERT_EQ(txn_out, nullptr);
@@ -101,35 +115,35 @@ TEST_F(I2CTransactionQueueTest, QueueAddMarksTransactionAsQueued)
     hal_i2c_txn_t txn_in = {
         .processing_state = HAL_I2C_TXN_STATE_CREATED, // init the processing state to CREATED.
     };
-    ASSERT_EQ(i2c_transaction_queue_add(&txn_in), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &txn_in), I2C_QUEUE_STATUS_SUCCESS);
 
     // Assert the processing state is now QUEUED.
     ASSERT_EQ(txn_in.processing_state, HAL_I2C_TXN_STATE_QUEUED);
 }
 
-TEST_F(I2CTransactionQueueTest, QueueHandlesRollover)
+TEST_F(I2CTransactionQueueTest, QueueHandlesInterleavedAddAndRemove)
 {
-    const size_t ROLLOVER_INCREMENT = (I2C_TRANSACTION_QUEUE_SIZE / 2) + 1;
+    const size_t ROLLOVER_INCREMENT = 6;
     const size_t NUM_OF_TRANSACTIONS = 100 * ROLLOVER_INCREMENT; // Divisible by ROLLOVER_INCREMENT.
     size_t transaction_in_index = 0;
     size_t transaction_out_index = 0;
     static hal_i2c_txn_t transactions_in[NUM_OF_TRANSACTIONS]; // Static because this data structure can be too large for the stack.
     hal_i2c_txn_t *transaction_out = nullptr;
 
-    // Conduct the rollover test.
+    // Repeatedly drain the queue to empty and refill it.
     for (size_t i = 0; i < NUM_OF_TRANSACTIONS / ROLLOVER_INCREMENT; i++)
     {
         // Queue ROLLOVER_INCREMENT number of transactions.
         for (size_t j = 0; j < ROLLOVER_INCREMENT; j++)
         {
-            ASSERT_EQ(i2c_transaction_queue_add(&transactions_in[transaction_in_index++]), I2C_QUEUE_STATUS_SUCCESS);
+            ASSERT_EQ(i2c_transaction_queue_add(&queue, &transactions_in[transaction_in_index++]), I2C_QUEUE_STATUS_SUCCESS);
         }
 
         // Dequeue ROLLOVER_INCREMENT number of transactions.
         for (size_t j = 0; j < ROLLOVER_INCREMENT; j++)
         {
             // Make sure we can dequeue.
-            ASSERT_EQ(i2c_transaction_queue_get_next(&transaction_out), I2C_QUEUE_STATUS_SUCCESS);
+            ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &transaction_out), I2C_QUEUE_STATUS_SUCCESS);
 
             // Assert that what we got out is what we put in and in the correct order.
             ASSERT_EQ(&transactions_in[transaction_out_index++], transaction_out);
@@ -164,8 +178,8 @@ TEST_F(I2CTransactionQueueTest, NoFieldsAreUnexpectedlyModifiedByQueue)
     };
 
     // Send the transaction through the queue.
-    ASSERT_EQ(i2c_transaction_queue_add(&my_transaction), I2C_QUEUE_STATUS_SUCCESS);
-    ASSERT_EQ(i2c_transaction_queue_get_next(&my_transaction_ptr), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &my_transaction), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &my_transaction_ptr), I2C_QUEUE_STATUS_SUCCESS);
     ASSERT_EQ(&my_transaction, my_transaction_ptr);
 
     // Verify nothing was unexpectedly modified.
@@ -180,3 +194,202 @@ TEST_F(I2CTransactionQueueTest, NoFieldsAreUnexpectedlyModifiedByQueue)
     ASSERT_EQ(my_transaction.actual_bytes_transmitted, 0);
     ASSERT_EQ(my_transaction.rx_data[0], 0);
 }
+
+TEST_F(I2CTransactionQueueTest, HigherPriorityIsDequeuedFirst)
+{
+    hal_i2c_txn_t low = {};
+    hal_i2c_txn_t medium = {};
+    hal_i2c_txn_t high = {};
+    hal_i2c_txn_t *txn_out = nullptr;
+
+    low.priority = HAL_I2C_PRIORITY_LOW;
+    medium.priority = HAL_I2C_PRIORITY_MEDIUM;
+    high.priority = HAL_I2C_PRIORITY_HIGH;
+
+    // Queue in the worst order.
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &low), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &medium), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &high), I2C_QUEUE_STATUS_SUCCESS);
+
+    // Assert they come out highest priority first.
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &high);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &medium);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &low);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
+}
+
+TEST_F(I2CTransactionQueueTest, HighPriorityPreemptsQueuedBackgroundWork)
+{
+    hal_i2c_txn_t bulk[3] = {};
+    hal_i2c_txn_t urgent = {};
+    hal_i2c_txn_t *txn_out = nullptr;
+
+    urgent.priority = HAL_I2C_PRIORITY_HIGH;
+
+    // A multi-part background job is queued.
+    for (size_t i = 0; i < ARRAY_SIZE(bulk); i++)
+    {
+        ASSERT_EQ(i2c_transaction_queue_add(&queue, &bulk[i]), I2C_QUEUE_STATUS_SUCCESS);
+    }
+
+    // The first part is taken for processing.
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &bulk[0]);
+
+    // Urgent work arrives while the job is underway.
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &urgent), I2C_QUEUE_STATUS_SUCCESS);
+
+    // Assert the urgent work is next, then the job resumes in order.
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &urgent);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &bulk[1]);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &bulk[2]);
+}
+
+TEST_F(I2CTransactionQueueTest, OutOfRangePriorityIsQueuedAsLow)
+{
+    hal_i2c_txn_t invalid = {};
+    hal_i2c_txn_t low = {};
+    hal_i2c_txn_t *txn_out = nullptr;
+
+    invalid.priority = _HAL_I2C_PRIORITY_MAX;
+
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &invalid), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &low), I2C_QUEUE_STATUS_SUCCESS);
+
+    // Assert FIFO order within the low priority.
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &invalid);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &low);
+}
+
+TEST_F(I2CTransactionQueueTest, QueueLinksAreClearedOnDequeue)
+{
+    hal_i2c_txn_t first = {};
+    hal_i2c_txn_t second = {};
+    hal_i2c_txn_t *txn_out = nullptr;
+
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &first), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &second), I2C_QUEUE_STATUS_SUCCESS);
+    // Until the consumer takes them, added transactions are linked newest first.
+    ASSERT_EQ(second.next, &first);
+
+    // Assert a dequeued transaction no longer references the queue.
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &first);
+    ASSERT_EQ(first.next, nullptr);
+
+    // Assert a dequeued transaction can be queued again behind the rest.
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &first), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &second);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &first);
+}
+
+TEST_F(I2CTransactionQueueTest, QueuesAreIndependent)
+{
+    i2c_transaction_queue_t other;
+    i2c_transaction_queue_reset(&other);
+
+    hal_i2c_txn_t txn = {};
+    hal_i2c_txn_t *txn_out = nullptr;
+
+    ASSERT_EQ(i2c_transaction_queue_add(&other, &txn), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&other, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &txn);
+}
+
+TEST_F(I2CTransactionQueueTest, QueueOperationsRejectNullQueue)
+{
+    hal_i2c_txn_t txn = {};
+    hal_i2c_txn_t *txn_out = nullptr;
+
+    ASSERT_EQ(i2c_transaction_queue_add(nullptr, &txn), I2C_QUEUE_STATUS_FAIL);
+    ASSERT_EQ(i2c_transaction_queue_get_next(nullptr, &txn_out), I2C_QUEUE_STATUS_FAIL);
+}
+
+TEST_F(I2CTransactionQueueTest, OrderIsKeptAcrossAddsMadeBetweenTakes)
+{
+    hal_i2c_txn_t a = {}, b = {}, c = {};
+    hal_i2c_txn_t *txn_out = nullptr;
+
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &a), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &b), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &a);
+
+    // c lands in the inbox while b already sits in the FIFO.
+    ASSERT_EQ(i2c_transaction_queue_add(&queue, &c), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &b);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_SUCCESS);
+    ASSERT_EQ(txn_out, &c);
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
+}
+
+TEST_F(I2CTransactionQueueTest, ConcurrentProducersLoseNothing)
+{
+    // Threads stand in for interrupt handlers preempting each other and the servicer.
+    const size_t PRODUCERS = 4;
+    const size_t PER_PRODUCER = 2000;
+
+    std::vector<hal_i2c_txn_t> txns(PRODUCERS * PER_PRODUCER);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> producers;
+
+    for (size_t p = 0; p < PRODUCERS; p++)
+    {
+        producers.emplace_back([&, p]() {
+            while (!go.load()) {}
+            for (size_t i = 0; i < PER_PRODUCER; i++)
+            {
+                hal_i2c_txn_t *txn = &txns[p * PER_PRODUCER + i];
+                txn->target_addr = (uint8_t)p;
+                txn->priority = (hal_i2c_priority_t)(i % _HAL_I2C_PRIORITY_MAX);
+                txn->expected_bytes_to_tx = i;
+                ASSERT_EQ(i2c_transaction_queue_add(&queue, txn), I2C_QUEUE_STATUS_SUCCESS);
+            }
+        });
+    }
+
+    std::vector<size_t> next_expected(PRODUCERS * _HAL_I2C_PRIORITY_MAX, 0);
+    std::vector<bool> seen(txns.size(), false);
+    size_t taken = 0;
+
+    go.store(true);
+    while (taken < txns.size())
+    {
+        hal_i2c_txn_t *txn_out = nullptr;
+        if (i2c_transaction_queue_get_next(&queue, &txn_out) != I2C_QUEUE_STATUS_SUCCESS)
+        {
+            continue;
+        }
+
+        size_t index = (size_t)(txn_out - txns.data());
+        ASSERT_LT(index, txns.size());
+        ASSERT_FALSE(seen[index]);
+        seen[index] = true;
+        taken++;
+
+        // Each producer's transactions of one priority come out in the order it added them.
+        size_t stream = txn_out->target_addr * _HAL_I2C_PRIORITY_MAX + txn_out->priority;
+        ASSERT_GE(txn_out->expected_bytes_to_tx, next_expected[stream]);
+        next_expected[stream] = txn_out->expected_bytes_to_tx + 1;
+    }
+
+    for (auto &producer : producers)
+    {
+        producer.join();
+    }
+
+    hal_i2c_txn_t *txn_out = nullptr;
+    ASSERT_EQ(i2c_transaction_queue_get_next(&queue, &txn_out), I2C_QUEUE_STATUS_QUEUE_EMPTY);
+}
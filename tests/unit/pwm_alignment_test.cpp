@@ -0,0 +1,144 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/pwm.h"
+#include "registers.h"
+#include "nvic.h"
+#include "stm32f4_hal.h"
+
+void _test_fixture_hal_pwm_reset_internals();
+}
+
+// Center-aligned counting and the TRGO trigger output of TIM1.
+class PWMAlignmentTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_RCC = { 0 };
+        Sim_GPIOA = { 0 };
+        Sim_TIM1 = { 0 };
+
+        _test_fixture_hal_pwm_reset_internals();
+
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+        for (int ch = HAL_PWM_CH1; ch < _HAL_PWM_CH_MAX; ch++)
+        {
+            ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init((hal_pwm_channel_t)ch));
+        }
+    }
+
+    static uint32_t cms()
+    {
+        return (Sim_TIM1.CR1 & TIM_CR1_CMS) >> TIM_CR1_CMS_Pos;
+    }
+
+    static uint32_t mms()
+    {
+        return (Sim_TIM1.CR2 & TIM_CR2_MMS) >> TIM_CR2_MMS_Pos;
+    }
+};
+
+TEST_F(PWMAlignmentTest, CenterAlignmentKeepsTheFrequency)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_UP));
+
+    // Up 400 counts and back down is still 800 counts, 20 kHz at 16 MHz.
+    ASSERT_EQ(cms(), 0b10u);
+    ASSERT_EQ(Sim_TIM1.PSC, 0u);
+    ASSERT_EQ(Sim_TIM1.ARR, 400u);
+    ASSERT_EQ(hal_pwm_get_period_counts(), 400u);
+    ASSERT_EQ(hal_pwm_get_resolution_bits(), 8u);
+    ASSERT_TRUE(Sim_TIM1.CR1 & TIM_CR1_CEN);
+    ASSERT_TRUE(Sim_TIM1.CR1 & TIM_CR1_ARPE);
+
+    // Frequency changes stay center-aligned.
+    hal_pwm_set_frequency(200);
+    ASSERT_EQ(cms(), 0b10u);
+    ASSERT_EQ(Sim_TIM1.PSC, 0u);
+    ASSERT_EQ(Sim_TIM1.ARR, 40000u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_BOTH));
+    ASSERT_EQ(cms(), 0b11u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_DOWN));
+    ASSERT_EQ(cms(), 0b01u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_EDGE));
+    ASSERT_EQ(cms(), 0u);
+    ASSERT_EQ(Sim_TIM1.PSC, 1u);
+    ASSERT_EQ(Sim_TIM1.ARR, 39999u);
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_set_alignment(_HAL_PWM_ALIGN_MAX));
+}
+
+TEST_F(PWMAlignmentTest, DutyCyclesSurviveAlignmentChanges)
+{
+    hal_pwm_enable(HAL_PWM_CH1, true);
+    hal_pwm_enable(HAL_PWM_CH2, true);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_cycle(HAL_PWM_CH1, 50));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_cycle(HAL_PWM_CH2, 100));
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+
+    // In center alignment the duty is CCR/ARR.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_UP));
+    ASSERT_EQ(Sim_TIM1.CCR1, 200u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b110u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b101u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_q16(HAL_PWM_CH1, 0x4000));
+    ASSERT_EQ(Sim_TIM1.CCR1, 100u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_cycle(HAL_PWM_CH1, 75));
+    ASSERT_EQ(Sim_TIM1.CCR1, 300u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_EDGE));
+    ASSERT_EQ(Sim_TIM1.CCR1, 600u);
+}
+
+TEST_F(PWMAlignmentTest, OC4RefPlacesTheTriggerInThePeriod)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_OC4REF, 0x8000));
+
+    // CH4 in PWM Mode 2 rises half way through the period.
+    ASSERT_EQ(mms(), 0b111u);
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC4M) >> TIM_CCMR2_OC4M_Pos, 0b111u);
+    ASSERT_TRUE(Sim_TIM1.CCMR2 & TIM_CCMR2_OC4PE);
+    ASSERT_EQ(Sim_TIM1.CCR4, 400u);
+
+    // CH4 is taken, the others are not.
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_enable(HAL_PWM_CH4, true));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_duty_cycle(HAL_PWM_CH4, 0));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_duty_q16(HAL_PWM_CH4, 0x1000));
+    const uint16_t duties[4] = { 0, 0, 0, 0 };
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_all(duties));
+    ASSERT_EQ(Sim_TIM1.CCR4, 400u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_enable(HAL_PWM_CH1, true));
+
+    // The point follows the period.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_UP));
+    ASSERT_EQ(Sim_TIM1.CCR4, 200u);
+    hal_pwm_set_frequency(10000);
+    ASSERT_EQ(Sim_TIM1.CCR4, 400u);
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC4M) >> TIM_CCMR2_OC4M_Pos, 0b111u);
+
+    // Full scale lands on the peak, zero just after the start.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_OC4REF, 0xFFFF));
+    ASSERT_EQ(Sim_TIM1.CCR4, Sim_TIM1.ARR);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_OC4REF, 0));
+    ASSERT_EQ(Sim_TIM1.CCR4, 1u);
+}
+
+TEST_F(PWMAlignmentTest, OtherTriggerSourcesReleaseCH4)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_OC4REF, 0x8000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_UPDATE, 0));
+
+    ASSERT_EQ(mms(), 0b010u);
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC4M) >> TIM_CCMR2_OC4M_Pos, 0b100u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_enable(HAL_PWM_CH4, true));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_cycle(HAL_PWM_CH4, 50));
+    ASSERT_EQ(Sim_TIM1.CCR4, 400u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_NONE, 0));
+    ASSERT_EQ(mms(), 0u);
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC4M) >> TIM_CCMR2_OC4M_Pos, 0b110u);
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_set_trigger_output(_HAL_PWM_TRIGGER_MAX, 0));
+}
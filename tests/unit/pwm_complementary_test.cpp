@@ -0,0 +1,204 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/pwm.h"
+#include "registers.h"
+#include "nvic.h"
+#include "stm32f4_hal.h"
+
+void TIM1_BRK_TIM9_IRQHandler(void);
+void _test_fixture_hal_pwm_reset_internals();
+}
+
+static int breaks;
+
+static void count_break(void *context)
+{
+    (void)context;
+    breaks++;
+}
+
+// Complementary outputs, dead-time and the break input of TIM1.
+class PWMComplementaryTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_RCC = { 0 };
+        Sim_GPIOA = { 0 };
+        Sim_GPIOB = { 0 };
+        Sim_TIM1 = { 0 };
+
+        _test_fixture_hal_pwm_reset_internals();
+        breaks = 0;
+
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    }
+
+    // Dead-time as programmed, in ticks of tDTS.
+    static uint32_t dtg()
+    {
+        return (Sim_TIM1.BDTR & TIM_BDTR_DTG) >> TIM_BDTR_DTG_Pos;
+    }
+
+    static uint32_t ckd()
+    {
+        return (Sim_TIM1.CR1 & TIM_CR1_CKD) >> TIM_CR1_CKD_Pos;
+    }
+};
+
+TEST_F(PWMComplementaryTest, ComplementaryInitConfiguresPinsAndOutputs)
+{
+    for (int ch = HAL_PWM_CH1; ch <= HAL_PWM_CH3; ch++)
+    {
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init((hal_pwm_channel_t)ch));
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_complementary_init((hal_pwm_channel_t)ch));
+    }
+
+    ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_GPIOBEN);
+    for (uint32_t pin = 13; pin <= 15; pin++)
+    {
+        // Alternate function 1, push-pull.
+        ASSERT_EQ((Sim_GPIOB.MODER >> (pin * 2)) & 0x3u, 0x2u);
+        ASSERT_EQ((Sim_GPIOB.AFR[1] >> ((pin - 8) * 4)) & 0xFu, 1u);
+        ASSERT_FALSE(Sim_GPIOB.OTYPER & (1u << pin));
+    }
+
+    // Both outputs of each pair enabled, active high.
+    ASSERT_TRUE(Sim_TIM1.CCER & TIM_CCER_CC1E);
+    ASSERT_TRUE(Sim_TIM1.CCER & TIM_CCER_CC1NE);
+    ASSERT_TRUE(Sim_TIM1.CCER & TIM_CCER_CC2NE);
+    ASSERT_TRUE(Sim_TIM1.CCER & TIM_CCER_CC3NE);
+    ASSERT_FALSE(Sim_TIM1.CCER & (TIM_CCER_CC1NP | TIM_CCER_CC2NP | TIM_CCER_CC3NP));
+
+    // Pins are driven inactive rather than released while off.
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_OSSR);
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_OSSI);
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_MOE);
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_complementary_init(HAL_PWM_CH4));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_complementary_init((hal_pwm_channel_t)_HAL_PWM_CH_MAX));
+}
+
+TEST_F(PWMComplementaryTest, DeadTimeIsRoundedUpToTheGeneratorSteps)
+{
+    uint32_t actual = 0;
+
+    // 62.5 ns steps at 16 MHz.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(500, &actual));
+    ASSERT_EQ(dtg(), 8u);
+    ASSERT_EQ(actual, 500u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(100, &actual));
+    ASSERT_EQ(dtg(), 2u);
+    ASSERT_EQ(actual, 125u);
+
+    // 125 ns steps: (64 + 16) x 2 ticks.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(10000, &actual));
+    ASSERT_EQ(dtg(), 0x90u);
+    ASSERT_EQ(actual, 10000u);
+
+    // 500 ns steps: (32 + 8) x 8 ticks.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(20000, &actual));
+    ASSERT_EQ(dtg(), 0xC8u);
+    ASSERT_EQ(actual, 20000u);
+
+    // 1 us steps: (32 + 18) x 16 ticks.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(49800, &actual));
+    ASSERT_EQ(dtg(), 0xF2u);
+    ASSERT_EQ(actual, 50000u);
+    ASSERT_EQ(ckd(), 0u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(0, NULL));
+    ASSERT_EQ(dtg(), 0u);
+}
+
+TEST_F(PWMComplementaryTest, LongDeadTimesRaiseTheClockDivision)
+{
+    uint32_t actual = 0;
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(100000, &actual));
+    ASSERT_EQ(ckd(), 1u);
+    ASSERT_EQ(dtg(), 0xF2u);
+    ASSERT_EQ(actual, 100000u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(252000, &actual));
+    ASSERT_EQ(ckd(), 2u);
+    ASSERT_EQ(dtg(), 0xFFu);
+    ASSERT_EQ(actual, 252000u);
+
+    // Out of reach, nothing changes.
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_set_dead_time(252001, &actual));
+    ASSERT_EQ(ckd(), 2u);
+    ASSERT_EQ(dtg(), 0xFFu);
+
+    // Back to the undivided clock when it suffices.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_dead_time(500, &actual));
+    ASSERT_EQ(ckd(), 0u);
+    ASSERT_TRUE(Sim_TIM1.CR1 & TIM_CR1_CEN);
+}
+
+TEST_F(PWMComplementaryTest, BreakInitArmsTheBreakInput)
+{
+    hal_pwm_break_config_t config = {};
+    config.polarity = HAL_PWM_BREAK_ACTIVE_HIGH;
+    config.auto_restart = true;
+    config.on_break = count_break;
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_break_init(&config));
+
+    // BKIN on PA6, alternate function 1.
+    ASSERT_EQ((Sim_GPIOA.MODER >> 12) & 0x3u, 0x2u);
+    ASSERT_EQ((Sim_GPIOA.AFR[0] >> 24) & 0xFu, 1u);
+
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_BKE);
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_BKP);
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_AOE);
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_OSSR);
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_MOE);
+    ASSERT_TRUE(Sim_TIM1.DIER & TIM_DIER_BIE);
+    ASSERT_TRUE(NVIC_IsIRQEnabled(TIM1_BRK_TIM9_IRQn));
+
+    // Reconfigured active low, manual restart, no callback.
+    config.polarity = HAL_PWM_BREAK_ACTIVE_LOW;
+    config.auto_restart = false;
+    config.on_break = NULL;
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_break_init(&config));
+    ASSERT_TRUE(Sim_TIM1.BDTR & TIM_BDTR_BKE);
+    ASSERT_FALSE(Sim_TIM1.BDTR & TIM_BDTR_BKP);
+    ASSERT_FALSE(Sim_TIM1.BDTR & TIM_BDTR_AOE);
+    ASSERT_FALSE(Sim_TIM1.DIER & TIM_DIER_BIE);
+    ASSERT_FALSE(NVIC_IsIRQEnabled(TIM1_BRK_TIM9_IRQn));
+
+    config.polarity = _HAL_PWM_BREAK_POLARITY_MAX;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_break_init(&config));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_break_init(NULL));
+}
+
+TEST_F(PWMComplementaryTest, BreakIsReportedOnceAndOutputsRestartOnRequest)
+{
+    hal_pwm_break_config_t config = {};
+    config.polarity = HAL_PWM_BREAK_ACTIVE_LOW;
+    config.on_break = count_break;
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_break_init(&config));
+    ASSERT_TRUE(hal_pwm_main_output_is_enabled());
+
+    // Nothing latched, nothing reported.
+    Sim_TIM1.SR = 0;
+    TIM1_BRK_TIM9_IRQHandler();
+    ASSERT_EQ(breaks, 0);
+
+    // The hardware cuts MOE and flags the break.
+    Sim_TIM1.BDTR &= ~TIM_BDTR_MOE;
+    Sim_TIM1.SR = TIM_SR_BIF;
+    TIM1_BRK_TIM9_IRQHandler();
+    ASSERT_EQ(breaks, 1);
+    ASSERT_FALSE(Sim_TIM1.SR & TIM_SR_BIF);
+    ASSERT_FALSE(Sim_TIM1.DIER & TIM_DIER_BIE);
+    ASSERT_FALSE(hal_pwm_main_output_is_enabled());
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_main_output_enable(true));
+    ASSERT_TRUE(hal_pwm_main_output_is_enabled());
+    ASSERT_TRUE(Sim_TIM1.DIER & TIM_DIER_BIE);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_main_output_enable(false));
+    ASSERT_FALSE(hal_pwm_main_output_is_enabled());
+}
@@ -590,6 +590,161 @@ TEST_F(PWMDriverTest, SetFrequencyRescalesAllEnabledChannels)
     ASSERT_TRUE(0.74 < ch4_ratio && ch4_ratio < 0.76);
 }
 
+/***********************************************************************/
+// High-resolution duty cycle tests
+/***********************************************************************/
+
+TEST_F(PWMDriverTest, SetDutyQ16UsesEveryTimerStep)
+{
+    // Arrange: 20 kHz gives 800 counts per period.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init(HAL_PWM_CH1));
+    hal_pwm_enable(HAL_PWM_CH1, true);
+
+    // Act / Assert: Fractions of 65536 round to the nearest count.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_q16(HAL_PWM_CH1, 0x8000));
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b110u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_q16(HAL_PWM_CH1, 0x4000));
+    ASSERT_EQ(Sim_TIM1.CCR1, 200u);
+
+    // One count, a step the percent API cannot make.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_q16(HAL_PWM_CH1, 82));
+    ASSERT_EQ(Sim_TIM1.CCR1, 1u);
+
+    // Less than half a count rounds to off.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_q16(HAL_PWM_CH1, 1));
+    ASSERT_EQ(Sim_TIM1.CCR1, 0u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b100u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_q16(HAL_PWM_CH1, HAL_PWM_DUTY_Q16_FULL));
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b101u);
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_set_duty_q16((hal_pwm_channel_t)_HAL_PWM_CH_MAX, 0x8000));
+}
+
+TEST_F(PWMDriverTest, SetDutyCountsWritesCompareRegister)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init(HAL_PWM_CH2));
+
+    // Dropped while disabled.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_counts(HAL_PWM_CH2, 123));
+    ASSERT_EQ(Sim_TIM1.CCR2, 0u);
+
+    hal_pwm_enable(HAL_PWM_CH2, true);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_counts(HAL_PWM_CH2, 123));
+    ASSERT_EQ(Sim_TIM1.CCR2, 123u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b110u);
+
+    // A whole period or more is fully on.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_counts(HAL_PWM_CH2, hal_pwm_get_period_counts()));
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b101u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_counts(HAL_PWM_CH2, 0));
+    ASSERT_EQ(Sim_TIM1.CCR2, 0u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b100u);
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_set_duty_counts((hal_pwm_channel_t)_HAL_PWM_CH_MAX, 1));
+}
+
+TEST_F(PWMDriverTest, ResolutionFollowsTheFrequency)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(hal_pwm_get_period_counts(), 800u);
+    ASSERT_EQ(hal_pwm_get_resolution_bits(), 9u);
+
+    hal_pwm_set_frequency(200);
+    ASSERT_EQ(hal_pwm_get_period_counts(), 40000u);
+    ASSERT_EQ(hal_pwm_get_resolution_bits(), 15u);
+
+    hal_pwm_set_frequency(8000000);
+    ASSERT_EQ(hal_pwm_get_period_counts(), 2u);
+    ASSERT_EQ(hal_pwm_get_resolution_bits(), 1u);
+}
+
+/***********************************************************************/
+// Multi-channel update tests
+/***********************************************************************/
+
+TEST_F(PWMDriverTest, SetDutyAllLatchesAtTheNextNaturalUpdate)
+{
+    // Arrange: all four channels running, counter part way through a period.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    for (int ch = HAL_PWM_CH1; ch < _HAL_PWM_CH_MAX; ch++)
+    {
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init((hal_pwm_channel_t)ch));
+        hal_pwm_enable((hal_pwm_channel_t)ch, true);
+    }
+    hal_pwm_set_duty_cycle(HAL_PWM_CH1, 10);
+    Sim_TIM1.EGR = 0;
+    Sim_TIM1.CNT = 123;
+
+    // Act
+    const uint16_t duties[4] = { 0x8000, 0x4000, 0, HAL_PWM_DUTY_Q16_FULL };
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_all(duties));
+
+    // Assert: Every level, 0% and 100% included, is a compare value in PWM Mode 1.
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+    ASSERT_EQ(Sim_TIM1.CCR2, 200u);
+    ASSERT_EQ(Sim_TIM1.CCR3, 0u);
+    ASSERT_EQ(Sim_TIM1.CCR4, 800u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b110u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b110u);
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC3M) >> TIM_CCMR2_OC3M_Pos, 0b110u);
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC4M) >> TIM_CCMR2_OC4M_Pos, 0b110u);
+
+    // No forced update, the counter was left alone and update events are allowed again.
+    ASSERT_EQ(Sim_TIM1.EGR, 0u);
+    ASSERT_EQ(Sim_TIM1.CNT, 123u);
+    ASSERT_FALSE(Sim_TIM1.CR1 & TIM_CR1_UDIS);
+    ASSERT_TRUE(Sim_TIM1.CR1 & TIM_CR1_CEN);
+}
+
+TEST_F(PWMDriverTest, SetDutyAllTakesForcedChannelsBackToPwmMode)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init(HAL_PWM_CH1));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init(HAL_PWM_CH2));
+    hal_pwm_enable(HAL_PWM_CH1, true);
+    hal_pwm_enable(HAL_PWM_CH2, true);
+
+    // Single-channel setters force 100% and 0%.
+    hal_pwm_set_duty_cycle(HAL_PWM_CH1, 100);
+    hal_pwm_set_duty_cycle(HAL_PWM_CH2, 0);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b101u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b100u);
+
+    // From forced high to 0, and from forced low to full scale.
+    const uint16_t duties[4] = { 0, HAL_PWM_DUTY_Q16_FULL, 0, 0 };
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_all(duties));
+
+    ASSERT_EQ(Sim_TIM1.CCR1, 0u);
+    ASSERT_EQ(Sim_TIM1.CCR2, 800u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b110u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b110u);
+}
+
+TEST_F(PWMDriverTest, SetDutyAllLeavesDisabledChannelsLow)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init(HAL_PWM_CH1));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init(HAL_PWM_CH2));
+    hal_pwm_enable(HAL_PWM_CH1, true);
+    hal_pwm_enable(HAL_PWM_CH2, false);
+    Sim_TIM1.CCR2 = 77;
+
+    const uint16_t duties[4] = { 0x8000, 0x8000, 0, 0 };
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_all(duties));
+
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+    ASSERT_EQ(Sim_TIM1.CCR2, 77u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b100u);
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_set_duty_all(NULL));
+}
+
 /***********************************************************************/
 // Out-of-bounds channel tests
 /***********************************************************************/
@@ -0,0 +1,180 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/pwm.h"
+#include "registers.h"
+#include "nvic.h"
+#include "stm32f4_hal.h"
+
+void TIM1_UP_TIM10_IRQHandler(void);
+void _test_fixture_hal_pwm_reset_internals();
+}
+
+// Duty-cycle ramps stepped in the TIM1 update interrupt, driven by hand one update event at a time.
+class PWMRampTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_RCC = { 0 };
+        Sim_GPIOA = { 0 };
+        Sim_TIM1 = { 0 };
+
+        _test_fixture_hal_pwm_reset_internals();
+        NVIC_DisableIRQ(TIM1_UP_TIM10_IRQn);
+
+        // 20 kHz from 16 MHz: ARR = 799, 20 update events per 1 ms step.
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init(HAL_PWM_CH1));
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_enable(HAL_PWM_CH1, true));
+    }
+
+    static void updates(uint32_t n)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            Sim_TIM1.SR = TIM_SR_UIF;
+            TIM1_UP_TIM10_IRQHandler();
+        }
+    }
+
+    static bool interrupt_enabled()
+    {
+        return (Sim_TIM1.DIER & TIM_DIER_UIE) && NVIC_IsIRQEnabled(TIM1_UP_TIM10_IRQn);
+    }
+};
+
+TEST_F(PWMRampTest, RampStepsEveryMillisecondAndLandsOnTarget)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0x8000, 10));
+    ASSERT_TRUE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    ASSERT_TRUE(interrupt_enabled());
+    ASSERT_EQ(Sim_TIM1.CCR1, 0u);
+
+    // Ten steps of 40 counts, one every 20 update events.
+    updates(19);
+    ASSERT_EQ(Sim_TIM1.CCR1, 0u);
+    updates(1);
+    ASSERT_EQ(Sim_TIM1.CCR1, 40u);
+    ASSERT_EQ(Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M, 0b110u << TIM_CCMR1_OC1M_Pos);
+    updates(20 * 4);
+    ASSERT_EQ(Sim_TIM1.CCR1, 200u);
+    ASSERT_TRUE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+
+    updates(20 * 5);
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    ASSERT_FALSE(Sim_TIM1.DIER & TIM_DIER_UIE);
+    ASSERT_FALSE(NVIC_IsIRQEnabled(TIM1_UP_TIM10_IRQn));
+
+    // Back down to off, ending forced low like the setters.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0, 2));
+    updates(20);
+    ASSERT_EQ(Sim_TIM1.CCR1, 200u);
+    updates(20);
+    ASSERT_EQ(Sim_TIM1.CCR1, 0u);
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+}
+
+TEST_F(PWMRampTest, NewTargetStartsFromWhereTheRampIs)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_q16(HAL_PWM_CH1, HAL_PWM_DUTY_Q16_FULL));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0, 4));
+    updates(20);
+    ASSERT_EQ(Sim_TIM1.CCR1, 600u);
+
+    // From 75% to 25% in two steps.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0x4000, 2));
+    updates(20);
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+    updates(20);
+    ASSERT_EQ(Sim_TIM1.CCR1, 200u);
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+
+    // A duration of 0 is a plain set.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0x8000, 0));
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    ASSERT_FALSE(Sim_TIM1.DIER & TIM_DIER_UIE);
+}
+
+TEST_F(PWMRampTest, SlewLimitStretchesTheRamp)
+{
+    // One full scale per second: half scale takes 500 ms, whatever was asked.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_slew_limit(HAL_PWM_CH1, 0x10000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0x8000, 0));
+    ASSERT_EQ(Sim_TIM1.CCR1, 0u);
+
+    updates(20 * 250);
+    ASSERT_EQ(Sim_TIM1.CCR1, 200u);
+    updates(20 * 249);
+    ASSERT_TRUE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    updates(20);
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+
+    // Longer durations than the limit needs are kept.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0, 1000));
+    updates(20 * 500);
+    ASSERT_EQ(Sim_TIM1.CCR1, 200u);
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_set_slew_limit(_HAL_PWM_CH_MAX, 1));
+}
+
+TEST_F(PWMRampTest, ChannelsRampIndependently)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init(HAL_PWM_CH2));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_enable(HAL_PWM_CH2, true));
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0x8000, 2));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH2, 0x8000, 4));
+
+    updates(40);
+    ASSERT_EQ(Sim_TIM1.CCR1, 400u);
+    ASSERT_EQ(Sim_TIM1.CCR2, 200u);
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    ASSERT_TRUE(interrupt_enabled());
+
+    updates(40);
+    ASSERT_EQ(Sim_TIM1.CCR2, 400u);
+    ASSERT_FALSE(interrupt_enabled());
+}
+
+TEST_F(PWMRampTest, CenterAlignedCountsTwoUpdatesPerPeriod)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_BOTH));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, HAL_PWM_DUTY_Q16_FULL, 1));
+
+    updates(39);
+    ASSERT_TRUE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    updates(1);
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    ASSERT_GE(Sim_TIM1.CCR1, Sim_TIM1.ARR);
+}
+
+TEST_F(PWMRampTest, DirectSettersAndOwnersEndTheRamp)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0x8000, 10));
+    updates(20);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_cycle(HAL_PWM_CH1, 10));
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    ASSERT_FALSE(interrupt_enabled());
+    updates(20);
+    ASSERT_EQ(Sim_TIM1.CCR1, 80u);
+
+    // Disabling the channel.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0x8000, 10));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_enable(HAL_PWM_CH1, false));
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    ASSERT_FALSE(interrupt_enabled());
+
+    // Disabled channels drop the ramp, as the setters drop non-zero values.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_ramp_to(HAL_PWM_CH1, 0x8000, 10));
+    ASSERT_FALSE(hal_pwm_ramp_is_active(HAL_PWM_CH1));
+    ASSERT_FALSE(interrupt_enabled());
+
+    // CH4 as the trigger channel.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_OC4REF, 0x8000));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_ramp_to(HAL_PWM_CH4, 0x8000, 10));
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_ramp_to(_HAL_PWM_CH_MAX, 0x8000, 10));
+    ASSERT_FALSE(hal_pwm_ramp_is_active(_HAL_PWM_CH_MAX));
+}
@@ -0,0 +1,302 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/pwm.h"
+#include "registers.h"
+#include "nvic.h"
+#include "stm32f4_hal.h"
+
+void DMA2_Stream5_IRQHandler(void);
+void _test_fixture_hal_pwm_reset_internals();
+}
+
+#define FRAMES 8
+
+struct stream_event {
+    hal_pwm_stream_event_t event;
+    hal_pwm_frame_t *done;
+    size_t count;
+    void *context;
+};
+
+static stream_event events[8];
+static int event_count;
+
+static void record_event(hal_pwm_stream_event_t event, hal_pwm_frame_t *done, size_t count, void *context)
+{
+    if (event_count < 8)
+    {
+        events[event_count] = { event, done, count, context };
+    }
+    event_count++;
+}
+
+// DMA-burst streaming of frames into the TIM1 compare registers.
+class PWMStreamTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_RCC = { 0 };
+        Sim_GPIOA = { 0 };
+        Sim_TIM1 = { 0 };
+        Sim_DMA2 = { 0 };
+        Sim_DMA2_Stream5 = { 0 };
+
+        _test_fixture_hal_pwm_reset_internals();
+        event_count = 0;
+
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+        for (int ch = HAL_PWM_CH1; ch < _HAL_PWM_CH_MAX; ch++)
+        {
+            ASSERT_EQ(HAL_STATUS_OK, hal_pwm_channel_init((hal_pwm_channel_t)ch));
+        }
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_enable(HAL_PWM_CH1, true));
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_enable(HAL_PWM_CH3, true));
+    }
+
+    void TearDown() override {
+        hal_pwm_stream_stop();
+    }
+
+    // Raise DMA flags for stream 5 and take the interrupt.
+    static void dma_interrupt(uint32_t flags)
+    {
+        Sim_DMA2.HISR = flags;
+        Sim_DMA2.HIFCR = 0;
+        DMA2_Stream5_IRQHandler();
+        ASSERT_EQ(Sim_DMA2.HIFCR & flags, flags);
+        Sim_DMA2.HISR = 0;
+    }
+
+    hal_pwm_stream_config_t circular_config()
+    {
+        hal_pwm_stream_config_t config = {};
+        config.mode = HAL_PWM_STREAM_CIRCULAR;
+        config.buffer = ring;
+        config.frames = FRAMES;
+        config.on_event = record_event;
+        config.context = this;
+        return config;
+    }
+
+    hal_pwm_stream_config_t double_config()
+    {
+        hal_pwm_stream_config_t config = circular_config();
+        config.mode = HAL_PWM_STREAM_DOUBLE_BUFFER;
+        config.buffer = ping;
+        config.second_buffer = pong;
+        return config;
+    }
+
+    hal_pwm_frame_t ring[FRAMES] = {};
+    hal_pwm_frame_t ping[FRAMES] = {};
+    hal_pwm_frame_t pong[FRAMES] = {};
+};
+
+TEST_F(PWMStreamTest, StartProgramsTimerBurstAndDma)
+{
+    hal_pwm_stream_config_t config = circular_config();
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+    ASSERT_TRUE(hal_pwm_stream_active());
+
+    // Four writes per update event, starting at CCR1.
+    ASSERT_EQ((Sim_TIM1.DCR & TIM_DCR_DBA) >> TIM_DCR_DBA_Pos, 13u);
+    ASSERT_EQ((Sim_TIM1.DCR & TIM_DCR_DBL) >> TIM_DCR_DBL_Pos, 3u);
+    ASSERT_TRUE(Sim_TIM1.DIER & TIM_DIER_UDE);
+
+    // DMA2 Stream 5 Channel 6 (TIM1_UP), half-words from memory to DMAR in a loop.
+    ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_DMA2EN);
+    ASSERT_EQ((Sim_DMA2_Stream5.CR & DMA_SxCR_CHSEL) >> DMA_SxCR_CHSEL_Pos, 6u);
+    ASSERT_EQ(Sim_DMA2_Stream5.CR & DMA_SxCR_DIR, DMA_SxCR_DIR_0);
+    ASSERT_EQ(Sim_DMA2_Stream5.CR & DMA_SxCR_MSIZE, DMA_SxCR_MSIZE_0);
+    ASSERT_EQ(Sim_DMA2_Stream5.CR & DMA_SxCR_PSIZE, DMA_SxCR_PSIZE_0);
+    ASSERT_TRUE(Sim_DMA2_Stream5.CR & DMA_SxCR_MINC);
+    ASSERT_FALSE(Sim_DMA2_Stream5.CR & DMA_SxCR_PINC);
+    ASSERT_TRUE(Sim_DMA2_Stream5.CR & DMA_SxCR_CIRC);
+    ASSERT_TRUE(Sim_DMA2_Stream5.CR & DMA_SxCR_HTIE);
+    ASSERT_TRUE(Sim_DMA2_Stream5.CR & DMA_SxCR_TCIE);
+    ASSERT_FALSE(Sim_DMA2_Stream5.CR & DMA_SxCR_DBM);
+    ASSERT_TRUE(Sim_DMA2_Stream5.CR & DMA_SxCR_EN);
+    ASSERT_EQ(Sim_DMA2_Stream5.NDTR, FRAMES * 4u);
+    ASSERT_EQ(Sim_DMA2_Stream5.PAR, (uint32_t)(uintptr_t)&Sim_TIM1.DMAR);
+    ASSERT_EQ(Sim_DMA2_Stream5.M0AR, (uint32_t)(uintptr_t)ring);
+    ASSERT_TRUE(NVIC_IsIRQEnabled(DMA2_Stream5_IRQn));
+
+    // Enabled channels follow the frames, disabled ones stay low.
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b110u);
+    ASSERT_EQ((Sim_TIM1.CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos, 0b100u);
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC3M) >> TIM_CCMR2_OC3M_Pos, 0b110u);
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC4M) >> TIM_CCMR2_OC4M_Pos, 0b100u);
+
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_stream_start(&config));
+}
+
+TEST_F(PWMStreamTest, CircularStreamHandsBackEachHalf)
+{
+    hal_pwm_stream_config_t config = circular_config();
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+
+    dma_interrupt(DMA_HISR_HTIF5);
+    dma_interrupt(DMA_HISR_TCIF5);
+    // Both halves at once when the interrupt was held off.
+    dma_interrupt(DMA_HISR_HTIF5 | DMA_HISR_TCIF5);
+
+    ASSERT_EQ(event_count, 4);
+    ASSERT_EQ(events[0].event, HAL_PWM_STREAM_EVENT_HALF);
+    ASSERT_EQ(events[0].done, ring);
+    ASSERT_EQ(events[0].count, (size_t)FRAMES / 2);
+    ASSERT_EQ(events[0].context, this);
+    ASSERT_EQ(events[1].event, HAL_PWM_STREAM_EVENT_COMPLETE);
+    ASSERT_EQ(events[1].done, ring + FRAMES / 2);
+    ASSERT_EQ(events[1].count, (size_t)FRAMES / 2);
+    ASSERT_EQ(events[2].event, HAL_PWM_STREAM_EVENT_HALF);
+    ASSERT_EQ(events[3].event, HAL_PWM_STREAM_EVENT_COMPLETE);
+    ASSERT_TRUE(hal_pwm_stream_active());
+}
+
+TEST_F(PWMStreamTest, DoubleBufferHandsBackTheFinishedBuffer)
+{
+    hal_pwm_frame_t next[FRAMES] = {};
+    hal_pwm_stream_config_t config = double_config();
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+
+    ASSERT_TRUE(Sim_DMA2_Stream5.CR & DMA_SxCR_DBM);
+    ASSERT_FALSE(Sim_DMA2_Stream5.CR & DMA_SxCR_HTIE);
+    ASSERT_EQ(Sim_DMA2_Stream5.M0AR, (uint32_t)(uintptr_t)ping);
+    ASSERT_EQ(Sim_DMA2_Stream5.M1AR, (uint32_t)(uintptr_t)pong);
+
+    // Ping done, the DMA moved on to pong.
+    Sim_DMA2_Stream5.CR |= DMA_SxCR_CT;
+    dma_interrupt(DMA_HISR_TCIF5);
+    ASSERT_EQ(events[0].event, HAL_PWM_STREAM_EVENT_COMPLETE);
+    ASSERT_EQ(events[0].done, ping);
+    ASSERT_EQ(events[0].count, (size_t)FRAMES);
+
+    // Only the idle buffer is replaced.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_queue(next));
+    ASSERT_EQ(Sim_DMA2_Stream5.M0AR, (uint32_t)(uintptr_t)next);
+    ASSERT_EQ(Sim_DMA2_Stream5.M1AR, (uint32_t)(uintptr_t)pong);
+
+    Sim_DMA2_Stream5.CR &= ~DMA_SxCR_CT;
+    dma_interrupt(DMA_HISR_TCIF5);
+    ASSERT_EQ(events[1].done, pong);
+
+    Sim_DMA2_Stream5.CR |= DMA_SxCR_CT;
+    dma_interrupt(DMA_HISR_TCIF5);
+    ASSERT_EQ(events[2].done, next);
+    ASSERT_EQ(event_count, 3);
+}
+
+TEST_F(PWMStreamTest, TransferErrorStopsTheStream)
+{
+    hal_pwm_stream_config_t config = circular_config();
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+
+    dma_interrupt(DMA_HISR_TEIF5 | DMA_HISR_TCIF5);
+
+    ASSERT_EQ(event_count, 1);
+    ASSERT_EQ(events[0].event, HAL_PWM_STREAM_EVENT_ERROR);
+    ASSERT_EQ(events[0].done, nullptr);
+    ASSERT_FALSE(hal_pwm_stream_active());
+    ASSERT_FALSE(Sim_TIM1.DIER & TIM_DIER_UDE);
+    ASSERT_FALSE(Sim_DMA2_Stream5.CR & DMA_SxCR_EN);
+    ASSERT_FALSE(NVIC_IsIRQEnabled(DMA2_Stream5_IRQn));
+
+    // A stray interrupt afterwards is ignored.
+    dma_interrupt(DMA_HISR_TCIF5);
+    ASSERT_EQ(event_count, 1);
+}
+
+TEST_F(PWMStreamTest, StreamOwnsTheCompareRegistersUntilStopped)
+{
+    hal_pwm_stream_config_t config = circular_config();
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_duty_cycle(HAL_PWM_CH1, 50));
+    const uint16_t duties[4] = { 0x8000, 0x8000, 0x8000, 0x8000 };
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_duty_all(duties));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_UP));
+
+    // No forced update events, they would request an extra burst.
+    Sim_TIM1.EGR = 0;
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_enable(HAL_PWM_CH3, false));
+    ASSERT_EQ((Sim_TIM1.CCMR2 & TIM_CCMR2_OC3M) >> TIM_CCMR2_OC3M_Pos, 0b100u);
+    hal_pwm_set_frequency(10);
+    ASSERT_EQ(Sim_TIM1.EGR, 0u);
+    ASSERT_EQ(Sim_TIM1.PSC, 24u);
+    ASSERT_EQ(Sim_TIM1.ARR, 63999u);
+    ASSERT_TRUE(Sim_TIM1.CR1 & TIM_CR1_CEN);
+
+    hal_pwm_stream_stop();
+    ASSERT_FALSE(hal_pwm_stream_active());
+    ASSERT_FALSE(Sim_TIM1.DIER & TIM_DIER_UDE);
+    ASSERT_EQ(Sim_TIM1.DCR, 0u);
+    ASSERT_FALSE(Sim_DMA2_Stream5.CR & DMA_SxCR_EN);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_duty_cycle(HAL_PWM_CH1, 50));
+    ASSERT_EQ(Sim_TIM1.CCR1, 32000u);
+    ASSERT_EQ(Sim_TIM1.EGR, TIM_EGR_UG);
+}
+
+TEST_F(PWMStreamTest, StreamAndTriggerPointExcludeEachOther)
+{
+    hal_pwm_stream_config_t config = circular_config();
+
+    // Stream first: its bursts would overwrite the trigger point in CCR4.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_OC4REF, 0x8000));
+    ASSERT_EQ(Sim_TIM1.CR2 & TIM_CR2_MMS, 0u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_UPDATE, 0));
+    hal_pwm_stream_stop();
+
+    // Trigger first.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_OC4REF, 0x8000));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_stream_start(&config));
+    ASSERT_FALSE(hal_pwm_stream_active());
+    ASSERT_FALSE(Sim_TIM1.DIER & TIM_DIER_UDE);
+    ASSERT_EQ(Sim_TIM1.CCR4, 400u);
+
+    // Either way round once the other has let go.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_NONE, 0));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+}
+
+TEST_F(PWMStreamTest, StartRejectsBadConfigs)
+{
+    hal_pwm_stream_config_t config = circular_config();
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_start(NULL));
+
+    config.frames = FRAMES - 1;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_start(&config));
+    config.frames = 0;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_start(&config));
+    config.frames = HAL_PWM_STREAM_MAX_FRAMES + 1;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_start(&config));
+
+    config = circular_config();
+    config.buffer = NULL;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_start(&config));
+    config.buffer = ring;
+    config.mode = _HAL_PWM_STREAM_MODE_MAX;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_start(&config));
+
+    config = double_config();
+    config.second_buffer = NULL;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_start(&config));
+    config.second_buffer = ping;
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_start(&config));
+
+    // Double buffers may have an odd length.
+    config = double_config();
+    config.frames = FRAMES - 1;
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_queue(NULL));
+    hal_pwm_stream_stop();
+
+    // Only a running double-buffered stream takes a queued buffer.
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_queue(pong));
+    config = circular_config();
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_stream_start(&config));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_stream_queue(pong));
+}
@@ -0,0 +1,175 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/pwm.h"
+#include "registers.h"
+#include "stm32f4_hal.h"
+
+void _test_fixture_hal_pwm_reset_internals();
+}
+
+// PWM on timers other than TIM1, each with its own frequency.
+class PWMTimersTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_RCC = { 0 };
+        Sim_GPIOA = { 0 };
+        Sim_GPIOB = { 0 };
+        Sim_GPIOC = { 0 };
+        Sim_TIM1 = { 0 };
+        Sim_TIM2 = { 0 };
+        Sim_TIM3 = { 0 };
+        Sim_TIM4 = { 0 };
+        Sim_TIM5 = { 0 };
+        Sim_TIM8 = { 0 };
+
+        _test_fixture_hal_pwm_reset_internals();
+    }
+
+    static uint32_t af(const GPIO_TypeDef &port, uint32_t pin)
+    {
+        return (port.AFR[pin / 8] >> ((pin % 8) * 4)) & 0xFu;
+    }
+
+    static uint32_t mode(const GPIO_TypeDef &port, uint32_t pin)
+    {
+        return (port.MODER >> (pin * 2)) & 0x3u;
+    }
+};
+
+TEST_F(PWMTimersTest, EachTimerKeepsItsOwnFrequency)
+{
+    // Servos at 50 Hz next to fans at 25 kHz.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM3, 50));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM4, 25000));
+
+    ASSERT_EQ(Sim_TIM3.PSC, 4u);
+    ASSERT_EQ(Sim_TIM3.ARR, 63999u);
+    ASSERT_EQ(Sim_TIM4.PSC, 0u);
+    ASSERT_EQ(Sim_TIM4.ARR, 639u);
+    ASSERT_TRUE(Sim_TIM3.CR1 & TIM_CR1_CEN);
+    ASSERT_TRUE(Sim_TIM4.CR1 & TIM_CR1_ARPE);
+    ASSERT_TRUE(Sim_RCC.APB1ENR & RCC_APB1ENR_TIM3EN);
+    ASSERT_TRUE(Sim_RCC.APB1ENR & RCC_APB1ENR_TIM4EN);
+
+    // Untouched by either.
+    ASSERT_EQ(Sim_TIM1.ARR, 0u);
+    ASSERT_EQ(Sim_RCC.APB2ENR, 0u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_channel_init(HAL_PWM_TIM3, HAL_PWM_CH1));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_enable(HAL_PWM_TIM3, HAL_PWM_CH1, true));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_set_duty_cycle(HAL_PWM_TIM3, HAL_PWM_CH1, 50));
+    ASSERT_EQ(Sim_TIM3.CCR1, 32000u);
+
+    // The duty ratio follows a frequency change, the other timer does not move.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_set_frequency(HAL_PWM_TIM3, 100));
+    ASSERT_EQ(Sim_TIM3.PSC, 3u);
+    ASSERT_EQ(Sim_TIM3.ARR, 39999u);
+    ASSERT_EQ(Sim_TIM3.CCR1, 20000u);
+    ASSERT_EQ(Sim_TIM4.ARR, 639u);
+    ASSERT_EQ(hal_pwm_tim_get_period_counts(HAL_PWM_TIM4), 640u);
+    ASSERT_EQ(hal_pwm_tim_get_resolution_bits(HAL_PWM_TIM4), 9u);
+}
+
+TEST_F(PWMTimersTest, ThirtyTwoBitTimersSkipThePrescaler)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM2, 1));
+    ASSERT_EQ(Sim_TIM2.PSC, 0u);
+    ASSERT_EQ(Sim_TIM2.ARR, 15999999u);
+    ASSERT_EQ(hal_pwm_tim_get_period_counts(HAL_PWM_TIM2), 16000000u);
+    ASSERT_EQ(hal_pwm_tim_get_resolution_bits(HAL_PWM_TIM2), 23u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM5, 10));
+    ASSERT_EQ(Sim_TIM5.PSC, 0u);
+    ASSERT_EQ(Sim_TIM5.ARR, 1599999u);
+
+    // Compare values above 16 bits land in CCR as they are.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_channel_init(HAL_PWM_TIM5, HAL_PWM_CH1));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_channel_init(HAL_PWM_TIM5, HAL_PWM_CH2));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_enable(HAL_PWM_TIM5, HAL_PWM_CH1, true));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_enable(HAL_PWM_TIM5, HAL_PWM_CH2, true));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_set_duty_counts(HAL_PWM_TIM5, HAL_PWM_CH1, 100000));
+    ASSERT_EQ(Sim_TIM5.CCR1, 100000u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_set_duty_q16(HAL_PWM_TIM5, HAL_PWM_CH2, 0x8000));
+    ASSERT_EQ(Sim_TIM5.CCR2, 800000u);
+    ASSERT_EQ((Sim_TIM5.CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, 0b110u);
+
+    // Full scale holds the output high.
+    const uint16_t duties[4] = { HAL_PWM_DUTY_Q16_FULL, 0x4000, 0, 0 };
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_set_duty_all(HAL_PWM_TIM5, duties));
+    ASSERT_EQ(Sim_TIM5.CCR1, 1600000u);
+    ASSERT_EQ(Sim_TIM5.CCR2, 400000u);
+}
+
+TEST_F(PWMTimersTest, ChannelsComeOutOnTheirOwnPins)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM2, 1000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM8, 1000));
+    for (int ch = HAL_PWM_CH1; ch < _HAL_PWM_CH_MAX; ch++)
+    {
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_channel_init(HAL_PWM_TIM2, (hal_pwm_channel_t)ch));
+        ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_channel_init(HAL_PWM_TIM8, (hal_pwm_channel_t)ch));
+    }
+
+    // TIM2 on AF1: PA5, PB3, PB10, PB2.
+    ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_GPIOAEN);
+    ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_GPIOBEN);
+    ASSERT_EQ(mode(Sim_GPIOA, 5), 0x2u);
+    ASSERT_EQ(af(Sim_GPIOA, 5), 1u);
+    ASSERT_EQ(af(Sim_GPIOB, 3), 1u);
+    ASSERT_EQ(af(Sim_GPIOB, 10), 1u);
+    ASSERT_EQ(af(Sim_GPIOB, 2), 1u);
+    ASSERT_EQ(Sim_TIM2.BDTR, 0u);
+
+    // TIM8 on AF3: PC6-PC9. Advanced, so the main output is enabled.
+    ASSERT_TRUE(Sim_RCC.AHB1ENR & RCC_AHB1ENR_GPIOCEN);
+    ASSERT_TRUE(Sim_RCC.APB2ENR & RCC_APB2ENR_TIM8EN);
+    for (uint32_t pin = 6; pin <= 9; pin++)
+    {
+        ASSERT_EQ(mode(Sim_GPIOC, pin), 0x2u);
+        ASSERT_EQ(af(Sim_GPIOC, pin), 3u);
+    }
+    ASSERT_TRUE(Sim_TIM8.BDTR & TIM_BDTR_MOE);
+    ASSERT_TRUE(Sim_TIM8.CCER & TIM_CCER_CC4E);
+    ASSERT_EQ((Sim_TIM8.CCMR2 & TIM_CCMR2_OC4M) >> TIM_CCMR2_OC4M_Pos, 0b100u);
+
+    // Nothing on the TIM1 pins.
+    ASSERT_EQ(Sim_GPIOA.AFR[1], 0u);
+}
+
+TEST_F(PWMTimersTest, TIM1OnlyFeaturesStayOnTIM1)
+{
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(hal_pwm_tim_get_period_counts(HAL_PWM_TIM1), 800u);
+
+    // TIM1's CH4 is the trigger, TIM3's CH4 is still an output.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_trigger_output(HAL_PWM_TRIGGER_OC4REF, 0x8000));
+    ASSERT_EQ(HAL_STATUS_BUSY, hal_pwm_tim_enable(HAL_PWM_TIM1, HAL_PWM_CH4, true));
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM3, 20000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_channel_init(HAL_PWM_TIM3, HAL_PWM_CH4));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_enable(HAL_PWM_TIM3, HAL_PWM_CH4, true));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_set_duty_cycle(HAL_PWM_TIM3, HAL_PWM_CH4, 25));
+    ASSERT_EQ(Sim_TIM3.CCR4, 200u);
+    ASSERT_EQ(Sim_TIM1.CCR4, 400u);
+}
+
+TEST_F(PWMTimersTest, BadTimersAreRejected)
+{
+    const uint16_t duties[4] = { 0, 0, 0, 0 };
+    const hal_pwm_timer_t bad = _HAL_PWM_TIMER_MAX;
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_init(bad, 1000));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_channel_init(bad, HAL_PWM_CH1));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_enable(bad, HAL_PWM_CH1, true));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_set_duty_cycle(bad, HAL_PWM_CH1, 50));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_set_duty_q16(bad, HAL_PWM_CH1, 1));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_set_duty_counts(bad, HAL_PWM_CH1, 1));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_set_duty_all(bad, duties));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_set_frequency(bad, 1000));
+    ASSERT_EQ(hal_pwm_tim_get_period_counts(bad), 0u);
+    ASSERT_EQ(hal_pwm_tim_get_resolution_bits(bad), 0u);
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM4, 1000));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_channel_init(HAL_PWM_TIM4, _HAL_PWM_CH_MAX));
+}
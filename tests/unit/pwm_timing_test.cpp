@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "hal/pwm.h"
+#include "registers.h"
+#include "stm32f4_hal.h"
+
+void _test_fixture_hal_pwm_reset_internals();
+}
+
+// Frequency planning from the RCC clock tree.
+class PWMTimingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Sim_RCC = { 0 };
+        Sim_GPIOA = { 0 };
+        Sim_GPIOB = { 0 };
+        Sim_TIM1 = { 0 };
+        Sim_TIM3 = { 0 };
+
+        _test_fixture_hal_pwm_reset_internals();
+    }
+
+    // 8 MHz HSE / 4 * 180 / 2 = 180 MHz SYSCLK, APB1 at /4, APB2 at /2.
+    static void clock_at_180mhz()
+    {
+        Sim_RCC.PLLCFGR = RCC_PLLCFGR_PLLSRC_HSE | (4u << RCC_PLLCFGR_PLLM_Pos) | (180u << RCC_PLLCFGR_PLLN_Pos) |
+                          (0u << RCC_PLLCFGR_PLLP_Pos);
+        Sim_RCC.CFGR = RCC_CFGR_SWS_PLL | RCC_CFGR_PPRE1_DIV4 | RCC_CFGR_PPRE2_DIV2;
+    }
+};
+
+TEST_F(PWMTimingTest, ResetClockIsTheHSI)
+{
+    hal_pwm_timing_t timing = {};
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_get_timing(&timing));
+
+    ASSERT_EQ(timing.timer_clock_hz, 16000000u);
+    ASSERT_EQ(timing.requested_hz, 20000u);
+    ASSERT_EQ(timing.achieved_hz, 20000u);
+    ASSERT_EQ(timing.error_ppm, 0);
+    ASSERT_EQ(timing.period_counts, 800u);
+    ASSERT_EQ(timing.resolution_bits, 9u);
+}
+
+TEST_F(PWMTimingTest, APBPrescalersDoubleTheTimerClock)
+{
+    hal_pwm_timing_t timing = {};
+    clock_at_180mhz();
+
+    // APB2 at 90 MHz, so TIM1 counts at 180 MHz.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(Sim_TIM1.PSC, 0u);
+    ASSERT_EQ(Sim_TIM1.ARR, 8999u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_get_timing(&timing));
+    ASSERT_EQ(timing.timer_clock_hz, 180000000u);
+    ASSERT_EQ(timing.resolution_bits, 13u);
+
+    // APB1 at 45 MHz, so TIM3 counts at 90 MHz.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_init(HAL_PWM_TIM3, 20000));
+    ASSERT_EQ(Sim_TIM3.ARR, 4499u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_get_timing(HAL_PWM_TIM3, &timing));
+    ASSERT_EQ(timing.timer_clock_hz, 90000000u);
+    ASSERT_EQ(timing.achieved_hz, 20000u);
+
+    // TIMPRE: up to /4 on APB, the timers run at HCLK.
+    Sim_RCC.DCKCFGR = RCC_DCKCFGR_TIMPRE;
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_set_frequency(HAL_PWM_TIM3, 20000));
+    ASSERT_EQ(Sim_TIM3.ARR, 8999u);
+
+    // A divided AHB clock divides everything after it.
+    Sim_RCC.DCKCFGR = 0;
+    Sim_RCC.CFGR |= RCC_CFGR_HPRE_DIV2;
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_tim_get_timing(HAL_PWM_TIM3, &timing));
+    ASSERT_EQ(timing.timer_clock_hz, 45000000u);
+}
+
+TEST_F(PWMTimingTest, ExactFitIsPreferredAtTheSameResolution)
+{
+    hal_pwm_timing_t timing = {};
+
+    // The smallest prescaler would be 2 with 53333 counts. 3 and 40000 is exact and still 15 bits.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(100));
+    ASSERT_EQ(Sim_TIM1.PSC, 3u);
+    ASSERT_EQ(Sim_TIM1.ARR, 39999u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_get_timing(&timing));
+    ASSERT_EQ(timing.error_ppm, 0);
+    ASSERT_EQ(timing.resolution_bits, 15u);
+}
+
+TEST_F(PWMTimingTest, ErrorIsReportedWhenNothingFits)
+{
+    hal_pwm_timing_t timing = {};
+
+    // 16 MHz / 7 kHz = 2285.7 counts, rounded to 2286. A bigger prescaler would cost a bit.
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(7000));
+    ASSERT_EQ(Sim_TIM1.PSC, 0u);
+    ASSERT_EQ(Sim_TIM1.ARR, 2285u);
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_get_timing(&timing));
+    ASSERT_EQ(timing.achieved_hz, 6999u);
+    ASSERT_EQ(timing.error_ppm, -124);
+    ASSERT_EQ(timing.resolution_bits, 11u);
+
+}
+
+TEST_F(PWMTimingTest, CenterAlignedTimingCountsBothSlopes)
+{
+    hal_pwm_timing_t timing = {};
+
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_timer_init(20000));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_set_alignment(HAL_PWM_ALIGN_CENTER_UP));
+    ASSERT_EQ(HAL_STATUS_OK, hal_pwm_get_timing(&timing));
+    ASSERT_EQ(timing.achieved_hz, 20000u);
+    ASSERT_EQ(timing.error_ppm, 0);
+    ASSERT_EQ(timing.period_counts, 400u);
+    ASSERT_EQ(timing.resolution_bits, 8u);
+
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_get_timing(NULL));
+    ASSERT_EQ(HAL_STATUS_ERROR, hal_pwm_tim_get_timing(_HAL_PWM_TIMER_MAX, &timing));
+}
@@ -104,6 +104,26 @@ TEST_F(SysTickDriverTest, GetTick_WrapsAroundOnUint32Overflow)
     ASSERT_EQ(0u, hal_get_tick());
 }
 
+/***********************************************************************/
+// hal_get_time_us
+/***********************************************************************/
+
+TEST_F(SysTickDriverTest, GetTimeUs_AddsTheElapsedPartOfTheMillisecond)
+{
+    hal_systick_init();
+    tick(3);
+
+    Sim_SysTick.VAL = 15999;
+    ASSERT_EQ(3000u, hal_get_time_us());
+
+    // 16 cycles per microsecond at 16 MHz.
+    Sim_SysTick.VAL = 15999 - 16 * 250;
+    ASSERT_EQ(3250u, hal_get_time_us());
+
+    Sim_SysTick.VAL = 0;
+    ASSERT_EQ(3999u, hal_get_time_us());
+}
+
 /***********************************************************************/
 // hal_systick_timer_register — argument validation
 /***********************************************************************/